@@ -0,0 +1,68 @@
+#include <pthread.h>
+#include "bench.h"
+
+/*
+ * pthread_barrier_wait round trip: n threads pass the same barrier over and over,
+ * like the fork/join regions of OpenMP code.
+ *
+ * usage: barrier.so [rounds] [threads...]
+ */
+
+static pthread_barrier_t barrier;
+static long              rounds;
+
+static void* worker(void* arg) {
+  for (long i = 0; i <= rounds; i++) {
+    pthread_barrier_wait(&barrier);
+  }
+  return NULL;
+}
+
+static void run(int nthreads) {
+
+  pthread_t threads[nthreads];
+
+  if (pthread_barrier_init(&barrier, NULL, nthreads) != 0) {
+    bench_fail("pthread_barrier_init");
+  }
+
+  for (int i = 1; i < nthreads; i++) {
+    if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+      bench_fail("pthread_create");
+    }
+  }
+
+  // the first round only lines the threads up
+  pthread_barrier_wait(&barrier);
+
+  uint64_t start = bench_now();
+  for (long i = 0; i < rounds; i++) {
+    pthread_barrier_wait(&barrier);
+  }
+  uint64_t elapsed = bench_now() - start;
+
+  for (int i = 1; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  pthread_barrier_destroy(&barrier);
+
+  printf("%3d threads: %8.0f ns per round\n", nthreads, (double)elapsed / rounds);
+}
+
+int bench_main(int argc, char** argv) {
+
+  rounds = bench_arg(argc, argv, 1, 100000);
+
+  if (argc <= 2) {
+    run(2);
+    run(4);
+    run(8);
+  } else {
+    for (int i = 2; i < argc; i++) {
+      run(bench_arg(argc, argv, i, 2));
+    }
+  }
+
+  return 0;
+}
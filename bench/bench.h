@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static inline uint64_t bench_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// argv[i] as a number, or def if it wasn't given
+static inline long bench_arg(int argc, char** argv, int i, long def) {
+  return i < argc ? strtol(argv[i], NULL, 0) : def;
+}
+
+static inline void bench_fail(const char* what) {
+  perror(what);
+  exit(1);
+}
@@ -0,0 +1,99 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bench.h"
+
+/*
+ * Loopback TCP connection rate: the main thread connects and closes over and
+ * over, another thread accepts with accept4, asks getpeername and closes. Every
+ * step passes a sockaddr through the shim.
+ *
+ * usage: connect-accept.so [connections] [inet | inet6]
+ */
+
+static int  listen_fd;
+static long connections;
+
+static void* acceptor(void* arg) {
+
+  for (long i = 0; i < connections; i++) {
+
+    struct sockaddr_storage peer;
+    socklen_t               peerlen = sizeof(peer);
+
+    int fd = accept4(listen_fd, (struct sockaddr*)&peer, &peerlen, SOCK_CLOEXEC);
+    if (fd == -1) {
+      bench_fail("accept4");
+    }
+
+    peerlen = sizeof(peer);
+    if (getpeername(fd, (struct sockaddr*)&peer, &peerlen) == -1) {
+      bench_fail("getpeername");
+    }
+
+    close(fd);
+  }
+
+  return NULL;
+}
+
+int bench_main(int argc, char** argv) {
+
+  connections = bench_arg(argc, argv, 1, 20000);
+
+  bool inet6 = argc > 2 && strcmp(argv[2], "inet6") == 0;
+
+  struct sockaddr_storage addr    = {};
+  socklen_t               addrlen = inet6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+
+  if (inet6) {
+    struct sockaddr_in6* sin6 = (struct sockaddr_in6*)&addr;
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_addr   = in6addr_loopback;
+  } else {
+    struct sockaddr_in* sin = (struct sockaddr_in*)&addr;
+    sin->sin_family      = AF_INET;
+    sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  }
+
+  listen_fd = socket(addr.ss_family, SOCK_STREAM, 0);
+  if (listen_fd == -1 || bind(listen_fd, (struct sockaddr*)&addr, addrlen) == -1 || listen(listen_fd, 1024) == -1) {
+    bench_fail("listen");
+  }
+
+  if (getsockname(listen_fd, (struct sockaddr*)&addr, &addrlen) == -1) {
+    bench_fail("getsockname");
+  }
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, acceptor, NULL) != 0) {
+    bench_fail("pthread_create");
+  }
+
+  uint64_t start = bench_now();
+
+  for (long i = 0; i < connections; i++) {
+
+    int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr*)&addr, addrlen) == -1) {
+      bench_fail("connect");
+    }
+
+    close(fd);
+  }
+
+  pthread_join(thread, NULL);
+
+  uint64_t elapsed = bench_now() - start;
+
+  printf("%s: %.0f connections per second\n", inet6 ? "inet6" : "inet", connections / (elapsed / 1e9));
+
+  close(listen_fd);
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include <errno.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "bench.h"
+
+/*
+ * futex_waitv wait-any latency: a thread waits on n futexes at once, and the
+ * main thread sets and wakes a different one each round and waits for the
+ * waiter to acknowledge it. Reports the round trip and checks that the index
+ * futex_waitv returns is the futex that was woken.
+ *
+ * usage: futex-waitv.so [rounds] [futexes] [private | shared]
+ */
+
+#ifndef SYS_futex_waitv
+#define SYS_futex_waitv 449
+#endif
+
+#define FUTEX2_SIZE_U32 0x02
+#define FUTEX2_PRIVATE  FUTEX_PRIVATE_FLAG
+#define MAX_FUTEXES     128
+
+struct waitv {
+  uint64_t val;
+  uint64_t uaddr;
+  uint32_t flags;
+  uint32_t __reserved;
+};
+
+static uint32_t futexes[MAX_FUTEXES];
+static uint32_t ack;
+static long     rounds;
+static int      nfutexes;
+static uint32_t flags;
+static long     mismatches;
+
+static void wait_on(uint32_t* uaddr, uint32_t val) {
+  while (__atomic_load_n(uaddr, __ATOMIC_ACQUIRE) == val) {
+    syscall(SYS_futex, uaddr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+  }
+}
+
+static void wake(uint32_t* uaddr, int op) {
+  syscall(SYS_futex, uaddr, op, 1, NULL, NULL, 0);
+}
+
+static void* waiter(void* arg) {
+
+  struct waitv waitv[MAX_FUTEXES];
+  for (int i = 0; i < nfutexes; i++) {
+    waitv[i] = (struct waitv){ .val = 0, .uaddr = (uintptr_t)&futexes[i], .flags = flags };
+  }
+
+  for (long i = 0; i < rounds; i++) {
+
+    int expected = i % nfutexes;
+
+    // EAGAIN if it was set before we got there, and a spurious wakeup reports some index too
+    long index;
+    do {
+      index = syscall(SYS_futex_waitv, waitv, nfutexes, 0, NULL, 0);
+      if (index == -1 && errno != EAGAIN && errno != EINTR) {
+        bench_fail("futex_waitv");
+      }
+    } while (__atomic_load_n(&futexes[expected], __ATOMIC_ACQUIRE) == 0);
+
+    if (index != -1 && index != expected) {
+      mismatches++;
+    }
+
+    __atomic_store_n(&futexes[expected], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ack, 1, __ATOMIC_RELEASE);
+    wake(&ack, FUTEX_WAKE_PRIVATE);
+  }
+
+  return NULL;
+}
+
+int bench_main(int argc, char** argv) {
+
+  rounds   = bench_arg(argc, argv, 1, 100000);
+  nfutexes = bench_arg(argc, argv, 2, 64);
+
+  bool shared = argc > 3 && strcmp(argv[3], "shared") == 0;
+
+  if (nfutexes < 1 || nfutexes > MAX_FUTEXES) {
+    fprintf(stderr, "futexes: 1 to %d\n", MAX_FUTEXES);
+    return 2;
+  }
+
+  flags = FUTEX2_SIZE_U32 | (shared ? 0 : FUTEX2_PRIVATE);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, waiter, NULL) != 0) {
+    bench_fail("pthread_create");
+  }
+
+  uint64_t start = bench_now();
+
+  for (long i = 0; i < rounds; i++) {
+    uint32_t* futex = &futexes[i % nfutexes];
+    __atomic_store_n(futex, 1, __ATOMIC_RELEASE);
+    wake(futex, shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE);
+    wait_on(&ack, 0);
+    __atomic_store_n(&ack, 0, __ATOMIC_RELAXED);
+  }
+
+  uint64_t elapsed = bench_now() - start;
+
+  pthread_join(thread, NULL);
+
+  printf("%d %s futexes: %8.0f ns per wake round trip, %ld wrong indexes\n",
+    nfutexes, shared ? "shared" : "private", (double)elapsed / rounds, mismatches);
+
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "bench.h"
+
+/*
+ * Checks getaddrinfo against the stub entries of bench/gai-hosts.hosts, then
+ * times repeated lookups of one of them (cached ones with SHIM_GAI_CACHE set).
+ *
+ * usage: env SHIM_GAI_HOSTS=bench/gai-hosts.hosts [SHIM_GAI_CACHE=<seconds>] ... gai-hosts.so [lookups]
+ */
+
+static int failures = 0;
+
+// Looks name up and compares the addresses and the canonical name with the expected ones.
+static void check(const char* name, int family, int flags, const char* expected[], const char* canonname) {
+
+  struct addrinfo  hints = { .ai_family = family, .ai_socktype = SOCK_STREAM, .ai_flags = flags };
+  struct addrinfo* res;
+
+  int err = getaddrinfo(name, "80", &hints, &res);
+  if (err != 0) {
+    printf("FAIL %s: %s\n", name, gai_strerror(err));
+    failures++;
+    return;
+  }
+
+  int i = 0;
+  for (struct addrinfo* ai = res; ai != NULL; ai = ai->ai_next, i++) {
+
+    char      address[INET6_ADDRSTRLEN];
+    in_port_t port;
+
+    if (ai->ai_family == AF_INET) {
+      struct sockaddr_in* sin = (struct sockaddr_in*)ai->ai_addr;
+      inet_ntop(AF_INET, &sin->sin_addr, address, sizeof(address));
+      port = ntohs(sin->sin_port);
+    } else {
+      struct sockaddr_in6* sin6 = (struct sockaddr_in6*)ai->ai_addr;
+      inet_ntop(AF_INET6, &sin6->sin6_addr, address, sizeof(address));
+      port = ntohs(sin6->sin6_port);
+    }
+
+    if (expected[i] == NULL || strcmp(address, expected[i]) != 0 || port != 80) {
+      printf("FAIL %s: got %s port %u, expected %s\n", name, address, port, expected[i] != NULL ? expected[i] : "nothing");
+      failures++;
+    }
+  }
+
+  if (expected[i] != NULL) {
+    printf("FAIL %s: %s missing\n", name, expected[i]);
+    failures++;
+  }
+
+  if (canonname != NULL && (res->ai_canonname == NULL || strcmp(res->ai_canonname, canonname) != 0)) {
+    printf("FAIL %s: canonical name %s, expected %s\n", name, res->ai_canonname, canonname);
+    failures++;
+  }
+
+  freeaddrinfo(res);
+}
+
+int bench_main(int argc, char** argv) {
+
+  if (getenv("SHIM_GAI_HOSTS") == NULL) {
+    fprintf(stderr, "run with SHIM_GAI_HOSTS=bench/gai-hosts.hosts\n");
+    return 2;
+  }
+
+  check("stub-one.test",  AF_INET,   0,            (const char*[]){ "192.0.2.10", NULL },                 NULL);
+  check("alias-one.test", AF_INET,   0,            (const char*[]){ "192.0.2.10", NULL },                 NULL);
+  check("STUB-ONE.test",  AF_INET6,  0,            (const char*[]){ "2001:db8::10", NULL },               NULL);
+  check("stub-one.test",  AF_UNSPEC, 0,            (const char*[]){ "192.0.2.10", "2001:db8::10", NULL }, NULL);
+  check("alias-one.test", AF_INET,   AI_CANONNAME, (const char*[]){ "192.0.2.10", NULL },                 "stub-one.test");
+  check("stub-two.test",  AF_INET,   0,            (const char*[]){ "192.0.2.20", NULL },                 NULL);
+
+  if (failures > 0) {
+    return 1;
+  }
+
+  long lookups = bench_arg(argc, argv, 1, 100000);
+
+  struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+
+  uint64_t start = bench_now();
+
+  for (long i = 0; i < lookups; i++) {
+    struct addrinfo* res;
+    if (getaddrinfo("stub-one.test", "80", &hints, &res) != 0) {
+      bench_fail("getaddrinfo");
+    }
+    freeaddrinfo(res);
+  }
+
+  uint64_t elapsed = bench_now() - start;
+
+  printf("stub entries OK, %.0f ns per lookup\n", (double)elapsed / lookups);
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "bench.h"
+
+/*
+ * Cross-process ping-pong through a PTHREAD_PROCESS_SHARED mutex and condvar
+ * in an anonymous shared mapping: parent and child take turns flipping a flag.
+ *
+ * usage: pshared-pingpong.so [round trips]
+ */
+
+struct shared {
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;
+  int             turn;  // 0: parent's, 1: child's
+};
+
+static void play(struct shared* shared, int me, long rounds) {
+  for (long i = 0; i < rounds; i++) {
+    pthread_mutex_lock(&shared->mutex);
+    while (shared->turn != me) {
+      pthread_cond_wait(&shared->cond, &shared->mutex);
+    }
+    shared->turn = !me;
+    pthread_cond_signal(&shared->cond);
+    pthread_mutex_unlock(&shared->mutex);
+  }
+}
+
+int bench_main(int argc, char** argv) {
+
+  long rounds = bench_arg(argc, argv, 1, 100000);
+
+  struct shared* shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    bench_fail("mmap");
+  }
+
+  pthread_mutexattr_t mutexattr;
+  pthread_mutexattr_init(&mutexattr);
+  pthread_mutexattr_setpshared(&mutexattr, PTHREAD_PROCESS_SHARED);
+  if (pthread_mutex_init(&shared->mutex, &mutexattr) != 0) {
+    bench_fail("pthread_mutex_init");
+  }
+
+  pthread_condattr_t condattr;
+  pthread_condattr_init(&condattr);
+  pthread_condattr_setpshared(&condattr, PTHREAD_PROCESS_SHARED);
+  if (pthread_cond_init(&shared->cond, &condattr) != 0) {
+    bench_fail("pthread_cond_init");
+  }
+
+  shared->turn = 0;
+
+  uint64_t start = bench_now();
+
+  pid_t child = fork();
+  if (child == -1) {
+    bench_fail("fork");
+  }
+
+  if (child == 0) {
+    play(shared, 1, rounds);
+    _exit(0);
+  }
+
+  play(shared, 0, rounds);
+
+  int status;
+  waitpid(child, &status, 0);
+
+  uint64_t elapsed = bench_now() - start;
+
+  printf("%ld round trips: %8.0f ns per round trip\n", rounds, (double)elapsed / rounds);
+
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+#include <dlfcn.h>
+#include <stdio.h>
+
+/*
+ * Native loader for the benchmarks. They are built on Linux as shared objects,
+ * the way the shim is meant to be used, and this process loads one of them under
+ * bin/with-glibc-shim and calls its bench_main.
+ */
+
+int main(int argc, char** argv) {
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <benchmark.so> [args]\n", argv[0]);
+    return 2;
+  }
+
+  void* handle = dlopen(argv[1], RTLD_NOW);
+  if (handle == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    return 2;
+  }
+
+  int (*bench_main)(int, char**) = (int (*)(int, char**))dlsym(handle, "bench_main");
+  if (bench_main == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    return 2;
+  }
+
+  return bench_main(argc - 1, argv + 1);
+}
@@ -0,0 +1,127 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bench.h"
+
+/*
+ * Loopback UDP packets per second through sendmmsg/recvmmsg: one thread sends
+ * batches of datagrams as fast as it can, another receives them in batches
+ * until the line has been idle for a while. Loopback drops what the receiver
+ * can't keep up with, so both rates are reported.
+ *
+ * usage: udp-pps.so [packets] [batch] [size]
+ */
+
+#define MAX_BATCH 1024
+#define MAX_SIZE  2048
+
+static int  receiver_fd;
+static long batch;
+static long size;
+static long received;
+
+static uint64_t receive_end;
+
+static void* receiver(void* arg) {
+
+  static char buffers[MAX_BATCH][MAX_SIZE];
+
+  struct mmsghdr msgs[MAX_BATCH];
+  struct iovec   iovs[MAX_BATCH];
+
+  for (long i = 0; i < batch; i++) {
+    iovs[i] = (struct iovec){ .iov_base = buffers[i], .iov_len = sizeof(buffers[i]) };
+    msgs[i] = (struct mmsghdr){ .msg_hdr = { .msg_iov = &iovs[i], .msg_iovlen = 1 } };
+  }
+
+  for (;;) {
+    int n = recvmmsg(receiver_fd, msgs, batch, 0, NULL);
+    if (n == -1) {
+      break; // idle for SO_RCVTIMEO
+    }
+    received += n;
+    receive_end = bench_now();
+  }
+
+  return NULL;
+}
+
+int bench_main(int argc, char** argv) {
+
+  long packets = bench_arg(argc, argv, 1, 1000000);
+  batch        = bench_arg(argc, argv, 2, 32);
+  size         = bench_arg(argc, argv, 3, 64);
+
+  if (batch < 1 || batch > MAX_BATCH || size < 1 || size > MAX_SIZE) {
+    fprintf(stderr, "batch: 1 to %d, size: 1 to %d\n", MAX_BATCH, MAX_SIZE);
+    return 2;
+  }
+
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  socklen_t          addrlen = sizeof(addr);
+
+  receiver_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (receiver_fd == -1 || bind(receiver_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    bench_fail("receiver");
+  }
+
+  getsockname(receiver_fd, (struct sockaddr*)&addr, &addrlen);
+
+  int rcvbuf = 4 * 1024 * 1024;
+  setsockopt(receiver_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  struct timeval idle = { .tv_sec = 0, .tv_usec = 200000 };
+  setsockopt(receiver_fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+
+  int sender_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sender_fd == -1 || connect(sender_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    bench_fail("sender");
+  }
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, receiver, NULL) != 0) {
+    bench_fail("pthread_create");
+  }
+
+  static char payload[MAX_SIZE];
+
+  struct mmsghdr msgs[MAX_BATCH];
+  struct iovec   iov = { .iov_base = payload, .iov_len = size };
+
+  for (long i = 0; i < batch; i++) {
+    msgs[i] = (struct mmsghdr){ .msg_hdr = { .msg_iov = &iov, .msg_iovlen = 1 } };
+  }
+
+  long sent = 0;
+
+  uint64_t start = bench_now();
+
+  while (sent < packets) {
+    int n = sendmmsg(sender_fd, msgs, packets - sent < batch ? packets - sent : batch, 0);
+    if (n == -1 && errno != ENOBUFS) {
+      bench_fail("sendmmsg");
+    }
+    sent += n > 0 ? n : 0;
+  }
+
+  uint64_t send_end = bench_now();
+
+  pthread_join(thread, NULL);
+
+  printf("batch %ld, %ld bytes: sent %.0f pps, received %.0f pps (%ld of %ld)\n",
+    batch, size,
+    sent / ((send_end - start) / 1e9),
+    received > 0 ? received / ((receive_end - start) / 1e9) : 0,
+    received, sent
+  );
+
+  close(sender_fd);
+  close(receiver_fd);
+
+  return 0;
+}
@@ -0,0 +1,267 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/cpuset.h>
+#include <sys/mount.h>
+#include <sys/rctl.h>
+#include <sys/sysctl.h>
+#include <sys/user.h>
+#include "shim.h"
+#include "cgroup.h"
+#include "sysfs.h"
+#include "libc/sys/numa.h"
+
+/*
+ * A cgroup v2 view of the limits FreeBSD puts on this process.
+ *
+ * The process appears to sit in the root of a cgroup2 hierarchy mounted on
+ * /sys/fs/cgroup, whose cpu.max and memory.max come from the rctl rules that
+ * apply to it (usually per jail) and whose cpuset.cpus.effective is its cpuset.
+ * That's what Go, the JVM, .NET, libuv and Rust look at to size themselves.
+ */
+
+#define CGROUP_CPU_PERIOD 100000
+
+struct limits {
+  long long pcpu;                // percent of a single CPU, -1 when unlimited
+  long long memoryuse;           // bytes
+  long long maxproc;
+  char      memory_subject[128]; // whose usage to report, e.g. "jail:foo"
+};
+
+// rctl(8) calls fail with ENOSYS unless kern.racct.enable=1
+static char* rctl_query(int (*query)(const char*, size_t, char*, size_t), const char* filter) {
+
+  size_t size = 4096;
+  char*  out  = NULL;
+
+  for (;;) {
+
+    out = realloc(out, size);
+
+    if (query(filter, strlen(filter) + 1, out, size) == 0) {
+      return out;
+    }
+
+    if (errno != ERANGE) {
+      free(out);
+      return NULL;
+    }
+
+    size *= 2;
+  }
+}
+
+static void get_limits(struct limits* limits) {
+
+  limits->pcpu              = -1;
+  limits->memoryuse         = -1;
+  limits->maxproc           = -1;
+  limits->memory_subject[0] = '\0';
+
+  char filter[32];
+  snprintf(filter, sizeof(filter), "process:%d", getpid());
+
+  char* rules = rctl_query(rctl_get_limits, filter);
+  if (rules == NULL) {
+    return;
+  }
+
+  // subject:subject-id:resource:action=amount[/per], comma separated
+  char* saveptr;
+  for (char* rule = strtok_r(rules, ",", &saveptr); rule != NULL; rule = strtok_r(NULL, ",", &saveptr)) {
+
+    char* subject_end  = strchr(rule, ':');
+    char* id_end       = subject_end  != NULL ? strchr(subject_end + 1, ':')  : NULL;
+    char* resource_end = id_end       != NULL ? strchr(id_end + 1, ':')       : NULL;
+
+    if (resource_end == NULL || !str_starts_with(resource_end + 1, "deny=")) {
+      continue;
+    }
+
+    *id_end       = '\0';
+    *resource_end = '\0';
+
+    const char* resource = id_end + 1;
+    long long   amount   = strtoll(resource_end + 1 + sizeof("deny=") - 1, NULL, 10);
+
+    long long* limit = NULL;
+
+    if (strcmp(resource, "pcpu") == 0) {
+      limit = &limits->pcpu;
+    } else if (strcmp(resource, "memoryuse") == 0) {
+      limit = &limits->memoryuse;
+    } else if (strcmp(resource, "maxproc") == 0) {
+      limit = &limits->maxproc;
+    }
+
+    if (limit != NULL && (*limit == -1 || amount < *limit)) {
+      *limit = amount;
+      if (limit == &limits->memoryuse) {
+        strlcpy(limits->memory_subject, rule, sizeof(limits->memory_subject));
+      }
+    }
+  }
+
+  free(rules);
+}
+
+static long long get_memory_usage(const char* subject) {
+
+  char filter[160];
+
+  if (subject[0] != '\0') {
+    snprintf(filter, sizeof(filter), "%s", subject);
+  } else {
+    snprintf(filter, sizeof(filter), "process:%d", getpid());
+  }
+
+  char* usage = rctl_query(rctl_get_racct, filter);
+
+  if (usage != NULL) {
+    char* memoryuse = strstr(usage, "memoryuse=");
+    long long bytes = memoryuse != NULL ? strtoll(memoryuse + sizeof("memoryuse=") - 1, NULL, 10) : 0;
+    free(usage);
+    return bytes;
+  }
+
+  // no racct: this process' resident set is the best we have
+  int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, getpid() };
+  struct kinfo_proc kp;
+  size_t len = sizeof(kp);
+
+  if (sysctl(mib, 4, &kp, &len, NULL, 0) == 0) {
+    return (long long)kp.ki_rssize * getpagesize();
+  }
+
+  return 0;
+}
+
+static void print_limit(FILE* out, long long limit) {
+  if (limit < 0) {
+    fprintf(out, "max\n");
+  } else {
+    fprintf(out, "%lld\n", limit);
+  }
+}
+
+void render_proc_cgroups(FILE* out) {
+  // hierarchy 0 everywhere: all controllers are on the unified (v2) hierarchy
+  fprintf(out, "#subsys_name\thierarchy\tnum_cgroups\tenabled\n");
+  fprintf(out, "cpuset\t0\t1\t1\n");
+  fprintf(out, "cpu\t0\t1\t1\n");
+  fprintf(out, "cpuacct\t0\t1\t1\n");
+  fprintf(out, "memory\t0\t1\t1\n");
+  fprintf(out, "pids\t0\t1\t1\n");
+}
+
+void render_self_cgroup(FILE* out) {
+  fprintf(out, "0::/\n");
+}
+
+static void print_escaped(FILE* out, const char* path) {
+  for (const char* c = path; *c != '\0'; c++) {
+    if (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\\') {
+      fprintf(out, "\\%03o", *c);
+    } else {
+      fputc(*c, out);
+    }
+  }
+}
+
+void render_self_mountinfo(FILE* out) {
+
+  struct statfs* mounts;
+  int n = getmntinfo(&mounts, MNT_NOWAIT);
+
+  for (int i = 0; i < n; i++) {
+
+    const char* options = (mounts[i].f_flags & MNT_RDONLY) ? "ro" : "rw";
+
+    // mount ID, parent ID, major:minor, root
+    fprintf(out, "%d %d 0:%d / ", i + 1, i == 0 ? 0 : 1, i + 1);
+
+    print_escaped(out, mounts[i].f_mntonname);
+
+    fprintf(out, " %s%s%s - %s ",
+      options,
+      (mounts[i].f_flags & MNT_NOSUID) ? ",nosuid" : "",
+      (mounts[i].f_flags & MNT_NOEXEC) ? ",noexec" : "",
+      mounts[i].f_fstypename
+    );
+
+    print_escaped(out, mounts[i].f_mntfromname);
+
+    fprintf(out, " %s\n", options);
+  }
+
+  fprintf(out, "%d 1 0:%d / /sys/fs/cgroup rw,nosuid,nodev,noexec,relatime - cgroup2 cgroup2 rw,nsdelegate\n", n + 1, n + 1);
+}
+
+void render_cgroup_controllers(FILE* out) {
+  fprintf(out, "cpuset cpu memory pids\n");
+}
+
+void render_cgroup_cpu_max(FILE* out) {
+
+  struct limits limits;
+  get_limits(&limits);
+
+  if (limits.pcpu < 0) {
+    fprintf(out, "max %d\n", CGROUP_CPU_PERIOD);
+  } else {
+    fprintf(out, "%lld %d\n", MAX(limits.pcpu, 1) * CGROUP_CPU_PERIOD / 100, CGROUP_CPU_PERIOD);
+  }
+}
+
+void render_cgroup_cpu_weight(FILE* out) {
+  fprintf(out, "100\n");
+}
+
+void render_cgroup_cpuset_cpus(FILE* out) {
+
+  cpuset_t cpus;
+  if (cpuset_getaffinity(CPU_LEVEL_CPUSET, CPU_WHICH_PID, -1, sizeof(cpus), &cpus) == -1) {
+    return;
+  }
+
+  char buf[8 * CPU_SETSIZE];
+  format_cpulist(buf, sizeof(buf), &cpus);
+
+  fprintf(out, "%s\n", buf);
+}
+
+void render_cgroup_cpuset_mems(FILE* out) {
+  int ndomains = native_ndomains();
+  fprintf(out, ndomains > 1 ? "0-%d\n" : "0\n", ndomains - 1);
+}
+
+void render_cgroup_memory_max(FILE* out) {
+  struct limits limits;
+  get_limits(&limits);
+  print_limit(out, limits.memoryuse);
+}
+
+void render_cgroup_memory_high(FILE* out) {
+  print_limit(out, -1);
+}
+
+void render_cgroup_memory_swap_max(FILE* out) {
+  print_limit(out, -1);
+}
+
+void render_cgroup_memory_current(FILE* out) {
+  struct limits limits;
+  get_limits(&limits);
+  fprintf(out, "%lld\n", get_memory_usage(limits.memory_subject));
+}
+
+void render_cgroup_pids_max(FILE* out) {
+  struct limits limits;
+  get_limits(&limits);
+  print_limit(out, limits.maxproc);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdio.h>
+
+void render_proc_cgroups(FILE* out);
+void render_self_cgroup(FILE* out);
+void render_self_mountinfo(FILE* out);
+
+void render_cgroup_controllers(FILE* out);
+void render_cgroup_cpu_max(FILE* out);
+void render_cgroup_cpu_weight(FILE* out);
+void render_cgroup_cpuset_cpus(FILE* out);
+void render_cgroup_cpuset_mems(FILE* out);
+void render_cgroup_memory_max(FILE* out);
+void render_cgroup_memory_high(FILE* out);
+void render_cgroup_memory_swap_max(FILE* out);
+void render_cgroup_memory_current(FILE* out);
+void render_cgroup_pids_max(FILE* out);
@@ -0,0 +1,86 @@
+#include <cpuid.h>
+#include <stdbool.h>
+#include "cpuinfo.h"
+
+// "Auth"enticAMD, "Hygo"nGenuine
+#define CPUID_VENDOR_AMD   0x68747541
+#define CPUID_VENDOR_HYGON 0x6f677948
+
+static unsigned ceil_log2(unsigned n) {
+  unsigned shift = 0;
+  while ((1u << shift) < n) {
+    shift++;
+  }
+  return shift;
+}
+
+void read_cpuid(struct cpu_info* info) {
+
+  unsigned eax, ebx, ecx, edx;
+
+  unsigned max_leaf = __get_cpuid_max(0, &ebx);
+  __cpuid(0, eax, ebx, ecx, edx);
+
+  bool amd = (ebx == CPUID_VENDOR_AMD || ebx == CPUID_VENDOR_HYGON);
+
+  unsigned apic_id = 0, smt_shift = 0, package_shift = 0;
+
+  if (max_leaf >= 0xB) {
+    for (unsigned level = 0; level < 8; level++) {
+      __cpuid_count(0xB, level, eax, ebx, ecx, edx);
+      unsigned type = (ecx >> 8) & 0xFF;
+      if (type == 0) {
+        break;
+      }
+      if (type == 1) {
+        smt_shift = eax & 0x1F;
+      }
+      package_shift = eax & 0x1F;
+      apic_id = edx;
+    }
+  }
+
+  if (package_shift == 0) {
+    __cpuid(1, eax, ebx, ecx, edx);
+    apic_id = ebx >> 24;
+    // HTT: more than one logical processor per package
+    package_shift = (edx & (1 << 28)) ? ceil_log2((ebx >> 16) & 0xFF) : 0;
+  }
+
+  info->apic_id = apic_id;
+  info->package = apic_id >> package_shift;
+  info->core    = (apic_id & ((1u << package_shift) - 1)) >> smt_shift;
+
+  unsigned leaf = 0;
+  if (amd) {
+    // TOPOEXT
+    if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 22))) {
+      leaf = 0x8000001D;
+    }
+  } else if (max_leaf >= 4) {
+    leaf = 4;
+  }
+
+  info->ncaches = 0;
+
+  for (int i = 0; leaf != 0 && i < MAX_CACHES; i++) {
+
+    __cpuid_count(leaf, i, eax, ebx, ecx, edx);
+
+    unsigned type = eax & 0x1F;
+    if (type == 0) {
+      break;
+    }
+
+    struct cache_info* cache = &info->caches[info->ncaches++];
+
+    cache->level         = (eax >> 5) & 0x7;
+    cache->type          = type;
+    cache->ways          = (ebx >> 22) + 1;
+    cache->partitions    = ((ebx >> 12) & 0x3FF) + 1;
+    cache->line_size     = (ebx & 0xFFF) + 1;
+    cache->sets          = ecx + 1;
+    cache->size          = cache->ways * cache->partitions * cache->line_size * cache->sets;
+    cache->sharing_shift = ceil_log2(((eax >> 14) & 0xFFF) + 1);
+  }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+/*
+ * Topology and cache geometry of the CPU the calling thread runs on, from CPUID.
+ */
+
+#define MAX_CACHES 8
+
+#define CPUID_TYPE_DATA        1
+#define CPUID_TYPE_INSTRUCTION 2
+#define CPUID_TYPE_UNIFIED     3
+
+struct cache_info {
+  unsigned level;
+  unsigned type;
+  unsigned size;
+  unsigned line_size;
+  unsigned partitions;
+  unsigned ways;
+  unsigned sets;
+  unsigned sharing_shift;
+};
+
+struct cpu_info {
+  unsigned          apic_id;
+  unsigned          package;
+  unsigned          core;
+  int               ncaches;
+  struct cache_info caches[MAX_CACHES];
+};
+
+void read_cpuid(struct cpu_info* info);
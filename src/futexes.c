@@ -1,10 +1,19 @@
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <pthread_np.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
-
-/*
- * Just enough stuff to keep Steam from complaining.
- */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/param.h>
+#include <sys/mman.h>
+#include "shim.h"
+#include "libc/time.h"
+#include "libthr/umtx.h"
 
 #ifdef __i386__
 #define FUTEX_OFFSET -20
@@ -14,12 +23,33 @@
 #define FUTEX_OFFSET -32
 #endif
 
+#define LINUX_FUTEX_WAITERS    0x80000000u
+#define LINUX_FUTEX_OWNER_DIED 0x40000000u
+#define LINUX_FUTEX_TID_MASK   0x3FFFFFFFu
+
+// limit on list entries handled at exit, like the kernel's ROBUST_LIST_LIMIT
+#define ROBUST_LIST_LIMIT 2048
+
+struct robust_list {
+  struct robust_list* next;
+};
+
 struct robust_list_head {
-  void* list;
-  long  futex_offset;
-  void* list_op_pending;
+  struct robust_list list;
+  long               futex_offset;
+  struct robust_list* list_op_pending;
 };
 
+/*
+ * A list nobody registered is handed out as an empty one, just enough to keep
+ * Steam from complaining. Lists registered with set_robust_list are walked when
+ * the thread exits, so futex-based locks it still holds get FUTEX_OWNER_DIED.
+ *
+ * Thread exit is seen through a pthread key destructor, and process exit through
+ * atexit, which walks the lists of all threads still alive. Unlike the kernel,
+ * this can't see _exit, a fatal signal or a crash, so locks held then stay held.
+ */
+
 struct fake_pthread {
   void*  robust_prev;
   struct robust_list_head list;
@@ -27,15 +57,144 @@ struct fake_pthread {
 
 static __thread struct fake_pthread pthread = {};
 
+static __thread struct robust_list_head* registered_list = NULL;
+
+struct robust_list_owner {
+  struct robust_list_owner* next;
+  struct robust_list_head*  head;
+  int                       tid;
+};
+
+static __thread struct robust_list_owner robust_list_owner;
+
+static pthread_key_t robust_list_key;
+
+static pthread_mutex_t           robust_list_owners_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct robust_list_owner* robust_list_owners       = NULL;
+
+static int futex_wake(volatile uint32_t* uaddr, int count, bool private);
+
+static void handle_futex_death(struct robust_list* entry, long futex_offset, int tid) {
+
+  volatile uint32_t* futex = (volatile uint32_t*)((char*)entry + futex_offset);
+
+  uint32_t value = __atomic_load_n(futex, __ATOMIC_RELAXED);
+  while ((value & LINUX_FUTEX_TID_MASK) == (uint32_t)tid) {
+    uint32_t dead = (value & LINUX_FUTEX_WAITERS) | LINUX_FUTEX_OWNER_DIED;
+    if (__atomic_compare_exchange_n(futex, &value, dead, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      if (value & LINUX_FUTEX_WAITERS) {
+        futex_wake(futex, 1, false);
+      }
+      return;
+    }
+  }
+}
+
+static void walk_robust_list(struct robust_list_head* head, int tid) {
+
+  struct robust_list* entry = head->list.next;
+  for (int i = 0; entry != &head->list && i < ROBUST_LIST_LIMIT; i++) {
+    struct robust_list* next = entry->next;
+    if (entry != head->list_op_pending) {
+      handle_futex_death(entry, head->futex_offset, tid);
+    }
+    entry = next;
+  }
+
+  if (head->list_op_pending != NULL) {
+    handle_futex_death(head->list_op_pending, head->futex_offset, tid);
+  }
+}
+
+static void exit_robust_list(void* arg) {
+
+  struct robust_list_owner* owner = arg;
+
+  assert(pthread_mutex_lock(&robust_list_owners_mutex) == 0);
+  for (struct robust_list_owner** p = &robust_list_owners; *p != NULL; p = &(*p)->next) {
+    if (*p == owner) {
+      *p = owner->next;
+      break;
+    }
+  }
+  struct robust_list_head* head = owner->head;
+  owner->head = NULL;
+  assert(pthread_mutex_unlock(&robust_list_owners_mutex) == 0);
+
+  walk_robust_list(head, owner->tid);
+}
+
+static void exit_robust_lists() {
+
+  // the lists stay registered, threads still running may exit later
+  assert(pthread_mutex_lock(&robust_list_owners_mutex) == 0);
+  for (struct robust_list_owner* owner = robust_list_owners; owner != NULL; owner = owner->next) {
+    walk_robust_list(owner->head, owner->tid);
+  }
+  assert(pthread_mutex_unlock(&robust_list_owners_mutex) == 0);
+}
+
+// like Linux, a forked child starts without a robust list
+static void fork_robust_lists() {
+  pthread_mutex_init(&robust_list_owners_mutex, NULL);
+  robust_list_owners     = NULL;
+  robust_list_owner.head = NULL;
+  registered_list        = NULL;
+  pthread_setspecific(robust_list_key, NULL);
+}
+
+__attribute__((constructor))
+static void init_robust_list_key() {
+  int err = pthread_key_create(&robust_list_key, exit_robust_list);
+  assert(err == 0);
+  err = atexit(exit_robust_lists);
+  assert(err == 0);
+  err = pthread_atfork(NULL, NULL, fork_robust_lists);
+  assert(err == 0);
+}
+
+long set_robust_list(struct robust_list_head* head, size_t len) {
+
+  if (len != sizeof(struct robust_list_head)) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  registered_list = head;
+
+  assert(pthread_mutex_lock(&robust_list_owners_mutex) == 0);
+  if (robust_list_owner.head == NULL) {
+    robust_list_owner.tid  = pthread_getthreadid_np();
+    robust_list_owner.next = robust_list_owners;
+    robust_list_owners     = &robust_list_owner;
+  }
+  robust_list_owner.head = head;
+  assert(pthread_mutex_unlock(&robust_list_owners_mutex) == 0);
+
+  int err = pthread_setspecific(robust_list_key, &robust_list_owner);
+  assert(err == 0);
+
+  return 0;
+}
+
 long get_robust_list(int pid, struct robust_list_head** list_head, size_t* struct_len) {
 
   if (!(list_head && struct_len))
     return -1;
 
-  assert(pid == 0);
+  if (pid != 0 && pid != pthread_getthreadid_np()) {
+    errno = native_to_linux_errno(EPERM);
+    return -1;
+  }
+
+  if (registered_list != NULL) {
+    *list_head  = registered_list;
+    *struct_len = sizeof(struct robust_list_head);
+    return 0;
+  }
 
   pthread.robust_prev          = &pthread.list;
-  pthread.list.list            = &pthread.list;
+  pthread.list.list.next       = &pthread.list.list;
   pthread.list.futex_offset    = FUTEX_OFFSET;
   pthread.list.list_op_pending = NULL;
 
@@ -44,3 +203,461 @@ long get_robust_list(int pid, struct robust_list_head** list_head, size_t* struc
 
   return 0;
 }
+
+#define LINUX_FUTEX_WAIT           0
+#define LINUX_FUTEX_WAKE           1
+#define LINUX_FUTEX_WAIT_BITSET    9
+#define LINUX_FUTEX_WAKE_BITSET   10
+#define LINUX_FUTEX_PRIVATE_FLAG 128
+#define LINUX_FUTEX_CLOCK_REALTIME 256
+#define LINUX_FUTEX_CMD_MASK     (~(LINUX_FUTEX_PRIVATE_FLAG | LINUX_FUTEX_CLOCK_REALTIME))
+
+#define LINUX_FUTEX2_SIZE_U32    0x02
+#define LINUX_FUTEX2_SIZE_MASK   0x03
+#define LINUX_FUTEX2_PRIVATE     LINUX_FUTEX_PRIVATE_FLAG
+#define LINUX_FUTEX_WAITV_MAX    128
+
+struct linux_futex_waitv {
+  uint64_t val;
+  uint64_t uaddr;
+  uint32_t flags;
+  uint32_t __reserved;
+};
+
+/*
+ * futex_waitv emulation.
+ *
+ * umtx can only park on one word, so a multi-waiter parks on a word of its own
+ * and registers (futex, index) pairs in the waker registry below. futex wakes look
+ * the address up there first and hand the wakeup to a registered multi-waiter,
+ * which then reports that index.
+ *
+ * The registry is per process, and wakes on shared futexes may come from another
+ * process. A multi-waiter with shared futexes therefore takes a slot in a page
+ * shared by all of the user's processes and parks on the slot's word. It marks the
+ * slot in the buckets of its shared futexes, and a wake of a shared futex bumps
+ * and wakes the slots marked in its bucket. The slot's owner then rechecks its
+ * futex values. Processes map a shared futex at different addresses, but always
+ * at the same offset within the page, so that offset picks the bucket. Wakes from
+ * unrelated futexes in the same bucket, or from any other process of the user,
+ * are only spurious wakeups.
+ */
+
+#define WAITV_BUCKETS 256
+
+struct waitv_waiter {
+  uint32_t  state;  // 0 while waiting, 1 once woken
+  int       woken;  // index of the futex that woke us, -1 if none yet
+  uint32_t* park;   // shared word we park on instead of state, if any
+};
+
+struct waitv_node {
+  struct waitv_node*   next;
+  volatile uint32_t*   uaddr;
+  struct waitv_waiter* waiter;
+  int                  index;
+};
+
+static struct {
+  uint32_t           lock;
+  struct waitv_node* head;
+} __attribute__((aligned(64))) waitv_buckets[WAITV_BUCKETS];
+
+#define WAITV_SHARED_BUCKETS 256
+#define WAITV_SHARED_SLOTS    32
+
+struct waitv_shared {
+  uint32_t allocated;                         // bitmask of the slots in use
+  pid_t    owners[WAITV_SHARED_SLOTS];        // to reclaim slots of processes that died waiting
+  uint32_t slots[WAITV_SHARED_SLOTS];         // bumped to wake the slot's owner
+  uint32_t buckets[WAITV_SHARED_BUCKETS];     // bitmask of the slots waiting on a futex there
+  uint32_t overflow_waiters;                  // waiters that found no free slot
+  uint32_t overflow;                          // where they park, bumped by every shared wake
+};
+
+static pthread_once_t       waitv_shared_once = PTHREAD_ONCE_INIT;
+static struct waitv_shared* waitv_shared;
+static struct waitv_shared  waitv_shared_fallback;
+
+#define BUCKET(uaddr) (&waitv_buckets[((uintptr_t)(uaddr) >> 2) % WAITV_BUCKETS])
+
+#define SHARED_BUCKET(shared, uaddr) (&(shared)->buckets[(((uintptr_t)(uaddr) & PAGE_MASK) >> 2) % WAITV_SHARED_BUCKETS])
+
+static void init_waitv_shared() {
+
+  char name[64];
+  snprintf(name, sizeof(name), "/linux-shim-futex-waitv.%u", (unsigned)getuid());
+
+  int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+
+  if (fd != -1 && ftruncate(fd, sizeof(struct waitv_shared)) == 0) {
+    void* p = mmap(NULL, sizeof(struct waitv_shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED) {
+      waitv_shared = p;
+    }
+  }
+
+  if (fd != -1) {
+    close(fd);
+  }
+
+  if (waitv_shared == NULL) {
+    // wakes from other processes are missed
+    LOG("%s: no shared page for futex_waitv: %s", __func__, strerror(errno));
+    waitv_shared = &waitv_shared_fallback;
+  }
+}
+
+static struct waitv_shared* get_waitv_shared() {
+  assert(pthread_once(&waitv_shared_once, init_waitv_shared) == 0);
+  return waitv_shared;
+}
+
+static bool waitv_shared_reclaim(struct waitv_shared* shared) {
+
+  bool reclaimed = false;
+
+  for (int slot = 0; slot < WAITV_SHARED_SLOTS; slot++) {
+
+    pid_t owner = __atomic_load_n(&shared->owners[slot], __ATOMIC_ACQUIRE);
+    if (owner == 0 || kill(owner, 0) == 0 || errno != ESRCH) {
+      continue;
+    }
+
+    if (__atomic_compare_exchange_n(&shared->owners[slot], &owner, 0, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      for (int i = 0; i < WAITV_SHARED_BUCKETS; i++) {
+        __atomic_and_fetch(&shared->buckets[i], ~(1u << slot), __ATOMIC_SEQ_CST);
+      }
+      __atomic_and_fetch(&shared->allocated, ~(1u << slot), __ATOMIC_SEQ_CST);
+      reclaimed = true;
+    }
+  }
+
+  return reclaimed;
+}
+
+// Returns a free slot, or -1 if there is none.
+static int waitv_shared_alloc(struct waitv_shared* shared) {
+
+  uint32_t allocated = __atomic_load_n(&shared->allocated, __ATOMIC_RELAXED);
+
+  for (;;) {
+
+    if (allocated == UINT32_MAX) {
+      if (!waitv_shared_reclaim(shared)) {
+        return -1;
+      }
+      allocated = __atomic_load_n(&shared->allocated, __ATOMIC_RELAXED);
+      continue;
+    }
+
+    int slot = __builtin_ctz(~allocated);
+
+    if (__atomic_compare_exchange_n(&shared->allocated, &allocated, allocated | (1u << slot), false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      __atomic_store_n(&shared->owners[slot], getpid(), __ATOMIC_RELEASE);
+      return slot;
+    }
+  }
+}
+
+static void waitv_shared_free(struct waitv_shared* shared, int slot) {
+  __atomic_store_n(&shared->owners[slot], 0, __ATOMIC_RELEASE);
+  __atomic_and_fetch(&shared->allocated, ~(1u << slot), __ATOMIC_SEQ_CST);
+}
+
+static void waitv_shared_bump(uint32_t* word) {
+  __atomic_add_fetch(word, 1, __ATOMIC_SEQ_CST);
+  umtx_wake(word, UMTX_WAKE_ALL, true);
+}
+
+static void waitv_shared_notify(volatile uint32_t* uaddr) {
+
+  // pairs with the fence in futex_waitv: either we see its slot, or it sees the new futex value
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  struct waitv_shared* shared = get_waitv_shared();
+
+  uint32_t slots = __atomic_load_n(SHARED_BUCKET(shared, uaddr), __ATOMIC_SEQ_CST);
+  while (slots != 0) {
+    waitv_shared_bump(&shared->slots[__builtin_ctz(slots)]);
+    slots &= slots - 1;
+  }
+
+  if (__atomic_load_n(&shared->overflow_waiters, __ATOMIC_SEQ_CST) > 0) {
+    waitv_shared_bump(&shared->overflow);
+  }
+}
+
+static void bucket_lock(uint32_t* lock) {
+  while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE) != 0) {
+    while (__atomic_load_n(lock, __ATOMIC_RELAXED) != 0) {
+      cpu_relax();
+    }
+  }
+}
+
+static void bucket_unlock(uint32_t* lock) {
+  __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+static void waitv_register(struct waitv_node* node) {
+  bucket_lock(&BUCKET(node->uaddr)->lock);
+  node->next = BUCKET(node->uaddr)->head;
+  __atomic_store_n(&BUCKET(node->uaddr)->head, node, __ATOMIC_RELEASE);
+  bucket_unlock(&BUCKET(node->uaddr)->lock);
+}
+
+static void waitv_unregister(struct waitv_node* node) {
+  bucket_lock(&BUCKET(node->uaddr)->lock);
+  for (struct waitv_node** p = &BUCKET(node->uaddr)->head; *p != NULL; p = &(*p)->next) {
+    if (*p == node) {
+      *p = node->next;
+      break;
+    }
+  }
+  bucket_unlock(&BUCKET(node->uaddr)->lock);
+}
+
+static bool waitv_wake_waiter(struct waitv_waiter* waiter, int index) {
+
+  int none = -1;
+  if (!__atomic_compare_exchange_n(&waiter->woken, &none, index, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return false; // already woken through another futex
+  }
+
+  __atomic_store_n(&waiter->state, 1, __ATOMIC_SEQ_CST);
+
+  if (waiter->park != NULL) {
+    waitv_shared_bump(waiter->park);
+  } else {
+    umtx_wake(&waiter->state, 1, false);
+  }
+
+  return true;
+}
+
+// Wakes up to count multi-waiters registered on uaddr and returns how many.
+static int waitv_wake(volatile uint32_t* uaddr, int count) {
+
+  // pairs with the fence in futex_waitv: either we see its nodes, or it sees the new futex value
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&BUCKET(uaddr)->head, __ATOMIC_ACQUIRE) == NULL) {
+    return 0;
+  }
+
+  int woken = 0;
+
+  bucket_lock(&BUCKET(uaddr)->lock);
+  for (struct waitv_node* node = BUCKET(uaddr)->head; node != NULL && woken < count; node = node->next) {
+    if (node->uaddr == uaddr && waitv_wake_waiter(node->waiter, node->index)) {
+      woken++;
+    }
+  }
+  bucket_unlock(&BUCKET(uaddr)->lock);
+
+  return woken;
+}
+
+static int futex_wait(volatile uint32_t* uaddr, uint32_t val, bool private, clockid_t clock_id, const struct timespec* abstime) {
+
+  if (__atomic_load_n(uaddr, __ATOMIC_SEQ_CST) != val) {
+    return EAGAIN;
+  }
+
+  int err = umtx_wait_uint(uaddr, val, !private, clock_id, abstime);
+  assert(err == 0 || err == ETIMEDOUT || err == EINTR || err == EINVAL);
+
+  return err;
+}
+
+// umtx doesn't report how many threads it woke up, so only multi-waiters are counted.
+static int futex_wake(volatile uint32_t* uaddr, int count, bool private) {
+
+  int woken = waitv_wake(uaddr, count);
+
+  if (woken < count) {
+    umtx_wake(uaddr, count - woken, !private);
+  }
+
+  if (!private) {
+    waitv_shared_notify(uaddr);
+  }
+
+  return woken;
+}
+
+long futex(uint32_t* uaddr, int op, uint32_t val, const struct timespec* timeout, uint32_t* uaddr2, uint32_t val3) {
+
+  bool private = op & LINUX_FUTEX_PRIVATE_FLAG;
+
+  switch (op & LINUX_FUTEX_CMD_MASK) {
+
+    case LINUX_FUTEX_WAIT:
+    case LINUX_FUTEX_WAIT_BITSET: {
+
+      clockid_t clock_id = (op & LINUX_FUTEX_CLOCK_REALTIME) ? CLOCK_REALTIME : CLOCK_MONOTONIC;
+
+      struct timespec  deadline;
+      struct timespec* abstime = NULL;
+
+      if (timeout != NULL && (op & LINUX_FUTEX_CMD_MASK) == LINUX_FUTEX_WAIT) {
+        // FUTEX_WAIT takes a relative timeout, measured against CLOCK_MONOTONIC
+        clock_id = CLOCK_MONOTONIC;
+        clock_gettime(clock_id, &deadline);
+        deadline.tv_sec  += timeout->tv_sec;
+        deadline.tv_nsec += timeout->tv_nsec;
+        if (deadline.tv_nsec >= 1000000000) {
+          deadline.tv_sec  += 1;
+          deadline.tv_nsec -= 1000000000;
+        }
+        abstime = &deadline;
+      } else if (timeout != NULL) {
+        deadline = *timeout;
+        abstime  = &deadline;
+      }
+
+      // bitsets aren't tracked, a non-matching wakeup is just a spurious one
+      int err = futex_wait(uaddr, val, private, clock_id, abstime);
+      if (err != 0) {
+        errno = native_to_linux_errno(err);
+        return -1;
+      }
+
+      return 0;
+    }
+
+    case LINUX_FUTEX_WAKE:
+    case LINUX_FUTEX_WAKE_BITSET: {
+
+      return futex_wake(uaddr, val > INT32_MAX ? INT32_MAX : (int)val, private);
+    }
+
+    default:
+      LOG("%s: op %d is not supported", __func__, op);
+      errno = native_to_linux_errno(ENOSYS);
+      return -1;
+  }
+}
+
+long futex_waitv(struct linux_futex_waitv* waiters, unsigned int nr_futexes, unsigned int flags, const struct timespec* timeout, linux_clockid_t linux_clock_id) {
+
+  if (flags != 0 || waiters == NULL || nr_futexes == 0 || nr_futexes > LINUX_FUTEX_WAITV_MAX) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  if (timeout != NULL && linux_clock_id != LINUX_CLOCK_REALTIME && linux_clock_id != LINUX_CLOCK_MONOTONIC) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  bool any_shared = false;
+
+  for (unsigned int i = 0; i < nr_futexes; i++) {
+    if ((waiters[i].flags & ~(LINUX_FUTEX2_SIZE_MASK | LINUX_FUTEX2_PRIVATE)) != 0 ||
+        (waiters[i].flags & LINUX_FUTEX2_SIZE_MASK) != LINUX_FUTEX2_SIZE_U32 ||
+        waiters[i].__reserved != 0 || waiters[i].val > UINT32_MAX || waiters[i].uaddr % sizeof(uint32_t) != 0) {
+      errno = native_to_linux_errno(EINVAL);
+      return -1;
+    }
+    if (!(waiters[i].flags & LINUX_FUTEX2_PRIVATE)) {
+      any_shared = true;
+    }
+  }
+
+  struct waitv_waiter waiter = {
+    .state = 0,
+    .woken = -1,
+    .park  = NULL
+  };
+
+  struct waitv_shared* shared = any_shared ? get_waitv_shared() : NULL;
+  int                  slot   = -1;
+
+  if (shared != NULL) {
+    slot = waitv_shared_alloc(shared);
+    if (slot != -1) {
+      waiter.park = &shared->slots[slot];
+      for (unsigned int i = 0; i < nr_futexes; i++) {
+        if (!(waiters[i].flags & LINUX_FUTEX2_PRIVATE)) {
+          __atomic_or_fetch(SHARED_BUCKET(shared, waiters[i].uaddr), 1u << slot, __ATOMIC_SEQ_CST);
+        }
+      }
+    } else {
+      waiter.park = &shared->overflow;
+      __atomic_add_fetch(&shared->overflow_waiters, 1, __ATOMIC_SEQ_CST);
+    }
+  }
+
+  struct waitv_node nodes[LINUX_FUTEX_WAITV_MAX];
+
+  for (unsigned int i = 0; i < nr_futexes; i++) {
+    nodes[i].uaddr  = (volatile uint32_t*)(uintptr_t)waiters[i].uaddr;
+    nodes[i].waiter = &waiter;
+    nodes[i].index  = i;
+    waitv_register(&nodes[i]);
+  }
+
+  // pairs with the fences in waitv_wake and waitv_shared_notify
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  int err = 0;
+
+  for (unsigned int i = 0; i < nr_futexes; i++) {
+    if (*nodes[i].uaddr != (uint32_t)waiters[i].val) {
+      err = EAGAIN;
+      break;
+    }
+  }
+
+  clockid_t clock_id = timeout != NULL ? linux_to_native_clockid(linux_clock_id) : CLOCK_MONOTONIC;
+
+  while (err == 0 && __atomic_load_n(&waiter.state, __ATOMIC_ACQUIRE) == 0) {
+
+    if (waiter.park == NULL) {
+      err = umtx_wait_uint(&waiter.state, 0, false, clock_id, timeout);
+      continue;
+    }
+
+    uint32_t generation = __atomic_load_n(waiter.park, __ATOMIC_SEQ_CST);
+
+    // a shared futex may have been woken from another process
+    for (unsigned int i = 0; i < nr_futexes; i++) {
+      if (!(waiters[i].flags & LINUX_FUTEX2_PRIVATE) && *nodes[i].uaddr != (uint32_t)waiters[i].val) {
+        int none = -1;
+        __atomic_compare_exchange_n(&waiter.woken, &none, (int)i, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n(&waiter.state, 1, __ATOMIC_SEQ_CST);
+        break;
+      }
+    }
+
+    if (__atomic_load_n(&waiter.state, __ATOMIC_ACQUIRE) == 0) {
+      err = umtx_wait_uint(waiter.park, generation, true, clock_id, timeout);
+    }
+  }
+
+  for (unsigned int i = 0; i < nr_futexes; i++) {
+    waitv_unregister(&nodes[i]);
+  }
+
+  if (slot != -1) {
+    for (unsigned int i = 0; i < nr_futexes; i++) {
+      if (!(waiters[i].flags & LINUX_FUTEX2_PRIVATE)) {
+        __atomic_and_fetch(SHARED_BUCKET(shared, waiters[i].uaddr), ~(1u << slot), __ATOMIC_SEQ_CST);
+      }
+    }
+    waitv_shared_free(shared, slot);
+  } else if (shared != NULL) {
+    __atomic_sub_fetch(&shared->overflow_waiters, 1, __ATOMIC_SEQ_CST);
+  }
+
+  // a wakeup that raced with a timeout or signal still counts
+  int woken = __atomic_load_n(&waiter.woken, __ATOMIC_ACQUIRE);
+  if (woken >= 0) {
+    return woken;
+  }
+
+  errno = native_to_linux_errno(err);
+  return -1;
+}
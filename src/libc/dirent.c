@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <dirent.h>
+#include <errno.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -125,7 +126,14 @@ struct shim_directory* shim_fdopendir_impl(int fd) {
 }
 
 struct shim_directory* shim_opendir_impl(const char* filename) {
-  DIR* dir = opendir(filename);
+
+  const char* p = redirect(filename);
+  if (p == NULL) {
+    errno = EACCES;
+    return NULL;
+  }
+
+  DIR* dir = opendir(p);
   return dir != NULL ? create_shim_dir(dir) : NULL;
 }
 
@@ -202,7 +210,13 @@ int shim_scandir_impl(
   int (*compar)(const struct linux_dirent**, const struct linux_dirent**)
 ) {
 
-  DIR* dir = opendir(dirname);
+  const char* p = redirect(dirname);
+  if (p == NULL) {
+    errno = EACCES;
+    return -1;
+  }
+
+  DIR* dir = opendir(p);
   if (dir == NULL) {
     return -1;
   }
@@ -254,7 +268,13 @@ int shim_scandir64_impl(
   int (*compar)(const struct linux_dirent64**, const struct linux_dirent64**)
 ) {
 
-  DIR* dir = opendir(dirname);
+  const char* p = redirect(dirname);
+  if (p == NULL) {
+    errno = EACCES;
+    return -1;
+  }
+
+  DIR* dir = opendir(p);
   if (dir == NULL) {
     return -1;
   }
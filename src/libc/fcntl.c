@@ -148,13 +148,7 @@ int shim_fcntl64_impl(int fd, int cmd, va_list args) {
   return shim_fcntl_impl(fd, cmd, args);
 }
 
-int shim_open_impl(const char* path, int linux_flags, va_list args) {
-
-  char* p = redirect(path);
-  if (p == NULL) {
-    errno = EACCES;
-    return -1;
-  }
+static int open_native(int fd, const char* path, int linux_flags, va_list args) {
 
   assert((linux_flags & KNOWN_LINUX_OPEN_FLAGS) == linux_flags);
 
@@ -182,13 +176,46 @@ int shim_open_impl(const char* path, int linux_flags, va_list args) {
     mode = va_arg(args, linux_mode_t);
   }
 
-  return open(p, flags, mode);
+  return openat(fd, path, flags, mode);
+}
+
+int shim_open_impl(const char* path, int linux_flags, va_list args) {
+
+  if (vfile_exists(path)) {
+
+    if (linux_flags & (LINUX_O_WRONLY | LINUX_O_RDWR)) {
+      errno = EACCES;
+      return -1;
+    }
+
+    return vfile_open(path, (linux_flags & LINUX_O_CLOEXEC) ? O_CLOEXEC : 0);
+  }
+
+  char* p = redirect(path);
+  if (p == NULL) {
+    errno = EACCES;
+    return -1;
+  }
+
+  return open_native(AT_FDCWD, p, linux_flags, args);
 }
 
 int shim_open64_impl(const char* path, int linux_flags, va_list args) {
   return shim_open_impl(path, linux_flags, args);
 }
 
+// paths that open() would see go through it, for the virtual files and redirects
+int shim_openat_impl(int fd, const char* path, int linux_flags, va_list args) {
+  if (fd == LINUX_AT_FDCWD || path[0] == '/') {
+    return shim_open_impl(path, linux_flags, args);
+  }
+  return open_native(fd, path, linux_flags, args);
+}
+
+int shim_openat64_impl(int fd, const char* path, int linux_flags, va_list args) {
+  return shim_openat_impl(fd, path, linux_flags, args);
+}
+
 int shim_posix_fallocate64_impl(int fd, linux_off64_t offset, linux_off64_t len) {
   return posix_fallocate(fd, offset, len);
 }
@@ -197,6 +224,8 @@ SHIM_WRAP(fcntl);
 SHIM_WRAP(fcntl64);
 SHIM_WRAP(open);
 SHIM_WRAP(open64);
+SHIM_WRAP(openat);
+SHIM_WRAP(openat64);
 SHIM_WRAP(posix_fallocate64);
 
 int shim_shm_open_impl(const char* path, int linux_flags, linux_mode_t mode) {
@@ -25,6 +25,11 @@
 #define LINUX_O_CLOEXEC   0x80000
 #define LINUX_O_TMPFILE   (0x400000 | LINUX_O_DIRECTORY)
 
+#define LINUX_AT_FDCWD            -100
+#define LINUX_AT_SYMLINK_NOFOLLOW 0x0100
+#define LINUX_AT_NO_AUTOMOUNT     0x0800
+#define LINUX_AT_EMPTY_PATH       0x1000
+
 #define KNOWN_LINUX_OPEN_FLAGS ( \
  LINUX_O_RDONLY    |             \
  LINUX_O_WRONLY    |             \
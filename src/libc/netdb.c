@@ -1,8 +1,18 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/param.h>
+#include <sys/queue.h>
+#include <sys/stat.h>
 #include "../shim.h"
 #include "sys/socket.h"
 #include "netdb.h"
+#include "time.h"
 
 int* shim___h_errno_location_impl() {
   return &h_errno;
@@ -10,19 +20,76 @@ int* shim___h_errno_location_impl() {
 
 SHIM_WRAP(__h_errno_location);
 
-typedef struct linux_addrinfo linux_addrinfo;
-
-struct linux_addrinfo {
-  int              ai_flags;
-  int              ai_family;
-  int              ai_socktype;
-  int              ai_protocol;
-  socklen_t        ai_addrlen;
-  linux_sockaddr*  ai_addr;
-  char*            ai_canonname;
-  linux_addrinfo*  ai_next;
+static const struct {
+  int linux_error;
+  int native_error;
+} eai_errors[] = {
+  { LINUX_EAI_BADFLAGS,   EAI_BADFLAGS   },
+  { LINUX_EAI_NONAME,     EAI_NONAME     },
+  { LINUX_EAI_AGAIN,      EAI_AGAIN      },
+  { LINUX_EAI_FAIL,       EAI_FAIL       },
+  { LINUX_EAI_FAMILY,     EAI_FAMILY     },
+  { LINUX_EAI_SOCKTYPE,   EAI_SOCKTYPE   },
+  { LINUX_EAI_SERVICE,    EAI_SERVICE    },
+  { LINUX_EAI_MEMORY,     EAI_MEMORY     },
+  { LINUX_EAI_SYSTEM,     EAI_SYSTEM     },
+  { LINUX_EAI_OVERFLOW,   EAI_OVERFLOW   },
+#ifdef EAI_NODATA
+  { LINUX_EAI_NODATA,     EAI_NODATA     },
+#endif
+#ifdef EAI_ADDRFAMILY
+  { LINUX_EAI_ADDRFAMILY, EAI_ADDRFAMILY },
+#endif
+  // no Linux counterparts
+#ifdef EAI_BADHINTS
+  { LINUX_EAI_BADFLAGS,   EAI_BADHINTS   },
+#endif
+#ifdef EAI_PROTOCOL
+  { LINUX_EAI_SOCKTYPE,   EAI_PROTOCOL   },
+#endif
 };
 
+int native_to_linux_eai(int error) {
+
+  if (error == 0) {
+    return 0;
+  }
+
+  if (error == EAI_SYSTEM) {
+    errno = native_to_linux_errno(errno);
+  }
+
+  for (size_t i = 0; i < nitems(eai_errors); i++) {
+    if (eai_errors[i].native_error == error) {
+      return eai_errors[i].linux_error;
+    }
+  }
+
+  LOG("%s: unknown error %d", __func__, error);
+  return LINUX_EAI_FAIL;
+}
+
+const char* shim_gai_strerror_impl(int linux_error) {
+
+  switch (linux_error) {
+    case LINUX_EAI_INPROGRESS:  return "Processing request in progress";
+    case LINUX_EAI_CANCELED:    return "Request canceled";
+    case LINUX_EAI_NOTCANCELED: return "Request not canceled";
+    case LINUX_EAI_ALLDONE:     return "All requests done";
+    case LINUX_EAI_INTR:        return "Interrupted by a signal";
+  }
+
+  for (size_t i = 0; i < nitems(eai_errors); i++) {
+    if (eai_errors[i].linux_error == linux_error) {
+      return gai_strerror(eai_errors[i].native_error);
+    }
+  }
+
+  return "Unknown error";
+}
+
+SHIM_WRAP(gai_strerror);
+
 #define LINUX_AI_PASSIVE      0x01
 #define LINUX_AI_CANONNAME    0x02
 #define LINUX_AI_NUMERICHOST  0x04
@@ -44,33 +111,331 @@ static int linux_to_native_ai_flags(int linux_flags) {
   return flags;
 }
 
-static linux_addrinfo* copy_addrinfo(struct addrinfo* info) {
+/*
+ * A getaddrinfo result is packed into a single allocation, the nodes followed by
+ * their addresses and canonical names, so freeaddrinfo is a single free().
+ */
 
-  linux_addrinfo* linux_info = malloc(sizeof(linux_addrinfo));
+static linux_addrinfo* pack_addrinfo(const struct addrinfo* list, size_t* size) {
 
-  linux_info->ai_flags     = 0;
-  linux_info->ai_socktype  = native_to_linux_sock_type(info->ai_socktype);
-  linux_info->ai_protocol  = info->ai_protocol;
-  linux_info->ai_canonname = info->ai_canonname != NULL ? strdup(info->ai_canonname) : NULL;
+  *size = 0;
 
-  switch (info->ai_family) {
-    case PF_INET:
-      linux_info->ai_family    = LINUX_PF_INET;
-      linux_info->ai_addrlen   = sizeof(linux_sockaddr_in);
-      linux_info->ai_addr      = malloc(sizeof(linux_sockaddr_in));
-      native_to_linux_sockaddr_in((linux_sockaddr_in*)linux_info->ai_addr, (struct sockaddr_in*)info->ai_addr);
-      break;
-    case PF_INET6:
-      linux_info->ai_family    = LINUX_PF_INET6;
-      linux_info->ai_addrlen   = sizeof(linux_sockaddr_in6);
-      linux_info->ai_addr      = malloc(sizeof(linux_sockaddr_in6));
-      native_to_linux_sockaddr_in6((linux_sockaddr_in6*)linux_info->ai_addr, (struct sockaddr_in6*)info->ai_addr);
+  for (const struct addrinfo* info = list; info != NULL; info = info->ai_next) {
+    socklen_t addrlen = native_to_linux_sockaddr(NULL, 0, info->ai_addr);
+    if (addrlen > 0) {
+      *size += _ALIGN(sizeof(linux_addrinfo)) + _ALIGN(addrlen);
+      *size += info->ai_canonname != NULL ? _ALIGN(strlen(info->ai_canonname) + 1) : 0;
+    }
+  }
+
+  uint8_t* block = *size > 0 ? malloc(*size) : NULL;
+  if (block == NULL) {
+    return NULL;
+  }
+
+  linux_addrinfo*  head = NULL;
+  linux_addrinfo** tail = &head;
+  uint8_t*         p    = block;
+
+  for (const struct addrinfo* info = list; info != NULL; info = info->ai_next) {
+
+    socklen_t addrlen = native_to_linux_sockaddr(NULL, 0, info->ai_addr);
+    if (addrlen == 0) {
+      continue;
+    }
+
+    linux_addrinfo* linux_info = (linux_addrinfo*)p;
+    p += _ALIGN(sizeof(linux_addrinfo));
+
+    linux_info->ai_addr    = (linux_sockaddr*)p;
+    linux_info->ai_addrlen = native_to_linux_sockaddr(linux_info->ai_addr, addrlen, info->ai_addr);
+    p += _ALIGN(addrlen);
+
+    linux_info->ai_flags     = 0;
+    linux_info->ai_family    = linux_info->ai_addr->sa_family;
+    linux_info->ai_socktype  = native_to_linux_sock_type(info->ai_socktype);
+    linux_info->ai_protocol  = info->ai_protocol;
+    linux_info->ai_canonname = NULL;
+    linux_info->ai_next      = NULL;
+
+    if (info->ai_canonname != NULL) {
+      size_t len = strlen(info->ai_canonname) + 1;
+      linux_info->ai_canonname = memcpy(p, info->ai_canonname, len);
+      p += _ALIGN(len);
+    }
+
+    *tail = linux_info;
+    tail  = &linux_info->ai_next;
+  }
+
+  return head;
+}
+
+static void* relocate(void* ptr, const void* from, void* to) {
+  return ptr != NULL ? (uint8_t*)to + ((uint8_t*)ptr - (const uint8_t*)from) : NULL;
+}
+
+static linux_addrinfo* copy_packed_addrinfo(const linux_addrinfo* packed, size_t size) {
+
+  linux_addrinfo* copy = malloc(size);
+  if (copy == NULL) {
+    return NULL;
+  }
+
+  memcpy(copy, packed, size);
+
+  for (linux_addrinfo* info = copy; info != NULL; info = info->ai_next) {
+    info->ai_addr      = relocate(info->ai_addr,      packed, copy);
+    info->ai_canonname = relocate(info->ai_canonname, packed, copy);
+    info->ai_next      = relocate(info->ai_next,      packed, copy);
+  }
+
+  return copy;
+}
+
+/*
+ * With SHIM_GAI_CACHE=<seconds>, results and EAI_NONAME answers are kept for
+ * that long, keyed by (host, service, hints). The native resolver doesn't tell the
+ * TTL of the records it used, so the setting is the only bound. The cache is dropped
+ * whenever one of the resolver's configuration files changes.
+ *
+ * SHIM_GAI_HOSTS=<file> names a hosts(5) file consulted before the native resolver,
+ * which makes lookups, and the cache, testable against stub entries. It is watched
+ * like /etc/hosts.
+ */
+
+#define GAI_CACHE_SIZE 64
+
+struct gai_cache_entry {
+  char*           key;     // NULL when unused
+  int             err;     // cached failure, 0 for a result
+  linux_addrinfo* result;
+  size_t          size;
+  time_t          expires;
+};
+
+// the last one is SHIM_GAI_HOSTS, if set
+static const char* gai_cache_watched[] = { "/etc/hosts", "/etc/resolv.conf", "/etc/nsswitch.conf", NULL };
+
+static struct {
+  pthread_once_t         once;
+  pthread_mutex_t        mutex;
+  const char*            hosts;
+  time_t                 ttl;
+  time_t                 checked;
+  struct timespec        mtimes[nitems(gai_cache_watched)];
+  struct gai_cache_entry entries[GAI_CACHE_SIZE];
+} gai_cache = {
+  .once  = PTHREAD_ONCE_INIT,
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void init_gai_cache() {
+  const char* value = getenv("SHIM_GAI_CACHE");
+  gai_cache.ttl = value != NULL ? MAX(atoi(value), 0) : 0;
+
+  gai_cache.hosts = getenv("SHIM_GAI_HOSTS");
+  gai_cache_watched[nitems(gai_cache_watched) - 1] = gai_cache.hosts;
+}
+
+static time_t monotonic_seconds() {
+  struct timespec now;
+  assert(clock_gettime(CLOCK_MONOTONIC_FAST, &now) == 0);
+  return now.tv_sec;
+}
+
+static void clear_gai_cache() {
+  for (int i = 0; i < GAI_CACHE_SIZE; i++) {
+    struct gai_cache_entry* entry = &gai_cache.entries[i];
+    free(entry->key);
+    free(entry->result);
+    *entry = (struct gai_cache_entry){0};
+  }
+}
+
+// Looked at once a second at most.
+static void check_resolver_files(time_t now) {
+
+  if (now == gai_cache.checked) {
+    return;
+  }
+
+  gai_cache.checked = now;
+
+  bool changed = false;
+
+  for (size_t i = 0; i < nitems(gai_cache_watched); i++) {
+
+    struct stat sb;
+    struct timespec mtime = gai_cache_watched[i] != NULL && stat(gai_cache_watched[i], &sb) == 0 ? sb.st_mtim : (struct timespec){0};
+
+    if (mtime.tv_sec != gai_cache.mtimes[i].tv_sec || mtime.tv_nsec != gai_cache.mtimes[i].tv_nsec) {
+      gai_cache.mtimes[i] = mtime;
+      changed = true;
+    }
+  }
+
+  if (changed) {
+    clear_gai_cache();
+  }
+}
+
+// Returns NULL when the lookup is too big to be cached.
+static char* gai_cache_key(char* key, size_t size, const char* hostname, const char* servname, const struct addrinfo* hints) {
+
+  int n = snprintf(key, size, "%d/%d/%d/%d/%c%s/%c%s",
+    hints->ai_family, hints->ai_socktype, hints->ai_protocol, hints->ai_flags,
+    hostname != NULL ? '+' : '-', hostname != NULL ? hostname : "",
+    servname != NULL ? '+' : '-', servname != NULL ? servname : ""
+  );
+
+  return (n >= 0 && (size_t)n < size) ? key : NULL;
+}
+
+static bool gai_cache_lookup(const char* key, int* err, linux_addrinfo** res) {
+
+  bool found = false;
+
+  assert(pthread_mutex_lock(&gai_cache.mutex) == 0);
+
+  time_t now = monotonic_seconds();
+  check_resolver_files(now);
+
+  for (int i = 0; i < GAI_CACHE_SIZE; i++) {
+
+    struct gai_cache_entry* entry = &gai_cache.entries[i];
+
+    if (entry->key == NULL || entry->expires <= now || strcmp(entry->key, key) != 0) {
+      continue;
+    }
+
+    if (entry->err != 0) {
+      *err = entry->err;
+      found = true;
+    } else {
+      *res = copy_packed_addrinfo(entry->result, entry->size);
+      *err = 0;
+      found = (*res != NULL);
+    }
+
+    break;
+  }
+
+  assert(pthread_mutex_unlock(&gai_cache.mutex) == 0);
+
+  return found;
+}
+
+static void gai_cache_insert(const char* key, int err, const linux_addrinfo* result, size_t size) {
+
+  char*           entry_key    = strdup(key);
+  linux_addrinfo* entry_result = result != NULL ? copy_packed_addrinfo(result, size) : NULL;
+
+  if (entry_key == NULL || (result != NULL && entry_result == NULL)) {
+    free(entry_key);
+    free(entry_result);
+    return;
+  }
+
+  assert(pthread_mutex_lock(&gai_cache.mutex) == 0);
+
+  // the entry closest to expiry makes room
+  struct gai_cache_entry* victim = &gai_cache.entries[0];
+  for (int i = 1; i < GAI_CACHE_SIZE && victim->key != NULL; i++) {
+    struct gai_cache_entry* entry = &gai_cache.entries[i];
+    if (entry->key == NULL || entry->expires < victim->expires) {
+      victim = entry;
+    }
+  }
+
+  free(victim->key);
+  free(victim->result);
+
+  victim->key     = entry_key;
+  victim->err     = err;
+  victim->result  = entry_result;
+  victim->size    = size;
+  victim->expires = monotonic_seconds() + gai_cache.ttl;
+
+  assert(pthread_mutex_unlock(&gai_cache.mutex) == 0);
+}
+
+#define GAI_HOSTS_MAX 16
+
+/*
+ * Resolves hostname from the SHIM_GAI_HOSTS file, the way the native resolver does
+ * with /etc/hosts: each address listed for the name (or one of its aliases) that
+ * suits the hints is looked up numerically. Returns EAI_NONAME when the file doesn't
+ * list any, so that the native resolver is asked instead.
+ */
+static int getaddrinfo_hosts(const char* path, const char* hostname, const char* servname, const struct addrinfo* hints, struct addrinfo** res) {
+
+  FILE* file = fopen(path, "re");
+  if (file == NULL) {
+    return EAI_NONAME;
+  }
+
+  struct addrinfo numeric_hints = *hints;
+  numeric_hints.ai_flags = (hints->ai_flags & ~AI_CANONNAME) | AI_NUMERICHOST;
+
+  struct addrinfo* lists[GAI_HOSTS_MAX];
+  char*            canonname = NULL;
+  int              nlists    = 0;
+  int              err       = EAI_NONAME;
+
+  char*   line = NULL;
+  size_t  capacity = 0;
+
+  while (nlists < GAI_HOSTS_MAX && getline(&line, &capacity, file) != -1) {
+
+    line[strcspn(line, "#\n")] = '\0';
+
+    char* last;
+    char* address = strtok_r(line, " \t", &last);
+    char* canon   = strtok_r(NULL, " \t", &last);
+
+    bool matches = false;
+    for (char* name = canon; name != NULL && !matches; name = strtok_r(NULL, " \t", &last)) {
+      matches = (strcasecmp(name, hostname) == 0);
+    }
+
+    if (!matches || getaddrinfo(address, servname, &numeric_hints, &lists[nlists]) != 0) {
+      continue;
+    }
+
+    if (canonname == NULL && (canonname = strdup(canon)) == NULL) {
+      freeaddrinfo(lists[nlists]);
       break;
-    default:
-      assert(0);
+    }
+
+    nlists++;
   }
 
-  return linux_info;
+  free(line);
+  fclose(file);
+
+  if (nlists > 0) {
+
+    for (int i = 0; i < nlists - 1; i++) {
+      struct addrinfo* tail = lists[i];
+      while (tail->ai_next != NULL) {
+        tail = tail->ai_next;
+      }
+      tail->ai_next = lists[i + 1];
+    }
+
+    if (hints->ai_flags & AI_CANONNAME) {
+      lists[0]->ai_canonname = canonname;
+      canonname = NULL;
+    }
+
+    *res = lists[0];
+    err  = 0;
+  }
+
+  free(canonname);
+
+  return err;
 }
 
 int shim_getaddrinfo_impl(const char* hostname, const char* servname, const linux_addrinfo* linux_hints, linux_addrinfo** res) {
@@ -98,36 +463,46 @@ int shim_getaddrinfo_impl(const char* hostname, const char* servname, const linu
   hints.ai_canonname = NULL;
   hints.ai_next      = NULL;
 
+  pthread_once(&gai_cache.once, init_gai_cache);
+
+  char  key_buffer[1024];
+  char* key = gai_cache.ttl > 0 ? gai_cache_key(key_buffer, sizeof(key_buffer), hostname, servname, &hints) : NULL;
+
+  int err;
+  if (key != NULL && gai_cache_lookup(key, &err, res)) {
+    return native_to_linux_eai(err);
+  }
+
   struct addrinfo* list_head;
-  int err = getaddrinfo(hostname, servname, &hints, &list_head);
-  if (err == 0) {
-    struct addrinfo* info       = list_head;
-    linux_addrinfo*  linux_info = copy_addrinfo(info);
-    *res = linux_info;
-    info = info->ai_next;
 
-    while (info != NULL) {
-      linux_info->ai_next = copy_addrinfo(info);
-      linux_info = linux_info->ai_next;
-      info = info->ai_next;
-    }
+  err = EAI_NONAME;
+  if (gai_cache.hosts != NULL && hostname != NULL && !(hints.ai_flags & AI_NUMERICHOST)) {
+    err = getaddrinfo_hosts(gai_cache.hosts, hostname, servname, &hints, &list_head);
+  }
+  if (err == EAI_NONAME) {
+    err = getaddrinfo(hostname, servname, &hints, &list_head);
+  }
 
+  size_t size = 0;
+
+  if (err == 0) {
+    *res = pack_addrinfo(list_head, &size);
     freeaddrinfo(list_head);
+    if (*res == NULL) {
+      err = (size == 0) ? EAI_FAMILY : EAI_MEMORY;
+    }
   }
 
-  return err;
+  // other failures may well not last
+  if (key != NULL && (err == 0 || err == EAI_NONAME)) {
+    gai_cache_insert(key, err, err == 0 ? *res : NULL, size);
+  }
+
+  return native_to_linux_eai(err);
 }
 
 void shim_freeaddrinfo_impl(linux_addrinfo* ai) {
-  while (ai != NULL) {
-    linux_addrinfo* next = ai->ai_next;
-    if (ai->ai_canonname != NULL) {
-      free(ai->ai_canonname);
-    }
-    free(ai->ai_addr);
-    free(ai);
-    ai = next;
-  }
+  free(ai);
 }
 
 SHIM_WRAP(getaddrinfo);
@@ -156,34 +531,347 @@ static int linux_to_native_ni_flags(int linux_flags) {
 
 int shim_getnameinfo_impl(const linux_sockaddr* linux_addr, socklen_t linux_addrlen, char* host, size_t hostlen, char* serv, size_t servlen, int linux_flags) {
 
-  switch (linux_addr->sa_family) {
-    case LINUX_AF_UNIX:
-      {
-        struct sockaddr_un addr;
-        assert(linux_addrlen <= sizeof(struct linux_sockaddr_un));
-        linux_to_native_sockaddr_un(&addr, (linux_sockaddr_un*)linux_addr);
-        return getnameinfo((struct sockaddr*)&addr, sizeof(addr), host, hostlen, serv, servlen, linux_to_native_ni_flags(linux_flags));
+  struct sockaddr_storage addr;
+  socklen_t addrlen = linux_to_native_sockaddr(&addr, linux_addr, linux_addrlen);
+  if (addrlen == 0) {
+    return LINUX_EAI_FAMILY;
+  }
+
+  return native_to_linux_eai(getnameinfo((struct sockaddr*)&addr, addrlen, host, hostlen, serv, servlen, linux_to_native_ni_flags(linux_flags)));
+}
+
+SHIM_WRAP(getnameinfo);
+
+/*
+ * getaddrinfo_a(3) hands its requests to a small pool of resolver threads, started
+ * as needed and kept around afterwards. Each call's requests form a batch, which
+ * notifies the caller once the last of them is done.
+ */
+
+#define GAI_MAX_WORKERS 16
+
+struct gai_request {
+  linux_gaicb*             cb;
+  struct gai_batch*        batch;
+  TAILQ_ENTRY(gai_request) entries;
+};
+
+struct gai_batch {
+  int                pending;
+  bool               waiting; // GAI_WAIT: freed by the caller rather than on completion
+  linux_sigevent     sevp;
+  struct gai_request requests[];
+};
+
+static struct {
+  pthread_once_t                    once;
+  pthread_mutex_t                   mutex;
+  pthread_cond_t                    queued;
+  pthread_cond_t                    done;   // on CLOCK_MONOTONIC, for gai_suspend timeouts
+  TAILQ_HEAD(, gai_request)         queue;
+  int                               backlog;  // requests in queue
+  int                               workers;
+  int                               starting; // workers yet to look at the queue
+  int                               idle;     // workers waiting for requests, woken or not
+} gai_pool = {
+  .once   = PTHREAD_ONCE_INIT,
+  .mutex  = PTHREAD_MUTEX_INITIALIZER,
+  .queued = PTHREAD_COND_INITIALIZER,
+  .queue  = TAILQ_HEAD_INITIALIZER(gai_pool.queue),
+};
+
+static void init_gai_pool() {
+  pthread_condattr_t attr;
+  assert(pthread_condattr_init(&attr) == 0);
+  assert(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) == 0);
+  assert(pthread_cond_init(&gai_pool.done, &attr) == 0);
+  pthread_condattr_destroy(&attr);
+}
+
+static void* gai_notify_thread(void* arg) {
+  struct gai_batch* batch = arg;
+  batch->sevp._sigev_un._sigev_thread._function(batch->sevp.sigev_value);
+  free(batch);
+  return NULL;
+}
+
+static void gai_notify(struct gai_batch* batch) {
+
+  if (batch->sevp.sigev_notify == LINUX_SIGEV_THREAD) {
+
+    pthread_attr_t* attr = batch->sevp._sigev_un._sigev_thread._attribute;
+
+    pthread_attr_t detached;
+    if (attr == NULL) {
+      assert(pthread_attr_init(&detached) == 0);
+      assert(pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED) == 0);
+    }
+
+    pthread_t thread;
+    int err = pthread_create(&thread, attr != NULL ? attr : &detached, gai_notify_thread, batch);
+
+    if (attr == NULL) {
+      pthread_attr_destroy(&detached);
+    }
+
+    if (err == 0) {
+      return;
+    }
+
+    LOG("%s: pthread_create failed: %d", __func__, err);
+  }
+
+  free(batch);
+}
+
+// With gai_pool.mutex held. Returns the batch to notify, if it's now complete.
+static struct gai_batch* gai_complete(struct gai_batch* batch) {
+
+  assert(pthread_cond_broadcast(&gai_pool.done) == 0);
+
+  if (--batch->pending > 0 || batch->waiting) {
+    return NULL;
+  }
+
+  return batch;
+}
+
+static void* gai_worker(void* arg) {
+
+  assert(pthread_mutex_lock(&gai_pool.mutex) == 0);
+
+  gai_pool.starting--;
+
+  for (;;) {
+
+    while (TAILQ_EMPTY(&gai_pool.queue)) {
+      gai_pool.idle++;
+      assert(pthread_cond_wait(&gai_pool.queued, &gai_pool.mutex) == 0);
+      gai_pool.idle--;
+    }
+
+    struct gai_request* request = TAILQ_FIRST(&gai_pool.queue);
+    TAILQ_REMOVE(&gai_pool.queue, request, entries);
+    gai_pool.backlog--;
+
+    linux_gaicb* cb = request->cb;
+
+    assert(pthread_mutex_unlock(&gai_pool.mutex) == 0);
+
+    linux_addrinfo* result = NULL;
+    int err = shim_getaddrinfo_impl(cb->ar_name, cb->ar_service, cb->ar_request, &result);
+
+    assert(pthread_mutex_lock(&gai_pool.mutex) == 0);
+
+    cb->ar_result = result;
+    cb->__return  = err;
+
+    struct gai_batch* batch = gai_complete(request->batch);
+
+    if (batch != NULL) {
+      assert(pthread_mutex_unlock(&gai_pool.mutex) == 0);
+      gai_notify(batch);
+      assert(pthread_mutex_lock(&gai_pool.mutex) == 0);
+    }
+  }
+}
+
+// With gai_pool.mutex held. Starts one more worker unless there's one for each queued request.
+static void gai_start_worker() {
+
+  if (gai_pool.backlog <= gai_pool.idle + gai_pool.starting || gai_pool.workers == GAI_MAX_WORKERS) {
+    return;
+  }
+
+  pthread_attr_t attr;
+  assert(pthread_attr_init(&attr) == 0);
+  assert(pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED) == 0);
+
+  // signals are for the application's threads
+  sigset_t all, old;
+  sigfillset(&all);
+  assert(pthread_sigmask(SIG_SETMASK, &all, &old) == 0);
+
+  pthread_t thread;
+  int err = pthread_create(&thread, &attr, gai_worker, NULL);
+
+  assert(pthread_sigmask(SIG_SETMASK, &old, NULL) == 0);
+  pthread_attr_destroy(&attr);
+
+  if (err == 0) {
+    gai_pool.workers++;
+    gai_pool.starting++;
+  } else {
+    // what's queued is picked up by the workers there are
+    LOG("%s: pthread_create failed: %d", __func__, err);
+  }
+}
+
+int shim_getaddrinfo_a_impl(int mode, linux_gaicb** list, int nitems, linux_sigevent* sevp) {
+
+  if ((mode != LINUX_GAI_WAIT && mode != LINUX_GAI_NOWAIT) || nitems < 0) {
+    errno = native_to_linux_errno(EINVAL);
+    return LINUX_EAI_SYSTEM;
+  }
+
+  // the shim doesn't deliver signals to Linux handlers, so only these are of use
+  int notify = (mode == LINUX_GAI_NOWAIT && sevp != NULL) ? sevp->sigev_notify : LINUX_SIGEV_NONE;
+  if (notify != LINUX_SIGEV_NONE && notify != LINUX_SIGEV_THREAD) {
+    LOG("%s: sigev_notify %d is not supported", __func__, notify);
+    errno = native_to_linux_errno(EINVAL);
+    return LINUX_EAI_SYSTEM;
+  }
+
+  assert(pthread_once(&gai_pool.once, init_gai_pool) == 0);
+
+  struct gai_batch* batch = malloc(sizeof(struct gai_batch) + nitems * sizeof(struct gai_request));
+  if (batch == NULL) {
+    return LINUX_EAI_AGAIN;
+  }
+
+  batch->pending = 1; // held until every request is queued
+  batch->waiting = (mode == LINUX_GAI_WAIT);
+  batch->sevp    = (sevp != NULL) ? *sevp : (linux_sigevent){ .sigev_notify = LINUX_SIGEV_NONE };
+
+  assert(pthread_mutex_lock(&gai_pool.mutex) == 0);
+
+  for (int i = 0; i < nitems; i++) {
+
+    if (list[i] == NULL) {
+      continue;
+    }
+
+    struct gai_request* request = &batch->requests[i];
+
+    request->cb    = list[i];
+    request->batch = batch;
+
+    list[i]->ar_result = NULL;
+    list[i]->__return  = LINUX_EAI_INPROGRESS;
+
+    TAILQ_INSERT_TAIL(&gai_pool.queue, request, entries);
+    gai_pool.backlog++;
+    batch->pending++;
+
+    gai_start_worker();
+    assert(pthread_cond_signal(&gai_pool.queued) == 0);
+  }
+
+  struct gai_batch* completed = gai_complete(batch);
+
+  if (mode == LINUX_GAI_WAIT) {
+    while (batch->pending > 0) {
+      assert(pthread_cond_wait(&gai_pool.done, &gai_pool.mutex) == 0);
+    }
+    free(batch);
+  }
+
+  assert(pthread_mutex_unlock(&gai_pool.mutex) == 0);
+
+  // nothing was queued
+  if (completed != NULL) {
+    gai_notify(completed);
+  }
+
+  return 0;
+}
+
+int shim_gai_error_impl(linux_gaicb* req) {
+  assert(pthread_mutex_lock(&gai_pool.mutex) == 0);
+  int err = req->__return;
+  assert(pthread_mutex_unlock(&gai_pool.mutex) == 0);
+  return err;
+}
+
+int shim_gai_cancel_impl(linux_gaicb* req) {
+
+  int result = LINUX_EAI_ALLDONE;
+  struct gai_batch* completed = NULL;
+
+  assert(pthread_mutex_lock(&gai_pool.mutex) == 0);
+
+  if (req->__return == LINUX_EAI_INPROGRESS) {
+
+    // requests already being resolved can't be stopped
+    result = LINUX_EAI_NOTCANCELED;
+
+    struct gai_request* request;
+    TAILQ_FOREACH(request, &gai_pool.queue, entries) {
+      if (request->cb == req) {
+        TAILQ_REMOVE(&gai_pool.queue, request, entries);
+        gai_pool.backlog--;
+        req->__return = LINUX_EAI_CANCELED;
+        completed = gai_complete(request->batch);
+        result = LINUX_EAI_CANCELED;
+        break;
       }
-      break;
-    case LINUX_AF_INET:
-      {
-        struct sockaddr_in addr;
-        assert(linux_addrlen == sizeof(struct linux_sockaddr_in));
-        linux_to_native_sockaddr_in(&addr, (linux_sockaddr_in*)linux_addr);
-        return getnameinfo((struct sockaddr*)&addr, sizeof(addr), host, hostlen, serv, servlen, linux_to_native_ni_flags(linux_flags));
+    }
+  }
+
+  assert(pthread_mutex_unlock(&gai_pool.mutex) == 0);
+
+  if (completed != NULL) {
+    gai_notify(completed);
+  }
+
+  return result;
+}
+
+// Whether any listed request is done, or else whether there's one to wait for.
+static bool any_done(const linux_gaicb* const* list, int nitems, bool* any_listed) {
+
+  *any_listed = false;
+
+  for (int i = 0; i < nitems; i++) {
+    if (list[i] != NULL) {
+      *any_listed = true;
+      if (list[i]->__return != LINUX_EAI_INPROGRESS) {
+        return true;
       }
+    }
+  }
+
+  return false;
+}
+
+int shim_gai_suspend_impl(const linux_gaicb* const* list, int nitems, const linux_timespec* timeout) {
+
+  assert(pthread_once(&gai_pool.once, init_gai_pool) == 0);
+
+  struct timespec deadline;
+  if (timeout != NULL) {
+    assert(clock_gettime(CLOCK_MONOTONIC, &deadline) == 0);
+    deadline.tv_sec  += timeout->tv_sec + (deadline.tv_nsec + timeout->tv_nsec) / 1000000000;
+    deadline.tv_nsec  =                   (deadline.tv_nsec + timeout->tv_nsec) % 1000000000;
+  }
+
+  int  result = 0;
+  bool any_listed;
+
+  assert(pthread_mutex_lock(&gai_pool.mutex) == 0);
+
+  // like glibc, a request that's already done ends the wait straight away
+  while (!any_done(list, nitems, &any_listed)) {
+
+    if (!any_listed) {
+      result = LINUX_EAI_ALLDONE;
       break;
-    case LINUX_AF_INET6:
-      {
-        struct sockaddr_in6 addr;
-        assert(linux_addrlen == sizeof(struct linux_sockaddr_in6));
-        linux_to_native_sockaddr_in6(&addr, (linux_sockaddr_in6*)linux_addr);
-        return getnameinfo((struct sockaddr*)&addr, sizeof(addr), host, hostlen, serv, servlen, linux_to_native_ni_flags(linux_flags));
-      }
+    }
+
+    if (timeout == NULL) {
+      assert(pthread_cond_wait(&gai_pool.done, &gai_pool.mutex) == 0);
+    } else if (pthread_cond_timedwait(&gai_pool.done, &gai_pool.mutex, &deadline) == ETIMEDOUT) {
+      result = LINUX_EAI_AGAIN;
       break;
-    default:
-      assert(0);
+    }
   }
+
+  assert(pthread_mutex_unlock(&gai_pool.mutex) == 0);
+
+  return result;
 }
 
-SHIM_WRAP(getnameinfo);
+SHIM_WRAP(getaddrinfo_a);
+SHIM_WRAP(gai_error);
+SHIM_WRAP(gai_cancel);
+SHIM_WRAP(gai_suspend);
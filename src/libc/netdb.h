@@ -1,3 +1,54 @@
+#pragma once
+
 #include <netdb.h>
 
-typedef struct hostent linux_hostent;
+#include "sys/socket.h"
+
+#define LINUX_EAI_BADFLAGS      -1
+#define LINUX_EAI_NONAME        -2
+#define LINUX_EAI_AGAIN         -3
+#define LINUX_EAI_FAIL          -4
+#define LINUX_EAI_NODATA        -5
+#define LINUX_EAI_FAMILY        -6
+#define LINUX_EAI_SOCKTYPE      -7
+#define LINUX_EAI_SERVICE       -8
+#define LINUX_EAI_ADDRFAMILY    -9
+#define LINUX_EAI_MEMORY       -10
+#define LINUX_EAI_SYSTEM       -11
+#define LINUX_EAI_OVERFLOW     -12
+#define LINUX_EAI_INPROGRESS  -100
+#define LINUX_EAI_CANCELED    -101
+#define LINUX_EAI_NOTCANCELED -102
+#define LINUX_EAI_ALLDONE     -103
+#define LINUX_EAI_INTR        -104
+
+#define LINUX_GAI_WAIT   0
+#define LINUX_GAI_NOWAIT 1
+
+typedef struct hostent        linux_hostent;
+typedef struct linux_addrinfo linux_addrinfo;
+typedef struct linux_gaicb    linux_gaicb;
+
+struct linux_addrinfo {
+  int              ai_flags;
+  int              ai_family;
+  int              ai_socktype;
+  int              ai_protocol;
+  socklen_t        ai_addrlen;
+  linux_sockaddr*  ai_addr;
+  char*            ai_canonname;
+  linux_addrinfo*  ai_next;
+};
+
+struct linux_gaicb {
+  const char*           ar_name;
+  const char*           ar_service;
+  const linux_addrinfo* ar_request;
+  linux_addrinfo*       ar_result;
+  int                   __return;
+  int                   __glibc_reserved[5];
+};
+
+int native_to_linux_eai(int error);
+
+int shim_getaddrinfo_impl(const char* hostname, const char* servname, const linux_addrinfo* linux_hints, linux_addrinfo** res);
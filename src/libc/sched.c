@@ -1,6 +1,14 @@
+#include <cpuid.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/param.h>
+#include <sys/cpuset.h>
 #include <sys/types.h>
 #include "../shim.h"
 #include "sched.h"
+#include "sys/numa.h"
 
 typedef void linux_cpu_set_t;
 
@@ -72,3 +80,149 @@ int shim_posix_spawnattr_setschedpolicy_impl(posix_spawnattr_t* attr, int linux_
 
 SHIM_WRAP(posix_spawnattr_getschedpolicy);
 SHIM_WRAP(posix_spawnattr_setschedpolicy);
+
+/*
+ * The kernel stores the current CPU id in IA32_TSC_AUX, readable from userspace
+ * with RDPID (or RDTSCP on older CPUs) in a few cycles, no syscall needed.
+ *
+ * The value is checked against the native sched_getcpu(3) once at startup where
+ * one exists, since nothing guarantees the kernel keeps TSC_AUX up to date.
+ */
+
+enum {
+  CPU_SOURCE_NONE,
+  CPU_SOURCE_RDPID,
+  CPU_SOURCE_RDTSCP,
+  CPU_SOURCE_NATIVE
+};
+
+static int cpu_source = CPU_SOURCE_NONE;
+
+#define CPUID_7_ECX_RDPID           (1 << 22)
+#define CPUID_80000001_EDX_RDTSCP   (1 << 27)
+
+#define TSC_AUX_CPU_MASK 0xFFF
+
+static inline unsigned int read_tsc_aux(int source) {
+  if (source == CPU_SOURCE_RDPID) {
+    unsigned long aux;
+    __asm__ __volatile__("rdpid %0" : "=r"(aux));
+    return aux & TSC_AUX_CPU_MASK;
+  } else {
+    uint32_t lo, hi, aux;
+    __asm__ __volatile__("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux));
+    return aux & TSC_AUX_CPU_MASK;
+  }
+}
+
+static bool tsc_aux_is_valid(int source) {
+#if __FreeBSD_version >= 1301000
+  // tolerate a migration between the two reads
+  for (int i = 0; i < 10; i++) {
+    if ((int)read_tsc_aux(source) == sched_getcpu()) {
+      return true;
+    }
+  }
+  return false;
+#else
+  // There's no sched_getcpu() to compare with, and older kernels don't always
+  // load TSC_AUX with the CPU id: pin the thread to two of its CPUs in turn instead.
+  cpuset_t saved;
+  if (cpuset_getaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(saved), &saved) == -1) {
+    return false;
+  }
+
+  int checked = 0;
+  bool valid  = true;
+
+  for (int cpu = 0; cpu < CPU_SETSIZE && checked < 2 && valid; cpu++) {
+
+    if (!CPU_ISSET(cpu, &saved)) {
+      continue;
+    }
+
+    cpuset_t pinned;
+    CPU_SETOF(cpu, &pinned);
+
+    valid = cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(pinned), &pinned) == 0 &&
+            (int)read_tsc_aux(source) == cpu;
+    checked++;
+  }
+
+  if (cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(saved), &saved) == -1) {
+    return false;
+  }
+
+  return valid && checked > 0;
+#endif
+}
+
+__attribute__((constructor))
+static void init_cpu_source() {
+
+  unsigned int eax, ebx, ecx, edx;
+
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ecx & CPUID_7_ECX_RDPID) && tsc_aux_is_valid(CPU_SOURCE_RDPID)) {
+    cpu_source = CPU_SOURCE_RDPID;
+    return;
+  }
+
+  if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (edx & CPUID_80000001_EDX_RDTSCP) && tsc_aux_is_valid(CPU_SOURCE_RDTSCP)) {
+    cpu_source = CPU_SOURCE_RDTSCP;
+    return;
+  }
+
+#if __FreeBSD_version >= 1301000
+  cpu_source = CPU_SOURCE_NATIVE;
+#endif
+}
+
+int shim_sched_getcpu_impl() {
+  switch (cpu_source) {
+    case CPU_SOURCE_RDPID:
+    case CPU_SOURCE_RDTSCP:
+      return read_tsc_aux(cpu_source);
+#if __FreeBSD_version >= 1301000
+    case CPU_SOURCE_NATIVE:
+      return sched_getcpu();
+#endif
+    default:
+      errno = native_to_linux_errno(ENOSYS);
+      return -1;
+  }
+}
+
+int shim_getcpu_impl(unsigned int* cpu, unsigned int* node) {
+
+  int n = shim_sched_getcpu_impl();
+  if (n == -1) {
+    return -1;
+  }
+
+  if (cpu != NULL) {
+    *cpu = n;
+  }
+
+  if (node != NULL) {
+    *node = native_cpu_domain(n);
+  }
+
+  return 0;
+}
+
+SHIM_WRAP(sched_getcpu);
+SHIM_WRAP(getcpu);
+
+/*
+ * glibc 2.35+ registers rseq for every thread and publishes the area through these.
+ * A zero __rseq_size tells libraries (tcmalloc, folly, ...) that no area is registered;
+ * they then try rseq(2) themselves, get ENOSYS and settle on sched_getcpu(3) above.
+ */
+
+const ptrdiff_t    shim___rseq_offset = 0;
+const unsigned int shim___rseq_size   = 0;
+const unsigned int shim___rseq_flags  = 0;
+
+SHIM_EXPORT(__rseq_offset);
+SHIM_EXPORT(__rseq_size);
+SHIM_EXPORT(__rseq_flags);
@@ -1,29 +1,158 @@
+#include <assert.h>
 #include <errno.h>
-#include <semaphore.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include "../shim.h"
+#include "../libthr/umtx.h"
+#include "semaphore.h"
 #include "time.h"
 
-int shim_sem_trywait_impl(sem_t* sem) {
-  int err = sem_trywait(sem);
-  if (err == -1) {
-    errno = native_to_linux_errno(errno);
+#define LINUX_SEM_VALUE_MAX INT_MAX
+
+#define SEM_VALUE_MASK  0xFFFFFFFFull
+#define SEM_NWAITERS(d) ((d) >> 32)
+#define SEM_WAITER      (1ull << 32)
+
+static uint64_t* sem_data(linux_sem_t* sem) {
+#ifdef __i386__
+  return (uint64_t*)&sem->_words[((uintptr_t)sem & 4) ? 1 : 0];
+#else
+  return &sem->data;
+#endif
+}
+
+static volatile uint32_t* sem_value_word(linux_sem_t* sem) {
+  return (volatile uint32_t*)sem_data(sem); // low half, x86 is little-endian
+}
+
+static bool sem_try_decrement(linux_sem_t* sem, uint64_t delta) {
+  uint64_t* data = sem_data(sem);
+  uint64_t d = __atomic_load_n(data, __ATOMIC_RELAXED);
+  while ((d & SEM_VALUE_MASK) > 0) {
+    if (__atomic_compare_exchange_n(data, &d, d - 1 - delta, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return true;
+    }
   }
-  return err;
+  return false;
 }
 
-int shim_sem_timedwait_impl(sem_t* sem, const linux_timespec* abs_timeout) {
-  int err = sem_timedwait(sem, abs_timeout);
-  if (err == -1) {
-    errno = native_to_linux_errno(errno);
+static int sem_wait_slow(linux_sem_t* sem, clockid_t clock_id, const struct timespec* abstime) {
+
+  __atomic_fetch_add(sem_data(sem), SEM_WAITER, __ATOMIC_SEQ_CST);
+
+  while (true) {
+
+    if (sem_try_decrement(sem, SEM_WAITER)) {
+      return 0;
+    }
+
+    int err = umtx_wait_uint(sem_value_word(sem), 0, sem->pshared, clock_id, abstime);
+    if (err != 0) {
+      // a post may have raced with the timeout, take it rather than forward it
+      if (sem_try_decrement(sem, SEM_WAITER)) {
+        return 0;
+      }
+      __atomic_fetch_sub(sem_data(sem), SEM_WAITER, __ATOMIC_RELAXED);
+      return err;
+    }
   }
-  return err;
 }
 
-SHIM_WRAP(sem_trywait);
-SHIM_WRAP(sem_timedwait);
+static int sem_wait_common(linux_sem_t* sem, clockid_t clock_id, const struct timespec* abstime) {
+
+  if (sem_try_decrement(sem, 0)) {
+    return 0;
+  }
+
+  int err = sem_wait_slow(sem, clock_id, abstime);
+  if (err != 0) {
+    errno = native_to_linux_errno(err);
+    return -1;
+  }
 
-int shim_sem_getvalue_impl(sem_t* restrict sem, int* restrict sval) {
-  UNIMPLEMENTED();
+  return 0;
 }
 
+int shim_sem_init_impl(linux_sem_t* sem, int pshared, unsigned int value) {
+
+  if (value > LINUX_SEM_VALUE_MAX) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  *sem_data(sem) = value;
+  sem->pshared   = pshared != 0;
+
+  return 0;
+}
+
+int shim_sem_destroy_impl(linux_sem_t* sem) {
+
+  if (SEM_NWAITERS(__atomic_load_n(sem_data(sem), __ATOMIC_RELAXED)) > 0) {
+    errno = native_to_linux_errno(EBUSY);
+    return -1;
+  }
+
+  return 0;
+}
+
+int shim_sem_post_impl(linux_sem_t* sem) {
+
+  uint64_t* data = sem_data(sem);
+  uint64_t d = __atomic_load_n(data, __ATOMIC_RELAXED);
+  do {
+    if ((d & SEM_VALUE_MASK) == LINUX_SEM_VALUE_MAX) {
+      errno = native_to_linux_errno(EOVERFLOW);
+      return -1;
+    }
+  } while (!__atomic_compare_exchange_n(data, &d, d + 1, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+  if (SEM_NWAITERS(d) > 0) {
+    umtx_wake(sem_value_word(sem), 1, sem->pshared);
+  }
+
+  return 0;
+}
+
+int shim_sem_wait_impl(linux_sem_t* sem) {
+  return sem_wait_common(sem, CLOCK_REALTIME, NULL);
+}
+
+int shim_sem_trywait_impl(linux_sem_t* sem) {
+
+  if (sem_try_decrement(sem, 0)) {
+    return 0;
+  }
+
+  errno = native_to_linux_errno(EAGAIN);
+  return -1;
+}
+
+int shim_sem_timedwait_impl(linux_sem_t* sem, const linux_timespec* abs_timeout) {
+  return sem_wait_common(sem, CLOCK_REALTIME, abs_timeout);
+}
+
+int shim_sem_clockwait_impl(linux_sem_t* sem, linux_clockid_t linux_clock_id, const linux_timespec* abs_timeout) {
+
+  if (linux_clock_id != LINUX_CLOCK_REALTIME && linux_clock_id != LINUX_CLOCK_MONOTONIC) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  return sem_wait_common(sem, linux_to_native_clockid(linux_clock_id), abs_timeout);
+}
+
+int shim_sem_getvalue_impl(linux_sem_t* restrict sem, int* restrict sval) {
+  *sval = __atomic_load_n(sem_data(sem), __ATOMIC_RELAXED) & SEM_VALUE_MASK;
+  return 0;
+}
+
+SHIM_WRAP(sem_init);
+SHIM_WRAP(sem_destroy);
+SHIM_WRAP(sem_post);
+SHIM_WRAP(sem_wait);
+SHIM_WRAP(sem_trywait);
+SHIM_WRAP(sem_timedwait);
+SHIM_WRAP(sem_clockwait);
 SHIM_WRAP(sem_getvalue);
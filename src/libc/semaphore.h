@@ -0,0 +1,36 @@
+#pragma once
+
+#include <semaphore.h>
+#include <stdint.h>
+
+/*
+ * Lives entirely inside the glibc object, so it also works in shared memory.
+ * The count sits in the low half of data and the number of blocked waiters in
+ * the high half, which lets sem_post check for waiters with the same atomic op.
+ *
+ * glibc's sem_t is only 4-byte aligned on i386, so there data is whichever pair
+ * of _words is 8-byte aligned, see sem_data(). A shared mapping is page-aligned
+ * in every process, so they all agree on it.
+ */
+struct shim_sem {
+#ifdef __i386__
+  uint32_t _words[3];
+#endif
+#ifdef __x86_64__
+  uint64_t data;
+#endif
+  uint32_t pshared;
+#ifdef __x86_64__
+  uint32_t _pad[5];
+#endif
+};
+
+typedef struct shim_sem linux_sem_t;
+
+#ifdef __i386__
+_Static_assert(sizeof(struct shim_sem) == 16 /* sizeof(sem_t) on glibc/Linux */, "");
+#endif
+
+#ifdef __x86_64__
+_Static_assert(sizeof(struct shim_sem) == 32 /* sizeof(sem_t) on glibc/Linux */, "");
+#endif
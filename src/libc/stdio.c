@@ -1,10 +1,12 @@
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/sysctl.h>
 #include "../shim.h"
@@ -28,6 +30,17 @@ FILE* shim_fopen_impl(const char* path, const char* mode) {
     return mem;
   }
 
+  if (vfile_exists(path)) {
+
+    if (mode[0] != 'r' || strchr(mode, '+') != NULL) {
+      errno = EACCES;
+      return NULL;
+    }
+
+    int fd = vfile_open(path, strchr(mode, 'e') != NULL ? O_CLOEXEC : 0);
+    return fd != -1 ? fdopen(fd, "r") : NULL;
+  }
+
   char* p = redirect(path);
   if (p == NULL) {
     errno = EACCES;
@@ -41,6 +54,49 @@ FILE* shim_fopen64_impl(const char* path, const char* mode) {
   return shim_fopen_impl(path, mode);
 }
 
+FILE* shim_freopen_impl(const char* path, const char* mode, FILE* stream) {
+
+  if (path != NULL && vfile_exists(path)) {
+
+    if (mode[0] != 'r' || strchr(mode, '+') != NULL) {
+      errno = EACCES;
+      return NULL;
+    }
+
+    int fd = vfile_open(path, 0);
+    if (fd == -1) {
+      return NULL;
+    }
+
+    // keeps the stream's descriptor number, as freopen does for stdin and friends
+    stream = freopen("/dev/null", "r", stream);
+    if (stream == NULL || dup2(fd, fileno(stream)) == -1) {
+      close(fd);
+      return NULL;
+    }
+
+    close(fd);
+
+    if (strchr(mode, 'e') != NULL) {
+      fcntl(fileno(stream), F_SETFD, FD_CLOEXEC);
+    }
+
+    return stream;
+  }
+
+  const char* p = path;
+  if (p != NULL && (p = redirect(path)) == NULL) {
+    errno = EACCES;
+    return NULL;
+  }
+
+  return freopen(p, mode, stream);
+}
+
+FILE* shim_freopen64_impl(const char* path, const char* mode, FILE* stream) {
+  return shim_freopen_impl(path, mode, stream);
+}
+
 int shim_remove_impl(const char* path) {
   assert(str_starts_with(path, "/dev/char/195:") || !str_starts_with(path, "/dev/"));
   return remove(path);
@@ -49,6 +105,8 @@ int shim_remove_impl(const char* path) {
 SHIM_WRAP(__isoc99_fscanf);
 SHIM_WRAP(fopen);
 SHIM_WRAP(fopen64);
+SHIM_WRAP(freopen);
+SHIM_WRAP(freopen64);
 SHIM_WRAP(remove);
 
 int shim___printf_chk_impl(int flag, const char* format, va_list args) {
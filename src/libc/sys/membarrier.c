@@ -0,0 +1,136 @@
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/cpuset.h>
+#include <sys/mman.h>
+#if __FreeBSD_version >= 1401000
+#include <sys/membarrier.h>
+#endif
+#include "../../shim.h"
+
+#define LINUX_MEMBARRIER_CMD_QUERY                      0
+#define LINUX_MEMBARRIER_CMD_GLOBAL                     (1 << 0)
+#define LINUX_MEMBARRIER_CMD_PRIVATE_EXPEDITED          (1 << 3)
+#define LINUX_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED (1 << 4)
+
+#define EMULATED_COMMANDS (LINUX_MEMBARRIER_CMD_GLOBAL | LINUX_MEMBARRIER_CMD_PRIVATE_EXPEDITED | LINUX_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED)
+
+static bool private_expedited_registered = false;
+
+/*
+ * Without a native membarrier(2):
+ *
+ * PRIVATE_EXPEDITED downgrades the permissions of a page this thread just wrote to.
+ * The kernel has to shoot down the TLB entries on every CPU currently running a
+ * thread of this process, and the IPI serializes those CPUs.
+ *
+ * GLOBAL has to reach threads of other processes too, so migrate this thread over
+ * every CPU: each context switch implies a full barrier on that CPU.
+ */
+
+static pthread_mutex_t shootdown_mutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile char*  shootdown_page  = NULL;
+
+static void private_expedited_barrier() {
+
+  assert(pthread_mutex_lock(&shootdown_mutex) == 0);
+
+  if (shootdown_page == NULL) {
+    void* p = mmap(NULL, getpagesize(), PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    assert(p != MAP_FAILED);
+    shootdown_page = p;
+  }
+
+  int err = mprotect((void*)shootdown_page, getpagesize(), PROT_READ | PROT_WRITE);
+  assert(err == 0);
+
+  // make sure the page is mapped in, so there is something to shoot down
+  __atomic_add_fetch(shootdown_page, 1, __ATOMIC_SEQ_CST);
+
+  err = mprotect((void*)shootdown_page, getpagesize(), PROT_NONE);
+  assert(err == 0);
+
+  assert(pthread_mutex_unlock(&shootdown_mutex) == 0);
+}
+
+static void global_barrier() {
+
+  cpuset_t mask;
+  int err = cpuset_getaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(mask), &mask);
+  assert(err == 0);
+
+  cpuset_t all;
+  err = cpuset_getaffinity(CPU_LEVEL_ROOT, CPU_WHICH_PID, -1, sizeof(all), &all);
+  assert(err == 0);
+
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &all)) {
+      cpuset_t one;
+      CPU_SETOF(cpu, &one);
+      if (cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(one), &one) == 0) {
+        sched_yield();
+      }
+    }
+  }
+
+  err = cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(mask), &mask);
+  assert(err == 0);
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static long emulated_membarrier(int cmd, unsigned int flags, int cpu_id) {
+
+  switch (cmd) {
+
+    case LINUX_MEMBARRIER_CMD_QUERY:
+      return EMULATED_COMMANDS;
+
+    case LINUX_MEMBARRIER_CMD_GLOBAL:
+      global_barrier();
+      return 0;
+
+    case LINUX_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED:
+      __atomic_store_n(&private_expedited_registered, true, __ATOMIC_RELEASE);
+      return 0;
+
+    case LINUX_MEMBARRIER_CMD_PRIVATE_EXPEDITED:
+      if (!__atomic_load_n(&private_expedited_registered, __ATOMIC_ACQUIRE)) {
+        errno = native_to_linux_errno(EPERM);
+        return -1;
+      }
+      private_expedited_barrier();
+      return 0;
+
+    default:
+      errno = native_to_linux_errno(EINVAL);
+      return -1;
+  }
+}
+
+long linux_membarrier(int cmd, unsigned int flags, int cpu_id) {
+
+  if (flags != 0) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+#if __FreeBSD_version >= 1401000
+  // same command values as Linux
+  int err = membarrier(cmd, flags, cpu_id);
+  if (err != -1 || errno != ENOSYS) {
+    if (err == -1) {
+      errno = native_to_linux_errno(errno);
+    }
+    return err;
+  }
+  // built against newer headers than the running kernel
+#endif
+
+  return emulated_membarrier(cmd, flags, cpu_id);
+}
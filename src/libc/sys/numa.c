@@ -0,0 +1,561 @@
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/cpuset.h>
+#include <sys/domainset.h>
+#include <sys/mman.h>
+#include <sys/sysctl.h>
+#include <sys/user.h>
+#include "../../shim.h"
+#include "numa.h"
+
+#define LINUX_MPOL_DEFAULT        0
+#define LINUX_MPOL_PREFERRED      1
+#define LINUX_MPOL_BIND           2
+#define LINUX_MPOL_INTERLEAVE     3
+#define LINUX_MPOL_LOCAL          4
+
+// MPOL_F_NUMA_BALANCING, MPOL_F_RELATIVE_NODES, MPOL_F_STATIC_NODES
+#define LINUX_MPOL_MODE_FLAGS     (0x7 << 13)
+
+#define LINUX_MPOL_F_NODE         (1 << 0)
+#define LINUX_MPOL_F_ADDR         (1 << 1)
+#define LINUX_MPOL_F_MEMS_ALLOWED (1 << 2)
+
+#ifndef DOMAINSET_POLICY_INTERLEAVE
+#define DOMAINSET_POLICY_INTERLEAVE DOMAINSET_POLICY_ROUNDROBIN
+#endif
+
+static int ndomains = 1;
+static int cpu_domains[CPU_SETSIZE];
+
+static domainset_t all_domains;
+
+// pages looked up with one mincore() call when prefaulting
+#define PREFAULT_CHUNK_PAGES 256
+
+__attribute__((constructor))
+static void init_topology() {
+
+  size_t len = sizeof(ndomains);
+  if (sysctlbyname("vm.ndomains", &ndomains, &len, NULL, 0) == -1 || ndomains < 1) {
+    ndomains = 1;
+  }
+
+  DOMAINSET_ZERO(&all_domains);
+
+  for (int domain = 0; domain < ndomains; domain++) {
+
+    DOMAINSET_SET(domain, &all_domains);
+
+    cpuset_t cpus;
+    if (cpuset_getaffinity(CPU_LEVEL_WHICH, CPU_WHICH_DOMAIN, domain, sizeof(cpus), &cpus) == 0) {
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &cpus)) {
+          cpu_domains[cpu] = domain;
+        }
+      }
+    }
+  }
+}
+
+int native_ndomains() {
+  return ndomains;
+}
+
+int native_cpu_domain(int cpu) {
+  return (cpu >= 0 && cpu < CPU_SETSIZE) ? cpu_domains[cpu] : 0;
+}
+
+static int current_domain() {
+  int shim_sched_getcpu_impl();
+  return native_cpu_domain(shim_sched_getcpu_impl());
+}
+
+static int linux_to_native_nodemask(const unsigned long* nodemask, unsigned long maxnode, domainset_t* mask) {
+
+  DOMAINSET_ZERO(mask);
+
+  if (nodemask == NULL) {
+    return 0;
+  }
+
+  const unsigned long bits = 8 * sizeof(unsigned long);
+
+  // like Linux, only the first maxnode - 1 bits are looked at
+  for (unsigned long node = 0; node + 1 < maxnode; node++) {
+    if (nodemask[node / bits] & (1UL << (node % bits))) {
+      if (node >= (unsigned long)ndomains) {
+        return EINVAL;
+      }
+      DOMAINSET_SET(node, mask);
+    }
+  }
+
+  return 0;
+}
+
+static int native_to_linux_nodemask(const domainset_t* mask, unsigned long* nodemask, unsigned long maxnode) {
+
+  if (nodemask == NULL) {
+    return 0;
+  }
+
+  if (maxnode - 1 < (unsigned long)ndomains) {
+    return EINVAL;
+  }
+
+  const unsigned long bits = 8 * sizeof(unsigned long);
+
+  memset(nodemask, 0, (maxnode + bits - 1) / bits * sizeof(unsigned long));
+
+  for (int domain = 0; domain < ndomains; domain++) {
+    if (DOMAINSET_ISSET(domain, mask)) {
+      nodemask[domain / bits] |= 1UL << (domain % bits);
+    }
+  }
+
+  return 0;
+}
+
+static int linux_to_native_policy(int mode, const domainset_t* nodes, domainset_t* mask, int* policy) {
+
+  switch (mode) {
+
+    case LINUX_MPOL_DEFAULT:
+    case LINUX_MPOL_LOCAL:
+      if (!DOMAINSET_EMPTY(nodes)) {
+        return EINVAL;
+      }
+      DOMAINSET_COPY(&all_domains, mask);
+      *policy = DOMAINSET_POLICY_FIRSTTOUCH;
+      return 0;
+
+    case LINUX_MPOL_PREFERRED:
+      if (DOMAINSET_EMPTY(nodes)) {
+        // preferred with no nodes means local allocation
+        DOMAINSET_COPY(&all_domains, mask);
+        *policy = DOMAINSET_POLICY_FIRSTTOUCH;
+      } else {
+        DOMAINSET_ZERO(mask);
+        DOMAINSET_SET(DOMAINSET_FFS(nodes) - 1, mask);
+        *policy = DOMAINSET_POLICY_PREFER;
+      }
+      return 0;
+
+    case LINUX_MPOL_BIND:
+      if (DOMAINSET_EMPTY(nodes)) {
+        return EINVAL;
+      }
+      DOMAINSET_COPY(nodes, mask);
+      *policy = DOMAINSET_POLICY_FIRSTTOUCH;
+      return 0;
+
+    case LINUX_MPOL_INTERLEAVE:
+      if (DOMAINSET_EMPTY(nodes)) {
+        return EINVAL;
+      }
+      DOMAINSET_COPY(nodes, mask);
+      *policy = DOMAINSET_POLICY_INTERLEAVE;
+      return 0;
+
+    default:
+      return EINVAL;
+  }
+}
+
+static int native_to_linux_policy(const domainset_t* mask, int policy, domainset_t* nodes) {
+
+  switch (policy) {
+
+    case DOMAINSET_POLICY_PREFER:
+      DOMAINSET_COPY(mask, nodes);
+      return LINUX_MPOL_PREFERRED;
+
+    case DOMAINSET_POLICY_FIRSTTOUCH:
+      if (DOMAINSET_SUBSET(mask, &all_domains)) {
+        DOMAINSET_ZERO(nodes);
+        return LINUX_MPOL_DEFAULT;
+      }
+      DOMAINSET_COPY(mask, nodes);
+      return LINUX_MPOL_BIND;
+
+    default:
+      // round-robin over everything is FreeBSD's default for some processes
+      if (policy == DOMAINSET_POLICY_ROUNDROBIN && DOMAINSET_SUBSET(mask, &all_domains)) {
+        DOMAINSET_ZERO(nodes);
+        return LINUX_MPOL_DEFAULT;
+      }
+      DOMAINSET_COPY(mask, nodes);
+      return LINUX_MPOL_INTERLEAVE;
+  }
+}
+
+/*
+ * FreeBSD has no per-range memory policy: pages are placed by the policy of
+ * the thread that faults them in. mbind(2) therefore switches this thread to
+ * the requested policy and faults the range in on the spot.
+ *
+ * The last few bound ranges are remembered so get_mempolicy(MPOL_F_ADDR)
+ * can answer for them; newer entries shadow older ones.
+ */
+
+#define MAX_BOUND_RANGES 64
+
+struct bound_range {
+  uintptr_t   start;
+  uintptr_t   end;
+  int         mode;
+  domainset_t nodes;
+};
+
+static struct bound_range bound_ranges[MAX_BOUND_RANGES];
+static int                bound_ranges_count = 0;
+static pthread_mutex_t    bound_ranges_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void remember_range(uintptr_t start, uintptr_t end, int mode, const domainset_t* nodes) {
+
+  assert(pthread_mutex_lock(&bound_ranges_mutex) == 0);
+
+  if (bound_ranges_count == MAX_BOUND_RANGES) {
+    memmove(&bound_ranges[0], &bound_ranges[1], sizeof(bound_ranges[0]) * (MAX_BOUND_RANGES - 1));
+    bound_ranges_count--;
+  }
+
+  struct bound_range* range = &bound_ranges[bound_ranges_count++];
+
+  range->start = start;
+  range->end   = end;
+  range->mode  = mode;
+  DOMAINSET_COPY(nodes, &range->nodes);
+
+  assert(pthread_mutex_unlock(&bound_ranges_mutex) == 0);
+}
+
+static bool lookup_range(uintptr_t addr, int* mode, domainset_t* nodes) {
+
+  bool found = false;
+
+  assert(pthread_mutex_lock(&bound_ranges_mutex) == 0);
+
+  for (int i = bound_ranges_count - 1; i >= 0; i--) {
+    if (addr >= bound_ranges[i].start && addr < bound_ranges[i].end) {
+      *mode = bound_ranges[i].mode;
+      DOMAINSET_COPY(&bound_ranges[i].nodes, nodes);
+      found = true;
+      break;
+    }
+  }
+
+  assert(pthread_mutex_unlock(&bound_ranges_mutex) == 0);
+
+  return found;
+}
+
+static bool is_resident(void* page) {
+  char vec = 0;
+  return mincore(page, getpagesize(), &vec) == 0 && (vec & MINCORE_INCORE);
+}
+
+// Reads every page of [start, end) that isn't resident yet, so that it gets allocated.
+static void touch_range(uintptr_t start, uintptr_t end) {
+
+  size_t page_size = getpagesize();
+
+  for (uintptr_t chunk = start; chunk < end; chunk += PREFAULT_CHUNK_PAGES * page_size) {
+
+    size_t size = MIN(PREFAULT_CHUNK_PAGES * page_size, end - chunk);
+
+    char vec[PREFAULT_CHUNK_PAGES];
+    if (mincore((void*)chunk, size, vec) == -1) {
+      continue;
+    }
+
+    for (size_t i = 0; i < size / page_size; i++) {
+      if (!(vec[i] & MINCORE_INCORE)) {
+        (void)*(volatile char*)(chunk + i * page_size);
+      }
+    }
+  }
+}
+
+/*
+ * Faults the missing pages of a range in while the thread's domain policy is
+ * the range's, which is where the kernel allocates them. Only readable mappings
+ * are touched: PROT_NONE reservations have nothing to place yet.
+ */
+static void prefault(void* addr, size_t len, const domainset_t* mask, int policy) {
+
+  int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_VMMAP, getpid() };
+
+  size_t size = 0;
+  if (sysctl(mib, 4, NULL, &size, NULL, 0) == -1) {
+    return;
+  }
+
+  // leave room for mappings created in the meantime
+  size = size * 4 / 3;
+  char* buf = malloc(size);
+
+  if (buf == NULL || sysctl(mib, 4, buf, &size, NULL, 0) == -1) {
+    free(buf);
+    return;
+  }
+
+  domainset_t saved_mask;
+  int saved_policy;
+
+  if (cpuset_getdomain(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(saved_mask), &saved_mask, &saved_policy) == -1 ||
+      cpuset_setdomain(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(*mask), mask, policy) == -1) {
+    free(buf);
+    return;
+  }
+
+  uintptr_t start = (uintptr_t)addr;
+  uintptr_t end   = start + len;
+
+  for (char* p = buf; p < buf + size;) {
+
+    struct kinfo_vmentry* kve = (struct kinfo_vmentry*)p;
+    if (kve->kve_structsize == 0) {
+      break;
+    }
+    p += kve->kve_structsize;
+
+    if ((kve->kve_protection & KVME_PROT_READ) && kve->kve_start < end && kve->kve_end > start) {
+      touch_range(MAX(start, (uintptr_t)kve->kve_start), MIN(end, (uintptr_t)kve->kve_end));
+    }
+  }
+
+  int err = cpuset_setdomain(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(saved_mask), &saved_mask, saved_policy);
+  assert(err == 0);
+
+  free(buf);
+}
+
+/*
+ * A guess, not a query: FreeBSD has no way to ask which domain backs a page.
+ * It's the single node of an mbind range or of the thread's policy, and
+ * otherwise the domain of the CPU we're running on, which is only right for
+ * pages this thread faulted in.
+ */
+static int page_domain(void* page) {
+
+  int mode;
+  domainset_t nodes;
+
+  if (lookup_range((uintptr_t)page, &mode, &nodes) && DOMAINSET_COUNT(&nodes) == 1) {
+    return DOMAINSET_FFS(&nodes) - 1;
+  }
+
+  domainset_t mask;
+  int policy;
+
+  if (cpuset_getdomain(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(mask), &mask, &policy) == 0) {
+    if (policy == DOMAINSET_POLICY_PREFER || DOMAINSET_COUNT(&mask) == 1) {
+      return DOMAINSET_FFS(&mask) - 1;
+    }
+  }
+
+  // first touch: the page is local to whoever faulted it in
+  return current_domain();
+}
+
+long linux_set_mempolicy(int mode, const unsigned long* nodemask, unsigned long maxnode) {
+
+  domainset_t nodes, mask;
+  int policy;
+
+  int err = linux_to_native_nodemask(nodemask, maxnode, &nodes);
+  if (err == 0) {
+    err = linux_to_native_policy(mode & ~LINUX_MPOL_MODE_FLAGS, &nodes, &mask, &policy);
+  }
+
+  if (err != 0) {
+    errno = native_to_linux_errno(err);
+    return -1;
+  }
+
+  if (cpuset_setdomain(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(mask), &mask, policy) == -1) {
+    errno = native_to_linux_errno(errno);
+    return -1;
+  }
+
+  return 0;
+}
+
+long linux_get_mempolicy(int* mode, unsigned long* nodemask, unsigned long maxnode, void* addr, unsigned long flags) {
+
+  domainset_t mask, nodes;
+  int policy, err;
+
+  if (flags & LINUX_MPOL_F_MEMS_ALLOWED) {
+
+    if (flags & (LINUX_MPOL_F_NODE | LINUX_MPOL_F_ADDR)) {
+      errno = native_to_linux_errno(EINVAL);
+      return -1;
+    }
+
+    if (cpuset_getdomain(CPU_LEVEL_CPUSET, CPU_WHICH_TID, -1, sizeof(mask), &mask, &policy) == -1) {
+      errno = native_to_linux_errno(errno);
+      return -1;
+    }
+
+    if (mode != NULL) {
+      *mode = LINUX_MPOL_DEFAULT;
+    }
+
+    err = native_to_linux_nodemask(&mask, nodemask, maxnode);
+    if (err != 0) {
+      errno = native_to_linux_errno(err);
+      return -1;
+    }
+
+    return 0;
+  }
+
+  if ((flags & LINUX_MPOL_F_NODE) && (flags & LINUX_MPOL_F_ADDR)) {
+
+    void* page = (void*)((uintptr_t)addr & ~((uintptr_t)getpagesize() - 1));
+
+    // Linux faults the page in to answer
+    if (!is_resident(page) && cpuset_getdomain(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(mask), &mask, &policy) == 0) {
+      prefault(page, getpagesize(), &mask, policy);
+    }
+
+    if (mode != NULL) {
+      *mode = page_domain(page);
+    }
+
+    return 0;
+  }
+
+  int linux_mode;
+
+  if (flags & LINUX_MPOL_F_ADDR) {
+    if (!lookup_range((uintptr_t)addr, &linux_mode, &nodes)) {
+      linux_mode = LINUX_MPOL_DEFAULT;
+      DOMAINSET_ZERO(&nodes);
+    }
+  } else {
+    if (cpuset_getdomain(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(mask), &mask, &policy) == -1) {
+      errno = native_to_linux_errno(errno);
+      return -1;
+    }
+    linux_mode = native_to_linux_policy(&mask, policy, &nodes);
+  }
+
+  if (flags & LINUX_MPOL_F_NODE) {
+    // only meaningful for interleaving, where it names the next node to be used
+    if (linux_mode != LINUX_MPOL_INTERLEAVE) {
+      errno = native_to_linux_errno(EINVAL);
+      return -1;
+    }
+    if (mode != NULL) {
+      *mode = DOMAINSET_FFS(&nodes) - 1;
+    }
+    return 0;
+  }
+
+  if (mode != NULL) {
+    *mode = linux_mode;
+  }
+
+  err = native_to_linux_nodemask(&nodes, nodemask, maxnode);
+  if (err != 0) {
+    errno = native_to_linux_errno(err);
+    return -1;
+  }
+
+  return 0;
+}
+
+long linux_mbind(void* addr, unsigned long len, int mode, const unsigned long* nodemask, unsigned long maxnode, unsigned int flags) {
+
+  if ((uintptr_t)addr % (uintptr_t)getpagesize() != 0) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  domainset_t nodes, mask;
+  int policy;
+
+  mode &= ~LINUX_MPOL_MODE_FLAGS;
+
+  int err = linux_to_native_nodemask(nodemask, maxnode, &nodes);
+  if (err == 0) {
+    err = linux_to_native_policy(mode, &nodes, &mask, &policy);
+  }
+
+  if (err != 0) {
+    errno = native_to_linux_errno(err);
+    return -1;
+  }
+
+  len = roundup2(len, getpagesize());
+
+  remember_range((uintptr_t)addr, (uintptr_t)addr + len, mode, &nodes);
+
+  // Linux allocates the pages of the range by its policy whichever thread faults
+  // them, but FreeBSD has no per-mapping policy: a page goes to the domain of the
+  // thread that touches it first. So the missing pages are faulted in now, under
+  // the policy. Pages already resident can't be migrated and keep their domain.
+  if (mode != LINUX_MPOL_DEFAULT && mode != LINUX_MPOL_LOCAL) {
+    prefault(addr, len, &mask, policy);
+  }
+
+  return 0;
+}
+
+long linux_move_pages(int pid, unsigned long count, void** pages, const int* nodes, int* status, int flags) {
+
+  if (pid != 0 && pid != getpid()) {
+    errno = native_to_linux_errno(EPERM);
+    return -1;
+  }
+
+  if (nodes != NULL) {
+    for (unsigned long i = 0; i < count; i++) {
+      if (nodes[i] < 0 || nodes[i] >= ndomains) {
+        errno = native_to_linux_errno(ENODEV);
+        return -1;
+      }
+    }
+  }
+
+  long not_moved = 0;
+
+  for (unsigned long i = 0; i < count; i++) {
+
+    void* page = (void*)((uintptr_t)pages[i] & ~((uintptr_t)getpagesize() - 1));
+
+    if (nodes == NULL) {
+      status[i] = is_resident(page) ? page_domain(page) : -native_to_linux_errno(ENOENT);
+      continue;
+    }
+
+    if (is_resident(page)) {
+      status[i] = page_domain(page);
+      if (status[i] != nodes[i]) {
+        not_moved++;
+      }
+      continue;
+    }
+
+    // not there yet: fault it in on the requested node instead of moving it
+    domainset_t target;
+    DOMAINSET_ZERO(&target);
+    DOMAINSET_SET(nodes[i], &target);
+    prefault(page, getpagesize(), &target, DOMAINSET_POLICY_PREFER);
+
+    status[i] = is_resident(page) ? nodes[i] : -native_to_linux_errno(EFAULT);
+  }
+
+  return not_moved;
+}
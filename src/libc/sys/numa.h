@@ -0,0 +1,10 @@
+#pragma once
+
+/*
+ * Memory domain topology, as Linux NUMA node ids.
+ *
+ * Linux node ids are FreeBSD memory domain ids as-is.
+ */
+
+int native_ndomains(void);
+int native_cpu_domain(int cpu);
@@ -1,26 +1,188 @@
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/sysctl.h>
 #include "../../shim.h"
 
-typedef void linux_rlimit;
-typedef void linux_rlimit64;
+#define LINUX_RLIMIT_CPU         0
+#define LINUX_RLIMIT_FSIZE       1
+#define LINUX_RLIMIT_DATA        2
+#define LINUX_RLIMIT_STACK       3
+#define LINUX_RLIMIT_CORE        4
+#define LINUX_RLIMIT_RSS         5
+#define LINUX_RLIMIT_NPROC       6
+#define LINUX_RLIMIT_NOFILE      7
+#define LINUX_RLIMIT_MEMLOCK     8
+#define LINUX_RLIMIT_AS          9
+#define LINUX_RLIMIT_LOCKS      10
+#define LINUX_RLIMIT_SIGPENDING 11
+#define LINUX_RLIMIT_MSGQUEUE   12
+#define LINUX_RLIMIT_NICE       13
+#define LINUX_RLIMIT_RTPRIO     14
+#define LINUX_RLIMIT_RTTIME     15
+#define LINUX_RLIM_NLIMITS      16
+
+#define LINUX_RLIM_INFINITY   (~0ul)
+#define LINUX_RLIM64_INFINITY (~0ull)
+
+struct linux_rlimit {
+  unsigned long rlim_cur;
+  unsigned long rlim_max;
+};
+
+struct linux_rlimit64 {
+  uint64_t rlim_cur;
+  uint64_t rlim_max;
+};
+
+typedef struct linux_rlimit   linux_rlimit;
+typedef struct linux_rlimit64 linux_rlimit64;
+
+// -1: no FreeBSD counterpart
+static const int native_resources[LINUX_RLIM_NLIMITS] = {
+  [LINUX_RLIMIT_CPU]        = RLIMIT_CPU,
+  [LINUX_RLIMIT_FSIZE]      = RLIMIT_FSIZE,
+  [LINUX_RLIMIT_DATA]       = RLIMIT_DATA,
+  [LINUX_RLIMIT_STACK]      = RLIMIT_STACK,
+  [LINUX_RLIMIT_CORE]       = RLIMIT_CORE,
+  [LINUX_RLIMIT_RSS]        = RLIMIT_RSS,
+  [LINUX_RLIMIT_NPROC]      = RLIMIT_NPROC,
+  [LINUX_RLIMIT_NOFILE]     = RLIMIT_NOFILE,
+  [LINUX_RLIMIT_MEMLOCK]    = RLIMIT_MEMLOCK,
+  [LINUX_RLIMIT_AS]         = RLIMIT_AS,
+  [LINUX_RLIMIT_LOCKS]      = -1,
+  [LINUX_RLIMIT_SIGPENDING] = -1,
+  [LINUX_RLIMIT_MSGQUEUE]   = -1,
+  [LINUX_RLIMIT_NICE]       = -1,
+  [LINUX_RLIMIT_RTPRIO]     = -1,
+  [LINUX_RLIMIT_RTTIME]     = -1,
+};
+
+static uint64_t native_to_linux_rlim(rlim_t value) {
+  return value == RLIM_INFINITY ? LINUX_RLIM64_INFINITY : (uint64_t)value;
+}
+
+static rlim_t linux_to_native_rlim(uint64_t value) {
+  return value >= (uint64_t)RLIM_INFINITY ? RLIM_INFINITY : (rlim_t)value;
+}
+
+static int native_prlimit(pid_t pid, int resource, const struct rlimit* new_limit, struct rlimit* old_limit) {
+
+  if (pid == 0 || pid == getpid()) {
+
+    if (old_limit != NULL && getrlimit(resource, old_limit) == -1) {
+      return -1;
+    }
+
+    return new_limit != NULL ? setrlimit(resource, new_limit) : 0;
+  }
+
+  // reads the old and sets the new limit in one go
+  int mib[5] = { CTL_KERN, KERN_PROC, KERN_PROC_RLIMIT, pid, resource };
+  size_t len = sizeof(struct rlimit);
+
+  return sysctl(mib, 5, old_limit, old_limit != NULL ? &len : NULL, new_limit, new_limit != NULL ? sizeof(struct rlimit) : 0);
+}
+
+int shim_prlimit64_impl(pid_t pid, int resource, const linux_rlimit64* new_limit, linux_rlimit64* old_limit) {
+
+  if (resource < 0 || resource >= LINUX_RLIM_NLIMITS) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  if (new_limit != NULL && new_limit->rlim_cur > new_limit->rlim_max) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  int native_resource = native_resources[resource];
+
+  if (native_resource == -1) {
+    // not enforced here: no nice or realtime priority headroom, no limit on the rest
+    if (old_limit != NULL) {
+      bool priority = (resource == LINUX_RLIMIT_NICE || resource == LINUX_RLIMIT_RTPRIO);
+      old_limit->rlim_cur = priority ? 0 : LINUX_RLIM64_INFINITY;
+      old_limit->rlim_max = priority ? 0 : LINUX_RLIM64_INFINITY;
+    }
+    if (new_limit != NULL) {
+      LOG("%s: ignoring limit for resource %d", __func__, resource);
+    }
+    return 0;
+  }
+
+  struct rlimit native_new, native_old;
+
+  if (new_limit != NULL) {
+    native_new.rlim_cur = linux_to_native_rlim(new_limit->rlim_cur);
+    native_new.rlim_max = linux_to_native_rlim(new_limit->rlim_max);
+  }
+
+  if (native_prlimit(pid, native_resource, new_limit != NULL ? &native_new : NULL, old_limit != NULL ? &native_old : NULL) == -1) {
+    return -1;
+  }
+
+  if (old_limit != NULL) {
+    old_limit->rlim_cur = native_to_linux_rlim(native_old.rlim_cur);
+    old_limit->rlim_max = native_to_linux_rlim(native_old.rlim_max);
+  }
+
+  return 0;
+}
+
+static void rlimit_to_rlimit64(linux_rlimit64* dst, const linux_rlimit* src) {
+  dst->rlim_cur = src->rlim_cur == LINUX_RLIM_INFINITY ? LINUX_RLIM64_INFINITY : src->rlim_cur;
+  dst->rlim_max = src->rlim_max == LINUX_RLIM_INFINITY ? LINUX_RLIM64_INFINITY : src->rlim_max;
+}
+
+// like glibc, whatever doesn't fit into an unsigned long on i386 is reported as unlimited
+static void rlimit64_to_rlimit(linux_rlimit* dst, const linux_rlimit64* src) {
+  dst->rlim_cur = src->rlim_cur >= LINUX_RLIM_INFINITY ? LINUX_RLIM_INFINITY : src->rlim_cur;
+  dst->rlim_max = src->rlim_max >= LINUX_RLIM_INFINITY ? LINUX_RLIM_INFINITY : src->rlim_max;
+}
+
+int shim_prlimit_impl(pid_t pid, int resource, const linux_rlimit* new_limit, linux_rlimit* old_limit) {
+
+  linux_rlimit64 new_limit64, old_limit64;
+
+  if (new_limit != NULL) {
+    rlimit_to_rlimit64(&new_limit64, new_limit);
+  }
+
+  if (shim_prlimit64_impl(pid, resource, new_limit != NULL ? &new_limit64 : NULL, old_limit != NULL ? &old_limit64 : NULL) == -1) {
+    return -1;
+  }
+
+  if (old_limit != NULL) {
+    rlimit64_to_rlimit(old_limit, &old_limit64);
+  }
+
+  return 0;
+}
 
 int shim_getrlimit_impl(int resource, linux_rlimit* rlp) {
-  errno = native_to_linux_errno(EPERM);
-  return -1;
+  return shim_prlimit_impl(0, resource, NULL, rlp);
 }
 
 int shim_getrlimit64_impl(int resource, linux_rlimit64* rlp) {
-  errno = native_to_linux_errno(EPERM);
-  return -1;
+  return shim_prlimit64_impl(0, resource, NULL, rlp);
 }
 
 int shim_setrlimit_impl(int resource, const linux_rlimit* rlp) {
-  UNIMPLEMENTED();
+  return shim_prlimit_impl(0, resource, rlp, NULL);
+}
+
+int shim_setrlimit64_impl(int resource, const linux_rlimit64* rlp) {
+  return shim_prlimit64_impl(0, resource, rlp, NULL);
 }
 
 SHIM_WRAP(getrlimit);
 SHIM_WRAP(getrlimit64);
+SHIM_WRAP(prlimit);
+SHIM_WRAP(prlimit64);
 SHIM_WRAP(setrlimit);
+SHIM_WRAP(setrlimit64);
@@ -1,39 +1,28 @@
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/param.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/un.h>
+#include <net/if_dl.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <netinet/tcp_fsm.h>
 #include <arpa/inet.h>
 
+#include "../time.h"
 #include "../../shim.h"
 #include "socket.h"
-
-static int linux_to_native_sock_level(int level) {
-  switch (level) {
-    case LINUX_SOL_SOCKET: return SOL_SOCKET;
-    case LINUX_SOL_IP:     return IPPROTO_IP;
-    case LINUX_SOL_TCP:    return IPPROTO_TCP;
-    case LINUX_SOL_UDP:    return IPPROTO_UDP;
-    default:
-      assert(0);
-  }
-}
-
-static int native_to_linux_sock_level(int level) {
-  switch (level) {
-    case SOL_SOCKET:  return LINUX_SOL_SOCKET;
-    case IPPROTO_IP:  return LINUX_SOL_IP;
-    case IPPROTO_TCP: return LINUX_SOL_TCP;
-    case IPPROTO_UDP: return LINUX_SOL_UDP;
-    default:
-      assert(0);
-  }
-}
+#include "numa.h"
 
 _Static_assert(LINUX_SOCK_STREAM    == SOCK_STREAM,    "");
 _Static_assert(LINUX_SOCK_DGRAM     == SOCK_DGRAM,     "");
@@ -86,6 +75,8 @@ static int linux_to_native_msg_flags(int linux_flags) {
   if (linux_flags & LINUX_MSG_WAITFORONE)   flags |= MSG_WAITFORONE;
   if (linux_flags & LINUX_MSG_CMSG_CLOEXEC) flags |= MSG_CMSG_CLOEXEC;
 
+  // LINUX_MSG_MORE is left to the send calls, see hold_if_more
+
   return flags;
 }
 
@@ -114,57 +105,156 @@ static int native_to_linux_msg_flags(int flags) {
   return linux_flags;
 }
 
-void linux_to_native_sockaddr_in(struct sockaddr_in* dest, const linux_sockaddr_in* src) {
-
-  dest->sin_len    = 0;
-  dest->sin_family = PF_INET;
+void native_to_linux_sockaddr_in(linux_sockaddr_in* dest, const struct sockaddr_in* src) {
+  dest->sin_family = LINUX_PF_INET;
   dest->sin_port   = src->sin_port;
   dest->sin_addr   = src->sin_addr;
-
   memcpy(dest->sin_zero, src->sin_zero, sizeof(dest->sin_zero));
 }
 
-void linux_to_native_sockaddr_in6(struct sockaddr_in6* dest, const linux_sockaddr_in6* src) {
-  dest->sin6_len      = 0;
-  dest->sin6_family   = PF_INET6;
+void native_to_linux_sockaddr_in6(linux_sockaddr_in6* dest, const struct sockaddr_in6* src) {
+  dest->sin6_family   = LINUX_PF_INET6;
   dest->sin6_port     = src->sin6_port;
   dest->sin6_flowinfo = src->sin6_flowinfo;
   memcpy(dest->sin6_addr.s6_addr, src->sin6_addr.s6_addr, sizeof(dest->sin6_addr.s6_addr));
   dest->sin6_scope_id = src->sin6_scope_id;
 }
 
-void linux_to_native_sockaddr_un(struct sockaddr_un* dest, const linux_sockaddr_un* src) {
+/*
+ * Socket addresses, for every call that takes or returns one.
+ *
+ * Past the family, sockaddr_in and sockaddr_in6 are laid out the same on both sides
+ * and are copied as they are, so a family is mostly a row of sizes. Unix domain
+ * paths are longer on Linux, and abstract addresses are put under /var/run.
+ * Everything happens in the caller's sockaddr_storage: nothing is allocated.
+ */
+
+struct sockaddr_family {
+  sa_family_t linux_family;
+  sa_family_t native_family;
+  socklen_t   linux_min;   // the shortest address Linux takes
+  socklen_t   linux_size;
+  socklen_t   native_size;
+};
+
+#define SOCKADDR_HEADER_SIZE sizeof(uint16_t) // sa_family on Linux, sa_len and sa_family here
+
+static const struct sockaddr_family sockaddr_unix  = { LINUX_AF_UNIX,  AF_UNIX,  SOCKADDR_HEADER_SIZE,      sizeof(linux_sockaddr_un),  sizeof(struct sockaddr_un)  };
+static const struct sockaddr_family sockaddr_inet  = { LINUX_AF_INET,  AF_INET,  sizeof(linux_sockaddr_in), sizeof(linux_sockaddr_in),  sizeof(struct sockaddr_in)  };
+static const struct sockaddr_family sockaddr_inet6 = { LINUX_AF_INET6, AF_INET6, 24 /* no sin6_scope_id */, sizeof(linux_sockaddr_in6), sizeof(struct sockaddr_in6) };
+
+static const struct sockaddr_family* const linux_sockaddr_families[] = {
+  [LINUX_AF_UNIX]  = &sockaddr_unix,
+  [LINUX_AF_INET]  = &sockaddr_inet,
+  [LINUX_AF_INET6] = &sockaddr_inet6,
+};
+
+static const struct sockaddr_family* const native_sockaddr_families[] = {
+  [AF_UNIX]  = &sockaddr_unix,
+  [AF_INET]  = &sockaddr_inet,
+  [AF_INET6] = &sockaddr_inet6,
+};
+
+_Static_assert(sizeof(linux_sockaddr_in)  == sizeof(struct sockaddr_in),  "");
+_Static_assert(sizeof(linux_sockaddr_in6) == sizeof(struct sockaddr_in6), "");
+
+static socklen_t linux_to_native_sockaddr_un(struct sockaddr_un* dest, const linux_sockaddr_un* src, socklen_t srclen) {
+
+  const char* path    = src->sun_path;
+  size_t      pathlen = srclen - SOCKADDR_HEADER_SIZE;
+  int         n;
+
+  if (pathlen > 0 && path[0] == '\0' /* abstract socket address, not NUL-terminated */) {
+    n = snprintf(dest->sun_path, sizeof(dest->sun_path), "/var/run/%.*s", (int)(pathlen - 1), path + 1);
+  } else {
+    n = snprintf(dest->sun_path, sizeof(dest->sun_path), "%.*s", (int)pathlen, path);
+  }
+
+  if ((size_t)n >= sizeof(dest->sun_path)) {
+    errno = native_to_linux_errno(ENAMETOOLONG);
+    return 0;
+  }
+
+  return SUN_LEN(dest);
+}
+
+socklen_t linux_to_native_sockaddr(struct sockaddr_storage* dest, const linux_sockaddr* src, socklen_t srclen) {
 
-  dest->sun_len    = 0;
-  dest->sun_family = PF_UNIX;
+  if (srclen < SOCKADDR_HEADER_SIZE || srclen > sizeof(struct sockaddr_storage)) {
+    errno = native_to_linux_errno(EINVAL);
+    return 0;
+  }
+
+  const struct sockaddr_family* family = src->sa_family < nitems(linux_sockaddr_families) ? linux_sockaddr_families[src->sa_family] : NULL;
+
+  if (family == NULL) {
+    errno = native_to_linux_errno(EAFNOSUPPORT);
+    return 0;
+  }
 
-  if (src->sun_path[0] == 0 /* abstract socket address */) {
-    snprintf(dest->sun_path, sizeof(dest->sun_path), "/var/run/%s", &src->sun_path[1]);
+  if (srclen < family->linux_min) {
+    errno = native_to_linux_errno(EINVAL);
+    return 0;
+  }
+
+  socklen_t len = family->native_size;
+
+  if (family == &sockaddr_unix) {
+    len = linux_to_native_sockaddr_un((struct sockaddr_un*)dest, (const linux_sockaddr_un*)src, MIN(srclen, family->linux_size));
   } else {
-    size_t nbytes = strlcpy(dest->sun_path, src->sun_path, sizeof(dest->sun_path));
-    assert(nbytes < sizeof(dest->sun_path));
+    // longer addresses are fine, the rest is ignored
+    memset((uint8_t*)dest + srclen, 0, len > srclen ? len - srclen : 0);
+    memcpy((uint8_t*)dest + SOCKADDR_HEADER_SIZE, (const uint8_t*)src + SOCKADDR_HEADER_SIZE, MIN(srclen, len) - SOCKADDR_HEADER_SIZE);
   }
-}
 
-void native_to_linux_sockaddr_in(linux_sockaddr_in* dest, const struct sockaddr_in* src) {
-  dest->sin_family = LINUX_PF_INET;
-  dest->sin_port   = src->sin_port;
-  dest->sin_addr   = src->sin_addr;
-  memcpy(dest->sin_zero, src->sin_zero, sizeof(dest->sin_zero));
+  dest->ss_len    = len;
+  dest->ss_family = family->native_family;
+
+  return len;
 }
 
-void native_to_linux_sockaddr_in6(linux_sockaddr_in6* dest, const struct sockaddr_in6* src) {
-  dest->sin6_family   = LINUX_PF_INET6;
-  dest->sin6_port     = src->sin6_port;
-  dest->sin6_flowinfo = src->sin6_flowinfo;
-  memcpy(dest->sin6_addr.s6_addr, src->sin6_addr.s6_addr, sizeof(dest->sin6_addr.s6_addr));
-  dest->sin6_scope_id = src->sin6_scope_id;
+// Like the kernel, truncates to destlen and returns the full length of the Linux address, 0 for unknown families.
+socklen_t native_to_linux_sockaddr(linux_sockaddr* dest, socklen_t destlen, const struct sockaddr* src) {
+
+  const struct sockaddr_family* family = src->sa_family < nitems(native_sockaddr_families) ? native_sockaddr_families[src->sa_family] : NULL;
+
+  if (family == NULL) {
+    return 0;
+  }
+
+  union {
+    linux_sockaddr    sa;
+    linux_sockaddr_un un;
+    uint8_t           bytes[sizeof(linux_sockaddr_un)];
+  } addr;
+
+  socklen_t len = family->linux_size;
+
+  if (family == &sockaddr_unix) {
+    const struct sockaddr_un* un = (const struct sockaddr_un*)src;
+    size_t pathlen = strnlen(un->sun_path, sizeof(un->sun_path));
+    memcpy(addr.un.sun_path, un->sun_path, pathlen);
+    addr.un.sun_path[pathlen] = '\0';
+    // unnamed sockets have no path at all
+    len = SOCKADDR_HEADER_SIZE + (pathlen > 0 ? pathlen + 1 : 0);
+  } else {
+    memcpy(&addr.bytes[SOCKADDR_HEADER_SIZE], (const uint8_t*)src + SOCKADDR_HEADER_SIZE, len - SOCKADDR_HEADER_SIZE);
+  }
+
+  addr.sa.sa_family = family->linux_family;
+
+  if (dest != NULL) {
+    memcpy(dest, &addr, MIN(len, destlen));
+  }
+
+  return len;
 }
 
-void native_to_linux_sockaddr_un(linux_sockaddr_un* dest, const struct sockaddr_un* src) {
-  dest->sun_family = LINUX_PF_UNIX;
-  size_t nbytes = strlcpy(dest->sun_path, src->sun_path, sizeof(dest->sun_path));
-  assert(nbytes < sizeof(dest->sun_path));
+// For the calls returning an address: writes what fits, and the full length, to the caller's.
+static void return_sockaddr(linux_sockaddr* dest, socklen_t* destlen, const struct sockaddr_storage* src, socklen_t srclen) {
+  if (dest != NULL && destlen != NULL) {
+    *destlen = srclen > 0 ? native_to_linux_sockaddr(dest, *destlen, (const struct sockaddr*)src) : 0;
+  }
 }
 
 static int linux_to_native_domain(int domain) {
@@ -177,376 +267,1718 @@ static int linux_to_native_domain(int domain) {
   }
 }
 
-int shim_socket_impl(int domain, int type, int protocol) {
-  return socket(linux_to_native_domain(domain), linux_to_native_sock_type(type), protocol);
-}
+/*
+ * Socket options with no native counterpart are kept here, by descriptor. The
+ * state is cleared whenever socket() or accept() hands a descriptor out and
+ * whenever close() or dup2() gives the number back. It is copied along by dup().
+ * The table grows in chunks, so descriptors past any RLIMIT_NOFILE can have state too.
+ */
+
+#define SOCKET_STATE_CHUNK  4096
+#define SOCKET_STATE_CHUNKS 65536
+
+struct socket_state {
+  uint16_t gso_size;      // UDP_SEGMENT
+  bool     gro;           // UDP_GRO
+  uint8_t  priority;      // SO_PRIORITY
+  uint16_t incoming_cpu;  // SO_INCOMING_CPU plus one, 0 when unset
+  bool     corked;        // TCP_CORK
+  bool     more;          // TCP_NOPUSH set for MSG_MORE
+  bool     delayed_ack;   // TCP_QUICKACK turned off
+  uint32_t notsent_lowat; // TCP_NOTSENT_LOWAT
+  int      defer_accept;  // TCP_DEFER_ACCEPT
+};
+
+static struct socket_state* socket_states[SOCKET_STATE_CHUNKS];
+
+// Doesn't allocate: NULL when s has no state.
+static struct socket_state* find_socket_state(int s) {
+
+  if (s < 0 || s / SOCKET_STATE_CHUNK >= SOCKET_STATE_CHUNKS) {
+    return NULL;
+  }
 
-int shim_socketpair_impl(int domain, int type, int protocol, int* sv) {
-  return socketpair(linux_to_native_domain(domain), linux_to_native_sock_type(type), protocol, sv);
+  struct socket_state* chunk = __atomic_load_n(&socket_states[s / SOCKET_STATE_CHUNK], __ATOMIC_ACQUIRE);
+  return chunk != NULL ? &chunk[s % SOCKET_STATE_CHUNK] : NULL;
 }
 
-int shim_bind_impl(int s, const linux_sockaddr* linux_addr, socklen_t addrlen) {
+static struct socket_state* get_socket_state(int s) {
 
-  switch (linux_addr->sa_family) {
+  if (s < 0 || s / SOCKET_STATE_CHUNK >= SOCKET_STATE_CHUNKS) {
+    return NULL;
+  }
 
-    case LINUX_PF_UNIX:
-      {
-        struct sockaddr_un addr;
-        assert(addrlen <= sizeof(struct linux_sockaddr_un));
-        linux_to_native_sockaddr_un(&addr, (linux_sockaddr_un*)linux_addr);
+  struct socket_state** slot  = &socket_states[s / SOCKET_STATE_CHUNK];
+  struct socket_state*  chunk = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
 
-        int err = bind(s, (struct sockaddr*)&addr, sizeof(addr));
-        if (err == 0) {
-          // unlink(addr.sun_path); ?
-        }
+  if (chunk == NULL) {
 
-        return err;
-      }
+    struct socket_state* fresh = calloc(SOCKET_STATE_CHUNK, sizeof(struct socket_state));
+    if (fresh == NULL) {
+      return NULL;
+    }
 
-    case LINUX_PF_INET:
-      {
-        struct sockaddr_in addr;
-        assert(addrlen == sizeof(struct linux_sockaddr_in));
-        linux_to_native_sockaddr_in(&addr, (linux_sockaddr_in*)linux_addr);
-        return bind(s, (struct sockaddr*)&addr, sizeof(addr));
-      }
+    if (__atomic_compare_exchange_n(slot, &chunk, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      chunk = fresh;
+    } else {
+      free(fresh);
+    }
+  }
 
-    case LINUX_PF_INET6:
-      {
-        struct sockaddr_in6 addr;
-        assert(addrlen == sizeof(struct linux_sockaddr_in6));
-        linux_to_native_sockaddr_in6(&addr, (linux_sockaddr_in6*)linux_addr);
-        return bind(s, (struct sockaddr*)&addr, sizeof(addr));
-      }
+  return &chunk[s % SOCKET_STATE_CHUNK];
+}
 
-    default:
-      assert(0);
+static void reset_socket_state(int s) {
+  struct socket_state* state = find_socket_state(s);
+  if (state != NULL) {
+    memset(state, 0, sizeof(*state));
   }
 }
 
-int shim_connect_impl(int s, const linux_sockaddr* linux_name, socklen_t namelen) {
+void forget_socket_state(int first, int last) {
 
-  switch (linux_name->sa_family) {
+  if (first < 0) {
+    return;
+  }
 
-    case LINUX_PF_UNIX:
-      {
-        struct sockaddr_un addr;
-        assert(namelen <= sizeof(struct linux_sockaddr_un));
-        linux_to_native_sockaddr_un(&addr, (linux_sockaddr_un*)linux_name);
-        LOG("%s: path = %s", __func__, addr.sun_path);
-        return connect(s, (struct sockaddr*)&addr, sizeof(addr));
-      }
+  for (int chunk = first / SOCKET_STATE_CHUNK; chunk < SOCKET_STATE_CHUNKS && chunk <= last / SOCKET_STATE_CHUNK; chunk++) {
 
-    case LINUX_PF_INET:
-      {
-        struct sockaddr_in addr;
-        assert(namelen == sizeof(struct linux_sockaddr_in));
-        linux_to_native_sockaddr_in(&addr, (linux_sockaddr_in*)linux_name);
-        return connect(s, (struct sockaddr*)&addr, sizeof(addr));
-      }
+    struct socket_state* states = __atomic_load_n(&socket_states[chunk], __ATOMIC_ACQUIRE);
+    if (states == NULL) {
+      continue;
+    }
 
-    case LINUX_PF_INET6:
-      {
-        struct sockaddr_in6 addr;
-        assert(namelen == sizeof(struct linux_sockaddr_in6));
-        linux_to_native_sockaddr_in6(&addr, (linux_sockaddr_in6*)linux_name);
-        return connect(s, (struct sockaddr*)&addr, sizeof(addr));
-      }
+    int from = MAX(first, chunk * SOCKET_STATE_CHUNK)         - chunk * SOCKET_STATE_CHUNK;
+    int to   = MIN(last,  chunk * SOCKET_STATE_CHUNK + SOCKET_STATE_CHUNK - 1) - chunk * SOCKET_STATE_CHUNK;
 
-    default:
-      assert(0);
+    memset(&states[from], 0, (to - from + 1) * sizeof(struct socket_state));
   }
 }
 
-static void linux_to_native_msghdr(struct msghdr* msg, const struct linux_msghdr* linux_msg) {
+void copy_socket_state(int from, int to) {
 
-  msg->msg_name    = linux_msg->msg_name;
-  msg->msg_namelen = linux_msg->msg_namelen;
-  msg->msg_iov     = linux_msg->msg_iov;
-  msg->msg_iovlen  = linux_msg->msg_iovlen;
-  msg->msg_flags   = linux_to_native_msg_flags(linux_msg->msg_flags);
+  struct socket_state* source = find_socket_state(from);
 
-  if (linux_msg->msg_controllen > 0) {
+  if (source == NULL) {
+    reset_socket_state(to);
+    return;
+  }
 
-    assert(msg->msg_controllen >= linux_msg->msg_controllen);
-    msg->msg_controllen = linux_msg->msg_controllen;
+  struct socket_state* dest = get_socket_state(to);
+  if (dest != NULL) {
+    *dest = *source;
+  }
+}
 
-    memset(msg->msg_control, 0, linux_msg->msg_controllen);
+/*
+ * TCP_DEFER_ACCEPT, as an accept filter: accept() only returns connections that
+ * sent something, or with SHIM_ACCEPT_FILTER=httpready a whole HTTP request.
+ * A filter can only be put on a listening socket, so listen() puts it there when
+ * the option came first. Without the accf modules loaded, connections are accepted
+ * straight away, as if the option weren't set.
+ */
 
-    struct linux_cmsghdr* linux_cmsg = (struct linux_cmsghdr*)CMSG_FIRSTHDR(linux_msg);
-    while (linux_cmsg != NULL) {
-      struct cmsghdr* cmsg = (struct cmsghdr*)((uint8_t*)msg->msg_control + ((uint64_t)linux_cmsg - (uint64_t)linux_msg->msg_control));
+static void install_accept_filter(int s) {
 
-      assert(linux_cmsg->cmsg_type == LINUX_SCM_RIGHTS);
+  const char* configured = getenv("SHIM_ACCEPT_FILTER");
+  const char* names[]    = { configured != NULL ? configured : "dataready", "dataready" };
 
-      cmsg->cmsg_len   = linux_cmsg->cmsg_len;
-      cmsg->cmsg_level = linux_to_native_sock_level(linux_cmsg->cmsg_level);
-      cmsg->cmsg_type  = SCM_RIGHTS;
+  for (size_t i = 0; i < nitems(names); i++) {
 
-#ifdef __x86_64__
-      memcpy((uint8_t*)cmsg + 16, (uint8_t*)linux_cmsg + 16, linux_cmsg->cmsg_len - 16);
-#elif defined(__i386__)
-      memcpy((uint8_t*)cmsg + 12, (uint8_t*)linux_cmsg + 12, linux_cmsg->cmsg_len - 12);
-#else
-  #error
-#endif
+    struct accept_filter_arg filter = {0};
+    strlcpy(filter.af_name, names[i], sizeof(filter.af_name));
 
-      linux_cmsg = (struct linux_cmsghdr*)CMSG_NXTHDR(linux_msg, linux_cmsg);
+    if (setsockopt(s, SOL_SOCKET, SO_ACCEPTFILTER, &filter, sizeof(filter)) == 0) {
+      return;
     }
-  } else {
-    msg->msg_control    = NULL;
-    msg->msg_controllen = 0;
+
+    LOG("%s: no %s accept filter: %s", __func__, names[i], strerror(errno));
   }
 }
 
-static void native_to_linux_msghdr(struct linux_msghdr* linux_msg, const struct msghdr* msg) {
+static int set_defer_accept(int s, int seconds) {
 
-  linux_msg->msg_name    = msg->msg_name;
-  linux_msg->msg_namelen = msg->msg_namelen;
-  linux_msg->msg_iov     = msg->msg_iov;
-  linux_msg->msg_iovlen  = msg->msg_iovlen;
-  linux_msg->msg_flags   = native_to_linux_msg_flags(msg->msg_flags);
+  struct socket_state* state = get_socket_state(s);
 
-  if (msg->msg_controllen > 0) {
+  if (state == NULL) {
+    errno = native_to_linux_errno(ENOPROTOOPT);
+    return -1;
+  }
 
-    assert(linux_msg->msg_controllen >= msg->msg_controllen);
-    linux_msg->msg_controllen = msg->msg_controllen;
+  state->defer_accept = MAX(seconds, 0);
 
-    memset(linux_msg->msg_control, 0, msg->msg_controllen);
+  int listening = 0;
+  socklen_t len = sizeof(listening);
+  getsockopt(s, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len);
 
-    struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg);
-    while (cmsg != NULL) {
-      struct linux_cmsghdr* linux_cmsg = (struct linux_cmsghdr*)((uint8_t*)linux_msg->msg_control + ((uint64_t)cmsg - (uint64_t)msg->msg_control));
+  if (listening) {
+    if (state->defer_accept > 0) {
+      install_accept_filter(s);
+    } else {
+      setsockopt(s, SOL_SOCKET, SO_ACCEPTFILTER, NULL, 0);
+    }
+  }
 
-      assert(cmsg->cmsg_type == SCM_RIGHTS);
+  return 0;
+}
 
-      linux_cmsg->cmsg_len   = cmsg->cmsg_len;
-      linux_cmsg->cmsg_level = native_to_linux_sock_level(cmsg->cmsg_level);
-      linux_cmsg->cmsg_type  = LINUX_SCM_RIGHTS;
+int shim_socket_impl(int domain, int type, int protocol) {
+  int s = socket(linux_to_native_domain(domain), linux_to_native_sock_type(type), protocol);
+  reset_socket_state(s);
+  return s;
+}
 
-#ifdef __x86_64__
-      memcpy((uint8_t*)linux_cmsg + 16, (uint8_t*)cmsg + 16, cmsg->cmsg_len - 16);
-#elif defined(__i386__)
-      memcpy((uint8_t*)linux_cmsg + 12, (uint8_t*)cmsg + 12, cmsg->cmsg_len - 12);
-#else
-  #error
-#endif
+int shim_socketpair_impl(int domain, int type, int protocol, int* sv) {
+  int err = socketpair(linux_to_native_domain(domain), linux_to_native_sock_type(type), protocol, sv);
+  if (err == 0) {
+    reset_socket_state(sv[0]);
+    reset_socket_state(sv[1]);
+  }
+  return err;
+}
 
-      cmsg = CMSG_NXTHDR(msg, cmsg);
-    }
+int shim_bind_impl(int s, const linux_sockaddr* linux_addr, socklen_t addrlen) {
 
-  } else {
-    linux_msg->msg_control    = NULL;
-    linux_msg->msg_controllen = 0;
+  struct sockaddr_storage addr;
+  socklen_t len = linux_to_native_sockaddr(&addr, linux_addr, addrlen);
+  if (len == 0) {
+    return -1;
   }
-}
 
-ssize_t shim_recv_impl(int s, void* buf, size_t len, int linux_flags) {
-  ssize_t nbytes = recv(s, buf, len, linux_to_native_msg_flags(linux_flags));
-  if (nbytes == -1) {
+  int err = bind(s, (struct sockaddr*)&addr, len);
+  if (err == -1) {
     errno = native_to_linux_errno(errno);
   }
-  return nbytes;
+
+  return err;
 }
 
-ssize_t shim_send_impl(int s, const void* msg, size_t len, int linux_flags) {
-  ssize_t nbytes = send(s, msg, len, linux_to_native_msg_flags(linux_flags));
-  if (nbytes == -1) {
+int shim_connect_impl(int s, const linux_sockaddr* linux_name, socklen_t namelen) {
+
+  struct sockaddr_storage addr;
+  socklen_t len = linux_to_native_sockaddr(&addr, linux_name, namelen);
+  if (len == 0) {
+    return -1;
+  }
+
+  int err = connect(s, (struct sockaddr*)&addr, len);
+  if (err == -1) {
     errno = native_to_linux_errno(errno);
   }
-  return nbytes;
+
+  return err;
 }
 
-ssize_t shim_recvmsg_impl(int s, struct linux_msghdr* linux_msg, int linux_flags) {
+int shim_listen_impl(int s, int backlog) {
 
-  struct msghdr msg;
-  uint8_t buf[linux_msg->msg_controllen];
+  int err = listen(s, backlog);
+  if (err == -1) {
+    errno = native_to_linux_errno(errno);
+    return -1;
+  }
 
-  msg.msg_name       = linux_msg->msg_name;
-  msg.msg_namelen    = linux_msg->msg_namelen;
-  msg.msg_iov        = linux_msg->msg_iov;
-  msg.msg_iovlen     = linux_msg->msg_iovlen;
-  msg.msg_control    = &buf;
-  msg.msg_controllen = sizeof(buf);
-  msg.msg_flags      = linux_to_native_msg_flags(linux_msg->msg_flags);
+  struct socket_state* state = find_socket_state(s);
+  if (state != NULL && state->defer_accept > 0) {
+    install_accept_filter(s);
+  }
 
-  ssize_t nbytes = recvmsg(s, &msg, linux_to_native_msg_flags(linux_flags));
-  if (nbytes != -1) {
-    native_to_linux_msghdr(linux_msg, &msg);
-  } else {
+  return 0;
+}
+
+static int accept_common(int s, linux_sockaddr* restrict linux_addr, socklen_t* restrict linux_addrlen, int flags) {
+
+  struct sockaddr_storage addr;
+  socklen_t addrlen = sizeof(addr);
+
+  int fd = accept4(s, (struct sockaddr*)&addr, &addrlen, flags);
+  if (fd == -1) {
     errno = native_to_linux_errno(errno);
+    return -1;
   }
 
-  return nbytes;
+  reset_socket_state(fd);
+  return_sockaddr(linux_addr, linux_addrlen, &addr, addrlen);
+
+  return fd;
 }
 
-ssize_t shim_sendmsg_impl(int s, const struct linux_msghdr* linux_msg, int linux_flags) {
+int shim_accept_impl(int s, linux_sockaddr* restrict linux_addr, socklen_t* restrict linux_addrlen) {
+  return accept_common(s, linux_addr, linux_addrlen, 0);
+}
 
-  struct msghdr msg;
-  uint8_t buf[linux_msg->msg_controllen];
+int shim_accept4_impl(int s, linux_sockaddr* restrict linux_addr, socklen_t* restrict linux_addrlen, int linux_flags) {
 
-  msg.msg_control    = &buf;
-  msg.msg_controllen = sizeof(buf);
+  if (linux_flags & ~(LINUX_SOCK_NONBLOCK | LINUX_SOCK_CLOEXEC)) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
 
-  linux_to_native_msghdr(&msg, linux_msg);
+  return accept_common(s, linux_addr, linux_addrlen, linux_to_native_sock_type(linux_flags));
+}
 
-  ssize_t nbytes = sendmsg(s, &msg, linux_to_native_msg_flags(linux_flags));
-  if (nbytes == -1) {
-    errno = native_to_linux_errno(errno);
-  }
+/*
+ * Control messages.
+ *
+ * Both walkers go through one table per direction, matching on (level, type) and
+ * writing the other ABI's header, alignment and payload. Linux aligns to size_t,
+ * FreeBSD to long, and the header sizes differ on x86_64, so sizes are recomputed
+ * per message rather than copied. Messages without a counterpart are dropped.
+ */
+
+#define LINUX_CMSG_ALIGN(len)   (((len) + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1))
+#define LINUX_CMSG_HDRLEN       LINUX_CMSG_ALIGN(sizeof(linux_cmsghdr))
+#define LINUX_CMSG_LEN(len)     (LINUX_CMSG_HDRLEN + (len))
+#define LINUX_CMSG_SPACE(len)   (LINUX_CMSG_HDRLEN + LINUX_CMSG_ALIGN(len))
+#define LINUX_CMSG_DATA(cmsg)   ((uint8_t*)(cmsg) + LINUX_CMSG_HDRLEN)
+
+struct cmsg_translation {
+  int    from_level;
+  int    from_type;
+  int    to_level;
+  int    to_type;
+  size_t to_size; // 0: same as the source payload
+  bool   merge;   // fill in the previous message instead if it has the same level and type
+  void   (*convert)(void* dest, const void* src, size_t len); // NULL: copied as-is
+};
+
+static void bintime_to_timespec(void* dest, const void* src, size_t len) {
+  struct bintime bt;
+  memcpy(&bt, src, MIN(len, sizeof(bt)));
+  bintime2timespec(&bt, (struct timespec*)dest);
+}
 
-  return nbytes;
+static void cmsgcred_to_ucred(void* dest, const void* src, size_t len) {
+  const struct cmsgcred* cred = src;
+  linux_ucred* ucred = dest;
+  ucred->pid = cred->cmcred_pid;
+  ucred->uid = cred->cmcred_uid;
+  ucred->gid = cred->cmcred_gid;
 }
 
-ssize_t shim_recvfrom_impl(int s, void* buf, size_t len, int linux_flags, linux_sockaddr* restrict linux_from, socklen_t* restrict linux_fromlen) {
+#ifdef SCM_CREDS2
+static void sockcred2_to_ucred(void* dest, const void* src, size_t len) {
+  const struct sockcred2* cred = src;
+  linux_ucred* ucred = dest;
+  ucred->pid = cred->sc_pid;
+  ucred->uid = cred->sc_uid;
+  ucred->gid = cred->sc_gid;
+}
+#endif
 
-  ssize_t nbytes;
-  if (linux_from != NULL) {
+static void dstaddr_to_pktinfo(void* dest, const void* src, size_t len) {
+  linux_in_pktinfo* pktinfo = dest;
+  memcpy(&pktinfo->ipi_addr,     src, sizeof(struct in_addr));
+  memcpy(&pktinfo->ipi_spec_dst, src, sizeof(struct in_addr));
+}
 
-    uint8_t   from[110] __attribute__((aligned(8))); // ?
-    socklen_t fromlen = sizeof(from);
+static void recvif_to_pktinfo(void* dest, const void* src, size_t len) {
+  linux_in_pktinfo* pktinfo = dest;
+  pktinfo->ipi_ifindex = ((const struct sockaddr_dl*)src)->sdl_index;
+}
 
-    nbytes = recvfrom(s, buf, len, linux_to_native_msg_flags(linux_flags), (struct sockaddr*)&from, &fromlen);
-    if (nbytes != -1) {
-      switch (((struct sockaddr*)&from)->sa_family) {
-        case PF_UNIX:
-          assert(*linux_fromlen >= sizeof(struct linux_sockaddr_un));
-          native_to_linux_sockaddr_un((linux_sockaddr_un*)linux_from, (struct sockaddr_un*)&from);
-          break;
-        case PF_INET:
-          assert(*linux_fromlen >= sizeof(struct linux_sockaddr_in));
-          native_to_linux_sockaddr_in((linux_sockaddr_in*)linux_from, (struct sockaddr_in*)&from);
-          break;
-        case PF_INET6:
-          assert(*linux_fromlen >= sizeof(struct linux_sockaddr_in6));
-          native_to_linux_sockaddr_in6((linux_sockaddr_in6*)linux_from, (struct sockaddr_in6*)&from);
-          break;
-        default:
-          assert(0);
-      }
+static void uchar_to_int(void* dest, const void* src, size_t len) {
+  *(int*)dest = *(const uint8_t*)src;
+}
+
+// the kernel fills in the credentials, the sender only asks for them
+static void ucred_to_cmsgcred(void* dest, const void* src, size_t len) {
+}
+
+static void pktinfo_to_sendsrcaddr(void* dest, const void* src, size_t len) {
+  const linux_in_pktinfo* pktinfo = src;
+  memcpy(dest, pktinfo->ipi_spec_dst.s_addr != INADDR_ANY ? &pktinfo->ipi_spec_dst : &pktinfo->ipi_addr, sizeof(struct in_addr));
+}
+
+// IP_TOS is an int on Linux, though a single byte is accepted too
+static void tos_to_uchar(void* dest, const void* src, size_t len) {
+  *(uint8_t*)dest = len >= sizeof(int) ? *(const int*)src : *(const uint8_t*)src;
+}
+
+static const struct cmsg_translation linux_to_native_cmsg_table[] = {
+  { LINUX_SOL_SOCKET, LINUX_SCM_RIGHTS,      SOL_SOCKET,   SCM_RIGHTS,      0,                       false, NULL                   },
+  { LINUX_SOL_SOCKET, LINUX_SCM_CREDENTIALS, SOL_SOCKET,   SCM_CREDS,       sizeof(struct cmsgcred), false, ucred_to_cmsgcred      },
+  { LINUX_SOL_IP,     LINUX_IP_PKTINFO,      IPPROTO_IP,   IP_SENDSRCADDR,  sizeof(struct in_addr),  false, pktinfo_to_sendsrcaddr },
+  { LINUX_SOL_IP,     LINUX_IP_TOS,          IPPROTO_IP,   IP_TOS,          sizeof(uint8_t),         false, tos_to_uchar           },
+  { LINUX_SOL_IPV6,   LINUX_IPV6_PKTINFO,    IPPROTO_IPV6, IPV6_PKTINFO,    0,                       false, NULL                   },
+  { LINUX_SOL_IPV6,   LINUX_IPV6_HOPLIMIT,   IPPROTO_IPV6, IPV6_HOPLIMIT,   0,                       false, NULL                   },
+  { LINUX_SOL_IPV6,   LINUX_IPV6_TCLASS,     IPPROTO_IPV6, IPV6_TCLASS,     0,                       false, NULL                   },
+  { LINUX_SOL_UDP,    LINUX_UDP_SEGMENT,     -1,           -1,              0,                       false, NULL                   }, // see send_segmented
+};
+
+static const struct cmsg_translation native_to_linux_cmsg_table[] = {
+  { SOL_SOCKET,   SCM_RIGHTS,      LINUX_SOL_SOCKET, LINUX_SCM_RIGHTS,      0,                        false, NULL                },
+  { SOL_SOCKET,   SCM_TIMESTAMP,   LINUX_SOL_SOCKET, LINUX_SCM_TIMESTAMP,   0,                        false, NULL                },
+  { SOL_SOCKET,   SCM_REALTIME,    LINUX_SOL_SOCKET, LINUX_SCM_TIMESTAMPNS, 0,                        false, NULL                },
+  { SOL_SOCKET,   SCM_BINTIME,     LINUX_SOL_SOCKET, LINUX_SCM_TIMESTAMPNS, sizeof(struct timespec),  false, bintime_to_timespec },
+  { SOL_SOCKET,   SCM_CREDS,       LINUX_SOL_SOCKET, LINUX_SCM_CREDENTIALS, sizeof(linux_ucred),      false, cmsgcred_to_ucred   },
+#ifdef SCM_CREDS2
+  { SOL_SOCKET,   SCM_CREDS2,      LINUX_SOL_SOCKET, LINUX_SCM_CREDENTIALS, sizeof(linux_ucred),      false, sockcred2_to_ucred  },
+#endif
+  { IPPROTO_IP,   IP_RECVDSTADDR,  LINUX_SOL_IP,     LINUX_IP_PKTINFO,      sizeof(linux_in_pktinfo), true,  dstaddr_to_pktinfo  },
+  { IPPROTO_IP,   IP_RECVIF,       LINUX_SOL_IP,     LINUX_IP_PKTINFO,      sizeof(linux_in_pktinfo), true,  recvif_to_pktinfo   },
+  { IPPROTO_IP,   IP_RECVTTL,      LINUX_SOL_IP,     LINUX_IP_TTL,          sizeof(int),              false, uchar_to_int        },
+  { IPPROTO_IP,   IP_RECVTOS,      LINUX_SOL_IP,     LINUX_IP_TOS,          sizeof(uint8_t),          false, NULL                },
+  { IPPROTO_IPV6, IPV6_PKTINFO,    LINUX_SOL_IPV6,   LINUX_IPV6_PKTINFO,    0,                        false, NULL                },
+  { IPPROTO_IPV6, IPV6_HOPLIMIT,   LINUX_SOL_IPV6,   LINUX_IPV6_HOPLIMIT,   0,                        false, NULL                },
+  { IPPROTO_IPV6, IPV6_TCLASS,     LINUX_SOL_IPV6,   LINUX_IPV6_TCLASS,     0,                        false, NULL                },
+};
+
+_Static_assert(sizeof(linux_in6_pktinfo) == sizeof(struct in6_pktinfo), "");
+
+static const struct cmsg_translation* find_cmsg_translation(const struct cmsg_translation* table, size_t size, int level, int type) {
+  for (size_t i = 0; i < size; i++) {
+    if (table[i].from_level == level && table[i].from_type == type) {
+      return &table[i];
     }
+  }
+  return NULL;
+}
 
+static void convert_cmsg_payload(const struct cmsg_translation* t, void* dest, const void* src, size_t len) {
+  if (t->convert != NULL) {
+    t->convert(dest, src, len);
   } else {
-    nbytes = recvfrom(s, buf, len, linux_to_native_msg_flags(linux_flags), NULL, linux_fromlen);
+    memcpy(dest, src, t->to_size != 0 ? MIN(len, t->to_size) : len);
   }
+}
 
-  if (nbytes == -1) {
-    errno = native_to_linux_errno(errno);
-  }
+static size_t linux_to_native_cmsgs(uint8_t* control, size_t size, const linux_msghdr* linux_msg) {
 
-  return nbytes;
-}
+  const uint8_t* linux_control = linux_msg->msg_control;
 
-ssize_t shim_sendto_impl(int s, const void* msg, size_t len, int linux_flags, const linux_sockaddr* linux_to, socklen_t tolen) {
+  struct cmsghdr* prev = NULL;
+  size_t used = 0;
 
-  ssize_t nbytes;
-  switch (linux_to->sa_family) {
+  for (size_t offset = 0; offset + sizeof(linux_cmsghdr) <= linux_msg->msg_controllen; ) {
 
-    case LINUX_PF_UNIX:
-    {
-      struct sockaddr_un to;
-      assert(tolen <= sizeof(struct linux_sockaddr_un));
-      linux_to_native_sockaddr_un(&to, (linux_sockaddr_un*)linux_to);
-      nbytes = sendto(s, msg, len, linux_to_native_msg_flags(linux_flags), (struct sockaddr*)&to, sizeof(to));
+    const linux_cmsghdr* linux_cmsg = (const linux_cmsghdr*)(linux_control + offset);
+
+    if (linux_cmsg->cmsg_len < LINUX_CMSG_HDRLEN || offset + linux_cmsg->cmsg_len > linux_msg->msg_controllen) {
+      break;
     }
-    break;
 
-    case LINUX_PF_INET:
-    {
-      struct sockaddr_in to;
-      assert(tolen == sizeof(struct linux_sockaddr_in));
-      linux_to_native_sockaddr_in(&to, (linux_sockaddr_in*)linux_to);
-      nbytes = sendto(s, msg, len, linux_to_native_msg_flags(linux_flags), (struct sockaddr*)&to, sizeof(to));
+    offset += LINUX_CMSG_ALIGN(linux_cmsg->cmsg_len);
+
+    const void* data = LINUX_CMSG_DATA(linux_cmsg);
+    size_t      len  = linux_cmsg->cmsg_len - LINUX_CMSG_HDRLEN;
+
+    const struct cmsg_translation* t = find_cmsg_translation(linux_to_native_cmsg_table, nitems(linux_to_native_cmsg_table), linux_cmsg->cmsg_level, linux_cmsg->cmsg_type);
+    if (t == NULL) {
+      LOG("%s: dropping control message %d/%d", __func__, linux_cmsg->cmsg_level, linux_cmsg->cmsg_type);
+      continue;
     }
-    break;
 
-    case LINUX_PF_INET6:
-    {
-      struct sockaddr_in6 to;
-      assert(tolen == sizeof(struct linux_sockaddr_in6));
-      linux_to_native_sockaddr_in6(&to, (linux_sockaddr_in6*)linux_to);
-      nbytes = sendto(s, msg, len, linux_to_native_msg_flags(linux_flags), (struct sockaddr*)&to, sizeof(to));
+    if (t->to_level == -1) {
+      continue;
     }
-    break;
 
-    default:
-      assert(0);
-  }
+    if (t->merge && prev != NULL && prev->cmsg_level == t->to_level && prev->cmsg_type == t->to_type) {
+      convert_cmsg_payload(t, CMSG_DATA(prev), data, len);
+      continue;
+    }
 
-  if (nbytes == -1) {
-    errno = native_to_linux_errno(errno);
+    size_t native_len = t->to_size != 0 ? t->to_size : len;
+    if (used + CMSG_SPACE(native_len) > size) {
+      break;
+    }
+
+    struct cmsghdr* cmsg = (struct cmsghdr*)(control + used);
+    memset(cmsg, 0, CMSG_SPACE(native_len));
+
+    cmsg->cmsg_len   = CMSG_LEN(native_len);
+    cmsg->cmsg_level = t->to_level;
+    cmsg->cmsg_type  = t->to_type;
+    convert_cmsg_payload(t, CMSG_DATA(cmsg), data, len);
+
+    used += CMSG_SPACE(native_len);
+    prev  = cmsg;
   }
 
-  return nbytes;
+  return used;
 }
 
-SHIM_WRAP(bind);
-SHIM_WRAP(connect);
-SHIM_WRAP(recv);
-SHIM_WRAP(send);
-SHIM_WRAP(recvmsg);
-SHIM_WRAP(sendmsg);
-SHIM_WRAP(recvfrom);
-SHIM_WRAP(sendto);
-SHIM_WRAP(socket);
-SHIM_WRAP(socketpair);
+// Descriptors that don't fit are closed, like Linux does.
+static void close_rights(const struct cmsghdr* cmsg) {
+  const int* fds = (const int*)CMSG_DATA(cmsg);
+  size_t     n   = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+  for (size_t i = 0; i < n; i++) {
+    close(fds[i]);
+  }
+}
 
-ssize_t shim___recv_chk_impl(int fd, void* buf, size_t len, size_t buflen, int flags) {
-  assert(len <= buflen);
-  return recv(fd, buf, len, flags);
+// Passed descriptors take numbers that may have been closed behind the shim's back.
+static void forget_rights_state(const struct cmsghdr* cmsg) {
+  const int* fds = (const int*)CMSG_DATA(cmsg);
+  size_t     n   = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+  for (size_t i = 0; i < n; i++) {
+    reset_socket_state(fds[i]);
+  }
 }
 
-SHIM_WRAP(__recv_chk);
+static size_t native_to_linux_cmsgs(linux_msghdr* linux_msg, const struct msghdr* msg, bool* truncated) {
 
-static int linux_to_native_so_opt(int optname) {
-  switch (optname) {
-    case LINUX_SO_BROADCAST: return SO_BROADCAST;
-    case LINUX_SO_SNDBUF:    return SO_SNDBUF;
-    case LINUX_SO_RCVBUF:    return SO_RCVBUF;
-    case LINUX_SO_KEEPALIVE: return SO_KEEPALIVE;
-    default:
-      assert(0);
+  uint8_t* linux_control = linux_msg->msg_control;
+  size_t   size          = linux_msg->msg_controllen;
+
+  linux_cmsghdr* prev = NULL;
+  size_t used = 0;
+
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+
+    const void* data = CMSG_DATA(cmsg);
+    size_t      len  = cmsg->cmsg_len - CMSG_LEN(0);
+
+    const struct cmsg_translation* t = find_cmsg_translation(native_to_linux_cmsg_table, nitems(native_to_linux_cmsg_table), cmsg->cmsg_level, cmsg->cmsg_type);
+    if (t == NULL) {
+      LOG("%s: dropping control message %d/%d", __func__, cmsg->cmsg_level, cmsg->cmsg_type);
+      continue;
+    }
+
+    if (t->merge && prev != NULL && prev->cmsg_level == t->to_level && prev->cmsg_type == t->to_type) {
+      convert_cmsg_payload(t, LINUX_CMSG_DATA(prev), data, len);
+      continue;
+    }
+
+    size_t linux_len = t->to_size != 0 ? t->to_size : len;
+    if (used + LINUX_CMSG_SPACE(linux_len) > size) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        close_rights(cmsg);
+      }
+      *truncated = true;
+      continue;
+    }
+
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      forget_rights_state(cmsg);
+    }
+
+    linux_cmsghdr* linux_cmsg = (linux_cmsghdr*)(linux_control + used);
+    memset(linux_cmsg, 0, LINUX_CMSG_SPACE(linux_len));
+
+    linux_cmsg->cmsg_len   = LINUX_CMSG_LEN(linux_len);
+    linux_cmsg->cmsg_level = t->to_level;
+    linux_cmsg->cmsg_type  = t->to_type;
+    convert_cmsg_payload(t, LINUX_CMSG_DATA(linux_cmsg), data, len);
+
+    used += LINUX_CMSG_SPACE(linux_len);
+    prev  = linux_cmsg;
   }
+
+  return used;
 }
 
-static int linux_to_native_tcp_opt(int optname) {
-  switch (optname) {
-    case LINUX_TCP_NODELAY:      return TCP_NODELAY;
-    case LINUX_TCP_USER_TIMEOUT: return -1; // ?
-    default:
-      assert(0);
-  }
+/*
+ * Native control buffer space needed to receive what fits into linux_controllen bytes on Linux.
+ * IP_PKTINFO arrives as IP_RECVDSTADDR plus IP_RECVIF, and credentials carry more than
+ * a struct ucred, so the native messages can take about twice the room.
+ */
+static size_t native_cmsg_space(size_t linux_controllen) {
+  return linux_controllen > 0 ? 2 * linux_controllen + CMSG_SPACE(sizeof(struct cmsgcred)) : 0;
 }
 
-static int linux_to_native_ip6_opt(int optname) {
-  switch (optname) {
-    case LINUX_IPV6_V6ONLY: return IPV6_V6ONLY;
-    default:
-      assert(0);
+/*
+ * Builds the native msghdr for sending linux_msg. The address and control data go
+ * into the caller's buffers: no allocation, so this is cheap enough to do per datagram.
+ */
+static int linux_to_native_msghdr(struct msghdr* msg, struct sockaddr_storage* name, uint8_t* control, size_t control_size, const linux_msghdr* linux_msg) {
+
+  msg->msg_name       = NULL;
+  msg->msg_namelen    = 0;
+  msg->msg_iov        = linux_msg->msg_iov;
+  msg->msg_iovlen     = linux_msg->msg_iovlen;
+  msg->msg_control    = NULL;
+  msg->msg_controllen = 0;
+  msg->msg_flags      = 0;
+
+  if (linux_msg->msg_name != NULL && linux_msg->msg_namelen > 0) {
+    msg->msg_name    = name;
+    msg->msg_namelen = linux_to_native_sockaddr(name, linux_msg->msg_name, linux_msg->msg_namelen);
+    if (msg->msg_namelen == 0) {
+      return -1;
+    }
   }
-}
 
-int shim_getsockopt_impl(int s, int linux_level, int linux_optname, void* restrict optval, socklen_t* restrict optlen) {
-  switch (linux_level) {
-    case LINUX_SOL_SOCKET:
-      if (linux_optname == LINUX_SO_PASSCRED) {
-#ifdef LOCAL_CREDS_PERSISTENT
-        return getsockopt(s, SOL_LOCAL, LOCAL_CREDS_PERSISTENT, optval, optlen);
-#else
-        return -1;
-#endif
-      } else {
-        return getsockopt(s, SOL_SOCKET, linux_to_native_so_opt(linux_optname), optval, optlen);
-      }
-    case LINUX_SOL_TCP:    return getsockopt(s, IPPROTO_TCP, linux_to_native_tcp_opt(linux_optname), optval, optlen);
-    case LINUX_SOL_IPV6:   return getsockopt(s, IPPROTO_TCP, linux_to_native_ip6_opt(linux_optname), optval, optlen);
-    default:
-      assert(0);
+  if (linux_msg->msg_control != NULL && linux_msg->msg_controllen > 0) {
+    msg->msg_control    = control;
+    msg->msg_controllen = linux_to_native_cmsgs(control, control_size, linux_msg);
   }
+
+  return 0;
 }
 
-int shim_setsockopt_impl(int s, int linux_level, int linux_optname, const void* optval, socklen_t optlen) {
-  int err;
+// Builds the native msghdr receiving into linux_msg's buffers.
+static void native_msghdr_for_recv(struct msghdr* msg, struct sockaddr_storage* name, uint8_t* control, size_t control_size, const linux_msghdr* linux_msg) {
+
+  msg->msg_name       = name;
+  msg->msg_namelen    = sizeof(*name);
+  msg->msg_iov        = linux_msg->msg_iov;
+  msg->msg_iovlen     = linux_msg->msg_iovlen;
+  msg->msg_control    = linux_msg->msg_controllen > 0 ? control : NULL;
+  msg->msg_controllen = linux_msg->msg_controllen > 0 ? control_size : 0;
+  msg->msg_flags      = 0;
+}
+
+static void native_to_linux_msghdr(linux_msghdr* linux_msg, const struct msghdr* msg) {
+
+  if (linux_msg->msg_name != NULL) {
+    linux_msg->msg_namelen = msg->msg_namelen > 0 ? native_to_linux_sockaddr(linux_msg->msg_name, linux_msg->msg_namelen, msg->msg_name) : 0;
+  }
+
+  bool truncated = false;
+
+  if (msg->msg_controllen > 0) {
+    linux_msg->msg_controllen = native_to_linux_cmsgs(linux_msg, msg, &truncated);
+  } else {
+    linux_msg->msg_controllen = 0;
+  }
+
+  linux_msg->msg_flags = native_to_linux_msg_flags(msg->msg_flags) | (truncated ? LINUX_MSG_CTRUNC : 0);
+}
+
+/*
+ * UDP segmentation and receive offload (UDP_SEGMENT, UDP_GRO), emulated.
+ *
+ * A send of more than gso_size bytes goes out as gso_size datagrams in a single
+ * sendmmsg. With UDP_GRO on, a read is topped up with the datagrams from the same
+ * peer that are already queued and no larger than the first, and their size is
+ * reported in a UDP_GRO control message. Each such datagram is peeked before it is
+ * taken, as one that doesn't fit must stay queued: this saves the application work,
+ * not system calls, and assumes a single reader per socket, as GRO users have.
+ */
+
+static int set_udp_offload(int s, int linux_optname, const void* optval, socklen_t optlen) {
+
+  struct socket_state* offload = get_socket_state(s);
+
+  if (offload == NULL || (linux_optname != LINUX_UDP_SEGMENT && linux_optname != LINUX_UDP_GRO)) {
+    errno = native_to_linux_errno(ENOPROTOOPT);
+    return -1;
+  }
+
+  if (optlen < sizeof(int)) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  int value = *(const int*)optval;
+
+  if (linux_optname == LINUX_UDP_SEGMENT) {
+    if (value < 0 || value > UINT16_MAX) {
+      errno = native_to_linux_errno(EINVAL);
+      return -1;
+    }
+    offload->gso_size = value;
+  } else {
+    offload->gro = (value != 0);
+  }
+
+  return 0;
+}
+
+static int get_udp_offload_opt(int s, int linux_optname, void* optval, socklen_t* optlen) {
+
+  struct socket_state* offload = get_socket_state(s);
+
+  if (offload == NULL || (linux_optname != LINUX_UDP_SEGMENT && linux_optname != LINUX_UDP_GRO)) {
+    errno = native_to_linux_errno(ENOPROTOOPT);
+    return -1;
+  }
+
+  if (*optlen < sizeof(int)) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  *(int*)optval = (linux_optname == LINUX_UDP_SEGMENT) ? offload->gso_size : offload->gro;
+  *optlen = sizeof(int);
+
+  return 0;
+}
+
+// The UDP_SEGMENT control message wins over the socket option.
+static size_t get_gso_size(int s, const linux_msghdr* linux_msg) {
+
+  const uint8_t* control = linux_msg->msg_control;
+
+  for (size_t offset = 0; control != NULL && offset + sizeof(linux_cmsghdr) <= linux_msg->msg_controllen; ) {
+
+    const linux_cmsghdr* linux_cmsg = (const linux_cmsghdr*)(control + offset);
+
+    if (linux_cmsg->cmsg_len < LINUX_CMSG_HDRLEN || offset + linux_cmsg->cmsg_len > linux_msg->msg_controllen) {
+      break;
+    }
+
+    if (linux_cmsg->cmsg_level == LINUX_SOL_UDP && linux_cmsg->cmsg_type == LINUX_UDP_SEGMENT && linux_cmsg->cmsg_len >= LINUX_CMSG_LEN(sizeof(uint16_t))) {
+      uint16_t gso_size;
+      memcpy(&gso_size, LINUX_CMSG_DATA(linux_cmsg), sizeof(gso_size));
+      return gso_size;
+    }
+
+    offset += LINUX_CMSG_ALIGN(linux_cmsg->cmsg_len);
+  }
+
+  struct socket_state* offload = find_socket_state(s);
+  return offload != NULL ? offload->gso_size : 0;
+}
+
+static size_t iov_total(const struct iovec* iov, int iovlen) {
+  size_t total = 0;
+  for (int i = 0; i < iovlen; i++) {
+    total += iov[i].iov_len;
+  }
+  return total;
+}
+
+// Points dest at len bytes of iov starting at offset, returns the number of entries used.
+static int iov_slice(struct iovec* dest, const struct iovec* iov, int iovlen, size_t offset, size_t len) {
+
+  int n = 0;
+
+  for (int i = 0; i < iovlen && len > 0; i++) {
+
+    if (offset >= iov[i].iov_len) {
+      offset -= iov[i].iov_len;
+      continue;
+    }
+
+    size_t chunk = MIN(iov[i].iov_len - offset, len);
+
+    dest[n].iov_base = (uint8_t*)iov[i].iov_base + offset;
+    dest[n].iov_len  = chunk;
+    n++;
+
+    len   -= chunk;
+    offset = 0;
+  }
+
+  return n;
+}
+
+static ssize_t send_segmented(int s, const struct msghdr* msg, int flags, size_t gso_size) {
+
+  size_t total     = iov_total(msg->msg_iov, msg->msg_iovlen);
+  size_t nsegments = (total + gso_size - 1) / gso_size;
+
+  if (nsegments > LINUX_UDP_MAX_SEGMENTS) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  struct mmsghdr segments[nsegments];
+  struct iovec   iovs[msg->msg_iovlen + nsegments];
+
+  struct iovec* iov = iovs;
+
+  for (size_t i = 0; i < nsegments; i++) {
+    segments[i].msg_hdr            = *msg;
+    segments[i].msg_hdr.msg_iov    = iov;
+    segments[i].msg_hdr.msg_iovlen = iov_slice(iov, msg->msg_iov, msg->msg_iovlen, i * gso_size, gso_size);
+    iov += segments[i].msg_hdr.msg_iovlen;
+  }
+
+  ssize_t sent = sendmmsg(s, segments, nsegments, flags);
+  if (sent == -1) {
+    return -1;
+  }
+
+  ssize_t nbytes = 0;
+  for (ssize_t i = 0; i < sent; i++) {
+    nbytes += segments[i].msg_len;
+  }
+
+  return nbytes;
+}
+
+static bool same_sockaddr(const struct sockaddr_storage* a, socklen_t alen, const struct sockaddr_storage* b, socklen_t blen) {
+  return alen == blen && memcmp(a, b, alen) == 0;
+}
+
+// Appends to a read of `first` bytes, returns the new length and the number of datagrams in it.
+static ssize_t recv_coalesced(int s, const struct msghdr* msg, ssize_t first, int* nsegments) {
+
+  *nsegments = 1;
+
+  if (first <= 0 || (msg->msg_flags & MSG_TRUNC) || msg->msg_name == NULL) {
+    return first;
+  }
+
+  size_t capacity = iov_total(msg->msg_iov, msg->msg_iovlen);
+  size_t offset   = first;
+
+  while (*nsegments < LINUX_UDP_MAX_SEGMENTS && capacity - offset >= (size_t)first) {
+
+    struct iovec            iov[msg->msg_iovlen];
+    struct sockaddr_storage peer;
+
+    struct msghdr peek = {
+      .msg_name    = &peer,
+      .msg_namelen = sizeof(peer),
+      .msg_iov     = iov,
+      .msg_iovlen  = iov_slice(iov, msg->msg_iov, msg->msg_iovlen, offset, first),
+    };
+
+    ssize_t nbytes = recvmsg(s, &peek, MSG_PEEK | MSG_DONTWAIT);
+
+    if (nbytes <= 0 || (peek.msg_flags & MSG_TRUNC) || !same_sockaddr(&peer, peek.msg_namelen, msg->msg_name, msg->msg_namelen)) {
+      break;
+    }
+
+    // already copied by the peek, a zero-length read drops it
+    struct msghdr drop = {0};
+    if (recvmsg(s, &drop, MSG_DONTWAIT) == -1) {
+      break;
+    }
+
+    offset += nbytes;
+    *nsegments += 1;
+
+    // a shorter datagram ends the batch
+    if (nbytes < first) {
+      break;
+    }
+  }
+
+  return offset;
+}
+
+static void append_linux_cmsg(linux_msghdr* linux_msg, size_t capacity, int level, int type, const void* data, size_t len) {
+
+  if (linux_msg->msg_control == NULL || linux_msg->msg_controllen + LINUX_CMSG_SPACE(len) > capacity) {
+    linux_msg->msg_flags |= LINUX_MSG_CTRUNC;
+    return;
+  }
+
+  linux_cmsghdr* linux_cmsg = (linux_cmsghdr*)((uint8_t*)linux_msg->msg_control + linux_msg->msg_controllen);
+  memset(linux_cmsg, 0, LINUX_CMSG_SPACE(len));
+
+  linux_cmsg->cmsg_len   = LINUX_CMSG_LEN(len);
+  linux_cmsg->cmsg_level = level;
+  linux_cmsg->cmsg_type  = type;
+  memcpy(LINUX_CMSG_DATA(linux_cmsg), data, len);
+
+  linux_msg->msg_controllen += LINUX_CMSG_SPACE(len);
+}
+
+/*
+ * MSG_MORE holds a TCP send back as TCP_CORK does, but only until the next send
+ * without it: TCP_NOPUSH is set before the first send with MSG_MORE, and cleared
+ * after the first one without, which pushes out what was held back.
+ * Sockets corked with TCP_CORK are left alone.
+ */
+
+static void hold_if_more(int s, int linux_flags) {
+
+  if (!(linux_flags & LINUX_MSG_MORE)) {
+    return;
+  }
+
+  struct socket_state* state = get_socket_state(s);
+
+  if (state != NULL && !state->corked && !state->more) {
+    int on = 1;
+    state->more = (setsockopt(s, IPPROTO_TCP, TCP_NOPUSH, &on, sizeof(on)) == 0);
+  }
+}
+
+static void push_unless_more(int s, int linux_flags) {
+
+  if (linux_flags & LINUX_MSG_MORE) {
+    return;
+  }
+
+  struct socket_state* state = find_socket_state(s);
+
+  if (state != NULL && state->more) {
+    int off = 0;
+    setsockopt(s, IPPROTO_TCP, TCP_NOPUSH, &off, sizeof(off));
+    state->more = false;
+  }
+}
+
+ssize_t shim_recv_impl(int s, void* buf, size_t len, int linux_flags) {
+  ssize_t nbytes = recv(s, buf, len, linux_to_native_msg_flags(linux_flags));
+  if (nbytes == -1) {
+    errno = native_to_linux_errno(errno);
+  }
+  return nbytes;
+}
+
+/*
+ * Native control data for a single message goes in a bounded buffer on the
+ * stack, and only control lengths past that on the heap.
+ */
+
+#define MSG_CONTROL_SIZE 1024
+
+static uint8_t* get_control_buffer(uint8_t* scratch, size_t size) {
+
+  if (size <= MSG_CONTROL_SIZE) {
+    return scratch;
+  }
+
+  uint8_t* control = malloc(size);
+  if (control == NULL) {
+    errno = native_to_linux_errno(ENOMEM);
+  }
+
+  return control;
+}
+
+static void put_control_buffer(uint8_t* scratch, uint8_t* control) {
+  if (control != scratch) {
+    free(control);
+  }
+}
+
+static ssize_t recvmsg_with_control(int s, linux_msghdr* linux_msg, int linux_flags, uint8_t* control, size_t control_size) {
+
+  struct msghdr           msg;
+  struct sockaddr_storage name;
+
+  native_msghdr_for_recv(&msg, &name, control, control_size, linux_msg);
+
+  int flags = linux_to_native_msg_flags(linux_flags);
+
+  ssize_t nbytes = recvmsg(s, &msg, flags);
+  if (nbytes == -1) {
+    errno = native_to_linux_errno(errno);
+    return -1;
+  }
+
+  struct socket_state* offload = find_socket_state(s);
+
+  int nsegments = 1;
+  int segment_size = nbytes;
+
+  if (offload != NULL && offload->gro && !(flags & (MSG_PEEK | MSG_TRUNC))) {
+    nbytes = recv_coalesced(s, &msg, nbytes, &nsegments);
+  }
+
+  size_t control_capacity = linux_msg->msg_controllen;
+
+  native_to_linux_msghdr(linux_msg, &msg);
+
+  if (nsegments > 1) {
+    append_linux_cmsg(linux_msg, control_capacity, LINUX_SOL_UDP, LINUX_UDP_GRO, &segment_size, sizeof(segment_size));
+  }
+
+  return nbytes;
+}
+
+ssize_t shim_recvmsg_impl(int s, linux_msghdr* linux_msg, int linux_flags) {
+
+  uint8_t  scratch[MSG_CONTROL_SIZE] __attribute__((aligned(8)));
+  size_t   control_size = native_cmsg_space(linux_msg->msg_controllen);
+  uint8_t* control      = get_control_buffer(scratch, control_size);
+
+  if (control == NULL) {
+    return -1;
+  }
+
+  ssize_t nbytes = recvmsg_with_control(s, linux_msg, linux_flags, control, control_size);
+
+  put_control_buffer(scratch, control);
+
+  return nbytes;
+}
+
+static ssize_t sendmsg_with_control(int s, const linux_msghdr* linux_msg, int linux_flags, uint8_t* control, size_t control_size) {
+
+  struct msghdr           msg;
+  struct sockaddr_storage name;
+
+  if (linux_to_native_msghdr(&msg, &name, control, control_size, linux_msg) == -1) {
+    return -1;
+  }
+
+  int    flags    = linux_to_native_msg_flags(linux_flags);
+  size_t gso_size = get_gso_size(s, linux_msg);
+
+  hold_if_more(s, linux_flags);
+
+  ssize_t nbytes;
+  if (gso_size > 0 && iov_total(msg.msg_iov, msg.msg_iovlen) > gso_size) {
+    nbytes = send_segmented(s, &msg, flags, gso_size);
+  } else {
+    nbytes = sendmsg(s, &msg, flags);
+  }
+
+  if (nbytes != -1) {
+    push_unless_more(s, linux_flags);
+  } else {
+    errno = native_to_linux_errno(errno);
+  }
+
+  return nbytes;
+}
+
+ssize_t shim_sendmsg_impl(int s, const linux_msghdr* linux_msg, int linux_flags) {
+
+  uint8_t  scratch[MSG_CONTROL_SIZE] __attribute__((aligned(8)));
+  size_t   control_size = native_cmsg_space(linux_msg->msg_controllen);
+  uint8_t* control      = get_control_buffer(scratch, control_size);
+
+  if (control == NULL) {
+    return -1;
+  }
+
+  ssize_t nbytes = sendmsg_with_control(s, linux_msg, linux_flags, control, control_size);
+
+  put_control_buffer(scratch, control);
+
+  return nbytes;
+}
+
+// Sends bigger than UDP_SEGMENT are split by sendmsg.
+static bool needs_segmenting(int s, size_t len) {
+  struct socket_state* offload = find_socket_state(s);
+  return offload != NULL && offload->gso_size > 0 && len > offload->gso_size;
+}
+
+ssize_t shim_send_impl(int s, const void* msg, size_t len, int linux_flags) {
+
+  if (needs_segmenting(s, len)) {
+    struct iovec iov = { .iov_base = (void*)msg, .iov_len = len };
+    linux_msghdr linux_msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    return shim_sendmsg_impl(s, &linux_msg, linux_flags);
+  }
+
+  hold_if_more(s, linux_flags);
+
+  ssize_t nbytes = send(s, msg, len, linux_to_native_msg_flags(linux_flags));
+  if (nbytes != -1) {
+    push_unless_more(s, linux_flags);
+  } else {
+    errno = native_to_linux_errno(errno);
+  }
+  return nbytes;
+}
+
+/*
+ * sendmmsg/recvmmsg translate and submit up to MMSG_BATCH messages at a time, with
+ * the native headers, addresses and control data in a stack arena. A batch ends
+ * early when the arena has no room left for the next message's control data.
+ */
+
+#define MMSG_BATCH        32
+#define MMSG_CONTROL_SIZE 8192
+
+struct mmsg_batch {
+  struct mmsghdr          msgs[MMSG_BATCH];
+  struct sockaddr_storage names[MMSG_BATCH];
+  uint8_t                 control[MMSG_CONTROL_SIZE] __attribute__((aligned(8)));
+};
+
+static struct timespec timespec_sub(struct timespec a, struct timespec b) {
+  struct timespec diff = { a.tv_sec - b.tv_sec, a.tv_nsec - b.tv_nsec };
+  if (diff.tv_nsec < 0) {
+    diff.tv_sec  -= 1;
+    diff.tv_nsec += 1000000000;
+  }
+  return diff;
+}
+
+// false once the deadline has passed
+static bool time_left(const struct timespec* deadline, struct timespec* remaining) {
+  struct timespec now;
+  assert(clock_gettime(CLOCK_MONOTONIC, &now) == 0);
+  *remaining = timespec_sub(*deadline, now);
+  return remaining->tv_sec >= 0;
+}
+
+// Waits for something to read on a blocking socket, like the native recvmmsg does with its timeout.
+static bool wait_readable(int s, int flags, const struct timespec* deadline) {
+
+  if ((flags & MSG_DONTWAIT) || (fcntl(s, F_GETFL) & O_NONBLOCK)) {
+    return true;
+  }
+
+  struct timespec remaining;
+  if (!time_left(deadline, &remaining)) {
+    errno = native_to_linux_errno(EAGAIN);
+    return false;
+  }
+
+  struct pollfd pfd = { .fd = s, .events = POLLIN };
+
+  int ready = ppoll(&pfd, 1, &remaining, NULL);
+  if (ready == -1) {
+    errno = native_to_linux_errno(errno);
+    return false;
+  }
+
+  if (ready == 0) {
+    errno = native_to_linux_errno(EAGAIN);
+    return false;
+  }
+
+  return true;
+}
+
+int shim_sendmmsg_impl(int s, linux_mmsghdr* linux_msgs, unsigned int vlen, int linux_flags) {
+
+  if (vlen == 0) {
+    return 0;
+  }
+
+  struct mmsg_batch batch;
+
+  int flags = linux_to_native_msg_flags(linux_flags);
+  unsigned int sent = 0;
+
+  while (sent < vlen) {
+
+    size_t control_used = 0;
+    unsigned int n = 0;
+
+    for (; n < MMSG_BATCH && sent + n < vlen; n++) {
+
+      const linux_msghdr* linux_msg = &linux_msgs[sent + n].msg_hdr;
+
+      // datagrams that fit in one segment are sent as they are
+      size_t gso_size = get_gso_size(s, linux_msg);
+      bool   segment  = gso_size > 0 && iov_total(linux_msg->msg_iov, linux_msg->msg_iovlen) > gso_size;
+
+      size_t control_size = native_cmsg_space(linux_msg->msg_controllen);
+      if (control_used + control_size > sizeof(batch.control) || segment) {
+        break;
+      }
+
+      if (linux_to_native_msghdr(&batch.msgs[n].msg_hdr, &batch.names[n], &batch.control[control_used], control_size, linux_msg) == -1) {
+        break;
+      }
+
+      control_used += _ALIGN(control_size);
+    }
+
+    if (n == 0) {
+      // a single message that doesn't fit, or is to be segmented, goes through sendmsg
+      ssize_t nbytes = shim_sendmsg_impl(s, &linux_msgs[sent].msg_hdr, linux_flags);
+      if (nbytes == -1) {
+        break;
+      }
+      linux_msgs[sent++].msg_len = nbytes;
+      continue;
+    }
+
+    ssize_t done = sendmmsg(s, batch.msgs, n, flags);
+    if (done == -1) {
+      errno = native_to_linux_errno(errno);
+      break;
+    }
+
+    for (ssize_t i = 0; i < done; i++) {
+      linux_msgs[sent + i].msg_len = batch.msgs[i].msg_len;
+    }
+
+    sent += done;
+
+    if ((unsigned int)done < n) {
+      break;
+    }
+  }
+
+  return sent > 0 ? (int)sent : -1;
+}
+
+int shim_recvmmsg_impl(int s, linux_mmsghdr* linux_msgs, unsigned int vlen, int linux_flags, const linux_timespec* timeout) {
+
+  if (vlen == 0) {
+    return 0;
+  }
+
+  struct mmsg_batch batch;
+
+  int flags = linux_to_native_msg_flags(linux_flags);
+  unsigned int received = 0;
+
+  // coalescing reads are done by recvmsg
+  struct socket_state* offload = find_socket_state(s);
+  unsigned int batch_size = (offload != NULL && offload->gro) ? 0 : MMSG_BATCH;
+
+  struct timespec deadline;
+  if (timeout != NULL) {
+    assert(clock_gettime(CLOCK_MONOTONIC, &deadline) == 0);
+    deadline.tv_sec  += timeout->tv_sec;
+    deadline.tv_nsec += timeout->tv_nsec;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec  += 1;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+  while (received < vlen) {
+
+    size_t control_used = 0;
+    unsigned int n = 0;
+
+    for (; n < batch_size && received + n < vlen; n++) {
+
+      const linux_msghdr* linux_msg = &linux_msgs[received + n].msg_hdr;
+
+      size_t control_size = native_cmsg_space(linux_msg->msg_controllen);
+      if (control_used + control_size > sizeof(batch.control)) {
+        break;
+      }
+
+      native_msghdr_for_recv(&batch.msgs[n].msg_hdr, &batch.names[n], &batch.control[control_used], control_size, linux_msg);
+      control_used += _ALIGN(control_size);
+    }
+
+    if (n == 0) {
+      // a single message that doesn't fit, or is to be coalesced, goes through recvmsg
+      if (timeout != NULL && !wait_readable(s, flags, &deadline)) {
+        break;
+      }
+      ssize_t nbytes = shim_recvmsg_impl(s, &linux_msgs[received].msg_hdr, linux_flags);
+      if (nbytes == -1) {
+        break;
+      }
+      linux_msgs[received++].msg_len = nbytes;
+    } else {
+
+      struct timespec remaining, *remaining_ptr = NULL;
+
+      if (timeout != NULL) {
+        if (!time_left(&deadline, &remaining)) {
+          errno = native_to_linux_errno(EAGAIN);
+          break;
+        }
+        remaining_ptr = &remaining;
+      }
+
+      ssize_t done = recvmmsg(s, batch.msgs, n, flags, remaining_ptr);
+      if (done == -1) {
+        errno = native_to_linux_errno(errno);
+        break;
+      }
+
+      // the native recvmmsg returns 0 when the timeout expires first
+      if (done == 0 && received == 0) {
+        errno = native_to_linux_errno(EAGAIN);
+      }
+
+      for (ssize_t i = 0; i < done; i++) {
+        linux_msghdr* linux_msg = &linux_msgs[received + i].msg_hdr;
+        native_to_linux_msghdr(linux_msg, &batch.msgs[i].msg_hdr);
+        linux_msgs[received + i].msg_len = batch.msgs[i].msg_len;
+      }
+
+      received += done;
+
+      if ((unsigned int)done < n) {
+        break;
+      }
+    }
+
+    // once something arrived, MSG_WAITFORONE only takes what's already queued
+    if (linux_flags & LINUX_MSG_WAITFORONE) {
+      flags |= MSG_DONTWAIT;
+      linux_flags |= LINUX_MSG_DONTWAIT;
+    }
+  }
+
+  return received > 0 ? (int)received : -1;
+}
+
+ssize_t shim_recvfrom_impl(int s, void* buf, size_t len, int linux_flags, linux_sockaddr* restrict linux_from, socklen_t* restrict linux_fromlen) {
+
+  struct sockaddr_storage from;
+  socklen_t fromlen = sizeof(from);
+
+  ssize_t nbytes = recvfrom(s, buf, len, linux_to_native_msg_flags(linux_flags), (struct sockaddr*)&from, &fromlen);
+  if (nbytes == -1) {
+    errno = native_to_linux_errno(errno);
+    return -1;
+  }
+
+  return_sockaddr(linux_from, linux_fromlen, &from, fromlen);
+
+  return nbytes;
+}
+
+ssize_t shim_sendto_impl(int s, const void* msg, size_t len, int linux_flags, const linux_sockaddr* linux_to, socklen_t tolen) {
+
+  if (needs_segmenting(s, len)) {
+    struct iovec iov = { .iov_base = (void*)msg, .iov_len = len };
+    linux_msghdr linux_msg = { .msg_name = (void*)linux_to, .msg_namelen = tolen, .msg_iov = &iov, .msg_iovlen = 1 };
+    return shim_sendmsg_impl(s, &linux_msg, linux_flags);
+  }
+
+  struct sockaddr_storage to;
+  socklen_t native_tolen = 0;
+
+  // connected sockets take no address
+  if (linux_to != NULL) {
+    native_tolen = linux_to_native_sockaddr(&to, linux_to, tolen);
+    if (native_tolen == 0) {
+      return -1;
+    }
+  }
+
+  hold_if_more(s, linux_flags);
+
+  ssize_t nbytes = sendto(s, msg, len, linux_to_native_msg_flags(linux_flags), linux_to != NULL ? (struct sockaddr*)&to : NULL, native_tolen);
+  if (nbytes != -1) {
+    push_unless_more(s, linux_flags);
+  } else {
+    errno = native_to_linux_errno(errno);
+  }
+
+  return nbytes;
+}
+
+SHIM_WRAP(accept);
+SHIM_WRAP(accept4);
+SHIM_WRAP(bind);
+SHIM_WRAP(connect);
+SHIM_WRAP(listen);
+SHIM_WRAP(recv);
+SHIM_WRAP(send);
+SHIM_WRAP(recvmsg);
+SHIM_WRAP(recvmmsg);
+SHIM_WRAP(sendmsg);
+SHIM_WRAP(sendmmsg);
+SHIM_WRAP(recvfrom);
+SHIM_WRAP(sendto);
+SHIM_WRAP(socket);
+SHIM_WRAP(socketpair);
+
+ssize_t shim___recv_chk_impl(int fd, void* buf, size_t len, size_t buflen, int flags) {
+  assert(len <= buflen);
+  return recv(fd, buf, len, flags);
+}
+
+SHIM_WRAP(__recv_chk);
+
+// Options without a native counterpart (-1) fail the way Linux fails unknown ones.
+static int native_getsockopt(int s, int level, int optname, void* restrict optval, socklen_t* restrict optlen) {
+  if (optname == -1) {
+    errno = native_to_linux_errno(ENOPROTOOPT);
+    return -1;
+  }
+  return getsockopt(s, level, optname, optval, optlen);
+}
+
+static int native_setsockopt(int s, int level, int optname, const void* optval, socklen_t optlen) {
+  if (optname == -1) {
+    errno = native_to_linux_errno(ENOPROTOOPT);
+    return -1;
+  }
+  return setsockopt(s, level, optname, optval, optlen);
+}
+
+static int linux_to_native_so_opt(int optname) {
+  switch (optname) {
+    case LINUX_SO_DEBUG:       return SO_DEBUG;
+    case LINUX_SO_REUSEADDR:   return SO_REUSEADDR;
+    case LINUX_SO_TYPE:        return SO_TYPE;
+    case LINUX_SO_ERROR:       return SO_ERROR;
+    case LINUX_SO_DONTROUTE:   return SO_DONTROUTE;
+    case LINUX_SO_BROADCAST:   return SO_BROADCAST;
+    case LINUX_SO_SNDBUF:      return SO_SNDBUF;
+    case LINUX_SO_RCVBUF:      return SO_RCVBUF;
+    case LINUX_SO_KEEPALIVE:   return SO_KEEPALIVE;
+    case LINUX_SO_OOBINLINE:   return SO_OOBINLINE;
+    case LINUX_SO_LINGER:      return SO_LINGER;
+    case LINUX_SO_REUSEPORT:   return SO_REUSEPORT_LB; // Linux balances connections across the sockets sharing a port
+    case LINUX_SO_RCVLOWAT:    return SO_RCVLOWAT;
+    case LINUX_SO_SNDLOWAT:    return SO_SNDLOWAT;
+    case LINUX_SO_RCVTIMEO:    return SO_RCVTIMEO;
+    case LINUX_SO_SNDTIMEO:    return SO_SNDTIMEO;
+    case LINUX_SO_TIMESTAMP:   return SO_TIMESTAMP;
+    case LINUX_SO_ACCEPTCONN:  return SO_ACCEPTCONN;
+    case LINUX_SO_TIMESTAMPNS: return SO_TIMESTAMP;
+    case LINUX_SO_PROTOCOL:    return SO_PROTOCOL;
+    default:
+      return -1;
+  }
+}
+
+static int linux_to_native_ip_opt(int optname) {
+  switch (optname) {
+    case LINUX_IP_TOS:     return IP_TOS;
+    case LINUX_IP_TTL:     return IP_TTL;
+    case LINUX_IP_PKTINFO: return IP_RECVDSTADDR; // and IP_RECVIF, see shim_setsockopt_impl
+    case LINUX_IP_RECVTTL: return IP_RECVTTL;
+    case LINUX_IP_RECVTOS: return IP_RECVTOS;
+    default:
+      return -1;
+  }
+}
+
+static int linux_to_native_tcp_opt(int optname) {
+  switch (optname) {
+    case LINUX_TCP_NODELAY:          return TCP_NODELAY;
+    case LINUX_TCP_MAXSEG:           return TCP_MAXSEG;
+    case LINUX_TCP_CORK:             return TCP_NOPUSH; // which also pushes out what's pending when cleared
+    case LINUX_TCP_KEEPIDLE:         return TCP_KEEPIDLE;
+    case LINUX_TCP_KEEPINTVL:        return TCP_KEEPINTVL;
+    case LINUX_TCP_KEEPCNT:          return TCP_KEEPCNT;
+    case LINUX_TCP_FASTOPEN:         return TCP_FASTOPEN; // a queue length on Linux, any non-zero one enables it
+    case LINUX_TCP_FASTOPEN_CONNECT: return TCP_FASTOPEN; // which also does the client side
+    default:
+      return -1;
+  }
+}
+
+static const char* const congestion_names[][2] = {
+  // Linux,  FreeBSD
+  { "reno", "newreno" },
+};
+
+static int set_tcp_congestion(int s, const char* name, socklen_t namelen) {
+
+  char linux_name[TCP_CA_NAME_MAX] = {0};
+  memcpy(linux_name, name, MIN(namelen, sizeof(linux_name) - 1));
+
+  const char* native_name = linux_name;
+  for (size_t i = 0; i < nitems(congestion_names); i++) {
+    if (strcmp(linux_name, congestion_names[i][0]) == 0) {
+      native_name = congestion_names[i][1];
+    }
+  }
+
+  // a module not loaded yet makes this fail with ENOENT, as on Linux
+  return setsockopt(s, IPPROTO_TCP, TCP_CONGESTION, native_name, strlen(native_name) + 1);
+}
+
+static int get_tcp_congestion(int s, char* name, socklen_t* namelen) {
+
+  char native_name[TCP_CA_NAME_MAX];
+  socklen_t native_namelen = sizeof(native_name);
+
+  if (getsockopt(s, IPPROTO_TCP, TCP_CONGESTION, native_name, &native_namelen) == -1) {
+    return -1;
+  }
+
+  const char* linux_name = native_name;
+  for (size_t i = 0; i < nitems(congestion_names); i++) {
+    if (strcmp(native_name, congestion_names[i][1]) == 0) {
+      linux_name = congestion_names[i][0];
+    }
+  }
+
+  *namelen = MIN(*namelen, (socklen_t)TCP_CA_NAME_MAX);
+  strncpy(name, linux_name, *namelen);
+
+  return 0;
+}
+
+/*
+ * TCP options that need more than a name translation.
+ *
+ * TCP_QUICKACK is kept and mapped to TCP_DELACK where the TCP stack in use has it.
+ * TCP_USER_TIMEOUT is in milliseconds, TCP_MAXUNACKTIME in seconds.
+ * TCP_NOTSENT_LOWAT has no native counterpart, it is kept and otherwise ignored.
+ */
+
+static int set_tcp_opt(int s, int linux_optname, const void* optval, socklen_t optlen) {
+
+  if (linux_optname == LINUX_TCP_CONGESTION) {
+    return set_tcp_congestion(s, optval, optlen);
+  }
+
+  struct socket_state* state = get_socket_state(s);
+
+  if (optlen < sizeof(int)) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  int value = *(const int*)optval;
+
+  switch (linux_optname) {
+
+    case LINUX_TCP_CORK:
+      {
+        int err = setsockopt(s, IPPROTO_TCP, TCP_NOPUSH, optval, optlen);
+        if (err == 0 && state != NULL) {
+          state->corked = (value != 0);
+          state->more   = false;
+        }
+        return err;
+      }
+
+    case LINUX_TCP_QUICKACK:
+      if (state != NULL) {
+        state->delayed_ack = (value == 0);
+      }
+#ifdef TCP_DELACK
+      {
+        int delack = (value == 0);
+        setsockopt(s, IPPROTO_TCP, TCP_DELACK, &delack, sizeof(delack)); // only the RACK and BBR stacks have it
+      }
+#endif
+      return 0;
+
+    case LINUX_TCP_USER_TIMEOUT:
+#ifdef TCP_MAXUNACKTIME
+      {
+        if (value < 0) {
+          errno = native_to_linux_errno(EINVAL);
+          return -1;
+        }
+        int seconds = (value + 999) / 1000;
+        return setsockopt(s, IPPROTO_TCP, TCP_MAXUNACKTIME, &seconds, sizeof(seconds));
+      }
+#else
+      errno = native_to_linux_errno(ENOPROTOOPT);
+      return -1;
+#endif
+
+    case LINUX_TCP_DEFER_ACCEPT:
+      return set_defer_accept(s, value);
+
+    case LINUX_TCP_NOTSENT_LOWAT:
+      if (state == NULL) {
+        errno = native_to_linux_errno(ENOPROTOOPT);
+        return -1;
+      }
+      state->notsent_lowat = value;
+      return 0;
+
+    default:
+      return native_setsockopt(s, IPPROTO_TCP, linux_to_native_tcp_opt(linux_optname), optval, optlen);
+  }
+}
+
+_Static_assert(sizeof(linux_tcp_info) == 232, "");
+
+static const uint8_t linux_tcp_states[] = {
+  [TCPS_CLOSED]       = 7,  // TCP_CLOSE
+  [TCPS_LISTEN]       = 10, // TCP_LISTEN
+  [TCPS_SYN_SENT]     = 2,  // TCP_SYN_SENT
+  [TCPS_SYN_RECEIVED] = 3,  // TCP_SYN_RECV
+  [TCPS_ESTABLISHED]  = 1,  // TCP_ESTABLISHED
+  [TCPS_CLOSE_WAIT]   = 8,  // TCP_CLOSE_WAIT
+  [TCPS_FIN_WAIT_1]   = 4,  // TCP_FIN_WAIT1
+  [TCPS_CLOSING]      = 11, // TCP_CLOSING
+  [TCPS_LAST_ACK]     = 9,  // TCP_LAST_ACK
+  [TCPS_FIN_WAIT_2]   = 5,  // TCP_FIN_WAIT2
+  [TCPS_TIME_WAIT]    = 6,  // TCP_TIME_WAIT
+};
+
+static uint32_t bytes_to_segments(uint32_t bytes, uint32_t mss) {
+  return mss > 0 ? bytes / mss : 0;
+}
+
+/*
+ * FreeBSD has the window and timing fields; it counts the windows in bytes where
+ * Linux counts them in segments, and has no byte, delivery or pacing counters,
+ * which stay zero. Times are in microseconds on both, except tcpi_last_data_recv:
+ * FreeBSD has it in microseconds too, Linux in milliseconds.
+ */
+static int get_tcp_info(int s, void* optval, socklen_t* optlen) {
+
+  struct tcp_info info;
+  socklen_t len = sizeof(info);
+
+  if (getsockopt(s, IPPROTO_TCP, TCP_INFO, &info, &len) == -1) {
+    errno = native_to_linux_errno(errno);
+    return -1;
+  }
+
+  linux_tcp_info linux_info = {0};
+
+  linux_info.tcpi_state          = info.tcpi_state < nitems(linux_tcp_states) ? linux_tcp_states[info.tcpi_state] : 7;
+  linux_info.tcpi_options        = info.tcpi_options & (TCPI_OPT_TIMESTAMPS | TCPI_OPT_SACK | TCPI_OPT_WSCALE | TCPI_OPT_ECN); // same bits
+  linux_info.tcpi_snd_wscale     = info.tcpi_snd_wscale;
+  linux_info.tcpi_rcv_wscale     = info.tcpi_rcv_wscale;
+  linux_info.tcpi_rto            = info.tcpi_rto;
+  linux_info.tcpi_snd_mss        = info.tcpi_snd_mss;
+  linux_info.tcpi_rcv_mss        = info.tcpi_rcv_mss;
+  linux_info.tcpi_last_data_recv = info.tcpi_last_data_recv / 1000;
+  linux_info.tcpi_rtt            = info.tcpi_rtt;
+  linux_info.tcpi_rttvar         = info.tcpi_rttvar;
+  linux_info.tcpi_snd_cwnd       = bytes_to_segments(info.tcpi_snd_cwnd, info.tcpi_snd_mss);
+  linux_info.tcpi_rcv_space      = info.tcpi_rcv_space;
+  linux_info.tcpi_total_retrans  = info.tcpi_snd_rexmitpack;
+  linux_info.tcpi_rcv_ooopack    = info.tcpi_rcv_ooopack;
+  linux_info.tcpi_snd_wnd        = info.tcpi_snd_wnd;
+
+  // no slow start threshold yet, TCP_INFINITE_SSTHRESH on Linux
+  if (info.tcpi_snd_ssthresh >= (uint32_t)TCP_MAXWIN << TCP_MAX_WINSHIFT) {
+    linux_info.tcpi_snd_ssthresh = 0x7fffffff;
+  } else {
+    linux_info.tcpi_snd_ssthresh = bytes_to_segments(info.tcpi_snd_ssthresh, info.tcpi_snd_mss);
+  }
+
+  *optlen = MIN(*optlen, sizeof(linux_info));
+  memcpy(optval, &linux_info, *optlen);
+
+  return 0;
+}
+
+static int get_tcp_opt(int s, int linux_optname, void* optval, socklen_t* optlen) {
+
+  if (linux_optname == LINUX_TCP_CONGESTION) {
+    return get_tcp_congestion(s, optval, optlen);
+  }
+
+  if (linux_optname == LINUX_TCP_INFO) {
+    return get_tcp_info(s, optval, optlen);
+  }
+
+  struct socket_state* state = get_socket_state(s);
+
+  switch (linux_optname) {
+
+    case LINUX_TCP_QUICKACK:
+    case LINUX_TCP_DEFER_ACCEPT:
+    case LINUX_TCP_NOTSENT_LOWAT:
+      if (*optlen < sizeof(int)) {
+        errno = native_to_linux_errno(EINVAL);
+        return -1;
+      }
+      if (linux_optname == LINUX_TCP_QUICKACK) {
+        *(int*)optval = (state == NULL || !state->delayed_ack);
+      } else if (linux_optname == LINUX_TCP_DEFER_ACCEPT) {
+        *(int*)optval = (state != NULL) ? state->defer_accept : 0;
+      } else {
+        *(int*)optval = (state != NULL) ? (int)state->notsent_lowat : 0;
+      }
+      *optlen = sizeof(int);
+      return 0;
+
+    case LINUX_TCP_USER_TIMEOUT:
+#ifdef TCP_MAXUNACKTIME
+      {
+        int err = getsockopt(s, IPPROTO_TCP, TCP_MAXUNACKTIME, optval, optlen);
+        if (err == 0) {
+          *(int*)optval *= 1000;
+        }
+        return err;
+      }
+#else
+      errno = native_to_linux_errno(ENOPROTOOPT);
+      return -1;
+#endif
+
+    default:
+      return native_getsockopt(s, IPPROTO_TCP, linux_to_native_tcp_opt(linux_optname), optval, optlen);
+  }
+}
+
+static int linux_to_native_ip6_opt(int optname) {
+  switch (optname) {
+    case LINUX_IPV6_V6ONLY:       return IPV6_V6ONLY;
+    case LINUX_IPV6_RECVPKTINFO:  return IPV6_RECVPKTINFO;
+    case LINUX_IPV6_RECVHOPLIMIT: return IPV6_RECVHOPLIMIT;
+    case LINUX_IPV6_RECVTCLASS:   return IPV6_RECVTCLASS;
+    case LINUX_IPV6_TCLASS:       return IPV6_TCLASS;
+    case LINUX_IPV6_DONTFRAG:     return IPV6_DONTFRAG;
+    default:
+      return -1;
+  }
+}
+
+// SO_PRIORITY only orders a Linux interface's queues: it is kept, and otherwise ignored.
+// SO_INCOMING_CPU steers SO_REUSEPORT connections to the listener of that CPU's memory domain.
+static int set_emulated_so_opt(int s, int linux_optname, const void* optval, socklen_t optlen) {
+
+  struct socket_state* state = get_socket_state(s);
+
+  if (state == NULL) {
+    errno = native_to_linux_errno(ENOPROTOOPT);
+    return -1;
+  }
+
+  if (optlen < sizeof(int)) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  int value = *(const int*)optval;
+
+  if (linux_optname == LINUX_SO_PRIORITY) {
+    if (value < 0 || value > UINT8_MAX) {
+      errno = native_to_linux_errno(EPERM);
+      return -1;
+    }
+    state->priority = value;
+    return 0;
+  }
+
+  assert(linux_optname == LINUX_SO_INCOMING_CPU);
+
+  if (value < 0 || value >= UINT16_MAX) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  state->incoming_cpu = value + 1;
+
+#ifdef TCP_REUSPORT_LB_NUMA
+  // fails on anything but a TCP socket sharing its port, where there's nothing to steer
+  int domain = native_cpu_domain(value);
+  setsockopt(s, IPPROTO_TCP, TCP_REUSPORT_LB_NUMA, &domain, sizeof(domain));
+#endif
+
+  return 0;
+}
+
+static int get_emulated_so_opt(int s, int linux_optname, void* optval, socklen_t* optlen) {
+
+  struct socket_state* state = get_socket_state(s);
+
+  if (state == NULL) {
+    errno = native_to_linux_errno(ENOPROTOOPT);
+    return -1;
+  }
+
+  if (*optlen < sizeof(int)) {
+    errno = native_to_linux_errno(EINVAL);
+    return -1;
+  }
+
+  if (linux_optname == LINUX_SO_PRIORITY) {
+    *(int*)optval = state->priority;
+  } else {
+    assert(linux_optname == LINUX_SO_INCOMING_CPU);
+    int shim_sched_getcpu_impl();
+    // without a CPU set, the one handling this thread is where its packets are processed
+    *(int*)optval = state->incoming_cpu > 0 ? state->incoming_cpu - 1 : MAX(shim_sched_getcpu_impl(), 0);
+  }
+
+  *optlen = sizeof(int);
+
+  return 0;
+}
+
+int shim_getsockopt_impl(int s, int linux_level, int linux_optname, void* restrict optval, socklen_t* restrict optlen) {
+  switch (linux_level) {
+    case LINUX_SOL_SOCKET:
+      if (linux_optname == LINUX_SO_PASSCRED) {
+#ifdef LOCAL_CREDS_PERSISTENT
+        return getsockopt(s, SOL_LOCAL, LOCAL_CREDS_PERSISTENT, optval, optlen);
+#else
+        errno = native_to_linux_errno(ENOPROTOOPT);
+        return -1;
+#endif
+      } else if (linux_optname == LINUX_SO_PRIORITY || linux_optname == LINUX_SO_INCOMING_CPU) {
+        return get_emulated_so_opt(s, linux_optname, optval, optlen);
+      } else if (linux_optname == LINUX_SO_ERROR) {
+        int err = getsockopt(s, SOL_SOCKET, SO_ERROR, optval, optlen);
+        if (err == 0 && *optlen >= sizeof(int)) {
+          *(int*)optval = native_to_linux_errno(*(int*)optval);
+        }
+        return err;
+      } else {
+        return native_getsockopt(s, SOL_SOCKET, linux_to_native_so_opt(linux_optname), optval, optlen);
+      }
+    case LINUX_SOL_IP:     return native_getsockopt(s, IPPROTO_IP,   linux_to_native_ip_opt(linux_optname),  optval, optlen);
+    case LINUX_SOL_TCP:    return get_tcp_opt(s, linux_optname, optval, optlen);
+    case LINUX_SOL_IPV6:   return native_getsockopt(s, IPPROTO_IPV6, linux_to_native_ip6_opt(linux_optname), optval, optlen);
+    case LINUX_SOL_UDP:    return get_udp_offload_opt(s, linux_optname, optval, optlen);
+    default:
+      errno = native_to_linux_errno(ENOPROTOOPT);
+      return -1;
+  }
+}
+
+int shim_setsockopt_impl(int s, int linux_level, int linux_optname, const void* optval, socklen_t optlen) {
+  int err;
   switch (linux_level) {
     case LINUX_SOL_SOCKET:
       if (linux_optname == LINUX_SO_SNDBUF && optval && *((int*)optval) == 0) {
@@ -555,20 +1987,40 @@ int shim_setsockopt_impl(int s, int linux_level, int linux_optname, const void*
 #ifdef LOCAL_CREDS_PERSISTENT
         err = setsockopt(s, SOL_LOCAL, LOCAL_CREDS_PERSISTENT, optval, optlen);
 #else
+        errno = native_to_linux_errno(ENOPROTOOPT);
         err = -1;
 #endif
+      } else if (linux_optname == LINUX_SO_TIMESTAMP || linux_optname == LINUX_SO_TIMESTAMPNS) {
+        // nanoseconds come as SCM_BINTIME, which recvmsg turns into SCM_TIMESTAMPNS
+        int clock = (linux_optname == LINUX_SO_TIMESTAMPNS) ? SO_TS_BINTIME : SO_TS_REALTIME_MICRO;
+        err = setsockopt(s, SOL_SOCKET, SO_TS_CLOCK, &clock, sizeof(clock));
+        if (err == 0) {
+          err = setsockopt(s, SOL_SOCKET, SO_TIMESTAMP, optval, optlen);
+        }
+      } else if (linux_optname == LINUX_SO_PRIORITY || linux_optname == LINUX_SO_INCOMING_CPU) {
+        err = set_emulated_so_opt(s, linux_optname, optval, optlen);
       } else {
-        err = setsockopt(s, SOL_SOCKET, linux_to_native_so_opt(linux_optname), optval, optlen);
+        err = native_setsockopt(s, SOL_SOCKET, linux_to_native_so_opt(linux_optname), optval, optlen);
+      }
+      break;
+    case LINUX_SOL_IP:
+      err = native_setsockopt(s, IPPROTO_IP, linux_to_native_ip_opt(linux_optname), optval, optlen);
+      if (err == 0 && linux_optname == LINUX_IP_PKTINFO) {
+        err = setsockopt(s, IPPROTO_IP, IP_RECVIF, optval, optlen);
       }
       break;
     case LINUX_SOL_TCP:
-      err = setsockopt(s, IPPROTO_TCP, linux_to_native_tcp_opt(linux_optname), optval, optlen);
+      err = set_tcp_opt(s, linux_optname, optval, optlen);
       break;
     case LINUX_SOL_IPV6:
-      err = setsockopt(s, IPPROTO_TCP, linux_to_native_ip6_opt(linux_optname), optval, optlen);
+      err = native_setsockopt(s, IPPROTO_IPV6, linux_to_native_ip6_opt(linux_optname), optval, optlen);
+      break;
+    case LINUX_SOL_UDP:
+      err = set_udp_offload(s, linux_optname, optval, optlen);
       break;
     default:
-      assert(0);
+      errno = native_to_linux_errno(ENOPROTOOPT);
+      err = -1;
   }
   return err;
 }
@@ -578,32 +2030,37 @@ SHIM_WRAP(setsockopt);
 
 int shim_getsockname_impl(int s, linux_sockaddr* restrict linux_name, socklen_t* restrict linux_namelen) {
 
-  uint8_t   name[110] __attribute__((aligned(8))); // ?
+  struct sockaddr_storage name;
   socklen_t namelen = sizeof(name);
 
   int err = getsockname(s, (struct sockaddr*)&name, &namelen);
-  if (err != -1) {
-    switch (((struct sockaddr*)&name)->sa_family) {
-      case PF_UNIX:
-        assert(*linux_namelen >= sizeof(struct linux_sockaddr_un));
-        native_to_linux_sockaddr_un((linux_sockaddr_un*)linux_name, (struct sockaddr_un*)&name);
-        break;
-      case PF_INET:
-        assert(*linux_namelen >= sizeof(struct linux_sockaddr_in));
-        native_to_linux_sockaddr_in((linux_sockaddr_in*)linux_name, (struct sockaddr_in*)&name);
-        break;
-      case PF_INET6:
-        assert(*linux_namelen >= sizeof(struct linux_sockaddr_in6));
-        native_to_linux_sockaddr_in6((linux_sockaddr_in6*)linux_name, (struct sockaddr_in6*)&name);
-        break;
-      default:
-        assert(0);
-    }
+  if (err == -1) {
+    errno = native_to_linux_errno(errno);
+    return -1;
   }
 
-  return err;
+  return_sockaddr(linux_name, linux_namelen, &name, namelen);
+
+  return 0;
+}
+
+int shim_getpeername_impl(int s, linux_sockaddr* restrict linux_name, socklen_t* restrict linux_namelen) {
+
+  struct sockaddr_storage name;
+  socklen_t namelen = sizeof(name);
+
+  int err = getpeername(s, (struct sockaddr*)&name, &namelen);
+  if (err == -1) {
+    errno = native_to_linux_errno(errno);
+    return -1;
+  }
+
+  return_sockaddr(linux_name, linux_namelen, &name, namelen);
+
+  return 0;
 }
 
+SHIM_WRAP(getpeername);
 SHIM_WRAP(getsockname);
 
 const char* shim_inet_ntop_impl(int af, const void* restrict src, char* restrict dst, socklen_t size) {
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <stdint.h>
 
 #include <sys/types.h>
@@ -23,7 +25,13 @@
 #define LINUX_SOL_UDP    17
 #define LINUX_SOL_IPV6   41
 
-#define LINUX_SCM_RIGHTS 1
+#define LINUX_UDP_SEGMENT 103
+#define LINUX_UDP_GRO     104
+
+#define LINUX_UDP_MAX_SEGMENTS 64
+
+#define LINUX_SCM_RIGHTS      1
+#define LINUX_SCM_CREDENTIALS 2
 
 #define LINUX_SOCK_STREAM          1
 #define LINUX_SOCK_DGRAM           2
@@ -43,31 +51,62 @@
   LINUX_SOCK_CLOEXEC               \
 )
 
-#define LINUX_SO_DEBUG       1
-#define LINUX_SO_REUSEADDR   2
-#define LINUX_SO_TYPE        3
-#define LINUX_SO_ERROR       4
-#define LINUX_SO_DONTROUTE   5
-#define LINUX_SO_BROADCAST   6
-#define LINUX_SO_SNDBUF      7
-#define LINUX_SO_RCVBUF      8
-#define LINUX_SO_KEEPALIVE   9
-#define LINUX_SO_OOBINLINE  10
-#define LINUX_SO_LINGER     13
-#define LINUX_SO_REUSEPORT  15
-#define LINUX_SO_PASSCRED   16
-#define LINUX_SO_RCVLOWAT   18
-#define LINUX_SO_SNDLOWAT   19
-#define LINUX_SO_RCVTIMEO   20
-#define LINUX_SO_SNDTIMEO   21
-#define LINUX_SO_TIMESTAMP  29
-#define LINUX_SO_ACCEPTCONN 30
-#define LINUX_SO_PROTOCOL   38
-
-#define LINUX_TCP_NODELAY       1
-#define LINUX_TCP_USER_TIMEOUT 18
-
-#define LINUX_IPV6_V6ONLY      26
+#define LINUX_SO_DEBUG         1
+#define LINUX_SO_REUSEADDR     2
+#define LINUX_SO_TYPE          3
+#define LINUX_SO_ERROR         4
+#define LINUX_SO_DONTROUTE     5
+#define LINUX_SO_BROADCAST     6
+#define LINUX_SO_SNDBUF        7
+#define LINUX_SO_RCVBUF        8
+#define LINUX_SO_KEEPALIVE     9
+#define LINUX_SO_OOBINLINE    10
+#define LINUX_SO_PRIORITY     12
+#define LINUX_SO_LINGER       13
+#define LINUX_SO_REUSEPORT    15
+#define LINUX_SO_PASSCRED     16
+#define LINUX_SO_RCVLOWAT     18
+#define LINUX_SO_SNDLOWAT     19
+#define LINUX_SO_RCVTIMEO     20
+#define LINUX_SO_SNDTIMEO     21
+#define LINUX_SO_TIMESTAMP    29
+#define LINUX_SO_ACCEPTCONN   30
+#define LINUX_SO_TIMESTAMPNS  35
+#define LINUX_SO_PROTOCOL     38
+#define LINUX_SO_INCOMING_CPU 49
+
+#define LINUX_SCM_TIMESTAMP   LINUX_SO_TIMESTAMP
+#define LINUX_SCM_TIMESTAMPNS LINUX_SO_TIMESTAMPNS
+
+#define LINUX_TCP_NODELAY           1
+#define LINUX_TCP_MAXSEG            2
+#define LINUX_TCP_CORK              3
+#define LINUX_TCP_KEEPIDLE          4
+#define LINUX_TCP_KEEPINTVL         5
+#define LINUX_TCP_KEEPCNT           6
+#define LINUX_TCP_DEFER_ACCEPT      9
+#define LINUX_TCP_INFO             11
+#define LINUX_TCP_QUICKACK         12
+#define LINUX_TCP_CONGESTION       13
+#define LINUX_TCP_USER_TIMEOUT     18
+#define LINUX_TCP_FASTOPEN         23
+#define LINUX_TCP_NOTSENT_LOWAT    25
+#define LINUX_TCP_FASTOPEN_CONNECT 30
+
+#define LINUX_IP_TOS             1
+#define LINUX_IP_TTL             2
+#define LINUX_IP_PKTINFO         8
+#define LINUX_IP_RECVTTL        12
+#define LINUX_IP_RECVTOS        13
+
+#define LINUX_IPV6_V6ONLY       26
+#define LINUX_IPV6_RECVPKTINFO  49
+#define LINUX_IPV6_PKTINFO      50
+#define LINUX_IPV6_RECVHOPLIMIT 51
+#define LINUX_IPV6_HOPLIMIT     52
+#define LINUX_IPV6_DONTFRAG     62
+#define LINUX_IPV6_RECVTCLASS   66
+#define LINUX_IPV6_TCLASS       67
 
 #define LINUX_MSG_OOB          0x00000001
 #define LINUX_MSG_PEEK         0x00000002
@@ -78,6 +117,7 @@
 #define LINUX_MSG_EOR          0x00000080
 #define LINUX_MSG_WAITALL      0x00000100
 #define LINUX_MSG_NOSIGNAL     0x00004000
+#define LINUX_MSG_MORE         0x00008000
 #define LINUX_MSG_WAITFORONE   0x00010000
 #define LINUX_MSG_CMSG_CLOEXEC 0x40000000
 
@@ -91,6 +131,7 @@
   LINUX_MSG_EOR          |      \
   LINUX_MSG_WAITALL      |      \
   LINUX_MSG_NOSIGNAL     |      \
+  LINUX_MSG_MORE         |      \
   LINUX_MSG_WAITFORONE   |      \
   LINUX_MSG_CMSG_CLOEXEC        \
 )
@@ -149,6 +190,11 @@ struct linux_msghdr {
   int          msg_flags;
 };
 
+struct linux_mmsghdr {
+  struct linux_msghdr msg_hdr;
+  unsigned int        msg_len;
+};
+
 struct linux_cmsghdr {
   size_t cmsg_len;
   int    cmsg_level;
@@ -156,21 +202,102 @@ struct linux_cmsghdr {
   // unsigned char cmsg_data[];
 };
 
+struct linux_ucred {
+  pid_t pid;
+  uid_t uid;
+  gid_t gid;
+};
+
+struct linux_in_pktinfo {
+  int           ipi_ifindex;
+  linux_in_addr ipi_spec_dst;
+  linux_in_addr ipi_addr;
+};
+
+struct linux_in6_pktinfo {
+  linux_in6_addr ipi6_addr;
+  int            ipi6_ifindex;
+};
+
+// as of Linux 5.4, callers of older or newer versions get what they asked for
+struct linux_tcp_info {
+  uint8_t  tcpi_state;
+  uint8_t  tcpi_ca_state;
+  uint8_t  tcpi_retransmits;
+  uint8_t  tcpi_probes;
+  uint8_t  tcpi_backoff;
+  uint8_t  tcpi_options;
+  uint8_t  tcpi_snd_wscale : 4, tcpi_rcv_wscale : 4;
+  uint8_t  tcpi_delivery_rate_app_limited : 1, tcpi_fastopen_client_fail : 2;
+  uint32_t tcpi_rto;
+  uint32_t tcpi_ato;
+  uint32_t tcpi_snd_mss;
+  uint32_t tcpi_rcv_mss;
+  uint32_t tcpi_unacked;
+  uint32_t tcpi_sacked;
+  uint32_t tcpi_lost;
+  uint32_t tcpi_retrans;
+  uint32_t tcpi_fackets;
+  uint32_t tcpi_last_data_sent;
+  uint32_t tcpi_last_ack_sent;
+  uint32_t tcpi_last_data_recv;
+  uint32_t tcpi_last_ack_recv;
+  uint32_t tcpi_pmtu;
+  uint32_t tcpi_rcv_ssthresh;
+  uint32_t tcpi_rtt;
+  uint32_t tcpi_rttvar;
+  uint32_t tcpi_snd_ssthresh;
+  uint32_t tcpi_snd_cwnd;
+  uint32_t tcpi_advmss;
+  uint32_t tcpi_reordering;
+  uint32_t tcpi_rcv_rtt;
+  uint32_t tcpi_rcv_space;
+  uint32_t tcpi_total_retrans;
+  uint64_t tcpi_pacing_rate;
+  uint64_t tcpi_max_pacing_rate;
+  uint64_t tcpi_bytes_acked;
+  uint64_t tcpi_bytes_received;
+  uint32_t tcpi_segs_out;
+  uint32_t tcpi_segs_in;
+  uint32_t tcpi_notsent_bytes;
+  uint32_t tcpi_min_rtt;
+  uint32_t tcpi_data_segs_in;
+  uint32_t tcpi_data_segs_out;
+  uint64_t tcpi_delivery_rate;
+  uint64_t tcpi_busy_time;
+  uint64_t tcpi_rwnd_limited;
+  uint64_t tcpi_sndbuf_limited;
+  uint32_t tcpi_delivered;
+  uint32_t tcpi_delivered_ce;
+  uint64_t tcpi_bytes_sent;
+  uint64_t tcpi_bytes_retrans;
+  uint32_t tcpi_dsack_dups;
+  uint32_t tcpi_reord_seen;
+  uint32_t tcpi_rcv_ooopack;
+  uint32_t tcpi_snd_wnd;
+};
+
 typedef struct linux_cmsghdr      linux_cmsghdr;
+typedef struct linux_mmsghdr      linux_mmsghdr;
 typedef struct linux_msghdr       linux_msghdr;
 typedef struct linux_sockaddr     linux_sockaddr;
 typedef struct linux_sockaddr_in  linux_sockaddr_in;
 typedef struct linux_sockaddr_in6 linux_sockaddr_in6;
 typedef struct linux_sockaddr_un  linux_sockaddr_un;
+typedef struct linux_ucred        linux_ucred;
+typedef struct linux_in_pktinfo   linux_in_pktinfo;
+typedef struct linux_in6_pktinfo  linux_in6_pktinfo;
+typedef struct linux_tcp_info     linux_tcp_info;
 
 int linux_to_native_sock_type(int linux_type);
 int native_to_linux_sock_type(int linux_type);
 
-void linux_to_native_sockaddr_in(struct sockaddr_in* dest, const linux_sockaddr_in* src);
 void native_to_linux_sockaddr_in(linux_sockaddr_in* dest, const struct sockaddr_in* src);
-
-void linux_to_native_sockaddr_in6(struct sockaddr_in6* dest, const linux_sockaddr_in6* src);
 void native_to_linux_sockaddr_in6(linux_sockaddr_in6* dest, const struct sockaddr_in6* src);
 
-void linux_to_native_sockaddr_un(struct sockaddr_un* dest, const linux_sockaddr_un* src);
-void native_to_linux_sockaddr_un(linux_sockaddr_un* dest, const struct sockaddr_un* src);
+socklen_t linux_to_native_sockaddr(struct sockaddr_storage* dest, const linux_sockaddr* src, socklen_t srclen);
+socklen_t native_to_linux_sockaddr(linux_sockaddr* dest, socklen_t destlen, const struct sockaddr* src);
+
+// Emulated socket options kept by descriptor number, see socket.c.
+void forget_socket_state(int first, int last);
+void copy_socket_state(int from, int to);
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include "../../shim.h"
+#include "../fcntl.h"
 #include "stat.h"
 
 void copy_stat_buf(linux_stat* dst, struct stat* src) {
@@ -77,6 +78,13 @@ int shim___fxstat64_impl(int ver, int fd, linux_stat64* stat_buf) {
 
 int shim___lxstat_impl(int ver, const char* path, linux_stat* stat_buf) {
 
+  if (vfile_exists(path)) {
+    struct stat sb;
+    vfile_stat(path, &sb);
+    copy_stat_buf(stat_buf, &sb);
+    return 0;
+  }
+
   struct stat sb;
 
   int err = lstat(redirect(path), &sb);
@@ -89,6 +97,13 @@ int shim___lxstat_impl(int ver, const char* path, linux_stat* stat_buf) {
 
 int shim___lxstat64_impl(int ver, const char* path, linux_stat64* stat_buf) {
 
+  if (vfile_exists(path)) {
+    struct stat sb;
+    vfile_stat(path, &sb);
+    copy_stat_buf64(stat_buf, &sb);
+    return 0;
+  }
+
   struct stat sb;
 
   int err = lstat(redirect(path), &sb);
@@ -128,9 +143,22 @@ static uint64_t make_dev_id(uint32_t major, uint32_t minor) {
 
 int shim___xstat_impl(int ver, const char* path, linux_stat* stat_buf) {
 
+  if (vfile_exists(path)) {
+    struct stat sb;
+    vfile_stat(path, &sb);
+    copy_stat_buf(stat_buf, &sb);
+    return 0;
+  }
+
+  const char* p = redirect(path);
+  if (p == NULL) {
+    errno = EACCES;
+    return -1;
+  }
+
   struct stat sb;
 
-  int err = stat(path, &sb);
+  int err = stat(p, &sb);
   if (err == 0) {
     copy_stat_buf(stat_buf, &sb);
     FIX_NV_DEV_ID(path, stat_buf);
@@ -141,9 +169,73 @@ int shim___xstat_impl(int ver, const char* path, linux_stat* stat_buf) {
 
 int shim___xstat64_impl(int ver, const char* path, linux_stat64* stat_buf) {
 
+  if (vfile_exists(path)) {
+    struct stat sb;
+    vfile_stat(path, &sb);
+    copy_stat_buf64(stat_buf, &sb);
+    return 0;
+  }
+
+  const char* p = redirect(path);
+  if (p == NULL) {
+    errno = EACCES;
+    return -1;
+  }
+
+  struct stat sb;
+
+  int err = stat(p, &sb);
+  if (err == 0) {
+    copy_stat_buf64(stat_buf, &sb);
+    FIX_NV_DEV_ID(path, stat_buf);
+  }
+
+  return err;
+}
+
+// paths that stat() would see go through the same virtual files and redirects
+static int fstatat_native(int dirfd, const char* path, struct stat* sb, int linux_flags) {
+
+  if ((linux_flags & LINUX_AT_EMPTY_PATH) && path[0] == '\0') {
+    return dirfd == LINUX_AT_FDCWD ? stat(".", sb) : fstat(dirfd, sb);
+  }
+
+  if (dirfd == LINUX_AT_FDCWD || path[0] == '/') {
+
+    if (vfile_exists(path)) {
+      return vfile_stat(path, sb);
+    }
+
+    path = redirect(path);
+    if (path == NULL) {
+      errno = EACCES;
+      return -1;
+    }
+
+    dirfd = AT_FDCWD;
+  }
+
+  return fstatat(dirfd, path, sb, (linux_flags & LINUX_AT_SYMLINK_NOFOLLOW) ? AT_SYMLINK_NOFOLLOW : 0);
+}
+
+int shim___fxstatat_impl(int ver, int dirfd, const char* path, linux_stat* stat_buf, int linux_flags) {
+
+  struct stat sb;
+
+  int err = fstatat_native(dirfd, path, &sb, linux_flags);
+  if (err == 0) {
+    copy_stat_buf(stat_buf, &sb);
+    FIX_NV_DEV_ID(path, stat_buf);
+  }
+
+  return err;
+}
+
+int shim___fxstatat64_impl(int ver, int dirfd, const char* path, linux_stat64* stat_buf, int linux_flags) {
+
   struct stat sb;
 
-  int err = stat(path, &sb);
+  int err = fstatat_native(dirfd, path, &sb, linux_flags);
   if (err == 0) {
     copy_stat_buf64(stat_buf, &sb);
     FIX_NV_DEV_ID(path, stat_buf);
@@ -159,6 +251,8 @@ int shim_chmod_impl(const char* path, linux_mode_t mode) {
 
 SHIM_WRAP(__fxstat);
 SHIM_WRAP(__fxstat64);
+SHIM_WRAP(__fxstatat);
+SHIM_WRAP(__fxstatat64);
 SHIM_WRAP(__lxstat);
 SHIM_WRAP(__lxstat64);
 SHIM_WRAP(__xmknod);
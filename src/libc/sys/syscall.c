@@ -1,16 +1,22 @@
 #include <assert.h>
 #include <errno.h>
 #include <pthread_np.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/param.h>
 #include <sys/mman.h>
 #include <sys/thr.h>
 
 #include "../time.h"
 #include "../../shim.h"
+#include "socket.h"
+
+#define LINUX_CLOSE_RANGE_UNSHARE (1 << 1)
+#define LINUX_CLOSE_RANGE_CLOEXEC (1 << 2)
 
 #ifdef __i386__
 #define LINUX_WRITE             4
@@ -21,10 +27,21 @@
 #define LINUX_FUTEX           240
 #define LINUX_CLOCK_GETTIME   265
 #define LINUX_TGKILL          270
+#define LINUX_MBIND           274
+#define LINUX_GET_MEMPOLICY   275
+#define LINUX_SET_MEMPOLICY   276
+#define LINUX_SET_ROBUST_LIST 311
 #define LINUX_GET_ROBUST_LIST 312
+#define LINUX_MOVE_PAGES      317
+#define LINUX_GETCPU          318
 #define LINUX_PIPE2           331
+#define LINUX_PRLIMIT64       340
 #define LINUX_GETRANDOM       355
 #define LINUX_MEMFD_CREATE    356
+#define LINUX_MEMBARRIER      375
+#define LINUX_RSEQ            386
+#define LINUX_CLOSE_RANGE     436
+#define LINUX_FUTEX_WAITV     449
 #endif
 
 #ifdef __x86_64__
@@ -37,10 +54,21 @@
 #define LINUX_FUTEX           202
 #define LINUX_CLOCK_GETTIME   228
 #define LINUX_TGKILL          234
+#define LINUX_MBIND           237
+#define LINUX_SET_MEMPOLICY   238
+#define LINUX_GET_MEMPOLICY   239
+#define LINUX_SET_ROBUST_LIST 273
 #define LINUX_GET_ROBUST_LIST 274
+#define LINUX_MOVE_PAGES      279
 #define LINUX_PIPE2           293
+#define LINUX_PRLIMIT64       302
+#define LINUX_GETCPU          309
 #define LINUX_GETRANDOM       318
 #define LINUX_MEMFD_CREATE    319
+#define LINUX_MEMBARRIER      324
+#define LINUX_RSEQ            334
+#define LINUX_CLOSE_RANGE     436
+#define LINUX_FUTEX_WAITV     449
 #endif
 
 void* shim_mmap_impl(void*, size_t, int, int, int, linux_off_t);
@@ -120,8 +148,22 @@ long shim_syscall_impl(long number, va_list args) {
   }
 
   if (number == LINUX_FUTEX) {
-    errno = native_to_linux_errno(ENOSYS);
-    return -1;
+
+    long futex(uint32_t*, int, uint32_t, const linux_timespec*, uint32_t*, uint32_t);
+
+    uint32_t*             uaddr   = va_arg(args, uint32_t*);
+    int                   op      = va_arg(args, int);
+    uint32_t              val     = va_arg(args, uint32_t);
+    const linux_timespec* timeout = va_arg(args, const linux_timespec*);
+    uint32_t*             uaddr2  = va_arg(args, uint32_t*);
+    uint32_t              val3    = va_arg(args, uint32_t);
+
+    LOG("%s: futex(%p, %d, %u, %p, %p, %u)", __func__, uaddr, op, val, timeout, uaddr2, val3);
+
+    long err = futex(uaddr, op, val, timeout, uaddr2, val3);
+    LOG("%s: futex -> %ld", __func__, err);
+
+    return err;
   }
 
   if (number == LINUX_CLOCK_GETTIME) {
@@ -154,6 +196,23 @@ long shim_syscall_impl(long number, va_list args) {
     return err;
   }
 
+  if (number == LINUX_SET_ROBUST_LIST) {
+
+    typedef void robust_list_head;
+
+    long set_robust_list(robust_list_head*, size_t);
+
+    robust_list_head* head = va_arg(args, robust_list_head*);
+    size_t            len  = va_arg(args, size_t);
+
+    LOG("%s: set_robust_list(%p, %zu)", __func__, head, len);
+
+    int err = set_robust_list(head, len);
+    LOG("%s: set_robust_list -> %d", __func__, err);
+
+    return err;
+  }
+
   if (number == LINUX_GET_ROBUST_LIST) {
 
     typedef void robust_list_head;
@@ -164,11 +223,7 @@ long shim_syscall_impl(long number, va_list args) {
     robust_list_head** list_head  = va_arg(args, robust_list_head**);
     size_t*            struct_len = va_arg(args, size_t*);
 
-#if DEBUG
-    LOG("%s: get_robust_list(%d, %p, %p)\n", __func__, pid, list_head, struct_len);
-#else
-    fprintf(stderr, "%s [get_robust_list]: nothing to see here, move along\n", __func__);
-#endif
+    LOG("%s: get_robust_list(%d, %p, %p)", __func__, pid, list_head, struct_len);
 
     int err = get_robust_list(pid, list_head, struct_len);
     LOG("%s: get_robust_list -> %d", __func__, err);
@@ -196,6 +251,190 @@ long shim_syscall_impl(long number, va_list args) {
     return -1;
   }
 
+  if (number == LINUX_FUTEX_WAITV) {
+
+    typedef void linux_futex_waitv;
+
+    long futex_waitv(linux_futex_waitv*, unsigned int, unsigned int, const linux_timespec*, linux_clockid_t);
+
+    linux_futex_waitv*    waiters    = va_arg(args, linux_futex_waitv*);
+    unsigned int          nr_futexes = va_arg(args, unsigned int);
+    unsigned int          flags      = va_arg(args, unsigned int);
+    const linux_timespec* timeout    = va_arg(args, const linux_timespec*);
+    linux_clockid_t       clock_id   = va_arg(args, linux_clockid_t);
+
+    LOG("%s: futex_waitv(%p, %u, %u, %p, %d)", __func__, waiters, nr_futexes, flags, timeout, clock_id);
+
+    long err = futex_waitv(waiters, nr_futexes, flags, timeout, clock_id);
+    LOG("%s: futex_waitv -> %ld", __func__, err);
+
+    return err;
+  }
+
+  if (number == LINUX_MEMBARRIER) {
+
+    long linux_membarrier(int, unsigned int, int);
+
+    int          cmd    = va_arg(args, int);
+    unsigned int flags  = va_arg(args, unsigned int);
+    int          cpu_id = va_arg(args, int);
+
+    LOG("%s: membarrier(%d, %u, %d)", __func__, cmd, flags, cpu_id);
+
+    long err = linux_membarrier(cmd, flags, cpu_id);
+    LOG("%s: membarrier -> %ld", __func__, err);
+
+    return err;
+  }
+
+  if (number == LINUX_MBIND) {
+
+    long linux_mbind(void*, unsigned long, int, const unsigned long*, unsigned long, unsigned int);
+
+    void*                addr     = va_arg(args, void*);
+    unsigned long        len      = va_arg(args, unsigned long);
+    int                  mode     = va_arg(args, int);
+    const unsigned long* nodemask = va_arg(args, const unsigned long*);
+    unsigned long        maxnode  = va_arg(args, unsigned long);
+    unsigned int         flags    = va_arg(args, unsigned int);
+
+    LOG("%s: mbind(%p, %lu, %d, %p, %lu, 0x%x)", __func__, addr, len, mode, nodemask, maxnode, flags);
+
+    long err = linux_mbind(addr, len, mode, nodemask, maxnode, flags);
+    LOG("%s: mbind -> %ld", __func__, err);
+
+    return err;
+  }
+
+  if (number == LINUX_SET_MEMPOLICY) {
+
+    long linux_set_mempolicy(int, const unsigned long*, unsigned long);
+
+    int                  mode     = va_arg(args, int);
+    const unsigned long* nodemask = va_arg(args, const unsigned long*);
+    unsigned long        maxnode  = va_arg(args, unsigned long);
+
+    LOG("%s: set_mempolicy(%d, %p, %lu)", __func__, mode, nodemask, maxnode);
+
+    long err = linux_set_mempolicy(mode, nodemask, maxnode);
+    LOG("%s: set_mempolicy -> %ld", __func__, err);
+
+    return err;
+  }
+
+  if (number == LINUX_GET_MEMPOLICY) {
+
+    long linux_get_mempolicy(int*, unsigned long*, unsigned long, void*, unsigned long);
+
+    int*           mode     = va_arg(args, int*);
+    unsigned long* nodemask = va_arg(args, unsigned long*);
+    unsigned long  maxnode  = va_arg(args, unsigned long);
+    void*          addr     = va_arg(args, void*);
+    unsigned long  flags    = va_arg(args, unsigned long);
+
+    LOG("%s: get_mempolicy(%p, %p, %lu, %p, 0x%lx)", __func__, mode, nodemask, maxnode, addr, flags);
+
+    long err = linux_get_mempolicy(mode, nodemask, maxnode, addr, flags);
+    LOG("%s: get_mempolicy -> %ld", __func__, err);
+
+    return err;
+  }
+
+  if (number == LINUX_MOVE_PAGES) {
+
+    long linux_move_pages(int, unsigned long, void**, const int*, int*, int);
+
+    int           pid    = va_arg(args, int);
+    unsigned long count  = va_arg(args, unsigned long);
+    void**        pages  = va_arg(args, void**);
+    const int*    nodes  = va_arg(args, const int*);
+    int*          status = va_arg(args, int*);
+    int           flags  = va_arg(args, int);
+
+    LOG("%s: move_pages(%d, %lu, %p, %p, %p, 0x%x)", __func__, pid, count, pages, nodes, status, flags);
+
+    long err = linux_move_pages(pid, count, pages, nodes, status, flags);
+    LOG("%s: move_pages -> %ld", __func__, err);
+
+    return err;
+  }
+
+  if (number == LINUX_GETCPU) {
+
+    int shim_getcpu_impl(unsigned int*, unsigned int*);
+
+    unsigned int* cpu  = va_arg(args, unsigned int*);
+    unsigned int* node = va_arg(args, unsigned int*);
+
+    LOG("%s: getcpu(%p, %p)", __func__, cpu, node);
+
+    int err = shim_getcpu_impl(cpu, node);
+    LOG("%s: getcpu -> %d", __func__, err);
+
+    return err;
+  }
+
+  if (number == LINUX_PRLIMIT64) {
+
+    int shim_prlimit64_impl(pid_t, int, const void*, void*);
+
+    pid_t       pid       = va_arg(args, pid_t);
+    int         resource  = va_arg(args, int);
+    const void* new_limit = va_arg(args, const void*);
+    void*       old_limit = va_arg(args, void*);
+
+    LOG("%s: prlimit64(%d, %d, %p, %p)", __func__, pid, resource, new_limit, old_limit);
+
+    int err = shim_prlimit64_impl(pid, resource, new_limit, old_limit);
+    LOG("%s: prlimit64 -> %d", __func__, err);
+
+    return err;
+  }
+
+  if (number == LINUX_CLOSE_RANGE) {
+
+    unsigned int first = va_arg(args, unsigned int);
+    unsigned int last  = va_arg(args, unsigned int);
+    unsigned int flags = va_arg(args, unsigned int);
+
+    LOG("%s: close_range(%u, %u, 0x%x)", __func__, first, last, flags);
+
+    // the descriptor table is never shared with another process here, nothing to unshare
+    if ((flags & (LINUX_CLOSE_RANGE_UNSHARE | LINUX_CLOSE_RANGE_CLOEXEC)) != flags) {
+      errno = native_to_linux_errno(EINVAL);
+      return -1;
+    }
+
+    int native_flags = 0;
+
+    if (flags & LINUX_CLOSE_RANGE_CLOEXEC) {
+#ifdef CLOSE_RANGE_CLOEXEC
+      native_flags |= CLOSE_RANGE_CLOEXEC;
+#else
+      errno = native_to_linux_errno(EINVAL);
+      return -1;
+#endif
+    }
+
+    int err = close_range(first, last, native_flags);
+    if (err == -1) {
+      errno = native_to_linux_errno(errno);
+    } else if (native_flags == 0) {
+      forget_socket_state(MIN(first, INT_MAX), MIN(last, INT_MAX));
+    }
+
+    LOG("%s: close_range -> %d", __func__, err);
+
+    return err;
+  }
+
+  if (number == LINUX_RSEQ) {
+    // restartable sequences need kernel support; callers fall back to sched_getcpu
+    LOG("%s: rseq(...) -> ENOSYS", __func__);
+    errno = native_to_linux_errno(ENOSYS);
+    return -1;
+  }
+
   if (number == LINUX_MEMFD_CREATE) {
 #if __FreeBSD_version >= 1300139
     char* name  = va_arg(args, char*);
@@ -1,6 +1,43 @@
 #include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/param.h>
+#include <sys/sysctl.h>
+#include <sys/user.h>
+#include <vm/vm_param.h>
 #include "../../shim.h"
+#include "sysinfo.h"
+
+#define LINUX_SI_LOAD_SHIFT 16
+
+struct linux_sysinfo {
+  long           uptime;
+  unsigned long  loads[3];
+  unsigned long  totalram;
+  unsigned long  freeram;
+  unsigned long  sharedram;
+  unsigned long  bufferram;
+  unsigned long  totalswap;
+  unsigned long  freeswap;
+  unsigned short procs;
+  unsigned short pad;
+  unsigned long  totalhigh;
+  unsigned long  freehigh;
+  unsigned int   mem_unit;
+  char           _f[20 - 2 * sizeof(long) - sizeof(int)];
+};
+
+#ifdef __i386__
+_Static_assert(sizeof(struct linux_sysinfo) == 64, "");
+#endif
+
+#ifdef __x86_64__
+_Static_assert(sizeof(struct linux_sysinfo) == 112, "");
+#endif
 
 int shim_get_nprocs_impl() {
   return sysconf(_SC_NPROCESSORS_CONF);
@@ -8,8 +45,88 @@ int shim_get_nprocs_impl() {
 
 SHIM_WRAP(get_nprocs);
 
-int shim_sysinfo_impl(void* info) {
-  return -1;
+void native_swap_usage(unsigned long* total, unsigned long* used) {
+
+  *total = 0;
+  *used  = 0;
+
+  int mib[16];
+  size_t mib_len = nitems(mib) - 1;
+
+  if (sysctlnametomib("vm.swap_info", mib, &mib_len) == -1) {
+    return;
+  }
+
+  for (int i = 0; ; i++) {
+
+    mib[mib_len] = i;
+
+    struct xswdev xsw;
+    size_t len = sizeof(xsw);
+
+    if (sysctl(mib, mib_len + 1, &xsw, &len, NULL, 0) == -1) {
+      break;
+    }
+
+    *total += xsw.xsw_nblks;
+    *used  += xsw.xsw_used;
+  }
+}
+
+static unsigned short count_procs() {
+
+  int mib[3] = { CTL_KERN, KERN_PROC, KERN_PROC_PROC };
+  size_t len = 0;
+
+  if (sysctl(mib, 3, NULL, &len, NULL, 0) == -1) {
+    return 0;
+  }
+
+  // the size estimate is padded by five entries
+  size_t count = len / sizeof(struct kinfo_proc);
+  count = count > 5 ? count - 5 : count;
+
+  return MIN(count, USHRT_MAX);
+}
+
+int shim_sysinfo_impl(linux_sysinfo* info) {
+
+  memset(info, 0, sizeof(*info));
+
+  struct timespec uptime;
+  assert(clock_gettime(CLOCK_UPTIME, &uptime) == 0);
+
+  double loads[3] = {0};
+  getloadavg(loads, 3);
+
+  uint64_t page_size = getpagesize();
+
+  unsigned long swap_total, swap_used;
+  native_swap_usage(&swap_total, &swap_used);
+
+  uint64_t totalram  = sysctl_ulong("hw.physmem");
+  uint64_t freeram   = sysctl_ulong("vm.stats.vm.v_free_count") * page_size;
+  uint64_t bufferram = sysctl_ulong("vfs.bufspace");
+  uint64_t totalswap = swap_total * page_size;
+  uint64_t freeswap  = (swap_total - swap_used) * page_size;
+
+  // like Linux, switch to page units when bytes don't fit (i386)
+  uint64_t mem_unit = (totalram + totalswap > ULONG_MAX) ? page_size : 1;
+
+  info->uptime    = uptime.tv_sec;
+  info->totalram  = totalram  / mem_unit;
+  info->freeram   = freeram   / mem_unit;
+  info->bufferram = bufferram / mem_unit;
+  info->totalswap = totalswap / mem_unit;
+  info->freeswap  = freeswap  / mem_unit;
+  info->procs     = count_procs();
+  info->mem_unit  = mem_unit;
+
+  for (int i = 0; i < 3; i++) {
+    info->loads[i] = loads[i] * (1 << LINUX_SI_LOAD_SHIFT);
+  }
+
+  return 0;
 }
 
 SHIM_WRAP(sysinfo);
@@ -0,0 +1,4 @@
+#pragma once
+
+// configured and used swap, in pages
+void native_swap_usage(unsigned long* total, unsigned long* used);
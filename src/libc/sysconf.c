@@ -0,0 +1,463 @@
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/sysctl.h>
+#include "../shim.h"
+#include "../cpuinfo.h"
+
+#define GLIBC_SC_ARG_MAX                          0
+#define GLIBC_SC_CHILD_MAX                        1
+#define GLIBC_SC_CLK_TCK                          2
+#define GLIBC_SC_NGROUPS_MAX                      3
+#define GLIBC_SC_OPEN_MAX                         4
+#define GLIBC_SC_STREAM_MAX                       5
+#define GLIBC_SC_TZNAME_MAX                       6
+#define GLIBC_SC_JOB_CONTROL                      7
+#define GLIBC_SC_SAVED_IDS                        8
+#define GLIBC_SC_REALTIME_SIGNALS                 9
+#define GLIBC_SC_PRIORITY_SCHEDULING             10
+#define GLIBC_SC_TIMERS                          11
+#define GLIBC_SC_ASYNCHRONOUS_IO                 12
+#define GLIBC_SC_PRIORITIZED_IO                  13
+#define GLIBC_SC_SYNCHRONIZED_IO                 14
+#define GLIBC_SC_FSYNC                           15
+#define GLIBC_SC_MAPPED_FILES                    16
+#define GLIBC_SC_MEMLOCK                         17
+#define GLIBC_SC_MEMLOCK_RANGE                   18
+#define GLIBC_SC_MEMORY_PROTECTION               19
+#define GLIBC_SC_MESSAGE_PASSING                 20
+#define GLIBC_SC_SEMAPHORES                      21
+#define GLIBC_SC_SHARED_MEMORY_OBJECTS           22
+#define GLIBC_SC_AIO_LISTIO_MAX                  23
+#define GLIBC_SC_AIO_MAX                         24
+#define GLIBC_SC_AIO_PRIO_DELTA_MAX              25
+#define GLIBC_SC_DELAYTIMER_MAX                  26
+#define GLIBC_SC_MQ_OPEN_MAX                     27
+#define GLIBC_SC_MQ_PRIO_MAX                     28
+#define GLIBC_SC_VERSION                         29
+#define GLIBC_SC_PAGESIZE                        30
+#define GLIBC_SC_RTSIG_MAX                       31
+#define GLIBC_SC_SEM_NSEMS_MAX                   32
+#define GLIBC_SC_SEM_VALUE_MAX                   33
+#define GLIBC_SC_SIGQUEUE_MAX                    34
+#define GLIBC_SC_TIMER_MAX                       35
+#define GLIBC_SC_BC_BASE_MAX                     36
+#define GLIBC_SC_BC_DIM_MAX                      37
+#define GLIBC_SC_BC_SCALE_MAX                    38
+#define GLIBC_SC_BC_STRING_MAX                   39
+#define GLIBC_SC_COLL_WEIGHTS_MAX                40
+#define GLIBC_SC_EQUIV_CLASS_MAX                 41
+#define GLIBC_SC_EXPR_NEST_MAX                   42
+#define GLIBC_SC_LINE_MAX                        43
+#define GLIBC_SC_RE_DUP_MAX                      44
+#define GLIBC_SC_CHARCLASS_NAME_MAX              45
+#define GLIBC_SC_2_VERSION                       46
+#define GLIBC_SC_2_C_BIND                        47
+#define GLIBC_SC_2_C_DEV                         48
+#define GLIBC_SC_2_FORT_DEV                      49
+#define GLIBC_SC_2_FORT_RUN                      50
+#define GLIBC_SC_2_SW_DEV                        51
+#define GLIBC_SC_2_LOCALEDEF                     52
+#define GLIBC_SC_PII                             53
+#define GLIBC_SC_PII_XTI                         54
+#define GLIBC_SC_PII_SOCKET                      55
+#define GLIBC_SC_PII_INTERNET                    56
+#define GLIBC_SC_PII_OSI                         57
+#define GLIBC_SC_POLL                            58
+#define GLIBC_SC_SELECT                          59
+#define GLIBC_SC_IOV_MAX                         60
+#define GLIBC_SC_PII_INTERNET_STREAM             61
+#define GLIBC_SC_PII_INTERNET_DGRAM              62
+#define GLIBC_SC_PII_OSI_COTS                    63
+#define GLIBC_SC_PII_OSI_CLTS                    64
+#define GLIBC_SC_PII_OSI_M                       65
+#define GLIBC_SC_T_IOV_MAX                       66
+#define GLIBC_SC_THREADS                         67
+#define GLIBC_SC_THREAD_SAFE_FUNCTIONS           68
+#define GLIBC_SC_GETGR_R_SIZE_MAX                69
+#define GLIBC_SC_GETPW_R_SIZE_MAX                70
+#define GLIBC_SC_LOGIN_NAME_MAX                  71
+#define GLIBC_SC_TTY_NAME_MAX                    72
+#define GLIBC_SC_THREAD_DESTRUCTOR_ITERATIONS    73
+#define GLIBC_SC_THREAD_KEYS_MAX                 74
+#define GLIBC_SC_THREAD_STACK_MIN                75
+#define GLIBC_SC_THREAD_THREADS_MAX              76
+#define GLIBC_SC_THREAD_ATTR_STACKADDR           77
+#define GLIBC_SC_THREAD_ATTR_STACKSIZE           78
+#define GLIBC_SC_THREAD_PRIORITY_SCHEDULING      79
+#define GLIBC_SC_THREAD_PRIO_INHERIT             80
+#define GLIBC_SC_THREAD_PRIO_PROTECT             81
+#define GLIBC_SC_THREAD_PROCESS_SHARED           82
+#define GLIBC_SC_NPROCESSORS_CONF                83
+#define GLIBC_SC_NPROCESSORS_ONLN                84
+#define GLIBC_SC_PHYS_PAGES                      85
+#define GLIBC_SC_AVPHYS_PAGES                    86
+#define GLIBC_SC_ATEXIT_MAX                      87
+#define GLIBC_SC_PASS_MAX                        88
+#define GLIBC_SC_XOPEN_VERSION                   89
+#define GLIBC_SC_XOPEN_XCU_VERSION               90
+#define GLIBC_SC_XOPEN_UNIX                      91
+#define GLIBC_SC_XOPEN_CRYPT                     92
+#define GLIBC_SC_XOPEN_ENH_I18N                  93
+#define GLIBC_SC_XOPEN_SHM                       94
+#define GLIBC_SC_2_CHAR_TERM                     95
+#define GLIBC_SC_2_C_VERSION                     96
+#define GLIBC_SC_2_UPE                           97
+#define GLIBC_SC_XOPEN_XPG2                      98
+#define GLIBC_SC_XOPEN_XPG3                      99
+#define GLIBC_SC_XOPEN_XPG4                     100
+#define GLIBC_SC_CHAR_BIT                       101
+#define GLIBC_SC_CHAR_MAX                       102
+#define GLIBC_SC_CHAR_MIN                       103
+#define GLIBC_SC_INT_MAX                        104
+#define GLIBC_SC_INT_MIN                        105
+#define GLIBC_SC_LONG_BIT                       106
+#define GLIBC_SC_WORD_BIT                       107
+#define GLIBC_SC_MB_LEN_MAX                     108
+#define GLIBC_SC_NZERO                          109
+#define GLIBC_SC_SSIZE_MAX                      110
+#define GLIBC_SC_SCHAR_MAX                      111
+#define GLIBC_SC_SCHAR_MIN                      112
+#define GLIBC_SC_SHRT_MAX                       113
+#define GLIBC_SC_SHRT_MIN                       114
+#define GLIBC_SC_UCHAR_MAX                      115
+#define GLIBC_SC_UINT_MAX                       116
+#define GLIBC_SC_ULONG_MAX                      117
+#define GLIBC_SC_USHRT_MAX                      118
+#define GLIBC_SC_NL_ARGMAX                      119
+#define GLIBC_SC_NL_LANGMAX                     120
+#define GLIBC_SC_NL_MSGMAX                      121
+#define GLIBC_SC_NL_NMAX                        122
+#define GLIBC_SC_NL_SETMAX                      123
+#define GLIBC_SC_NL_TEXTMAX                     124
+#define GLIBC_SC_XBS5_ILP32_OFF32               125
+#define GLIBC_SC_XBS5_ILP32_OFFBIG              126
+#define GLIBC_SC_XBS5_LP64_OFF64                127
+#define GLIBC_SC_XBS5_LPBIG_OFFBIG              128
+#define GLIBC_SC_XOPEN_LEGACY                   129
+#define GLIBC_SC_XOPEN_REALTIME                 130
+#define GLIBC_SC_XOPEN_REALTIME_THREADS         131
+#define GLIBC_SC_ADVISORY_INFO                  132
+#define GLIBC_SC_BARRIERS                       133
+#define GLIBC_SC_BASE                           134
+#define GLIBC_SC_C_LANG_SUPPORT                 135
+#define GLIBC_SC_C_LANG_SUPPORT_R               136
+#define GLIBC_SC_CLOCK_SELECTION                137
+#define GLIBC_SC_CPUTIME                        138
+#define GLIBC_SC_THREAD_CPUTIME                 139
+#define GLIBC_SC_DEVICE_IO                      140
+#define GLIBC_SC_DEVICE_SPECIFIC                141
+#define GLIBC_SC_DEVICE_SPECIFIC_R              142
+#define GLIBC_SC_FD_MGMT                        143
+#define GLIBC_SC_FIFO                           144
+#define GLIBC_SC_PIPE                           145
+#define GLIBC_SC_FILE_ATTRIBUTES                146
+#define GLIBC_SC_FILE_LOCKING                   147
+#define GLIBC_SC_FILE_SYSTEM                    148
+#define GLIBC_SC_MONOTONIC_CLOCK                149
+#define GLIBC_SC_MULTI_PROCESS                  150
+#define GLIBC_SC_SINGLE_PROCESS                 151
+#define GLIBC_SC_NETWORKING                     152
+#define GLIBC_SC_READER_WRITER_LOCKS            153
+#define GLIBC_SC_SPIN_LOCKS                     154
+#define GLIBC_SC_REGEXP                         155
+#define GLIBC_SC_REGEX_VERSION                  156
+#define GLIBC_SC_SHELL                          157
+#define GLIBC_SC_SIGNALS                        158
+#define GLIBC_SC_SPAWN                          159
+#define GLIBC_SC_SPORADIC_SERVER                160
+#define GLIBC_SC_THREAD_SPORADIC_SERVER         161
+#define GLIBC_SC_SYSTEM_DATABASE                162
+#define GLIBC_SC_SYSTEM_DATABASE_R              163
+#define GLIBC_SC_TIMEOUTS                       164
+#define GLIBC_SC_TYPED_MEMORY_OBJECTS           165
+#define GLIBC_SC_USER_GROUPS                    166
+#define GLIBC_SC_USER_GROUPS_R                  167
+#define GLIBC_SC_2_PBS                          168
+#define GLIBC_SC_2_PBS_ACCOUNTING               169
+#define GLIBC_SC_2_PBS_LOCATE                   170
+#define GLIBC_SC_2_PBS_MESSAGE                  171
+#define GLIBC_SC_2_PBS_TRACK                    172
+#define GLIBC_SC_SYMLOOP_MAX                    173
+#define GLIBC_SC_STREAMS                        174
+#define GLIBC_SC_2_PBS_CHECKPOINT               175
+#define GLIBC_SC_V6_ILP32_OFF32                 176
+#define GLIBC_SC_V6_ILP32_OFFBIG                177
+#define GLIBC_SC_V6_LP64_OFF64                  178
+#define GLIBC_SC_V6_LPBIG_OFFBIG                179
+#define GLIBC_SC_HOST_NAME_MAX                  180
+#define GLIBC_SC_TRACE                          181
+#define GLIBC_SC_TRACE_EVENT_FILTER             182
+#define GLIBC_SC_TRACE_INHERIT                  183
+#define GLIBC_SC_TRACE_LOG                      184
+#define GLIBC_SC_LEVEL1_ICACHE_SIZE             185
+#define GLIBC_SC_LEVEL1_ICACHE_ASSOC            186
+#define GLIBC_SC_LEVEL1_ICACHE_LINESIZE         187
+#define GLIBC_SC_LEVEL1_DCACHE_SIZE             188
+#define GLIBC_SC_LEVEL1_DCACHE_ASSOC            189
+#define GLIBC_SC_LEVEL1_DCACHE_LINESIZE         190
+#define GLIBC_SC_LEVEL2_CACHE_SIZE              191
+#define GLIBC_SC_LEVEL2_CACHE_ASSOC             192
+#define GLIBC_SC_LEVEL2_CACHE_LINESIZE          193
+#define GLIBC_SC_LEVEL3_CACHE_SIZE              194
+#define GLIBC_SC_LEVEL3_CACHE_ASSOC             195
+#define GLIBC_SC_LEVEL3_CACHE_LINESIZE          196
+#define GLIBC_SC_LEVEL4_CACHE_SIZE              197
+#define GLIBC_SC_LEVEL4_CACHE_ASSOC             198
+#define GLIBC_SC_LEVEL4_CACHE_LINESIZE          199
+#define GLIBC_SC_IPV6                           235
+#define GLIBC_SC_RAW_SOCKETS                    236
+#define GLIBC_SC_V7_ILP32_OFF32                 237
+#define GLIBC_SC_V7_ILP32_OFFBIG                238
+#define GLIBC_SC_V7_LP64_OFF64                  239
+#define GLIBC_SC_V7_LPBIG_OFFBIG                240
+#define GLIBC_SC_SS_REPL_MAX                    241
+#define GLIBC_SC_TRACE_EVENT_NAME_MAX           242
+#define GLIBC_SC_TRACE_NAME_MAX                 243
+#define GLIBC_SC_TRACE_SYS_MAX                  244
+#define GLIBC_SC_TRACE_USER_EVENT_MAX           245
+#define GLIBC_SC_XOPEN_STREAMS                  246
+#define GLIBC_SC_THREAD_ROBUST_PRIO_INHERIT     247
+#define GLIBC_SC_THREAD_ROBUST_PRIO_PROTECT     248
+#define GLIBC_SC_MINSIGSTKSZ                    249
+#define GLIBC_SC_SIGSTKSZ                       250
+
+// glibc names with a FreeBSD counterpart; XBS5 and V7 environments are the V6 ones
+static const int native_names[] = {
+  [GLIBC_SC_ARG_MAX]                      = _SC_ARG_MAX,
+  [GLIBC_SC_CHILD_MAX]                    = _SC_CHILD_MAX,
+  [GLIBC_SC_NGROUPS_MAX]                  = _SC_NGROUPS_MAX,
+  [GLIBC_SC_OPEN_MAX]                     = _SC_OPEN_MAX,
+  [GLIBC_SC_STREAM_MAX]                   = _SC_STREAM_MAX,
+  [GLIBC_SC_TZNAME_MAX]                   = _SC_TZNAME_MAX,
+  [GLIBC_SC_JOB_CONTROL]                  = _SC_JOB_CONTROL,
+  [GLIBC_SC_SAVED_IDS]                    = _SC_SAVED_IDS,
+  [GLIBC_SC_REALTIME_SIGNALS]             = _SC_REALTIME_SIGNALS,
+  [GLIBC_SC_PRIORITY_SCHEDULING]          = _SC_PRIORITY_SCHEDULING,
+  [GLIBC_SC_TIMERS]                       = _SC_TIMERS,
+  [GLIBC_SC_ASYNCHRONOUS_IO]              = _SC_ASYNCHRONOUS_IO,
+  [GLIBC_SC_PRIORITIZED_IO]               = _SC_PRIORITIZED_IO,
+  [GLIBC_SC_SYNCHRONIZED_IO]              = _SC_SYNCHRONIZED_IO,
+  [GLIBC_SC_FSYNC]                        = _SC_FSYNC,
+  [GLIBC_SC_MAPPED_FILES]                 = _SC_MAPPED_FILES,
+  [GLIBC_SC_MEMLOCK]                      = _SC_MEMLOCK,
+  [GLIBC_SC_MEMLOCK_RANGE]                = _SC_MEMLOCK_RANGE,
+  [GLIBC_SC_MEMORY_PROTECTION]            = _SC_MEMORY_PROTECTION,
+  [GLIBC_SC_MESSAGE_PASSING]              = _SC_MESSAGE_PASSING,
+  [GLIBC_SC_SEMAPHORES]                   = _SC_SEMAPHORES,
+  [GLIBC_SC_SHARED_MEMORY_OBJECTS]        = _SC_SHARED_MEMORY_OBJECTS,
+  [GLIBC_SC_AIO_LISTIO_MAX]               = _SC_AIO_LISTIO_MAX,
+  [GLIBC_SC_AIO_MAX]                      = _SC_AIO_MAX,
+  [GLIBC_SC_AIO_PRIO_DELTA_MAX]           = _SC_AIO_PRIO_DELTA_MAX,
+  [GLIBC_SC_DELAYTIMER_MAX]               = _SC_DELAYTIMER_MAX,
+  [GLIBC_SC_MQ_OPEN_MAX]                  = _SC_MQ_OPEN_MAX,
+  [GLIBC_SC_MQ_PRIO_MAX]                  = _SC_MQ_PRIO_MAX,
+  [GLIBC_SC_VERSION]                      = _SC_VERSION,
+  [GLIBC_SC_PAGESIZE]                     = _SC_PAGESIZE,
+  [GLIBC_SC_RTSIG_MAX]                    = _SC_RTSIG_MAX,
+  [GLIBC_SC_SEM_NSEMS_MAX]                = _SC_SEM_NSEMS_MAX,
+  [GLIBC_SC_SEM_VALUE_MAX]                = _SC_SEM_VALUE_MAX,
+  [GLIBC_SC_SIGQUEUE_MAX]                 = _SC_SIGQUEUE_MAX,
+  [GLIBC_SC_TIMER_MAX]                    = _SC_TIMER_MAX,
+  [GLIBC_SC_BC_BASE_MAX]                  = _SC_BC_BASE_MAX,
+  [GLIBC_SC_BC_DIM_MAX]                   = _SC_BC_DIM_MAX,
+  [GLIBC_SC_BC_SCALE_MAX]                 = _SC_BC_SCALE_MAX,
+  [GLIBC_SC_BC_STRING_MAX]                = _SC_BC_STRING_MAX,
+  [GLIBC_SC_COLL_WEIGHTS_MAX]             = _SC_COLL_WEIGHTS_MAX,
+  [GLIBC_SC_EXPR_NEST_MAX]                = _SC_EXPR_NEST_MAX,
+  [GLIBC_SC_LINE_MAX]                     = _SC_LINE_MAX,
+  [GLIBC_SC_RE_DUP_MAX]                   = _SC_RE_DUP_MAX,
+  [GLIBC_SC_2_VERSION]                    = _SC_2_VERSION,
+  [GLIBC_SC_2_C_BIND]                     = _SC_2_C_BIND,
+  [GLIBC_SC_2_C_DEV]                      = _SC_2_C_DEV,
+  [GLIBC_SC_2_FORT_DEV]                   = _SC_2_FORT_DEV,
+  [GLIBC_SC_2_FORT_RUN]                   = _SC_2_FORT_RUN,
+  [GLIBC_SC_2_SW_DEV]                     = _SC_2_SW_DEV,
+  [GLIBC_SC_2_LOCALEDEF]                  = _SC_2_LOCALEDEF,
+  [GLIBC_SC_IOV_MAX]                      = _SC_IOV_MAX,
+  [GLIBC_SC_THREADS]                      = _SC_THREADS,
+  [GLIBC_SC_THREAD_SAFE_FUNCTIONS]        = _SC_THREAD_SAFE_FUNCTIONS,
+  [GLIBC_SC_GETGR_R_SIZE_MAX]             = _SC_GETGR_R_SIZE_MAX,
+  [GLIBC_SC_GETPW_R_SIZE_MAX]             = _SC_GETPW_R_SIZE_MAX,
+  [GLIBC_SC_LOGIN_NAME_MAX]               = _SC_LOGIN_NAME_MAX,
+  [GLIBC_SC_TTY_NAME_MAX]                 = _SC_TTY_NAME_MAX,
+  [GLIBC_SC_THREAD_DESTRUCTOR_ITERATIONS] = _SC_THREAD_DESTRUCTOR_ITERATIONS,
+  [GLIBC_SC_THREAD_KEYS_MAX]              = _SC_THREAD_KEYS_MAX,
+  [GLIBC_SC_THREAD_STACK_MIN]             = _SC_THREAD_STACK_MIN,
+  [GLIBC_SC_THREAD_THREADS_MAX]           = _SC_THREAD_THREADS_MAX,
+  [GLIBC_SC_THREAD_ATTR_STACKADDR]        = _SC_THREAD_ATTR_STACKADDR,
+  [GLIBC_SC_THREAD_ATTR_STACKSIZE]        = _SC_THREAD_ATTR_STACKSIZE,
+  [GLIBC_SC_THREAD_PRIORITY_SCHEDULING]   = _SC_THREAD_PRIORITY_SCHEDULING,
+  [GLIBC_SC_THREAD_PRIO_INHERIT]          = _SC_THREAD_PRIO_INHERIT,
+  [GLIBC_SC_THREAD_PRIO_PROTECT]          = _SC_THREAD_PRIO_PROTECT,
+  [GLIBC_SC_THREAD_PROCESS_SHARED]        = _SC_THREAD_PROCESS_SHARED,
+  [GLIBC_SC_NPROCESSORS_CONF]             = _SC_NPROCESSORS_CONF,
+  [GLIBC_SC_NPROCESSORS_ONLN]             = _SC_NPROCESSORS_ONLN,
+  [GLIBC_SC_PHYS_PAGES]                   = _SC_PHYS_PAGES,
+  [GLIBC_SC_ATEXIT_MAX]                   = _SC_ATEXIT_MAX,
+  [GLIBC_SC_XOPEN_VERSION]                = _SC_XOPEN_VERSION,
+  [GLIBC_SC_XOPEN_XCU_VERSION]            = _SC_XOPEN_XCU_VERSION,
+  [GLIBC_SC_XOPEN_UNIX]                   = _SC_XOPEN_UNIX,
+  [GLIBC_SC_XOPEN_CRYPT]                  = _SC_XOPEN_CRYPT,
+  [GLIBC_SC_XOPEN_ENH_I18N]               = _SC_XOPEN_ENH_I18N,
+  [GLIBC_SC_XOPEN_SHM]                    = _SC_XOPEN_SHM,
+  [GLIBC_SC_2_CHAR_TERM]                  = _SC_2_CHAR_TERM,
+  [GLIBC_SC_2_UPE]                        = _SC_2_UPE,
+  [GLIBC_SC_XBS5_ILP32_OFF32]             = _SC_V6_ILP32_OFF32,
+  [GLIBC_SC_XBS5_ILP32_OFFBIG]            = _SC_V6_ILP32_OFFBIG,
+  [GLIBC_SC_XBS5_LP64_OFF64]              = _SC_V6_LP64_OFF64,
+  [GLIBC_SC_XBS5_LPBIG_OFFBIG]            = _SC_V6_LPBIG_OFFBIG,
+  [GLIBC_SC_XOPEN_LEGACY]                 = _SC_XOPEN_LEGACY,
+  [GLIBC_SC_XOPEN_REALTIME]               = _SC_XOPEN_REALTIME,
+  [GLIBC_SC_XOPEN_REALTIME_THREADS]       = _SC_XOPEN_REALTIME_THREADS,
+  [GLIBC_SC_ADVISORY_INFO]                = _SC_ADVISORY_INFO,
+  [GLIBC_SC_BARRIERS]                     = _SC_BARRIERS,
+  [GLIBC_SC_CLOCK_SELECTION]              = _SC_CLOCK_SELECTION,
+  [GLIBC_SC_CPUTIME]                      = _SC_CPUTIME,
+  [GLIBC_SC_THREAD_CPUTIME]               = _SC_THREAD_CPUTIME,
+  [GLIBC_SC_FILE_LOCKING]                 = _SC_FILE_LOCKING,
+  [GLIBC_SC_MONOTONIC_CLOCK]              = _SC_MONOTONIC_CLOCK,
+  [GLIBC_SC_READER_WRITER_LOCKS]          = _SC_READER_WRITER_LOCKS,
+  [GLIBC_SC_SPIN_LOCKS]                   = _SC_SPIN_LOCKS,
+  [GLIBC_SC_REGEXP]                       = _SC_REGEXP,
+  [GLIBC_SC_SHELL]                        = _SC_SHELL,
+  [GLIBC_SC_SPAWN]                        = _SC_SPAWN,
+  [GLIBC_SC_SPORADIC_SERVER]              = _SC_SPORADIC_SERVER,
+  [GLIBC_SC_THREAD_SPORADIC_SERVER]       = _SC_THREAD_SPORADIC_SERVER,
+  [GLIBC_SC_TIMEOUTS]                     = _SC_TIMEOUTS,
+  [GLIBC_SC_TYPED_MEMORY_OBJECTS]         = _SC_TYPED_MEMORY_OBJECTS,
+  [GLIBC_SC_2_PBS]                        = _SC_2_PBS,
+  [GLIBC_SC_2_PBS_ACCOUNTING]             = _SC_2_PBS_ACCOUNTING,
+  [GLIBC_SC_2_PBS_LOCATE]                 = _SC_2_PBS_LOCATE,
+  [GLIBC_SC_2_PBS_MESSAGE]                = _SC_2_PBS_MESSAGE,
+  [GLIBC_SC_2_PBS_TRACK]                  = _SC_2_PBS_TRACK,
+  [GLIBC_SC_SYMLOOP_MAX]                  = _SC_SYMLOOP_MAX,
+  [GLIBC_SC_2_PBS_CHECKPOINT]             = _SC_2_PBS_CHECKPOINT,
+  [GLIBC_SC_V6_ILP32_OFF32]               = _SC_V6_ILP32_OFF32,
+  [GLIBC_SC_V6_ILP32_OFFBIG]              = _SC_V6_ILP32_OFFBIG,
+  [GLIBC_SC_V6_LP64_OFF64]                = _SC_V6_LP64_OFF64,
+  [GLIBC_SC_V6_LPBIG_OFFBIG]              = _SC_V6_LPBIG_OFFBIG,
+  [GLIBC_SC_HOST_NAME_MAX]                = _SC_HOST_NAME_MAX,
+  [GLIBC_SC_TRACE]                        = _SC_TRACE,
+  [GLIBC_SC_TRACE_EVENT_FILTER]           = _SC_TRACE_EVENT_FILTER,
+  [GLIBC_SC_TRACE_INHERIT]                = _SC_TRACE_INHERIT,
+  [GLIBC_SC_TRACE_LOG]                    = _SC_TRACE_LOG,
+  [GLIBC_SC_IPV6]                         = _SC_IPV6,
+  [GLIBC_SC_RAW_SOCKETS]                  = _SC_RAW_SOCKETS,
+  [GLIBC_SC_V7_ILP32_OFF32]               = _SC_V6_ILP32_OFF32,
+  [GLIBC_SC_V7_ILP32_OFFBIG]              = _SC_V6_ILP32_OFFBIG,
+  [GLIBC_SC_V7_LP64_OFF64]                = _SC_V6_LP64_OFF64,
+  [GLIBC_SC_V7_LPBIG_OFFBIG]              = _SC_V6_LPBIG_OFFBIG,
+};
+
+static pthread_once_t  cpu_info_once = PTHREAD_ONCE_INIT;
+static struct cpu_info cpu_info;
+
+static void init_cpu_info() {
+  read_cpuid(&cpu_info);
+}
+
+// _SC_LEVEL1_ICACHE_SIZE .. _SC_LEVEL4_CACHE_LINESIZE: size, assoc and line size for L1i, L1d, L2, L3 and L4
+static long cache_geometry(int name) {
+
+  assert(pthread_once(&cpu_info_once, init_cpu_info) == 0);
+
+  int      index       = name - GLIBC_SC_LEVEL1_ICACHE_SIZE;
+  unsigned level       = index < 3 ? 1 : index / 3;
+  bool     instruction = index < 3;
+
+  for (int i = 0; i < cpu_info.ncaches; i++) {
+
+    const struct cache_info* cache = &cpu_info.caches[i];
+
+    if (cache->level != level || (cache->type == CPUID_TYPE_INSTRUCTION) != instruction) {
+      continue;
+    }
+
+    switch (index % 3) {
+      case 0:  return cache->size;
+      case 1:  return cache->ways;
+      default: return cache->line_size;
+    }
+  }
+
+  // like glibc: no such cache
+  return 0;
+}
+
+static long avphys_pages() {
+  u_int free_count;
+  size_t len = sizeof(free_count);
+  return sysctlbyname("vm.stats.vm.v_free_count", &free_count, &len, NULL, 0) == 0 ? (long)free_count : -1;
+}
+
+long shim_sysconf_impl(int name) {
+
+  if (name >= GLIBC_SC_LEVEL1_ICACHE_SIZE && name <= GLIBC_SC_LEVEL4_CACHE_LINESIZE) {
+    return cache_geometry(name);
+  }
+
+  switch (name) {
+    case GLIBC_SC_AVPHYS_PAGES:               return avphys_pages();
+    case GLIBC_SC_CLK_TCK:                    return LINUX_USER_HZ;
+    case GLIBC_SC_CHARCLASS_NAME_MAX:         return 2048;
+    case GLIBC_SC_POLL:                       return 1;
+    case GLIBC_SC_SELECT:                     return 1;
+    case GLIBC_SC_PASS_MAX:                   return _PASSWORD_LEN;
+    case GLIBC_SC_XOPEN_XPG2:                 return 1;
+    case GLIBC_SC_XOPEN_XPG3:                 return 1;
+    case GLIBC_SC_XOPEN_XPG4:                 return 1;
+    case GLIBC_SC_NZERO:                      return 20;
+    case GLIBC_SC_NL_NMAX:                    return INT_MAX;
+    case GLIBC_SC_THREAD_ROBUST_PRIO_INHERIT: return 200809;
+    case GLIBC_SC_MINSIGSTKSZ:                return MINSIGSTKSZ;
+    case GLIBC_SC_SIGSTKSZ:                   return SIGSTKSZ;
+    case GLIBC_SC_CHAR_BIT:   return CHAR_BIT;
+    case GLIBC_SC_CHAR_MAX:   return CHAR_MAX;
+    case GLIBC_SC_CHAR_MIN:   return CHAR_MIN;
+    case GLIBC_SC_INT_MAX:    return INT_MAX;
+    case GLIBC_SC_INT_MIN:    return INT_MIN;
+    case GLIBC_SC_LONG_BIT:   return LONG_BIT;
+    case GLIBC_SC_WORD_BIT:   return WORD_BIT;
+    case GLIBC_SC_MB_LEN_MAX: return MB_LEN_MAX;
+    case GLIBC_SC_SSIZE_MAX:  return SSIZE_MAX;
+    case GLIBC_SC_SCHAR_MAX:  return SCHAR_MAX;
+    case GLIBC_SC_SCHAR_MIN:  return SCHAR_MIN;
+    case GLIBC_SC_SHRT_MAX:   return SHRT_MAX;
+    case GLIBC_SC_SHRT_MIN:   return SHRT_MIN;
+    case GLIBC_SC_UCHAR_MAX:  return UCHAR_MAX;
+    case GLIBC_SC_UINT_MAX:   return UINT_MAX;
+    case GLIBC_SC_ULONG_MAX:  return (long)ULONG_MAX;
+    case GLIBC_SC_USHRT_MAX:  return USHRT_MAX;
+    case GLIBC_SC_NL_ARGMAX:  return NL_ARGMAX;
+    case GLIBC_SC_NL_LANGMAX: return NL_LANGMAX;
+    case GLIBC_SC_NL_MSGMAX:  return NL_MSGMAX;
+    case GLIBC_SC_NL_SETMAX:  return NL_SETMAX;
+    case GLIBC_SC_NL_TEXTMAX: return NL_TEXTMAX;
+  }
+
+  if (name >= 0 && name < (int)nitems(native_names) && native_names[name] != 0) {
+    return sysconf(native_names[name]);
+  }
+
+  // a name glibc knows but that has no meaning here, e.g. _SC_PII or _SC_TRACE_NAME_MAX
+  if (name >= 0 && name <= GLIBC_SC_SIGSTKSZ && !(name > GLIBC_SC_LEVEL4_CACHE_LINESIZE && name < GLIBC_SC_IPV6)) {
+    return -1;
+  }
+
+  errno = native_to_linux_errno(EINVAL);
+  return -1;
+}
+
+long shim___sysconf_impl(int name) {
+  return shim_sysconf_impl(name);
+}
+
+SHIM_WRAP(sysconf);
+SHIM_WRAP(__sysconf);
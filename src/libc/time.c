@@ -31,7 +31,7 @@ SHIM_WRAP(tzset);
 #define CLOCK_BOOTTIME CLOCK_UPTIME
 #endif
 
-static clockid_t linux_to_native_clockid(linux_clockid_t linux_clock_id) {
+clockid_t linux_to_native_clockid(linux_clockid_t linux_clock_id) {
   switch (linux_clock_id) {
     case LINUX_CLOCK_REALTIME:         return CLOCK_REALTIME;
     case LINUX_CLOCK_MONOTONIC:        return CLOCK_MONOTONIC;
@@ -44,6 +44,15 @@ static clockid_t linux_to_native_clockid(linux_clockid_t linux_clock_id) {
   }
 }
 
+linux_clockid_t native_to_linux_clockid(clockid_t clock_id) {
+  switch (clock_id) {
+    case CLOCK_REALTIME:  return LINUX_CLOCK_REALTIME;
+    case CLOCK_MONOTONIC: return LINUX_CLOCK_MONOTONIC;
+    default:
+      UNIMPLEMENTED_ARGS("%d", clock_id);
+  }
+}
+
 int shim_clock_gettime_impl(linux_clockid_t linux_clock_id, linux_timespec* tp) {
   return clock_gettime(linux_to_native_clockid(linux_clock_id),  tp);
 }
@@ -16,4 +16,35 @@ typedef struct timeval  linux_timeval;
 typedef struct timezone linux_timezone;
 typedef struct tm       linux_tm;
 
+#define LINUX_SIGEV_SIGNAL    0
+#define LINUX_SIGEV_NONE      1
+#define LINUX_SIGEV_THREAD    2
+#define LINUX_SIGEV_THREAD_ID 4
+
+union linux_sigval {
+  int   sival_int;
+  void* sival_ptr;
+};
+
+struct linux_sigevent {
+  union linux_sigval sigev_value;
+  int                sigev_signo;
+  int                sigev_notify;
+  union {
+    int _pad[(64 - 2 * sizeof(int) - sizeof(union linux_sigval)) / sizeof(int)];
+    int _tid;
+    struct {
+      void  (*_function)(union linux_sigval);
+      void*   _attribute; // pthread_attr_t*
+    } _sigev_thread;
+  } _sigev_un;
+};
+
+_Static_assert(sizeof(struct linux_sigevent) == 64, "");
+
+typedef struct linux_sigevent linux_sigevent;
+
+clockid_t linux_to_native_clockid(linux_clockid_t linux_clock_id);
+linux_clockid_t native_to_linux_clockid(clockid_t clock_id);
+
 int shim_clock_gettime_impl(linux_clockid_t clock_id, linux_timespec* tp);
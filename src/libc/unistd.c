@@ -11,6 +11,7 @@
 #include <sys/sysctl.h>
 #include "../shim.h"
 #include "fcntl.h"
+#include "sys/socket.h"
 
 int shim_chown_impl(const char* path, uid_t owner, gid_t group) {
   assert(!str_starts_with(path, "/dev/"));
@@ -81,37 +82,6 @@ ssize_t shim_readlink_impl(const char* path, char* buf, size_t bufsize) {
   //~ UNIMPLEMENTED();
 //~ }
 
-#define GLIBC_SC_PAGESIZE          30
-#define GLIBC_SC_NPROCESSORS_CONF  83
-#define GLIBC_SC_NPROCESSORS_ONLN  84
-#define GLIBC_SC_PHYS_PAGES        85
-#define GLIBC_SC_MONOTONIC_CLOCK  149
-
-long shim_sysconf_impl(int name) {
-
-  if (name == GLIBC_SC_NPROCESSORS_CONF) {
-    return sysconf(_SC_NPROCESSORS_CONF);
-  }
-
-  if (name == GLIBC_SC_NPROCESSORS_ONLN) {
-    return sysconf(_SC_NPROCESSORS_ONLN);
-  }
-
-  if (name == GLIBC_SC_PAGESIZE) {
-    return sysconf(_SC_PAGESIZE);
-  }
-
-  if (name == GLIBC_SC_PHYS_PAGES) {
-    return sysconf(_SC_PHYS_PAGES);
-  }
-
-  if (name == GLIBC_SC_MONOTONIC_CLOCK) {
-    return sysconf(_SC_MONOTONIC_CLOCK);
-  }
-
-  UNIMPLEMENTED_ARGS("%d", name);
-}
-
 int shim_ftruncate64_impl(int fd, linux_off64_t length) {
   return ftruncate(fd, length);
 }
@@ -119,7 +89,6 @@ int shim_ftruncate64_impl(int fd, linux_off64_t length) {
 SHIM_WRAP(chown);
 SHIM_WRAP(ftruncate64);
 SHIM_WRAP(readlink);
-SHIM_WRAP(sysconf);
 
 int shim_pipe2_impl(int fildes[2], int linux_flags) {
 
@@ -135,6 +104,43 @@ int shim_pipe2_impl(int fildes[2], int linux_flags) {
 
 SHIM_WRAP(pipe2);
 
+int shim_close_impl(int fd) {
+  forget_socket_state(fd, fd);
+  return close(fd);
+}
+
+int shim_dup_impl(int oldd) {
+  int newd = dup(oldd);
+  if (newd != -1) {
+    copy_socket_state(oldd, newd);
+  }
+  return newd;
+}
+
+int shim_dup2_impl(int oldd, int newd) {
+  int fd = dup2(oldd, newd);
+  if (fd != -1 && oldd != newd) {
+    copy_socket_state(oldd, fd);
+  }
+  return fd;
+}
+
+int shim_dup3_impl(int oldd, int newd, int linux_flags) {
+
+  assert((linux_flags & LINUX_O_CLOEXEC) == linux_flags);
+
+  int fd = dup3(oldd, newd, (linux_flags & LINUX_O_CLOEXEC) ? O_CLOEXEC : 0);
+  if (fd != -1) {
+    copy_socket_state(oldd, fd);
+  }
+  return fd;
+}
+
+SHIM_WRAP(close);
+SHIM_WRAP(dup);
+SHIM_WRAP(dup2);
+SHIM_WRAP(dup3);
+
 linux_off64_t shim_lseek64_impl(int fd, linux_off64_t offset, int whence) {
   return lseek(fd, offset, whence);
 }
@@ -159,6 +165,14 @@ SHIM_WRAP(getopt);
 
 int shim_access_impl(const char* path, int mode) {
 
+  if (vfile_exists(path)) {
+    if (mode & (W_OK | X_OK)) {
+      errno = EACCES;
+      return -1;
+    }
+    return 0;
+  }
+
   char* p = redirect(path);
   if (p == NULL) {
     errno = EACCES;
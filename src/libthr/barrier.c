@@ -0,0 +1,182 @@
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "../shim.h"
+#include "pthread.h"
+#include "umtx.h"
+
+#define BARRIER_PSHARED    0x80000000u
+#define BARRIER_COUNT_MASK 0x7FFFFFFFu
+
+/*
+ * Every arrival takes a ticket from arrived, and the round of ticket i ends with
+ * ticket roundup(i, count), whose holder moves released up to it. Tickets never
+ * move backwards within a round, so a thread already arriving for the next round
+ * can't be counted into the current one. Before the tickets could wrap, the last
+ * thread to leave resets the counters, and arrivals beyond the threshold wait for
+ * that.
+ */
+#define BARRIER_THRESHOLD (UINT32_MAX / 8)
+
+/*
+ * Threads usually arrive within a few microseconds of each other, so spin on
+ * released before parking. Pointless when there are more threads than CPUs: the
+ * ones we wait for may not be running.
+ */
+#define BARRIER_SPINS 2000
+
+#define LINUX_PTHREAD_BARRIER_SERIAL_THREAD -1
+
+static uint32_t online_cpus = 0;
+
+__attribute__((constructor))
+static void init_online_cpus() {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  online_cpus = n > 0 ? n : 1;
+}
+
+static bool barrier_pshared(const linux_pthread_barrier_t* barrier) {
+  return barrier->count & BARRIER_PSHARED;
+}
+
+// Tickets up to this are handed out before a reset, a whole number of rounds.
+static uint32_t barrier_last_ticket(uint32_t count) {
+  return BARRIER_THRESHOLD - BARRIER_THRESHOLD % count;
+}
+
+static void barrier_await_round(linux_pthread_barrier_t* barrier, uint32_t end) {
+
+  uint32_t count = barrier->count & BARRIER_COUNT_MASK;
+
+  if (count <= online_cpus) {
+    for (int i = 0; i < BARRIER_SPINS; i++) {
+      if (__atomic_load_n(&barrier->released, __ATOMIC_ACQUIRE) >= end) {
+        return;
+      }
+      cpu_relax();
+    }
+  }
+
+  __atomic_fetch_add(&barrier->sleepers, 1, __ATOMIC_SEQ_CST);
+
+  uint32_t released;
+  while ((released = __atomic_load_n(&barrier->released, __ATOMIC_ACQUIRE)) < end) {
+    int err = umtx_wait_uint(&barrier->released, released, barrier_pshared(barrier), CLOCK_REALTIME, NULL);
+    assert(err == 0 || err == EINTR);
+  }
+
+  __atomic_fetch_sub(&barrier->sleepers, 1, __ATOMIC_RELAXED);
+}
+
+int shim_pthread_barrier_init_impl(linux_pthread_barrier_t* barrier, const linux_pthread_barrierattr_t* attr, unsigned count) {
+
+  if (count == 0 || count >= BARRIER_THRESHOLD) {
+    return EINVAL;
+  }
+
+  bool pshared = attr != NULL && *attr == LINUX_PTHREAD_PROCESS_SHARED;
+
+  barrier->count    = count | (pshared ? BARRIER_PSHARED : 0);
+  barrier->arrived  = 0;
+  barrier->released = 0;
+  barrier->sleepers = 0;
+  barrier->left     = 0;
+
+  return 0;
+}
+
+int shim_pthread_barrier_destroy_impl(linux_pthread_barrier_t* barrier) {
+
+  // someone is waiting for a round to complete
+  if (__atomic_load_n(&barrier->arrived, __ATOMIC_ACQUIRE) != __atomic_load_n(&barrier->released, __ATOMIC_ACQUIRE)) {
+    return native_to_linux_errno(EBUSY);
+  }
+
+  // let threads released by the last round get out before the memory is reused
+  while (__atomic_load_n(&barrier->left, __ATOMIC_ACQUIRE) != __atomic_load_n(&barrier->arrived, __ATOMIC_ACQUIRE)) {
+    sched_yield();
+  }
+
+  return 0;
+}
+
+int shim_pthread_barrier_wait_impl(linux_pthread_barrier_t* barrier) {
+
+  uint32_t count = barrier->count & BARRIER_COUNT_MASK;
+  uint32_t last  = barrier_last_ticket(count);
+
+  uint32_t ticket;
+  while ((ticket = __atomic_add_fetch(&barrier->arrived, 1, __ATOMIC_ACQ_REL)) > last) {
+    // the counters are about to be reset, then take a ticket again
+    while (__atomic_load_n(&barrier->arrived, __ATOMIC_ACQUIRE) > last) {
+      sched_yield();
+    }
+  }
+
+  uint32_t end = ticket + (count - ticket % count) % count;
+
+  int ret = 0;
+
+  if (ticket == end) {
+
+    // a later round may have completed first
+    uint32_t released = __atomic_load_n(&barrier->released, __ATOMIC_RELAXED);
+    while (released < end && !__atomic_compare_exchange_n(&barrier->released, &released, end, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    }
+
+    if (__atomic_load_n(&barrier->sleepers, __ATOMIC_SEQ_CST) > 0) {
+      umtx_wake(&barrier->released, UMTX_WAKE_ALL, barrier_pshared(barrier));
+    }
+
+    ret = LINUX_PTHREAD_BARRIER_SERIAL_THREAD;
+
+  } else {
+    barrier_await_round(barrier, end);
+  }
+
+  // every ticket before the reset has been released and is on its way out
+  if (__atomic_add_fetch(&barrier->left, 1, __ATOMIC_ACQ_REL) == last) {
+    __atomic_store_n(&barrier->released, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&barrier->left, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&barrier->arrived, 0, __ATOMIC_RELEASE);
+  }
+
+  return ret;
+}
+
+SHIM_WRAP(pthread_barrier_init);
+SHIM_WRAP(pthread_barrier_destroy);
+SHIM_WRAP(pthread_barrier_wait);
+
+int shim_pthread_barrierattr_init_impl(linux_pthread_barrierattr_t* attr) {
+  *attr = LINUX_PTHREAD_PROCESS_PRIVATE;
+  return 0;
+}
+
+int shim_pthread_barrierattr_destroy_impl(linux_pthread_barrierattr_t* attr) {
+  return 0;
+}
+
+SHIM_WRAP(pthread_barrierattr_init);
+SHIM_WRAP(pthread_barrierattr_destroy);
+
+int shim_pthread_barrierattr_getpshared_impl(const linux_pthread_barrierattr_t* attr, int* pshared) {
+  *pshared = *attr;
+  return 0;
+}
+
+int shim_pthread_barrierattr_setpshared_impl(linux_pthread_barrierattr_t* attr, int pshared) {
+
+  if (pshared != LINUX_PTHREAD_PROCESS_PRIVATE && pshared != LINUX_PTHREAD_PROCESS_SHARED) {
+    return EINVAL;
+  }
+
+  *attr = pshared;
+  return 0;
+}
+
+SHIM_WRAP(pthread_barrierattr_getpshared);
+SHIM_WRAP(pthread_barrierattr_setpshared);
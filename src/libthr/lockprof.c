@@ -0,0 +1,321 @@
+#include <assert.h>
+#include <dlfcn.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../shim.h"
+#include "lockprof.h"
+
+#define LOCKPROF_LOCKS     1024
+#define LOCKPROF_SITES        4
+#define LOCKPROF_HELD         8
+#define LOCKPROF_REPORT_TOP  20
+
+struct lockprof_stats {
+  uint64_t count;
+  uint64_t wait_ns;
+  uint64_t hold_ns;
+};
+
+struct lockprof_site {
+  void*                 caller;
+  struct lockprof_stats stats;
+};
+
+struct lockprof_lock {
+  void*                 lock;
+  enum lockprof_type    type;
+  struct lockprof_stats stats;
+  struct lockprof_site  sites[LOCKPROF_SITES]; // first few call sites, the rest only count towards stats
+};
+
+uint32_t lockprof_period = 0;
+
+static struct lockprof_lock locks[LOCKPROF_LOCKS];
+static uint32_t             locks_dropped = 0;
+
+static __thread uint32_t contended_count = 0;
+
+// contended acquisitions this thread still holds, to measure hold times
+static __thread struct {
+  void*                  lock;
+  struct lockprof_stats* lock_stats;
+  struct lockprof_stats* site_stats;
+  uint64_t               start;
+} held[LOCKPROF_HELD];
+
+static __thread int held_count = 0;
+
+static uint32_t report_requested = 0;
+
+static void lockprof_report();
+
+// SIGINFO only sets report_requested, the report is printed from here as none of it is async-signal-safe.
+static void check_report() {
+  if (__atomic_load_n(&report_requested, __ATOMIC_RELAXED) != 0 && __atomic_exchange_n(&report_requested, 0, __ATOMIC_ACQUIRE) != 0) {
+    lockprof_report();
+  }
+}
+
+bool lockprof_sample() {
+  check_report();
+  return ++contended_count % lockprof_period == 0;
+}
+
+uint64_t lockprof_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct lockprof_lock* find_lock(void* lock, enum lockprof_type type) {
+
+  uint32_t start = ((uintptr_t)lock >> 4) % LOCKPROF_LOCKS;
+
+  for (uint32_t i = 0; i < LOCKPROF_LOCKS; i++) {
+
+    struct lockprof_lock* entry = &locks[(start + i) % LOCKPROF_LOCKS];
+
+    void* current = __atomic_load_n(&entry->lock, __ATOMIC_ACQUIRE);
+    if (current == NULL) {
+      if (__atomic_compare_exchange_n(&entry->lock, &current, lock, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        entry->type = type;
+        return entry;
+      }
+    }
+
+    if (current == lock) {
+      return entry;
+    }
+  }
+
+  __atomic_fetch_add(&locks_dropped, 1, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+static struct lockprof_site* find_site(struct lockprof_lock* entry, void* caller) {
+
+  for (int i = 0; i < LOCKPROF_SITES; i++) {
+
+    struct lockprof_site* site = &entry->sites[i];
+
+    void* current = __atomic_load_n(&site->caller, __ATOMIC_ACQUIRE);
+    if (current == NULL) {
+      if (__atomic_compare_exchange_n(&site->caller, &current, caller, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return site;
+      }
+    }
+
+    if (current == caller) {
+      return site;
+    }
+  }
+
+  return NULL;
+}
+
+void lockprof_contended(void* lock, enum lockprof_type type, void* caller, uint64_t start, int err) {
+
+  uint64_t now = lockprof_now();
+
+  struct lockprof_lock* entry = find_lock(lock, type);
+  if (entry == NULL) {
+    return;
+  }
+
+  struct lockprof_site* site = find_site(entry, caller);
+
+  __atomic_fetch_add(&entry->stats.count,   1,           __ATOMIC_RELAXED);
+  __atomic_fetch_add(&entry->stats.wait_ns, now - start, __ATOMIC_RELAXED);
+
+  if (site != NULL) {
+    __atomic_fetch_add(&site->stats.count,   1,           __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->stats.wait_ns, now - start, __ATOMIC_RELAXED);
+  }
+
+  if (err == 0 && held_count < LOCKPROF_HELD) {
+    held[held_count].lock       = lock;
+    held[held_count].lock_stats = &entry->stats;
+    held[held_count].site_stats = site != NULL ? &site->stats : NULL;
+    held[held_count].start      = now;
+    held_count++;
+  }
+}
+
+static int find_held(void* lock) {
+  for (int i = held_count - 1; i >= 0; i--) {
+    if (held[i].lock == lock) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Adds the time since the entry was (re)opened to the hold time, a paused one has none.
+static void close_held(int i) {
+
+  if (held[i].start == 0) {
+    return;
+  }
+
+  uint64_t hold_ns = lockprof_now() - held[i].start;
+
+  __atomic_fetch_add(&held[i].lock_stats->hold_ns, hold_ns, __ATOMIC_RELAXED);
+  if (held[i].site_stats != NULL) {
+    __atomic_fetch_add(&held[i].site_stats->hold_ns, hold_ns, __ATOMIC_RELAXED);
+  }
+
+  held[i].start = 0;
+}
+
+void lockprof_release(void* lock) {
+  int i = find_held(lock);
+  if (i != -1) {
+    close_held(i);
+    held[i] = held[--held_count];
+  }
+  check_report();
+}
+
+void lockprof_pause(void* lock) {
+  int i = find_held(lock);
+  if (i != -1) {
+    close_held(i);
+  }
+}
+
+void lockprof_resume(void* lock) {
+  int i = find_held(lock);
+  if (i != -1) {
+    held[i].start = lockprof_now();
+  }
+}
+
+// format into a buffer and write(2) it, bypassing the application's stdio buffers
+static void report_printf(const char* format, ...) {
+  char buffer[512];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (n > 0) {
+    write(STDERR_FILENO, buffer, n < (int)sizeof(buffer) ? n : (int)sizeof(buffer) - 1);
+  }
+}
+
+static const char* type_name(enum lockprof_type type) {
+  switch (type) {
+    case LOCKPROF_MUTEX:        return "mutex";
+    case LOCKPROF_RWLOCK_READ:  return "rwlock (rd)";
+    case LOCKPROF_RWLOCK_WRITE: return "rwlock (wr)";
+    default:
+      assert(0);
+  }
+}
+
+static void report_caller(void* caller) {
+
+  Dl_info info;
+  if (dladdr(caller, &info) == 0) {
+    report_printf("%p", caller);
+  } else if (info.dli_sname != NULL) {
+    report_printf("%s+0x%tx (%s)", info.dli_sname, (char*)caller - (char*)info.dli_saddr, info.dli_fname);
+  } else {
+    report_printf("%p (%s+0x%tx)", caller, info.dli_fname, (char*)caller - (char*)info.dli_fbase);
+  }
+}
+
+static void lockprof_report() {
+
+  struct lockprof_lock* top[LOCKPROF_REPORT_TOP];
+  int ntop = 0;
+
+  // insertion into a small array ordered by total wait time
+  for (int i = 0; i < LOCKPROF_LOCKS; i++) {
+
+    struct lockprof_lock* entry = &locks[i];
+    if (entry->lock == NULL || entry->stats.count == 0) {
+      continue;
+    }
+
+    int pos = ntop;
+    while (pos > 0 && top[pos - 1]->stats.wait_ns < entry->stats.wait_ns) {
+      pos--;
+    }
+
+    if (pos < LOCKPROF_REPORT_TOP) {
+      int last = ntop < LOCKPROF_REPORT_TOP ? ntop : LOCKPROF_REPORT_TOP - 1;
+      memmove(&top[pos + 1], &top[pos], (last - pos) * sizeof(top[0]));
+      top[pos] = entry;
+      if (ntop < LOCKPROF_REPORT_TOP) {
+        ntop++;
+      }
+    }
+  }
+
+  report_printf("[%d] lockprof: top %d contended locks (sampling 1/%u contended acquisitions)\n", getpid(), ntop, lockprof_period);
+
+  for (int i = 0; i < ntop; i++) {
+
+    struct lockprof_lock* entry = top[i];
+
+    report_printf("%2d. %s %p: %ju contended, wait %ju us (avg %ju ns), hold %ju us\n",
+      i + 1, type_name(entry->type), entry->lock,
+      (uintmax_t)entry->stats.count,
+      (uintmax_t)entry->stats.wait_ns / 1000,
+      (uintmax_t)(entry->stats.wait_ns / entry->stats.count),
+      (uintmax_t)entry->stats.hold_ns / 1000
+    );
+
+    for (int j = 0; j < LOCKPROF_SITES && entry->sites[j].caller != NULL; j++) {
+      struct lockprof_site* site = &entry->sites[j];
+      report_printf("      %ju contended, wait %ju us, hold %ju us at ",
+        (uintmax_t)site->stats.count,
+        (uintmax_t)site->stats.wait_ns / 1000,
+        (uintmax_t)site->stats.hold_ns / 1000
+      );
+      report_caller(site->caller);
+      report_printf("\n");
+    }
+  }
+
+  if (locks_dropped > 0) {
+    report_printf("lockprof: %u acquisitions not recorded, lock table full\n", locks_dropped);
+  }
+}
+
+static void lockprof_signal_handler(int sig) {
+  __atomic_store_n(&report_requested, 1, __ATOMIC_RELEASE);
+}
+
+__attribute__((constructor))
+static void init_lockprof() {
+
+  const char* value = getenv("SHIM_LOCKPROF");
+  if (value == NULL) {
+    return;
+  }
+
+  int period = atoi(value);
+  if (period <= 0) {
+    return;
+  }
+
+  lockprof_period = period;
+
+  atexit(lockprof_report);
+
+  // Linux has no SIGINFO, so no Linux binary expects to handle it
+  struct sigaction act = {
+    .sa_handler = lockprof_signal_handler,
+    .sa_flags   = SA_RESTART
+  };
+  sigemptyset(&act.sa_mask);
+
+  int err = sigaction(SIGINFO, &act, NULL);
+  assert(err == 0);
+}
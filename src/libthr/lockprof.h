@@ -0,0 +1,53 @@
+#pragma once
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Contention profiler for shim-managed locks, enabled with SHIM_LOCKPROF=<n>:
+ * every n-th contended acquisition (n = 1: all of them) records its wait time,
+ * the time the lock is then held and the code that called into the shim. A report
+ * of the most contended locks goes to stderr at exit and on SIGINFO.
+ */
+
+enum lockprof_type {
+  LOCKPROF_MUTEX,
+  LOCKPROF_RWLOCK_READ,
+  LOCKPROF_RWLOCK_WRITE
+};
+
+extern uint32_t lockprof_period;
+
+bool     lockprof_sample(void);
+uint64_t lockprof_now(void);
+void     lockprof_contended(void* lock, enum lockprof_type type, void* caller, uint64_t start, int err);
+void     lockprof_release(void* lock);
+void     lockprof_pause(void* lock);
+void     lockprof_resume(void* lock);
+
+/*
+ * Only an acquisition that would block is timed, so the uncontended path costs
+ * one extra trylock. caller is the application code that called into the shim:
+ * functions using this are wrapped with SHIM_WRAP(fun, caller), which passes the
+ * wrapper's return address as an extra last argument to the *_impl function.
+ */
+#define LOCKPROF_ACQUIRE(lock, type, caller, try_acquire, acquire) (lockprof_period == 0 ? (acquire) : ({ \
+  int _err_ = (try_acquire);                                                                             \
+  if (_err_ == EBUSY) {                                                                                  \
+    if (lockprof_sample()) {                                                                             \
+      uint64_t _start_ = lockprof_now();                                                                 \
+      _err_ = (acquire);                                                                                 \
+      lockprof_contended((lock), (type), (caller), _start_, _err_);                                      \
+    } else {                                                                                             \
+      _err_ = (acquire);                                                                                 \
+    }                                                                                                    \
+  }                                                                                                      \
+  _err_;                                                                                                 \
+}))
+
+#define LOCKPROF_RELEASE(lock) (lockprof_period == 0 ? (void)0 : lockprof_release(lock))
+
+// A condvar wait gives the mutex up while asleep, which doesn't count as holding it.
+#define LOCKPROF_PAUSE(lock)  (lockprof_period == 0 ? (void)0 : lockprof_pause(lock))
+#define LOCKPROF_RESUME(lock) (lockprof_period == 0 ? (void)0 : lockprof_resume(lock))
@@ -0,0 +1,215 @@
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <pthread_np.h>
+#include <stdint.h>
+#include "../shim.h"
+#include "pshared.h"
+#include "umtx.h"
+
+#define MUTEX_UNLOCKED  0
+#define MUTEX_LOCKED    1
+#define MUTEX_CONTENDED 2
+
+#define MUTEX_SPINS 100
+
+static int mutex_kind(const linux_pthread_mutex_t* mutex) {
+  return mutex->linux_kind & LINUX_PTHREAD_MUTEX_KIND_MASK;
+}
+
+int pshared_mutex_init(linux_pthread_mutex_t* mutex, int linux_kind) {
+
+  mutex->_wrapped_mutex = NULL;
+  mutex->shared_lock    = MUTEX_UNLOCKED;
+  mutex->shared_owner   = 0;
+  mutex->shared_count   = 0;
+  mutex->linux_kind     = linux_kind | LINUX_PTHREAD_MUTEX_PSHARED_BIT;
+
+  return 0;
+}
+
+int pshared_mutex_destroy(linux_pthread_mutex_t* mutex) {
+
+  if (__atomic_load_n(&mutex->shared_lock, __ATOMIC_RELAXED) != MUTEX_UNLOCKED) {
+    return EBUSY;
+  }
+
+  return 0;
+}
+
+static int pshared_mutex_relock(linux_pthread_mutex_t* mutex) {
+
+  switch (mutex_kind(mutex)) {
+    case LINUX_PTHREAD_MUTEX_RECURSIVE:
+      if (mutex->shared_count == UINT32_MAX) {
+        return EAGAIN;
+      }
+      mutex->shared_count++;
+      return 0;
+    case LINUX_PTHREAD_MUTEX_ERRORCHECK:
+      return EDEADLK;
+    default:
+      return -1; // deadlock like glibc does
+  }
+}
+
+int pshared_mutex_lock(linux_pthread_mutex_t* mutex, const struct timespec* abstime) {
+
+  int tid = pthread_getthreadid_np();
+
+  if (mutex->shared_owner == tid) {
+    int err = pshared_mutex_relock(mutex);
+    if (err != -1) {
+      return err;
+    }
+  }
+
+  uint32_t c = MUTEX_UNLOCKED;
+
+  for (int i = 0; i < MUTEX_SPINS; i++) {
+    if (__atomic_compare_exchange_n(&mutex->shared_lock, &c, MUTEX_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      goto owned;
+    }
+    if (c == MUTEX_CONTENDED) {
+      break;
+    }
+    c = MUTEX_UNLOCKED;
+    cpu_relax();
+  }
+
+  c = __atomic_exchange_n(&mutex->shared_lock, MUTEX_CONTENDED, __ATOMIC_ACQUIRE);
+  while (c != MUTEX_UNLOCKED) {
+    int err = umtx_wait_uint(&mutex->shared_lock, MUTEX_CONTENDED, true, CLOCK_REALTIME, abstime);
+    if (err == ETIMEDOUT || err == EINVAL) {
+      return err;
+    }
+    c = __atomic_exchange_n(&mutex->shared_lock, MUTEX_CONTENDED, __ATOMIC_ACQUIRE);
+  }
+
+owned:
+  mutex->shared_owner = tid;
+  mutex->shared_count = 0;
+
+  return 0;
+}
+
+int pshared_mutex_trylock(linux_pthread_mutex_t* mutex) {
+
+  int tid = pthread_getthreadid_np();
+
+  if (mutex->shared_owner == tid && mutex_kind(mutex) == LINUX_PTHREAD_MUTEX_RECURSIVE) {
+    return pshared_mutex_relock(mutex);
+  }
+
+  uint32_t c = MUTEX_UNLOCKED;
+  if (!__atomic_compare_exchange_n(&mutex->shared_lock, &c, MUTEX_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return EBUSY;
+  }
+
+  mutex->shared_owner = tid;
+  mutex->shared_count = 0;
+
+  return 0;
+}
+
+int pshared_mutex_unlock(linux_pthread_mutex_t* mutex) {
+
+  int kind = mutex_kind(mutex);
+
+  if (kind == LINUX_PTHREAD_MUTEX_RECURSIVE || kind == LINUX_PTHREAD_MUTEX_ERRORCHECK) {
+    if (mutex->shared_owner != pthread_getthreadid_np()) {
+      return EPERM;
+    }
+    if (mutex->shared_count > 0) {
+      mutex->shared_count--;
+      return 0;
+    }
+  }
+
+  mutex->shared_owner = 0;
+
+  if (__atomic_exchange_n(&mutex->shared_lock, MUTEX_UNLOCKED, __ATOMIC_RELEASE) == MUTEX_CONTENDED) {
+    umtx_wake(&mutex->shared_lock, 1, true);
+  }
+
+  return 0;
+}
+
+void pshared_cond_init(linux_pthread_cond_t* cond, bool pshared, clockid_t clock_id) {
+  cond->seq     = 0;
+  cond->waiters = 0;
+  cond->clock   = clock_id;
+  cond->flags   = pshared ? SHIM_COND_PSHARED : 0;
+}
+
+int pshared_cond_destroy(linux_pthread_cond_t* cond) {
+
+  if (__atomic_load_n(&cond->waiters, __ATOMIC_RELAXED) != 0) {
+    return EBUSY;
+  }
+
+  return 0;
+}
+
+static int cond_mutex_unlock(linux_pthread_mutex_t* mutex) {
+  return mutex_pshared(mutex) ? pshared_mutex_unlock(mutex) : pthread_mutex_unlock(&mutex->_wrapped_mutex);
+}
+
+static int cond_mutex_lock(linux_pthread_mutex_t* mutex) {
+  return mutex_pshared(mutex) ? pshared_mutex_lock(mutex, NULL) : pthread_mutex_lock(&mutex->_wrapped_mutex);
+}
+
+int pshared_cond_wait(linux_pthread_cond_t* cond, linux_pthread_mutex_t* mutex, const struct timespec* abstime) {
+
+  uint32_t seq = __atomic_load_n(&cond->seq, __ATOMIC_RELAXED);
+
+  // fully release a recursive mutex and restore its depth after the wait
+  uint32_t count = 0;
+  if (mutex_pshared(mutex)) {
+    count = mutex->shared_count;
+    mutex->shared_count = 0;
+  }
+
+  __atomic_fetch_add(&cond->waiters, 1, __ATOMIC_SEQ_CST);
+
+  int err = cond_mutex_unlock(mutex);
+  if (err != 0) {
+    __atomic_fetch_sub(&cond->waiters, 1, __ATOMIC_RELAXED);
+    if (mutex_pshared(mutex)) {
+      mutex->shared_count = count;
+    }
+    return err;
+  }
+
+  err = umtx_wait_uint(&cond->seq, seq, cond_pshared(cond), cond->clock, abstime);
+
+  __atomic_fetch_sub(&cond->waiters, 1, __ATOMIC_RELAXED);
+
+  int lock_err = cond_mutex_lock(mutex);
+  assert(lock_err == 0 || lock_err == EOWNERDEAD || lock_err == ENOTRECOVERABLE);
+
+  if (mutex_pshared(mutex)) {
+    mutex->shared_count = count;
+  }
+
+  if (lock_err != 0) {
+    return lock_err;
+  }
+
+  // EINTR is a spurious wakeup as far as the caller is concerned
+  return err == ETIMEDOUT || err == EINVAL ? err : 0;
+}
+
+void pshared_cond_signal(linux_pthread_cond_t* cond) {
+  if (__atomic_load_n(&cond->waiters, __ATOMIC_SEQ_CST) > 0) {
+    __atomic_fetch_add(&cond->seq, 1, __ATOMIC_SEQ_CST);
+    umtx_wake(&cond->seq, 1, cond_pshared(cond));
+  }
+}
+
+void pshared_cond_broadcast(linux_pthread_cond_t* cond) {
+  if (__atomic_load_n(&cond->waiters, __ATOMIC_SEQ_CST) > 0) {
+    __atomic_fetch_add(&cond->seq, 1, __ATOMIC_SEQ_CST);
+    umtx_wake(&cond->seq, UMTX_WAKE_ALL, cond_pshared(cond));
+  }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+#include "pthread.h"
+
+/*
+ * In-place mutexes and condvars for PTHREAD_PROCESS_SHARED objects. All state
+ * lives in the glibc-sized object and waiters park with the shared _umtx_op
+ * variants, so any process mapping the object can use it.
+ *
+ * Functions return native errno values.
+ */
+
+static inline bool mutex_pshared(const linux_pthread_mutex_t* mutex) {
+  return mutex->linux_kind & LINUX_PTHREAD_MUTEX_PSHARED_BIT;
+}
+
+static inline bool cond_pshared(const linux_pthread_cond_t* cond) {
+  return cond->flags & SHIM_COND_PSHARED;
+}
+
+int pshared_mutex_init(linux_pthread_mutex_t* mutex, int linux_kind);
+int pshared_mutex_destroy(linux_pthread_mutex_t* mutex);
+int pshared_mutex_lock(linux_pthread_mutex_t* mutex, const struct timespec* abstime);
+int pshared_mutex_trylock(linux_pthread_mutex_t* mutex);
+int pshared_mutex_unlock(linux_pthread_mutex_t* mutex);
+
+void pshared_cond_init(linux_pthread_cond_t* cond, bool pshared, clockid_t clock_id);
+int  pshared_cond_destroy(linux_pthread_cond_t* cond);
+int  pshared_cond_wait(linux_pthread_cond_t* cond, linux_pthread_mutex_t* mutex, const struct timespec* abstime);
+void pshared_cond_signal(linux_pthread_cond_t* cond);
+void pshared_cond_broadcast(linux_pthread_cond_t* cond);
@@ -7,6 +7,8 @@
 #include "../libc/sched.h"
 #include "../libc/time.h"
 #include "pthread.h"
+#include "pshared.h"
+#include "lockprof.h"
 
 #define NATIVE_WHATEVER_ATTRS(name, max_attrs) \
                                                                                                             \
@@ -65,9 +67,8 @@
     return err;                                                                                             \
   }
 
-NATIVE_WHATEVER_ATTRS(barrier,  10);
-NATIVE_WHATEVER_ATTRS(cond,    100);
-NATIVE_WHATEVER_ATTRS(mutex,   200);
+NATIVE_WHATEVER_ATTRS(cond,  100);
+NATIVE_WHATEVER_ATTRS(mutex, 200);
 
 int shim_pthread_join_impl(pthread_t thread, void** value_ptr) {
   int err = pthread_join(thread, value_ptr);
@@ -143,16 +144,28 @@ int shim_pthread_mutexattr_setprioceiling_impl(linux_pthread_mutexattr_t* attr,
   UNIMPLEMENTED();
 }
 
+int shim_pthread_mutexattr_getpshared_impl(const linux_pthread_mutexattr_t* attr, int* pshared) {
+  return pthread_mutexattr_getpshared(find_native_mutexattr(attr), pshared);
+}
+
 int shim_pthread_mutexattr_setpshared_impl(linux_pthread_mutexattr_t* attr, int pshared) {
   return pthread_mutexattr_setpshared(find_native_mutexattr(attr), pshared);
 }
 
 int shim_pthread_mutexattr_getrobust_impl(const linux_pthread_mutexattr_t* attr, int* robustness) {
-  UNIMPLEMENTED();
+  return pthread_mutexattr_getrobust(find_native_mutexattr(attr), robustness);
 }
 
 int shim_pthread_mutexattr_setrobust_impl(const linux_pthread_mutexattr_t* attr, int robustness) {
-  UNIMPLEMENTED();
+  return pthread_mutexattr_setrobust(find_native_mutexattr(attr), robustness);
+}
+
+int shim_pthread_mutexattr_getrobust_np_impl(const linux_pthread_mutexattr_t* attr, int* robustness) {
+  return shim_pthread_mutexattr_getrobust_impl(attr, robustness);
+}
+
+int shim_pthread_mutexattr_setrobust_np_impl(const linux_pthread_mutexattr_t* attr, int robustness) {
+  return shim_pthread_mutexattr_setrobust_impl(attr, robustness);
 }
 
 int shim_pthread_mutexattr_gettype_impl(const linux_pthread_mutexattr_t* attr, int* kind) {
@@ -170,6 +183,17 @@ static int linux_to_native_mutex_kind(int linux_kind) {
   }
 }
 
+static int native_to_linux_mutex_kind(int kind) {
+  switch (kind) {
+    case PTHREAD_MUTEX_NORMAL:      return LINUX_PTHREAD_MUTEX_NORMAL;
+    case PTHREAD_MUTEX_RECURSIVE:   return LINUX_PTHREAD_MUTEX_RECURSIVE;
+    case PTHREAD_MUTEX_ERRORCHECK:  return LINUX_PTHREAD_MUTEX_ERRORCHECK;
+    case PTHREAD_MUTEX_ADAPTIVE_NP: return LINUX_PTHREAD_MUTEX_ADAPTIVE_NP;
+    default:
+      assert(0);
+  }
+}
+
 int shim_pthread_mutexattr_settype_impl(linux_pthread_mutexattr_t* attr, int linux_kind) {
   return pthread_mutexattr_settype(find_native_mutexattr(attr), linux_to_native_mutex_kind(linux_kind));
 }
@@ -178,16 +202,38 @@ SHIM_WRAP(pthread_mutexattr_getkind_np);
 SHIM_WRAP(pthread_mutexattr_setkind_np);
 SHIM_WRAP(pthread_mutexattr_getprioceiling);
 SHIM_WRAP(pthread_mutexattr_setprioceiling);
+SHIM_WRAP(pthread_mutexattr_getpshared);
 SHIM_WRAP(pthread_mutexattr_setpshared);
 SHIM_WRAP(pthread_mutexattr_getrobust);
 SHIM_WRAP(pthread_mutexattr_setrobust);
+SHIM_WRAP(pthread_mutexattr_getrobust_np);
+SHIM_WRAP(pthread_mutexattr_setrobust_np);
 SHIM_WRAP(pthread_mutexattr_gettype);
 SHIM_WRAP(pthread_mutexattr_settype);
 
 #define NATIVE_MUTEX_T(shim_mutex) &(shim_mutex->_wrapped_mutex)
 
 int shim_pthread_mutex_init_impl(linux_pthread_mutex_t* mutex, const linux_pthread_mutexattr_t* attr) {
-  return pthread_mutex_init(NATIVE_MUTEX_T(mutex), find_native_mutexattr(attr));
+
+  pthread_mutexattr_t* native_attr = find_native_mutexattr(attr);
+
+  int pshared = PTHREAD_PROCESS_PRIVATE;
+  int robust  = PTHREAD_MUTEX_STALLED;
+  int kind    = PTHREAD_MUTEX_NORMAL;
+  if (native_attr != NULL) {
+    assert(pthread_mutexattr_getpshared(native_attr, &pshared) == 0);
+    assert(pthread_mutexattr_getrobust(native_attr, &robust) == 0);
+    assert(pthread_mutexattr_gettype(native_attr, &kind) == 0);
+  }
+
+  // robust ones, shared or not, are left to libthr and the kernel's robust lists
+  if (pshared == PTHREAD_PROCESS_SHARED && robust != PTHREAD_MUTEX_ROBUST) {
+    return pshared_mutex_init(mutex, native_to_linux_mutex_kind(kind));
+  }
+
+  mutex->linux_kind = robust == PTHREAD_MUTEX_ROBUST ? native_to_linux_mutex_kind(kind) | LINUX_PTHREAD_MUTEX_ROBUST_BIT : 0;
+
+  return native_to_linux_errno(pthread_mutex_init(NATIVE_MUTEX_T(mutex), native_attr));
 }
 
 static void init_mutex_if_necessary(linux_pthread_mutex_t* mutex) {
@@ -216,51 +262,100 @@ static void init_mutex_if_necessary(linux_pthread_mutex_t* mutex) {
   }
 }
 
-int shim_pthread_mutex_lock_impl(linux_pthread_mutex_t* mutex) {
+static int mutex_lock(linux_pthread_mutex_t* mutex, const linux_timespec* abs_timeout) {
+
+  if (mutex_pshared(mutex)) {
+    return native_to_linux_errno(pshared_mutex_lock(mutex, abs_timeout));
+  }
+
   init_mutex_if_necessary(mutex);
-  return pthread_mutex_lock(NATIVE_MUTEX_T(mutex));
+
+  if (abs_timeout != NULL) {
+    return native_to_linux_errno(pthread_mutex_timedlock(NATIVE_MUTEX_T(mutex), abs_timeout));
+  } else {
+    return native_to_linux_errno(pthread_mutex_lock(NATIVE_MUTEX_T(mutex)));
+  }
+}
+
+int shim_pthread_mutex_trylock_impl(linux_pthread_mutex_t* mutex);
+
+int shim_pthread_mutex_lock_impl(linux_pthread_mutex_t* mutex, void* caller) {
+  return LOCKPROF_ACQUIRE(mutex, LOCKPROF_MUTEX, caller, shim_pthread_mutex_trylock_impl(mutex), mutex_lock(mutex, NULL));
 }
 
 SHIM_WRAP(pthread_mutex_init);
-SHIM_WRAP(pthread_mutex_lock);
+SHIM_WRAP(pthread_mutex_lock, caller);
 
-int shim_pthread_cond_timedwait_impl(pthread_cond_t* cond, linux_pthread_mutex_t* mutex, const linux_timespec* abstime) {
+static int cond_wait(linux_pthread_cond_t* cond, linux_pthread_mutex_t* mutex, const linux_timespec* abstime) {
+  if (cond_pshared(cond) || mutex_pshared(mutex)) {
+    return pshared_cond_wait(cond, mutex, abstime);
+  }
   init_mutex_if_necessary(mutex);
-  return native_to_linux_errno(pthread_cond_timedwait(cond, NATIVE_MUTEX_T(mutex), abstime));
+  if (abstime != NULL) {
+    return pthread_cond_timedwait(&cond->_wrapped_cond, NATIVE_MUTEX_T(mutex), abstime);
+  } else {
+    return pthread_cond_wait(&cond->_wrapped_cond, NATIVE_MUTEX_T(mutex));
+  }
 }
 
-int shim_pthread_cond_wait_impl(pthread_cond_t* cond, linux_pthread_mutex_t* mutex) {
-  init_mutex_if_necessary(mutex);
-  return pthread_cond_wait(cond, NATIVE_MUTEX_T(mutex));
+int shim_pthread_cond_timedwait_impl(linux_pthread_cond_t* cond, linux_pthread_mutex_t* mutex, const linux_timespec* abstime) {
+  LOCKPROF_PAUSE(mutex);
+  int err = cond_wait(cond, mutex, abstime);
+  LOCKPROF_RESUME(mutex);
+  return native_to_linux_errno(err);
+}
+
+int shim_pthread_cond_wait_impl(linux_pthread_cond_t* cond, linux_pthread_mutex_t* mutex) {
+  LOCKPROF_PAUSE(mutex);
+  int err = cond_wait(cond, mutex, NULL);
+  LOCKPROF_RESUME(mutex);
+  return native_to_linux_errno(err);
 }
 
 int shim_pthread_mutex_consistent_impl(linux_pthread_mutex_t* mutex) {
+  if (mutex_pshared(mutex)) {
+    return EINVAL;
+  }
   assert(mutex->_wrapped_mutex != 0);
   return pthread_mutex_consistent(NATIVE_MUTEX_T(mutex));
 }
 
-int shim_pthread_mutex_timedlock_impl(linux_pthread_mutex_t* mutex, const linux_timespec* abs_timeout) {
-  init_mutex_if_necessary(mutex);
-  return native_to_linux_errno(pthread_mutex_timedlock(NATIVE_MUTEX_T(mutex), abs_timeout));
+int shim_pthread_mutex_consistent_np_impl(linux_pthread_mutex_t* mutex) {
+  return shim_pthread_mutex_consistent_impl(mutex);
+}
+
+int shim_pthread_mutex_timedlock_impl(linux_pthread_mutex_t* mutex, const linux_timespec* abs_timeout, void* caller) {
+  return LOCKPROF_ACQUIRE(mutex, LOCKPROF_MUTEX, caller, shim_pthread_mutex_trylock_impl(mutex), mutex_lock(mutex, abs_timeout));
 }
 
 int shim_pthread_mutex_trylock_impl(linux_pthread_mutex_t* mutex) {
+  if (mutex_pshared(mutex)) {
+    return native_to_linux_errno(pshared_mutex_trylock(mutex));
+  }
   init_mutex_if_necessary(mutex);
-  return pthread_mutex_trylock(NATIVE_MUTEX_T(mutex));
+  return native_to_linux_errno(pthread_mutex_trylock(NATIVE_MUTEX_T(mutex)));
 }
 
 SHIM_WRAP(pthread_cond_timedwait);
 SHIM_WRAP(pthread_cond_wait);
 SHIM_WRAP(pthread_mutex_consistent);
-SHIM_WRAP(pthread_mutex_timedlock);
+SHIM_WRAP(pthread_mutex_consistent_np);
+SHIM_WRAP(pthread_mutex_timedlock, caller);
 SHIM_WRAP(pthread_mutex_trylock);
 
 int shim_pthread_mutex_destroy_impl(linux_pthread_mutex_t* mutex) {
+  if (mutex_pshared(mutex)) {
+    return pshared_mutex_destroy(mutex);
+  }
   //~ assert(mutex->_wrapped_mutex != 0);
   return pthread_mutex_destroy(NATIVE_MUTEX_T(mutex));
 }
 
 int shim_pthread_mutex_unlock_impl(linux_pthread_mutex_t* mutex) {
+  LOCKPROF_RELEASE(mutex);
+  if (mutex_pshared(mutex)) {
+    return pshared_mutex_unlock(mutex);
+  }
   assert(mutex->_wrapped_mutex != 0);
   return pthread_mutex_unlock(NATIVE_MUTEX_T(mutex));
 }
@@ -268,17 +363,6 @@ int shim_pthread_mutex_unlock_impl(linux_pthread_mutex_t* mutex) {
 SHIM_WRAP(pthread_mutex_destroy);
 SHIM_WRAP(pthread_mutex_unlock);
 
-int shim_pthread_rwlock_timedrdlock_impl(pthread_rwlock_t* rwlock, const linux_timespec* abs_timeout) {
-  return native_to_linux_errno(pthread_rwlock_timedrdlock(rwlock, abs_timeout));
-}
-
-int shim_pthread_rwlock_timedwrlock_impl(pthread_rwlock_t* rwlock, const linux_timespec* abs_timeout) {
-  return native_to_linux_errno(pthread_rwlock_timedwrlock(rwlock, abs_timeout));
-}
-
-SHIM_WRAP(pthread_rwlock_timedrdlock);
-SHIM_WRAP(pthread_rwlock_timedwrlock);
-
 int shim_pthread_getattr_np_impl(pthread_t thread, pthread_attr_t* attr) {
   pthread_attr_init(attr);
   return pthread_attr_get_np(thread, attr);
@@ -287,7 +371,12 @@ int shim_pthread_getattr_np_impl(pthread_t thread, pthread_attr_t* attr) {
 SHIM_WRAP(pthread_getattr_np);
 
 int shim_pthread_mutexattr_init_impl(linux_pthread_mutexattr_t* attr) {
-  return init_native_mutexattr(attr);
+  int err = init_native_mutexattr(attr);
+  if (err == 0) {
+    // libthr defaults to PTHREAD_MUTEX_ERRORCHECK, glibc to PTHREAD_MUTEX_NORMAL
+    assert(pthread_mutexattr_settype(find_native_mutexattr(attr), PTHREAD_MUTEX_NORMAL) == 0);
+  }
+  return err;
 }
 
 SHIM_WRAP(pthread_mutexattr_init);
@@ -309,34 +398,6 @@ int shim_pthread_mutexattr_setprotocol_impl(linux_pthread_mutexattr_t* attr, int
 SHIM_WRAP(pthread_mutexattr_getprotocol);
 SHIM_WRAP(pthread_mutexattr_setprotocol);
 
-int shim_pthread_barrierattr_init_impl(linux_pthread_barrierattr_t* attr) {
-  return init_native_barrierattr(attr);
-}
-
-int shim_pthread_barrierattr_destroy_impl(linux_pthread_barrierattr_t* attr) {
-  return destroy_native_barrierattr(attr);
-}
-
-SHIM_WRAP(pthread_barrierattr_init);
-SHIM_WRAP(pthread_barrierattr_destroy);
-
-int shim_pthread_barrierattr_getpshared_impl(const linux_pthread_barrierattr_t* attr, int* pshared) {
-  return pthread_barrierattr_getpshared(find_native_barrierattr(attr), pshared);
-}
-
-int shim_pthread_barrierattr_setpshared_impl(linux_pthread_barrierattr_t* attr, int pshared) {
-  return pthread_barrierattr_setpshared(find_native_barrierattr(attr), pshared);
-}
-
-SHIM_WRAP(pthread_barrierattr_getpshared);
-SHIM_WRAP(pthread_barrierattr_setpshared);
-
-int shim_pthread_barrier_init_impl(pthread_barrier_t* barrier, const linux_pthread_barrierattr_t* attr, unsigned count) {
-  return pthread_barrier_init(barrier, find_native_barrierattr(attr), count);
-}
-
-SHIM_WRAP(pthread_barrier_init);
-
 int shim_pthread_condattr_init_impl(linux_pthread_condattr_t* attr) {
   return init_native_condattr(attr);
 }
@@ -348,12 +409,20 @@ int shim_pthread_condattr_destroy_impl(linux_pthread_condattr_t* attr) {
 SHIM_WRAP(pthread_condattr_init);
 SHIM_WRAP(pthread_condattr_destroy);
 
-int shim_pthread_condattr_getclock_impl(linux_pthread_condattr_t* restrict attr, clockid_t* restrict clock_id) {
-  return pthread_condattr_getclock(find_native_condattr(attr), clock_id);
+int shim_pthread_condattr_getclock_impl(linux_pthread_condattr_t* restrict attr, linux_clockid_t* restrict linux_clock_id) {
+  clockid_t clock_id;
+  int err = pthread_condattr_getclock(find_native_condattr(attr), &clock_id);
+  if (err == 0) {
+    *linux_clock_id = native_to_linux_clockid(clock_id);
+  }
+  return err;
 }
 
-int shim_pthread_condattr_setclock_impl(linux_pthread_condattr_t* attr, clockid_t clock_id) {
-  return pthread_condattr_setclock(find_native_condattr(attr), clock_id);
+int shim_pthread_condattr_setclock_impl(linux_pthread_condattr_t* attr, linux_clockid_t linux_clock_id) {
+  if (linux_clock_id != LINUX_CLOCK_REALTIME && linux_clock_id != LINUX_CLOCK_MONOTONIC) {
+    return EINVAL;
+  }
+  return pthread_condattr_setclock(find_native_condattr(attr), linux_to_native_clockid(linux_clock_id));
 }
 
 SHIM_WRAP(pthread_condattr_getclock);
@@ -370,11 +439,54 @@ int shim_pthread_condattr_setpshared_impl(linux_pthread_condattr_t* attr, int ps
 SHIM_WRAP(pthread_condattr_setpshared);
 SHIM_WRAP(pthread_condattr_getpshared);
 
-int shim_pthread_cond_init_impl(pthread_cond_t* cond, const linux_pthread_condattr_t* attr) {
-  return pthread_cond_init(cond, find_native_condattr(attr));
+int shim_pthread_cond_init_impl(linux_pthread_cond_t* cond, const linux_pthread_condattr_t* attr) {
+
+  pthread_condattr_t* native_attr = find_native_condattr(attr);
+
+  int pshared = PTHREAD_PROCESS_PRIVATE;
+  clockid_t clock_id = CLOCK_REALTIME;
+  if (native_attr != NULL) {
+    assert(pthread_condattr_getpshared(native_attr, &pshared) == 0);
+    assert(pthread_condattr_getclock(native_attr, &clock_id) == 0);
+  }
+
+  pshared_cond_init(cond, pshared == PTHREAD_PROCESS_SHARED, clock_id);
+
+  if (pshared == PTHREAD_PROCESS_SHARED) {
+    cond->_wrapped_cond = NULL;
+    return 0;
+  }
+
+  return pthread_cond_init(&cond->_wrapped_cond, native_attr);
+}
+
+int shim_pthread_cond_destroy_impl(linux_pthread_cond_t* cond) {
+  if (cond_pshared(cond)) {
+    return pshared_cond_destroy(cond);
+  }
+  return pthread_cond_destroy(&cond->_wrapped_cond);
+}
+
+int shim_pthread_cond_signal_impl(linux_pthread_cond_t* cond) {
+  pshared_cond_signal(cond);
+  if (cond_pshared(cond)) {
+    return 0;
+  }
+  return pthread_cond_signal(&cond->_wrapped_cond);
+}
+
+int shim_pthread_cond_broadcast_impl(linux_pthread_cond_t* cond) {
+  pshared_cond_broadcast(cond);
+  if (cond_pshared(cond)) {
+    return 0;
+  }
+  return pthread_cond_broadcast(&cond->_wrapped_cond);
 }
 
 SHIM_WRAP(pthread_cond_init);
+SHIM_WRAP(pthread_cond_destroy);
+SHIM_WRAP(pthread_cond_signal);
+SHIM_WRAP(pthread_cond_broadcast);
 
 int shim_pthread_attr_getinheritsched_impl(const pthread_attr_t* attr, int* linux_inheritsched) {
 
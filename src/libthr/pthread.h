@@ -1,14 +1,27 @@
+#pragma once
+
 #include <pthread.h>
 
 #define LINUX_PTHREAD_CANCELED ((void*)-1)
 
+/*
+ * Private mutexes wrap a lazily created libthr mutex. Process-shared ones can't
+ * point into one process' heap, so they live in place (see pshared.c); they are
+ * told apart by LINUX_PTHREAD_MUTEX_PSHARED_BIT in linux_kind, like glibc does.
+ */
 struct shim_pthread_mutex {
   pthread_mutex_t _wrapped_mutex;
-  uint32_t        _pad[2];
+  uint32_t        shared_lock;   // pshared only: 0 unlocked, 1 locked, 2 locked with waiters
+  int32_t         shared_owner;  // pshared only: thread id of the owner
   uint32_t        linux_kind;
+  uint32_t        shared_count;  // pshared only: recursion depth
   pthread_mutex_t _init_mutex;
 };
 
+#define LINUX_PTHREAD_MUTEX_ROBUST_BIT  16
+#define LINUX_PTHREAD_MUTEX_PSHARED_BIT 128
+#define LINUX_PTHREAD_MUTEX_KIND_MASK   0x0F
+
 typedef struct shim_pthread_mutex linux_pthread_mutex_t;
 
 #ifdef __i386__
@@ -19,14 +32,112 @@ _Static_assert(sizeof(struct shim_pthread_mutex) <= 24 /* sizeof(pthread_mutex_t
 _Static_assert(sizeof(struct shim_pthread_mutex) <= 40 /* sizeof(pthread_mutex_t) on glibc/Linux */, "");
 #endif
 
-typedef uint32_t linux_pthread_barrierattr_t;
+typedef uint32_t linux_pthread_barrierattr_t; // enum linux_pthread_process_shared
 typedef uint32_t linux_pthread_condattr_t;
 typedef uint32_t linux_pthread_mutexattr_t;
 typedef uint32_t linux_pthread_once_t;
 
-_Static_assert(sizeof(pthread_rwlockattr_t) <= 8 /* sizeof(pthread_rwlockattr_t) on glibc/Linux */, "");
+enum linux_pthread_process_shared {
+  LINUX_PTHREAD_PROCESS_PRIVATE = 0,
+  LINUX_PTHREAD_PROCESS_SHARED  = 1
+};
+
+enum linux_pthread_rwlock_kind {
+  LINUX_PTHREAD_RWLOCK_PREFER_READER_NP              = 0,
+  LINUX_PTHREAD_RWLOCK_PREFER_WRITER_NP              = 1,
+  LINUX_PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP = 2
+};
+
+struct shim_pthread_rwlockattr {
+  int32_t kind;
+  int32_t pshared;
+};
+
+typedef struct shim_pthread_rwlockattr linux_pthread_rwlockattr_t;
+
+_Static_assert(sizeof(struct shim_pthread_rwlockattr) <= 8 /* sizeof(pthread_rwlockattr_t) on glibc/Linux */, "");
+
+/*
+ * Lives entirely inside the glibc object. A zeroed object is a valid unlocked
+ * reader-preferring lock, and kind/pshared/owner sit where glibc keeps __flags,
+ * __shared and __cur_writer, so glibc's static initializers keep working.
+ */
+struct shim_pthread_rwlock {
+  uint32_t state;           // RWLOCK_WRITER | number of readers
+  uint32_t waiters;         // blocked readers (low 16 bits), blocked writers (high 16 bits)
+  uint32_t readers_seq;     // readers park here
+  uint32_t writers_seq;     // writers park here
+  uint32_t rbias;           // reader fast path (visible readers table) enabled
+  uint32_t rbias_inhibit;   // don't re-enable rbias before this time (usec, wrapping)
+#ifdef __i386__
+  uint8_t  kind;
+  uint8_t  pshared;
+  uint8_t  _pad[2];
+  int32_t  owner;
+#endif
+#ifdef __x86_64__
+  int32_t  owner;
+  int32_t  pshared;
+  uint8_t  _pad[16];
+  uint32_t kind;
+  uint32_t _pad2;
+#endif
+};
+
+typedef struct shim_pthread_rwlock linux_pthread_rwlock_t;
+
+#ifdef __i386__
+_Static_assert(sizeof(struct shim_pthread_rwlock) == 32 /* sizeof(pthread_rwlock_t) on glibc/Linux */, "");
+#endif
+
+#ifdef __x86_64__
+_Static_assert(sizeof(struct shim_pthread_rwlock) == 56 /* sizeof(pthread_rwlock_t) on glibc/Linux */, "");
+#endif
+
+struct shim_pthread_barrier {
+  uint32_t count;     // BARRIER_PSHARED | threads per round
+  uint32_t arrived;   // arrivals since the last reset, each one's ticket
+  uint32_t released;  // tickets up to here have been released, waiters park here
+  uint32_t sleepers;  // threads parked on released
+  uint32_t left;      // threads that have left pthread_barrier_wait since the last reset
+};
+
+typedef struct shim_pthread_barrier linux_pthread_barrier_t;
+
+#ifdef __i386__
+_Static_assert(sizeof(struct shim_pthread_barrier) <= 20 /* sizeof(pthread_barrier_t) on glibc/Linux */, "");
+#endif
+
+#ifdef __x86_64__
+_Static_assert(sizeof(struct shim_pthread_barrier) <= 32 /* sizeof(pthread_barrier_t) on glibc/Linux */, "");
+#endif
+
+/*
+ * Waiters on private condvars go through the wrapped libthr condvar, unless the
+ * mutex is process-shared. Everything else waits on seq, which is also what makes
+ * process-shared condvars work. flags sits where glibc keeps __wrefs, whose bit 0
+ * is the pshared flag too.
+ */
+struct shim_pthread_cond {
+  pthread_cond_t _wrapped_cond;
+  uint32_t       seq;      // bumped by signal/broadcast, waiters park here
+  uint32_t       waiters;  // threads parked on seq
+  int32_t        clock;    // native clock id
+#ifdef __i386__
+  uint32_t       _pad[5];
+#endif
+#ifdef __x86_64__
+  uint32_t       _pad[4];
+#endif
+  uint32_t       flags;
+  uint32_t       _pad2[2];
+};
+
+#define SHIM_COND_PSHARED 1
+
+typedef struct shim_pthread_cond linux_pthread_cond_t;
 
-typedef pthread_rwlockattr_t linux_pthread_rwlockattr_t;
+_Static_assert(sizeof(struct shim_pthread_cond) == 48 /* sizeof(pthread_cond_t) on glibc/Linux */, "");
 
 enum linux_pthread_mutextype {
   LINUX_PTHREAD_MUTEX_NORMAL      = 0,
@@ -0,0 +1,485 @@
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <pthread_np.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include "../shim.h"
+#include "../libc/time.h"
+#include "lockprof.h"
+#include "pthread.h"
+#include "umtx.h"
+
+#define RWLOCK_WRITER       0x80000000u
+#define RWLOCK_READERS_MASK 0x7FFFFFFFu
+
+#define WAITING_READER     0x00001u
+#define WAITING_WRITER     0x10000u
+#define WAITING_READERS(w) ((w) & 0xFFFFu)
+#define WAITING_WRITERS(w) ((w) >> 16)
+
+#define RWLOCK_SPINS 100
+
+/*
+ * Reader bias a la BRAVO (Dice, Kogan: "BRAVO -- Biased Locking for Reader-Writer Locks").
+ *
+ * Once a lock has seen RBIAS_THRESHOLD read acquisitions in a row without a writer,
+ * readers stop touching the lock word and instead publish themselves in a slot of
+ * the process-wide visible_readers table picked by hashing (lock, thread). A writer
+ * takes the underlying lock, revokes the bias and waits for the table to drain; the
+ * bias then stays off for RBIAS_INHIBIT_MULTIPLIER times the revocation cost.
+ *
+ * Not used for pshared locks, the table is per process.
+ */
+
+#define RBIAS_ENABLED            0x80000000u
+#define RBIAS_THRESHOLD          64
+#define RBIAS_INHIBIT_MULTIPLIER 9
+
+#define VISIBLE_READERS_SIZE 4096
+#define MAX_FAST_READS       8
+
+static void* visible_readers[VISIBLE_READERS_SIZE] __attribute__((aligned(64)));
+
+static __thread struct {
+  void** slots[MAX_FAST_READS];
+  int    count;
+} fast_reads;
+
+static bool rwlock_pshared(const linux_pthread_rwlock_t* rwlock) {
+  return rwlock->pshared == LINUX_PTHREAD_PROCESS_SHARED;
+}
+
+static bool rwlock_prefers_writers(const linux_pthread_rwlock_t* rwlock) {
+  return rwlock->kind == LINUX_PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP;
+}
+
+static uint32_t now_usec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_FAST, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+static void** visible_readers_slot(const linux_pthread_rwlock_t* rwlock) {
+  uint64_t h = (uint64_t)(uintptr_t)rwlock * 0x9E3779B97F4A7C15ull ^ (uint64_t)(uintptr_t)&fast_reads * 0xC2B2AE3D27D4EB4Full;
+  return &visible_readers[(h >> 32) % VISIBLE_READERS_SIZE];
+}
+
+static bool rwlock_fast_rdlock(linux_pthread_rwlock_t* rwlock) {
+
+  if (!(__atomic_load_n(&rwlock->rbias, __ATOMIC_RELAXED) & RBIAS_ENABLED) || fast_reads.count == MAX_FAST_READS) {
+    return false;
+  }
+
+  void** slot     = visible_readers_slot(rwlock);
+  void*  expected = NULL;
+
+  if (!__atomic_compare_exchange_n(slot, &expected, rwlock, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return false;
+  }
+
+  if (__atomic_load_n(&rwlock->rbias, __ATOMIC_SEQ_CST) & RBIAS_ENABLED) {
+    fast_reads.slots[fast_reads.count++] = slot;
+    return true;
+  }
+
+  // raced with a writer revoking the bias
+  __atomic_store_n(slot, NULL, __ATOMIC_RELEASE);
+  return false;
+}
+
+static bool rwlock_fast_unlock(linux_pthread_rwlock_t* rwlock) {
+
+  for (int i = fast_reads.count - 1; i >= 0; i--) {
+    if (*fast_reads.slots[i] == rwlock) {
+      __atomic_store_n(fast_reads.slots[i], NULL, __ATOMIC_RELEASE);
+      fast_reads.slots[i] = fast_reads.slots[--fast_reads.count];
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void rwlock_note_slow_read(linux_pthread_rwlock_t* rwlock) {
+
+  if (rwlock_pshared(rwlock)) {
+    return;
+  }
+
+  // readers overflowing fast_reads get here with the bias on: the count must not
+  // carry into RBIAS_ENABLED, which would drop the bias without draining the table
+  uint32_t rbias = __atomic_load_n(&rwlock->rbias, __ATOMIC_RELAXED);
+  uint32_t count;
+
+  do {
+    if (rbias & RBIAS_ENABLED) {
+      return;
+    }
+    count = (rbias + 1) & ~RBIAS_ENABLED;
+  } while (!__atomic_compare_exchange_n(&rwlock->rbias, &rbias, count, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  if (count % RBIAS_THRESHOLD != 0) {
+    return;
+  }
+
+  rbias = count;
+
+  uint32_t inhibit = __atomic_load_n(&rwlock->rbias_inhibit, __ATOMIC_RELAXED);
+  if (inhibit == 0 || (int32_t)(now_usec() - inhibit) >= 0) {
+    // we hold a read lock, so no writer can be revoking concurrently
+    __atomic_compare_exchange_n(&rwlock->rbias, &rbias, RBIAS_ENABLED, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+  }
+}
+
+static void rwlock_revoke_rbias(linux_pthread_rwlock_t* rwlock) {
+
+  uint32_t rbias = __atomic_exchange_n(&rwlock->rbias, 0, __ATOMIC_SEQ_CST);
+  if (!(rbias & RBIAS_ENABLED)) {
+    return;
+  }
+
+  uint32_t start = now_usec();
+
+  for (int i = 0; i < VISIBLE_READERS_SIZE; i++) {
+    for (int spins = 0; __atomic_load_n(&visible_readers[i], __ATOMIC_SEQ_CST) == rwlock; spins++) {
+      if (spins < RWLOCK_SPINS) {
+        cpu_relax();
+      } else {
+        sched_yield();
+      }
+    }
+  }
+
+  uint32_t end = now_usec();
+
+  __atomic_store_n(&rwlock->rbias_inhibit, (end + (end - start) * RBIAS_INHIBIT_MULTIPLIER) | 1, __ATOMIC_RELAXED);
+}
+
+static int rwlock_try_rdlock(linux_pthread_rwlock_t* rwlock) {
+
+  uint32_t state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+
+  for (;;) {
+
+    if (state & RWLOCK_WRITER) {
+      return EBUSY;
+    }
+
+    if (rwlock_prefers_writers(rwlock) && WAITING_WRITERS(__atomic_load_n(&rwlock->waiters, __ATOMIC_RELAXED)) > 0) {
+      return EBUSY;
+    }
+
+    if ((state & RWLOCK_READERS_MASK) == RWLOCK_READERS_MASK) {
+      return EAGAIN;
+    }
+
+    if (__atomic_compare_exchange_n(&rwlock->state, &state, state + 1, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      return 0;
+    }
+  }
+}
+
+static int rwlock_try_wrlock(linux_pthread_rwlock_t* rwlock) {
+  uint32_t state = 0;
+  if (__atomic_compare_exchange_n(&rwlock->state, &state, RWLOCK_WRITER, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return 0;
+  } else {
+    return EBUSY;
+  }
+}
+
+// called with the lock released, decides who goes next
+static void rwlock_wake_waiters(linux_pthread_rwlock_t* rwlock) {
+
+  uint32_t waiters = __atomic_load_n(&rwlock->waiters, __ATOMIC_SEQ_CST);
+  bool     pshared = rwlock_pshared(rwlock);
+
+  if (WAITING_WRITERS(waiters) > 0) {
+    __atomic_add_fetch(&rwlock->writers_seq, 1, __ATOMIC_SEQ_CST);
+    umtx_wake(&rwlock->writers_seq, 1, pshared);
+    if (rwlock_prefers_writers(rwlock)) {
+      return;
+    }
+  }
+
+  if (WAITING_READERS(waiters) > 0) {
+    __atomic_add_fetch(&rwlock->readers_seq, 1, __ATOMIC_SEQ_CST);
+    umtx_wake(&rwlock->readers_seq, UMTX_WAKE_ALL, pshared);
+  }
+}
+
+static int rwlock_rdlock(linux_pthread_rwlock_t* rwlock, clockid_t clock_id, const struct timespec* abstime) {
+
+  if (rwlock_fast_rdlock(rwlock)) {
+    return 0;
+  }
+
+  if ((__atomic_load_n(&rwlock->state, __ATOMIC_RELAXED) & RWLOCK_WRITER) && rwlock->owner == pthread_getthreadid_np()) {
+    return EDEADLK;
+  }
+
+  int err = rwlock_try_rdlock(rwlock);
+
+  for (int i = 0; err == EBUSY && i < RWLOCK_SPINS; i++) {
+    cpu_relax();
+    err = rwlock_try_rdlock(rwlock);
+  }
+
+  while (err == EBUSY) {
+
+    uint32_t seq = __atomic_load_n(&rwlock->readers_seq, __ATOMIC_SEQ_CST);
+
+    __atomic_add_fetch(&rwlock->waiters, WAITING_READER, __ATOMIC_SEQ_CST);
+
+    err = rwlock_try_rdlock(rwlock);
+    if (err == EBUSY) {
+      err = umtx_wait_uint(&rwlock->readers_seq, seq, rwlock_pshared(rwlock), clock_id, abstime);
+      if (err == 0 || err == EINTR) {
+        err = EBUSY;
+      }
+    }
+
+    __atomic_sub_fetch(&rwlock->waiters, WAITING_READER, __ATOMIC_SEQ_CST);
+  }
+
+  if (err == 0) {
+    rwlock_note_slow_read(rwlock);
+  } else if (__atomic_load_n(&rwlock->state, __ATOMIC_SEQ_CST) == 0) {
+    // we might have eaten a wakeup meant for someone else
+    rwlock_wake_waiters(rwlock);
+  }
+
+  return err;
+}
+
+static int rwlock_wrlock(linux_pthread_rwlock_t* rwlock, clockid_t clock_id, const struct timespec* abstime) {
+
+  int self = pthread_getthreadid_np();
+
+  if ((__atomic_load_n(&rwlock->state, __ATOMIC_RELAXED) & RWLOCK_WRITER) && rwlock->owner == self) {
+    return EDEADLK;
+  }
+
+  int err = rwlock_try_wrlock(rwlock);
+
+  for (int i = 0; err == EBUSY && i < RWLOCK_SPINS; i++) {
+    cpu_relax();
+    err = rwlock_try_wrlock(rwlock);
+  }
+
+  while (err == EBUSY) {
+
+    uint32_t seq = __atomic_load_n(&rwlock->writers_seq, __ATOMIC_SEQ_CST);
+
+    __atomic_add_fetch(&rwlock->waiters, WAITING_WRITER, __ATOMIC_SEQ_CST);
+
+    err = rwlock_try_wrlock(rwlock);
+    if (err == EBUSY) {
+      err = umtx_wait_uint(&rwlock->writers_seq, seq, rwlock_pshared(rwlock), clock_id, abstime);
+      if (err == 0 || err == EINTR) {
+        err = EBUSY;
+      }
+    }
+
+    __atomic_sub_fetch(&rwlock->waiters, WAITING_WRITER, __ATOMIC_SEQ_CST);
+  }
+
+  if (err == 0) {
+    rwlock->owner = self;
+    rwlock_revoke_rbias(rwlock);
+  } else if (__atomic_load_n(&rwlock->state, __ATOMIC_SEQ_CST) == 0 || rwlock_prefers_writers(rwlock)) {
+    // readers may have been held back on our account, or we ate a wakeup
+    rwlock_wake_waiters(rwlock);
+  }
+
+  return err;
+}
+
+int shim_pthread_rwlock_init_impl(linux_pthread_rwlock_t* rwlock, const linux_pthread_rwlockattr_t* attr) {
+
+  memset(rwlock, 0, sizeof(linux_pthread_rwlock_t));
+
+  if (attr != NULL) {
+    rwlock->kind    = attr->kind;
+    rwlock->pshared = attr->pshared;
+  }
+
+  return 0;
+}
+
+int shim_pthread_rwlock_destroy_impl(linux_pthread_rwlock_t* rwlock) {
+  return 0;
+}
+
+SHIM_WRAP(pthread_rwlock_init);
+SHIM_WRAP(pthread_rwlock_destroy);
+
+int shim_pthread_rwlock_tryrdlock_impl(linux_pthread_rwlock_t* rwlock);
+
+int shim_pthread_rwlock_rdlock_impl(linux_pthread_rwlock_t* rwlock, void* caller) {
+  return LOCKPROF_ACQUIRE(rwlock, LOCKPROF_RWLOCK_READ, caller, shim_pthread_rwlock_tryrdlock_impl(rwlock),
+    native_to_linux_errno(rwlock_rdlock(rwlock, CLOCK_REALTIME, NULL)));
+}
+
+int shim_pthread_rwlock_tryrdlock_impl(linux_pthread_rwlock_t* rwlock) {
+
+  if (rwlock_fast_rdlock(rwlock)) {
+    return 0;
+  }
+
+  int err = rwlock_try_rdlock(rwlock);
+  if (err == 0) {
+    rwlock_note_slow_read(rwlock);
+  }
+
+  return native_to_linux_errno(err);
+}
+
+int shim_pthread_rwlock_timedrdlock_impl(linux_pthread_rwlock_t* rwlock, const linux_timespec* abs_timeout, void* caller) {
+  return LOCKPROF_ACQUIRE(rwlock, LOCKPROF_RWLOCK_READ, caller, shim_pthread_rwlock_tryrdlock_impl(rwlock),
+    native_to_linux_errno(rwlock_rdlock(rwlock, CLOCK_REALTIME, abs_timeout)));
+}
+
+int shim_pthread_rwlock_clockrdlock_impl(linux_pthread_rwlock_t* rwlock, linux_clockid_t linux_clock_id, const linux_timespec* abs_timeout, void* caller) {
+
+  if (linux_clock_id != LINUX_CLOCK_REALTIME && linux_clock_id != LINUX_CLOCK_MONOTONIC) {
+    return EINVAL;
+  }
+
+  return LOCKPROF_ACQUIRE(rwlock, LOCKPROF_RWLOCK_READ, caller, shim_pthread_rwlock_tryrdlock_impl(rwlock),
+    native_to_linux_errno(rwlock_rdlock(rwlock, linux_to_native_clockid(linux_clock_id), abs_timeout)));
+}
+
+SHIM_WRAP(pthread_rwlock_rdlock, caller);
+SHIM_WRAP(pthread_rwlock_tryrdlock);
+SHIM_WRAP(pthread_rwlock_timedrdlock, caller);
+SHIM_WRAP(pthread_rwlock_clockrdlock, caller);
+
+int shim_pthread_rwlock_trywrlock_impl(linux_pthread_rwlock_t* rwlock);
+
+int shim_pthread_rwlock_wrlock_impl(linux_pthread_rwlock_t* rwlock, void* caller) {
+  return LOCKPROF_ACQUIRE(rwlock, LOCKPROF_RWLOCK_WRITE, caller, shim_pthread_rwlock_trywrlock_impl(rwlock),
+    native_to_linux_errno(rwlock_wrlock(rwlock, CLOCK_REALTIME, NULL)));
+}
+
+int shim_pthread_rwlock_trywrlock_impl(linux_pthread_rwlock_t* rwlock) {
+
+  int err = rwlock_try_wrlock(rwlock);
+  if (err == 0) {
+    rwlock->owner = pthread_getthreadid_np();
+    rwlock_revoke_rbias(rwlock);
+  }
+
+  return native_to_linux_errno(err);
+}
+
+int shim_pthread_rwlock_timedwrlock_impl(linux_pthread_rwlock_t* rwlock, const linux_timespec* abs_timeout, void* caller) {
+  return LOCKPROF_ACQUIRE(rwlock, LOCKPROF_RWLOCK_WRITE, caller, shim_pthread_rwlock_trywrlock_impl(rwlock),
+    native_to_linux_errno(rwlock_wrlock(rwlock, CLOCK_REALTIME, abs_timeout)));
+}
+
+int shim_pthread_rwlock_clockwrlock_impl(linux_pthread_rwlock_t* rwlock, linux_clockid_t linux_clock_id, const linux_timespec* abs_timeout, void* caller) {
+
+  if (linux_clock_id != LINUX_CLOCK_REALTIME && linux_clock_id != LINUX_CLOCK_MONOTONIC) {
+    return EINVAL;
+  }
+
+  return LOCKPROF_ACQUIRE(rwlock, LOCKPROF_RWLOCK_WRITE, caller, shim_pthread_rwlock_trywrlock_impl(rwlock),
+    native_to_linux_errno(rwlock_wrlock(rwlock, linux_to_native_clockid(linux_clock_id), abs_timeout)));
+}
+
+SHIM_WRAP(pthread_rwlock_wrlock, caller);
+SHIM_WRAP(pthread_rwlock_trywrlock);
+SHIM_WRAP(pthread_rwlock_timedwrlock, caller);
+SHIM_WRAP(pthread_rwlock_clockwrlock, caller);
+
+int shim_pthread_rwlock_unlock_impl(linux_pthread_rwlock_t* rwlock) {
+
+  LOCKPROF_RELEASE(rwlock);
+
+  if (rwlock_fast_unlock(rwlock)) {
+    return 0;
+  }
+
+  uint32_t state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+
+  if (state & RWLOCK_WRITER) {
+
+    if (rwlock->owner != pthread_getthreadid_np()) {
+      return EPERM;
+    }
+
+    rwlock->owner = 0;
+    __atomic_store_n(&rwlock->state, 0, __ATOMIC_SEQ_CST);
+
+    rwlock_wake_waiters(rwlock);
+
+  } else {
+
+    if ((state & RWLOCK_READERS_MASK) == 0) {
+      return EPERM;
+    }
+
+    if (__atomic_sub_fetch(&rwlock->state, 1, __ATOMIC_SEQ_CST) == 0) {
+      rwlock_wake_waiters(rwlock);
+    }
+  }
+
+  return 0;
+}
+
+SHIM_WRAP(pthread_rwlock_unlock);
+
+int shim_pthread_rwlockattr_init_impl(linux_pthread_rwlockattr_t* attr) {
+  attr->kind    = LINUX_PTHREAD_RWLOCK_PREFER_READER_NP;
+  attr->pshared = LINUX_PTHREAD_PROCESS_PRIVATE;
+  return 0;
+}
+
+int shim_pthread_rwlockattr_destroy_impl(linux_pthread_rwlockattr_t* attr) {
+  return 0;
+}
+
+SHIM_WRAP(pthread_rwlockattr_init);
+SHIM_WRAP(pthread_rwlockattr_destroy);
+
+int shim_pthread_rwlockattr_getpshared_impl(const linux_pthread_rwlockattr_t* attr, int* pshared) {
+  *pshared = attr->pshared;
+  return 0;
+}
+
+int shim_pthread_rwlockattr_setpshared_impl(linux_pthread_rwlockattr_t* attr, int pshared) {
+
+  if (pshared != LINUX_PTHREAD_PROCESS_PRIVATE && pshared != LINUX_PTHREAD_PROCESS_SHARED) {
+    return EINVAL;
+  }
+
+  attr->pshared = pshared;
+  return 0;
+}
+
+SHIM_WRAP(pthread_rwlockattr_getpshared);
+SHIM_WRAP(pthread_rwlockattr_setpshared);
+
+int shim_pthread_rwlockattr_getkind_np_impl(const linux_pthread_rwlockattr_t* attr, int* pref) {
+  *pref = attr->kind;
+  return 0;
+}
+
+int shim_pthread_rwlockattr_setkind_np_impl(linux_pthread_rwlockattr_t* attr, int pref) {
+
+  switch (pref) {
+    case LINUX_PTHREAD_RWLOCK_PREFER_READER_NP:
+    case LINUX_PTHREAD_RWLOCK_PREFER_WRITER_NP:
+    case LINUX_PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP:
+      attr->kind = pref;
+      return 0;
+    default:
+      return EINVAL;
+  }
+}
+
+SHIM_WRAP(pthread_rwlockattr_getkind_np);
+SHIM_WRAP(pthread_rwlockattr_setkind_np);
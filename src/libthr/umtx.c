@@ -0,0 +1,43 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/umtx.h>
+#include "../shim.h"
+#include "umtx.h"
+
+int umtx_wait_uint(volatile uint32_t* addr, uint32_t expected, bool pshared, clockid_t clock_id, const struct timespec* abstime) {
+
+  int op = pshared ? UMTX_OP_WAIT_UINT : UMTX_OP_WAIT_UINT_PRIVATE;
+
+  int err;
+  if (abstime != NULL) {
+
+    if (abstime->tv_nsec < 0 || abstime->tv_nsec >= 1000000000) {
+      return EINVAL;
+    }
+
+    struct _umtx_time timeout = {
+      ._timeout = *abstime,
+      ._flags   = UMTX_ABSTIME,
+      ._clockid = clock_id
+    };
+
+    err = _umtx_op((void*)addr, op, expected, (void*)(uintptr_t)sizeof(timeout), &timeout);
+
+  } else {
+    err = _umtx_op((void*)addr, op, expected, NULL, NULL);
+  }
+
+  if (err == -1) {
+    assert(errno == ETIMEDOUT || errno == EINTR || errno == EINVAL);
+    return errno;
+  }
+
+  return 0;
+}
+
+void umtx_wake(volatile uint32_t* addr, int count, bool pshared) {
+  int err = _umtx_op((void*)addr, pshared ? UMTX_OP_WAKE : UMTX_OP_WAKE_PRIVATE, count, NULL, NULL);
+  assert(err == 0);
+}
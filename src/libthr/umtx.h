@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Futex-style parking on a 32-bit word, backed by _umtx_op(2).
+ *
+ * Private objects use the *_PRIVATE ops (keyed by address in the current vmspace),
+ * pshared ones are keyed by the backing object so they work across processes.
+ */
+
+int  umtx_wait_uint(volatile uint32_t* addr, uint32_t expected, bool pshared, clockid_t clock_id, const struct timespec* abstime);
+void umtx_wake(volatile uint32_t* addr, int count, bool pshared);
+
+#define UMTX_WAKE_ALL INT32_MAX
+
+static inline void cpu_relax(void) {
+  __asm__ __volatile__("pause" ::: "memory");
+}
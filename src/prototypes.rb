@@ -383,7 +383,9 @@ define(["sys/types.h", "unistd.h"], [
 # GETRLIMIT(2)
 define(["sys/types.h", "sys/time.h", "sys/resource.h"], [
   "int getrlimit(int resource, struct rlimit* rlp)",
-  "int setrlimit(int resource, const struct rlimit* rlp)"
+  "int setrlimit(int resource, const struct rlimit* rlp)",
+  "int prlimit(pid_t pid, int resource, const struct rlimit* new_limit, struct rlimit* old_limit)",
+  "int prlimit64(pid_t pid, int resource, const struct rlimit64* new_limit, struct rlimit64* old_limit)"
 ])
 
 # GETRUSAGE(2)
@@ -532,7 +534,7 @@ define(["sys/mman.h"], [
 # OPEN(2)
 define(["fcntl.h"], [
   "int open(const char* path, int flags, ...)",
-  #~ "int openat(int fd, const char* path, int flags, ...)"
+  "int openat(int fd, const char* path, int flags, ...)"
 ])
 
 # PIPE(2)
@@ -633,6 +635,16 @@ define(["unistd.h"], [
   "int rmdir(const char* path)"
 ])
 
+# GETCPU(2)
+define(["sched.h"], [
+  "int getcpu(unsigned int* cpu, unsigned int* node)"
+])
+
+# SCHED_GETCPU(3)
+define(["sched.h"], [
+  "int sched_getcpu(void)"
+])
+
 # SCHED_GET_PRIORITY_MAX(2)
 define(["sched.h"], [
   "int sched_get_priority_max(int policy)",
@@ -2656,6 +2668,12 @@ define(["pthread.h"], [
   "int pthread_rwlock_timedwrlock(pthread_rwlock_t* rwlock, const struct timespec* abs_timeout)"
 ])
 
+# PTHREAD_RWLOCK_CLOCKRDLOCK(3)
+define(["pthread.h", "time.h"], [
+  "int pthread_rwlock_clockrdlock(pthread_rwlock_t* rwlock, clockid_t clockid, const struct timespec* abstime)",
+  "int pthread_rwlock_clockwrlock(pthread_rwlock_t* rwlock, clockid_t clockid, const struct timespec* abstime)"
+])
+
 # PTHREAD_RWLOCK_WRLOCK(3)
 define(["pthread.h"], [
   "int pthread_rwlock_wrlock(pthread_rwlock_t* lock)",
@@ -2825,6 +2843,11 @@ define(["semaphore.h", "time.h"], [
   "int sem_timedwait(sem_t* sem, const struct timespec* abs_timeout)"
 ])
 
+# SEM_CLOCKWAIT(3)
+define(["semaphore.h", "time.h"], [
+  "int sem_clockwait(sem_t* sem, clockid_t clockid, const struct timespec* abs_timeout)"
+])
+
 # SEM_OPEN(3)
 define(["semaphore.h"], [
   #~ "sem_t* sem_open(const char* name, int oflag, ...)",
@@ -3308,6 +3331,14 @@ define([
   "int getnameinfo(const struct sockaddr* restrict addr, socklen_t addrlen, char* restrict host, socklen_t hostlen, char* restrict serv, socklen_t servlen, int flags)",
   "const char* gai_strerror(int ecode)"
 ])
+
+# GETADDRINFO_A(3)
+define(["netdb.h", "signal.h"], [
+  "int getaddrinfo_a(int mode, struct gaicb** list, int nitems, struct sigevent* sevp)",
+  "int gai_suspend(const struct gaicb* const* list, int nitems, const struct timespec* timeout)",
+  "int gai_error(struct gaicb* req)",
+  "int gai_cancel(struct gaicb* req)"
+])
 # EPOLL_CREATE1(2)
 define(["sys/epoll.h"], [
     "int epoll_create1(int linux_flags)",
@@ -3638,7 +3669,7 @@ lsb_define(["pthread.h"], [
   "int pthread_mutexattr_getrobust_np(const pthread_mutexattr_t* __attr, int* __robustness)",
   "int pthread_mutexattr_setrobust_np(const pthread_mutexattr_t* __attr, int __robustness)",
   "int pthread_rwlockattr_getkind_np(const pthread_rwlockattr_t* attr, int* pref)",
-  "int pthread_rwlockattr_setkind_np(pthread_rwlockattr_t* attr, int* pref)"
+  "int pthread_rwlockattr_setkind_np(pthread_rwlockattr_t* attr, int pref)"
 ])
 
 # 14.17. Interface Definitions for libdl
@@ -3665,6 +3696,7 @@ lsb_define([], [
   "int fcntl64(int fd, int cmd, ...)",
   "int fgetpos64(FILE* stream, fpos64_t* pos)",
   "FILE* fopen64(const char* filename, const char* type)",
+  "FILE* freopen64(const char* filename, const char* type, FILE* stream)",
   "int ftruncate64(int fd, off64_t length)",
   "int ftw(const char* path, int (*fn)(const char*, const struct stat*, int), int maxfds)",
   "unsigned long getauxval(unsigned long type)",
@@ -3678,10 +3710,12 @@ lsb_define([], [
   "int open64(const char* path, int oflag, ...)",
   "int prctl(int option, unsigned long arg2, unsigned long arg3, unsigned long arg4, unsigned long arg5)",
   "int pthread_getname_np(pthread_t thread, char *name, size_t len)",
+  "int pthread_mutexattr_getpshared(const pthread_mutexattr_t* attr, int* pshared)",
   "int pthread_mutexattr_setpshared(pthread_mutexattr_t* attr, int pshared)",
   "int pthread_setname_np(pthread_t thread, const char *name)",
   "struct dirent64* readdir64(DIR* dirp)",
   "char* secure_getenv(const char* name)",
+  "int setrlimit64(int resource, const struct rlimit64* rlp)",
   "int sigaction(int signum, const struct sigaction* act, struct sigaction* oldact)",
   "sig_t signal(int sig, sig_t func)"
 ])
@@ -60,10 +60,23 @@ extern __thread int what_was_that_error;
 
 bool str_starts_with(const char* str, const char* substr);
 
+// 0 when there's no such sysctl
+unsigned long sysctl_ulong(const char* name);
+
+// clock ticks in /proc and sysconf(_SC_CLK_TCK), whatever kern.clockrate says
+#define LINUX_USER_HZ 100
+
 int native_to_linux_errno(int error);
 int linux_to_native_errno(int error);
 
 const char* redirect(const char* path);
+const char* sysfs_redirect(const char* path);
+
+struct stat;
+
+bool vfile_exists(const char* path);
+int  vfile_open(const char* path, int flags);
+int  vfile_stat(const char* path, struct stat* sb);
 
 struct globals {
 #ifdef __i386__
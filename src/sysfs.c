@@ -0,0 +1,622 @@
+#include <assert.h>
+#include <errno.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/cpuset.h>
+#include <sys/stat.h>
+#include <sys/sysctl.h>
+#include <sys/time.h>
+#include "shim.h"
+#include "cpuinfo.h"
+#include "sysfs.h"
+#include "libc/sys/numa.h"
+
+/*
+ * A synthetic, read-only /sys/devices/system/{cpu,node}.
+ *
+ * Thread pools and BLAS libraries size themselves from these files, so they get
+ * online/possible CPU lists, SMT/package topology, cache geometry and NUMA nodes.
+ * The tree is written out once per user, boot and set of online CPUs under /tmp
+ * and the paths are redirected there, which keeps open, fopen, stat and readdir
+ * working unchanged. Processes in different cpusets or jails get their own tree.
+ *
+ * Cache sharing and SMT siblings come from kern.sched.topology_spec, cache geometry
+ * and package/core ids from CPUID, read on each CPU in turn.
+ */
+
+#define SYSFS_PREFIX "/sys/devices/system"
+
+#define MAX_GROUPS 512
+#define MAX_DEPTH  16
+
+struct cpu_group {
+  int      cache_level;
+  bool     smt;
+  cpuset_t cpus;
+};
+
+static pthread_once_t sysfs_once = PTHREAD_ONCE_INIT;
+static char*          sysfs_root = NULL;
+
+static __thread char redirected_path[MAXPATHLEN];
+
+/*
+ * kern.sched.topology_spec looks like
+ *
+ *   <groups>
+ *    <group level="1" cache-level="3">
+ *     <cpu count="4" mask="f,0,0,0">0, 1, 2, 3</cpu>
+ *     <children>
+ *      <group level="2" cache-level="2">
+ *       <cpu count="2" mask="3,0,0,0">0, 1</cpu>
+ *       <flags><flag name="THREAD">THREAD group</flag><flag name="SMT">SMT group</flag></flags>
+ *      </group>
+ *      ...
+ */
+
+static int parse_topology_spec(struct cpu_group* groups) {
+
+  size_t len = 0;
+  if (sysctlbyname("kern.sched.topology_spec", NULL, &len, NULL, 0) == -1) {
+    return 0;
+  }
+
+  char* spec = malloc(len + 1);
+  if (sysctlbyname("kern.sched.topology_spec", spec, &len, NULL, 0) == -1) {
+    free(spec);
+    return 0;
+  }
+  spec[len] = '\0';
+
+  int ngroups = 0;
+  int stack[MAX_DEPTH];
+  int depth = 0;
+
+  for (char* s = strchr(spec, '<'); s != NULL; s = strchr(s + 1, '<')) {
+
+    int current = depth > 0 ? stack[depth - 1] : -1;
+
+    if (str_starts_with(s, "<group ")) {
+
+      int index = -1;
+      if (ngroups < MAX_GROUPS) {
+        index = ngroups++;
+        char* level = strstr(s, "cache-level=\"");
+        groups[index].cache_level = level != NULL ? atoi(level + sizeof("cache-level=\"") - 1) : 0;
+        groups[index].smt         = false;
+        CPU_ZERO(&groups[index].cpus);
+      }
+
+      if (depth < MAX_DEPTH) {
+        stack[depth++] = index;
+      }
+
+    } else if (str_starts_with(s, "</group>")) {
+
+      if (depth > 0) {
+        depth--;
+      }
+
+    } else if (str_starts_with(s, "<cpu ") && current != -1) {
+
+      char* list = strchr(s, '>');
+      while (list != NULL && *list != '<') {
+        char* end;
+        long cpu = strtol(list + 1, &end, 10);
+        if (end == list + 1) {
+          list++;
+          continue;
+        }
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+          CPU_SET(cpu, &groups[current].cpus);
+        }
+        list = end;
+      }
+
+    } else if ((str_starts_with(s, "<flag name=\"SMT\"") || str_starts_with(s, "<flag name=\"THREAD\"")) && current != -1) {
+      groups[current].smt = true;
+    }
+  }
+
+  free(spec);
+
+  return ngroups;
+}
+
+// the smallest group matching the predicate that contains the cpu
+static const cpuset_t* find_group(struct cpu_group* groups, int ngroups, int cpu, int cache_level, bool smt) {
+
+  const cpuset_t* best = NULL;
+
+  for (int i = 0; i < ngroups; i++) {
+    if (CPU_ISSET(cpu, &groups[i].cpus) && (smt ? groups[i].smt : groups[i].cache_level == cache_level)) {
+      if (best == NULL || CPU_COUNT(&groups[i].cpus) < CPU_COUNT(best)) {
+        best = &groups[i].cpus;
+      }
+    }
+  }
+
+  return best;
+}
+
+void format_cpulist(char* buf, size_t size, const cpuset_t* set) {
+
+  size_t len = 0;
+  buf[0] = '\0';
+
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+
+    if (!CPU_ISSET(cpu, set)) {
+      continue;
+    }
+
+    int last = cpu;
+    while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set)) {
+      last++;
+    }
+
+    const char* sep = len > 0 ? "," : "";
+    if (last == cpu) {
+      len += snprintf(buf + len, size - len, "%s%d", sep, cpu);
+    } else {
+      len += snprintf(buf + len, size - len, "%s%d-%d", sep, cpu, last);
+    }
+
+    assert(len < size);
+    cpu = last;
+  }
+}
+
+void format_cpumask(char* buf, size_t size, const cpuset_t* set, int ncpus) {
+
+  size_t len = 0;
+  buf[0] = '\0';
+
+  for (int word = (ncpus + 31) / 32 - 1; word >= 0; word--) {
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 32; i++) {
+      int cpu = word * 32 + i;
+      if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, set)) {
+        bits |= 1u << i;
+      }
+    }
+
+    len += snprintf(buf + len, size - len, "%s%08x", len > 0 ? "," : "", bits);
+    assert(len < size);
+  }
+}
+
+static void make_dir(char* path, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(path, MAXPATHLEN, fmt, args);
+  va_end(args);
+  mkdir(path, 0755);
+}
+
+static void put(const char* dir, const char* name, const char* fmt, ...) {
+
+  char path[MAXPATHLEN];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+  FILE* f = fopen(path, "w");
+  if (f == NULL) {
+    return;
+  }
+
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(f, fmt, args);
+  va_end(args);
+
+  fclose(f);
+  chmod(path, 0444);
+}
+
+static void put_cpuset(const char* dir, const char* name, const cpuset_t* set, int ncpus) {
+
+  char buf[8 * CPU_SETSIZE];
+  char list_name[64];
+
+  format_cpumask(buf, sizeof(buf), set, ncpus);
+  put(dir, name, "%s\n", buf);
+
+  format_cpulist(buf, sizeof(buf), set);
+  snprintf(list_name, sizeof(list_name), "%s_list", name);
+  put(dir, list_name, "%s\n", buf);
+}
+
+static int sysctl_int(const char* name, int fallback) {
+  int value;
+  size_t len = sizeof(value);
+  return sysctlbyname(name, &value, &len, NULL, 0) == 0 ? value : fallback;
+}
+
+static void write_cache(const char* cpu_dir, int index, const struct cache_info* cache, const cpuset_t* shared, int ncpus) {
+
+  static const char* types[] = {
+    [CPUID_TYPE_DATA]        = "Data",
+    [CPUID_TYPE_INSTRUCTION] = "Instruction",
+    [CPUID_TYPE_UNIFIED]     = "Unified"
+  };
+
+  char dir[MAXPATHLEN];
+  make_dir(dir, "%s/cache/index%d", cpu_dir, index);
+
+  put(dir, "level",                   "%u\n",  cache->level);
+  put(dir, "type",                    "%s\n",  cache->type <= CPUID_TYPE_UNIFIED ? types[cache->type] : "Unknown");
+  put(dir, "size",                    "%uK\n", cache->size / 1024);
+  put(dir, "coherency_line_size",     "%u\n",  cache->line_size);
+  put(dir, "physical_line_partition", "%u\n",  cache->partitions);
+  put(dir, "ways_of_associativity",   "%u\n",  cache->ways);
+  put(dir, "number_of_sets",          "%u\n",  cache->sets);
+
+  char buf[8 * CPU_SETSIZE];
+
+  format_cpumask(buf, sizeof(buf), shared, ncpus);
+  put(dir, "shared_cpu_map", "%s\n", buf);
+
+  format_cpulist(buf, sizeof(buf), shared);
+  put(dir, "shared_cpu_list", "%s\n", buf);
+
+  chmod(dir, 0555);
+}
+
+static void write_cpus(const char* root, const cpuset_t* online, struct cpu_info* infos, int ncpus) {
+
+  struct cpu_group* groups = malloc(sizeof(struct cpu_group) * MAX_GROUPS);
+  int ngroups = parse_topology_spec(groups);
+
+  char cpus_dir[MAXPATHLEN];
+  make_dir(cpus_dir, "%s/cpu", root);
+
+  cpuset_t possible;
+  CPU_ZERO(&possible);
+  for (int cpu = 0; cpu < ncpus; cpu++) {
+    CPU_SET(cpu, &possible);
+  }
+
+  char buf[8 * CPU_SETSIZE];
+
+  format_cpulist(buf, sizeof(buf), &possible);
+  put(cpus_dir, "possible", "%s\n", buf);
+  put(cpus_dir, "present",  "%s\n", buf);
+  put(cpus_dir, "kernel_max", "%d\n", CPU_SETSIZE - 1);
+
+  format_cpulist(buf, sizeof(buf), online);
+  put(cpus_dir, "online", "%s\n", buf);
+
+  cpuset_t offline;
+  CPU_ZERO(&offline);
+  for (int cpu = 0; cpu < ncpus; cpu++) {
+    if (!CPU_ISSET(cpu, online)) {
+      CPU_SET(cpu, &offline);
+    }
+  }
+  format_cpulist(buf, sizeof(buf), &offline);
+  put(cpus_dir, "offline", "%s\n", buf);
+
+  for (int cpu = 0; cpu < ncpus; cpu++) {
+
+    if (!CPU_ISSET(cpu, online)) {
+      continue;
+    }
+
+    struct cpu_info* info = &infos[cpu];
+
+    char cpu_dir[MAXPATHLEN], dir[MAXPATHLEN];
+    make_dir(cpu_dir, "%s/cpu%d", cpus_dir, cpu);
+
+    put(cpu_dir, "online", "1\n");
+
+    char node_link[MAXPATHLEN], node_target[64];
+    snprintf(node_link, sizeof(node_link), "%s/node%d", cpu_dir, native_cpu_domain(cpu));
+    snprintf(node_target, sizeof(node_target), "../../node/node%d", native_cpu_domain(cpu));
+    symlink(node_target, node_link);
+
+    cpuset_t package, siblings;
+    CPU_ZERO(&package);
+    CPU_ZERO(&siblings);
+
+    for (int other = 0; other < ncpus; other++) {
+      if (CPU_ISSET(other, online) && infos[other].package == info->package) {
+        CPU_SET(other, &package);
+        if (infos[other].core == info->core) {
+          CPU_SET(other, &siblings);
+        }
+      }
+    }
+
+    const cpuset_t* smt = find_group(groups, ngroups, cpu, 0, true);
+    if (smt != NULL) {
+      CPU_COPY(smt, &siblings);
+    }
+
+    make_dir(dir, "%s/topology", cpu_dir);
+
+    put(dir, "physical_package_id", "%u\n", info->package);
+    put(dir, "die_id",              "0\n");
+    put(dir, "core_id",             "%u\n", info->core);
+
+    put_cpuset(dir, "thread_siblings", &siblings, ncpus);
+    put_cpuset(dir, "core_cpus",       &siblings, ncpus);
+    put_cpuset(dir, "core_siblings",   &package,  ncpus);
+    put_cpuset(dir, "package_cpus",    &package,  ncpus);
+    put_cpuset(dir, "die_cpus",        &package,  ncpus);
+
+    chmod(dir, 0555);
+
+    make_dir(dir, "%s/cache", cpu_dir);
+
+    for (int i = 0; i < info->ncaches; i++) {
+
+      const struct cache_info* cache = &info->caches[i];
+
+      cpuset_t shared;
+      const cpuset_t* group = find_group(groups, ngroups, cpu, cache->level, false);
+
+      if (group != NULL) {
+        CPU_COPY(group, &shared);
+      } else {
+        // no scheduler group for this level: fall back on CPUID's sharing hint
+        CPU_ZERO(&shared);
+        for (int other = 0; other < ncpus; other++) {
+          if (CPU_ISSET(other, online) && (infos[other].apic_id >> cache->sharing_shift) == (info->apic_id >> cache->sharing_shift)) {
+            CPU_SET(other, &shared);
+          }
+        }
+      }
+
+      write_cache(cpu_dir, i, cache, &shared, ncpus);
+    }
+
+    chmod(dir, 0555);
+    chmod(cpu_dir, 0555);
+  }
+
+  chmod(cpus_dir, 0555);
+
+  free(groups);
+}
+
+static void write_nodes(const char* root, const cpuset_t* online, int ncpus) {
+
+  char nodes_dir[MAXPATHLEN];
+  make_dir(nodes_dir, "%s/node", root);
+
+  int ndomains = native_ndomains();
+
+  char list[32];
+  snprintf(list, sizeof(list), ndomains > 1 ? "0-%d" : "0", ndomains - 1);
+
+  put(nodes_dir, "possible",          "%s\n", list);
+  put(nodes_dir, "online",            "%s\n", list);
+  put(nodes_dir, "has_cpu",           "%s\n", list);
+  put(nodes_dir, "has_memory",        "%s\n", list);
+  put(nodes_dir, "has_normal_memory", "%s\n", list);
+
+  unsigned long physmem = 0;
+  size_t len = sizeof(physmem);
+  sysctlbyname("hw.physmem", &physmem, &len, NULL, 0);
+
+  for (int node = 0; node < ndomains; node++) {
+
+    char dir[MAXPATHLEN];
+    make_dir(dir, "%s/node%d", nodes_dir, node);
+
+    cpuset_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu = 0; cpu < ncpus; cpu++) {
+      if (CPU_ISSET(cpu, online) && native_cpu_domain(cpu) == node) {
+        CPU_SET(cpu, &cpus);
+      }
+    }
+
+    char buf[8 * CPU_SETSIZE];
+
+    format_cpumask(buf, sizeof(buf), &cpus, ncpus);
+    put(dir, "cpumap", "%s\n", buf);
+
+    format_cpulist(buf, sizeof(buf), &cpus);
+    put(dir, "cpulist", "%s\n", buf);
+
+    len = 0;
+    for (int other = 0; other < ndomains; other++) {
+      len += snprintf(buf + len, sizeof(buf) - len, "%s%d", other > 0 ? " " : "", other == node ? 10 : 20);
+    }
+    put(dir, "distance", "%s\n", buf);
+
+    // FreeBSD doesn't report per-domain sizes; assume an even split
+    char name[64];
+    snprintf(name, sizeof(name), "vm.domain.%d.stats.free_count", node);
+    unsigned long total = physmem / ndomains / 1024;
+    unsigned long free  = (unsigned long)(unsigned)sysctl_int(name, 0) * (getpagesize() / 1024);
+
+    put(dir, "meminfo",
+      "Node %d MemTotal:       %8lu kB\n"
+      "Node %d MemFree:        %8lu kB\n"
+      "Node %d MemUsed:        %8lu kB\n",
+      node, total, node, free, node, total > free ? total - free : 0
+    );
+
+    chmod(dir, 0555);
+  }
+
+  chmod(nodes_dir, 0555);
+}
+
+// The CPUs of the process's root cpuset, which is what a jail or `cpuset -s` restricts it to.
+static void get_online(cpuset_t* online) {
+  if (cpuset_getaffinity(CPU_LEVEL_ROOT, CPU_WHICH_PID, -1, sizeof(*online), online) == -1) {
+    CPU_ZERO(online);
+    for (int cpu = 0; cpu < MIN(sysctl_int("hw.ncpu", 1), CPU_SETSIZE); cpu++) {
+      CPU_SET(cpu, online);
+    }
+  }
+}
+
+// FNV-1a of the mask, to tell the trees of different cpusets apart.
+static uint32_t hash_cpuset(const cpuset_t* set) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < sizeof(*set); i++) {
+    hash = (hash ^ ((const uint8_t*)set)[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static bool generate(const char* root, const cpuset_t* online) {
+
+  int ncpus = MIN(sysctl_int("hw.ncpu", 1), CPU_SETSIZE);
+
+  for (int cpu = ncpus; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, online)) {
+      ncpus = cpu + 1;
+    }
+  }
+
+  struct cpu_info* infos = calloc(ncpus, sizeof(struct cpu_info));
+  if (infos == NULL) {
+    return false;
+  }
+
+  struct cpu_info local;
+  read_cpuid(&local);
+
+  cpuset_t mask;
+  int err = cpuset_getaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(mask), &mask);
+  assert(err == 0);
+
+  for (int cpu = 0; cpu < ncpus; cpu++) {
+    if (CPU_ISSET(cpu, online)) {
+      cpuset_t one;
+      CPU_SETOF(cpu, &one);
+      if (cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(one), &one) == 0) {
+        read_cpuid(&infos[cpu]);
+      } else {
+        infos[cpu] = local;
+      }
+    }
+  }
+
+  err = cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(mask), &mask);
+  assert(err == 0);
+
+  write_cpus(root, online, infos, ncpus);
+  write_nodes(root, online, ncpus);
+
+  free(infos);
+
+  return true;
+}
+
+// The tree's directories are read-only once written, so they're made writable on the way down.
+static int make_writable(const char* path, const struct stat* sb, int type, struct FTW* ftw) {
+  if (type == FTW_D) {
+    chmod(path, 0755);
+  }
+  return 0;
+}
+
+static int remove_entry(const char* path, const struct stat* sb, int type, struct FTW* ftw) {
+  return type == FTW_DP ? rmdir(path) : unlink(path);
+}
+
+static void remove_tree(const char* root) {
+  nftw(root, make_writable, 16, FTW_PHYS);
+  nftw(root, remove_entry, 16, FTW_PHYS | FTW_DEPTH);
+}
+
+static bool is_usable(const char* root) {
+  struct stat sb;
+  return lstat(root, &sb) == 0 && S_ISDIR(sb.st_mode) && sb.st_uid == getuid() && (sb.st_mode & 022) == 0;
+}
+
+static void init_sysfs() {
+
+  struct timeval boottime = {0};
+  size_t len = sizeof(boottime);
+  sysctlbyname("kern.boottime", &boottime, &len, NULL, 0);
+
+  cpuset_t online;
+  get_online(&online);
+
+  char root[MAXPATHLEN];
+  snprintf(root, sizeof(root), "/tmp/.linux-sysfs-%u-%ld-%08x", getuid(), (long)boottime.tv_sec, hash_cpuset(&online));
+
+  struct stat sb;
+  if (lstat(root, &sb) == 0) {
+    if (is_usable(root)) {
+      sysfs_root = strdup(root);
+    }
+    return;
+  }
+
+  char tmp[MAXPATHLEN];
+  snprintf(tmp, sizeof(tmp), "%s.XXXXXX", root);
+
+  if (mkdtemp(tmp) == NULL) {
+    return;
+  }
+
+  if (!generate(tmp, &online)) {
+    remove_tree(tmp);
+    return;
+  }
+
+  if (rename(tmp, root) == 0) {
+    chmod(root, 0555);
+    sysfs_root = strdup(root);
+    return;
+  }
+
+  // another process may have won the race, its tree is as good as ours
+  if (is_usable(root)) {
+    remove_tree(tmp);
+    sysfs_root = strdup(root);
+  } else {
+    chmod(tmp, 0555);
+    sysfs_root = strdup(tmp);
+  }
+}
+
+static bool is_emulated(const char* path) {
+
+  if (!str_starts_with(path, SYSFS_PREFIX)) {
+    return false;
+  }
+
+  const char* rest = path + sizeof(SYSFS_PREFIX) - 1;
+
+  if (rest[0] == '\0' || strcmp(rest, "/") == 0) {
+    return true;
+  }
+
+  return
+    (str_starts_with(rest, "/cpu")  && (rest[4] == '\0' || rest[4] == '/')) ||
+    (str_starts_with(rest, "/node") && (rest[5] == '\0' || rest[5] == '/'));
+}
+
+const char* sysfs_redirect(const char* path) {
+
+  if (!is_emulated(path)) {
+    return NULL;
+  }
+
+  pthread_once(&sysfs_once, init_sysfs);
+
+  if (sysfs_root == NULL) {
+    return NULL;
+  }
+
+  snprintf(redirected_path, sizeof(redirected_path), "%s%s", sysfs_root, path + sizeof(SYSFS_PREFIX) - 1);
+
+  return redirected_path;
+}
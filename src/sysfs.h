@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stddef.h>
+#include <sys/param.h>
+#include <sys/cpuset.h>
+
+// Linux cpu list ("0-3,8") and cpu mask ("00000000,000000ff") formats
+void format_cpulist(char* buf, size_t size, const cpuset_t* set);
+void format_cpumask(char* buf, size_t size, const cpuset_t* set, int ncpus);
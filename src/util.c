@@ -16,15 +16,36 @@ bool str_starts_with(const char* str, const char* substr) {
   return strncmp(str, substr, strlen(substr)) == 0;
 }
 
-#define LINUX_EAGAIN     11
-#define LINUX_ENOSYS     38
-#define LINUX_ETIMEDOUT 110
+unsigned long sysctl_ulong(const char* name) {
+
+  // some of these are ints, some are longs
+  union { uint32_t u32; uint64_t u64; } value = {0};
+  size_t len = sizeof(value);
+
+  if (sysctlbyname(name, &value, &len, NULL, 0) == -1) {
+    return 0;
+  }
+
+  return len == sizeof(uint32_t) ? value.u32 : value.u64;
+}
+
+#define LINUX_EAGAIN           11
+#define LINUX_EDEADLK          35
+#define LINUX_ENOSYS           38
+#define LINUX_EOVERFLOW        75
+#define LINUX_ETIMEDOUT       110
+#define LINUX_EOWNERDEAD      130
+#define LINUX_ENOTRECOVERABLE 131
 
 int native_to_linux_errno(int error) {
   switch (error) {
-    case EAGAIN:    return LINUX_EAGAIN;
-    case ENOSYS:    return LINUX_ENOSYS;
-    case ETIMEDOUT: return LINUX_ETIMEDOUT;
+    case EAGAIN:          return LINUX_EAGAIN;
+    case EDEADLK:         return LINUX_EDEADLK;
+    case ENOSYS:          return LINUX_ENOSYS;
+    case EOVERFLOW:       return LINUX_EOVERFLOW;
+    case ETIMEDOUT:       return LINUX_ETIMEDOUT;
+    case EOWNERDEAD:      return LINUX_EOWNERDEAD;
+    case ENOTRECOVERABLE: return LINUX_ENOTRECOVERABLE;
     //TODO: anything else?
     default:
       return error;
@@ -33,9 +54,13 @@ int native_to_linux_errno(int error) {
 
 int linux_to_native_errno(int error) {
   switch (error) {
-    case LINUX_EAGAIN:    return EAGAIN;
-    case LINUX_ENOSYS:    return ENOSYS;
-    case LINUX_ETIMEDOUT: return ETIMEDOUT;
+    case LINUX_EAGAIN:          return EAGAIN;
+    case LINUX_EDEADLK:         return EDEADLK;
+    case LINUX_ENOSYS:          return ENOSYS;
+    case LINUX_EOVERFLOW:       return EOVERFLOW;
+    case LINUX_ETIMEDOUT:       return ETIMEDOUT;
+    case LINUX_EOWNERDEAD:      return EOWNERDEAD;
+    case LINUX_ENOTRECOVERABLE: return ENOTRECOVERABLE;
     default:
       return error;
   }
@@ -46,7 +71,7 @@ static char** procfs_redirects = NULL;
 __attribute__((constructor))
 static void init_redirects() {
 
-  int capacity = 5;
+  int capacity = 3;
   procfs_redirects = malloc(sizeof(char*) * capacity);
 
   char linux_emul_path[MAXPATHLEN];
@@ -57,10 +82,6 @@ static void init_redirects() {
 
   int i = 0;
 
-  // CUDA init
-  procfs_redirects[i++] = "/proc/self/maps";
-  procfs_redirects[i++] = "/dev/null";
-
   // Steam
   //~ asprintf(&procfs_redirects[i++], "/proc/%d/status", getpid());
   //~ asprintf(&procfs_redirects[i++], "%s/proc/%d/status", linux_emul_path, getpid());
@@ -96,7 +117,7 @@ const char* redirect(const char* path) {
   }
 
   if (str_starts_with(path, "/sys/")) {
-    return NULL;
+    return sysfs_redirect(path);
   }
 
   // Steam
@@ -0,0 +1,477 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/sysctl.h>
+#include <sys/time.h>
+#include <sys/user.h>
+#include <sys/vmmeter.h>
+#include "shim.h"
+#include "cgroup.h"
+#include "sysfs.h"
+#include "libc/sys/numa.h"
+#include "libc/sys/sysinfo.h"
+
+/*
+ * Virtual files, rendered in-process on open.
+ *
+ * Each open gets its own anonymous shared memory descriptor holding a snapshot
+ * of the contents, so reads, seeks, fstat and mmap all behave like a regular file.
+ * Rendered contents are kept for a short while: runtimes tend to reopen the same
+ * file in a loop and the sysctls behind them are not free.
+ */
+
+struct vfile {
+  const char*     path;        // relative paths live under /proc/self/
+  int             ttl_ms;
+  void            (*render)(FILE* out);
+  pthread_mutex_t mutex;
+  pid_t           pid;
+  char*           data;
+  size_t          size;
+  struct timespec rendered_at;
+};
+
+static bool get_kinfo_proc(struct kinfo_proc* kp) {
+  int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, getpid() };
+  size_t len = sizeof(*kp);
+  return sysctl(mib, 4, kp, &len, NULL, 0) == 0 && len == sizeof(*kp);
+}
+
+static struct timeval get_boottime() {
+  struct timeval boottime = {0};
+  size_t len = sizeof(boottime);
+  sysctlbyname("kern.boottime", &boottime, &len, NULL, 0);
+  return boottime;
+}
+
+static unsigned long timeval_to_ticks(struct timeval tv) {
+  return tv.tv_sec * LINUX_USER_HZ + tv.tv_usec / (1000000 / LINUX_USER_HZ);
+}
+
+static void render_maps(FILE* out) {
+
+  int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_VMMAP, getpid() };
+
+  size_t len = 0;
+  if (sysctl(mib, 4, NULL, &len, NULL, 0) == -1) {
+    return;
+  }
+
+  // leave room for mappings created in the meantime
+  len = len * 4 / 3;
+  char* buf = malloc(len);
+
+  if (sysctl(mib, 4, buf, &len, NULL, 0) == -1) {
+    free(buf);
+    return;
+  }
+
+  for (char* p = buf; p < buf + len;) {
+
+    struct kinfo_vmentry* kve = (struct kinfo_vmentry*)p;
+    if (kve->kve_structsize == 0) {
+      break;
+    }
+    p += kve->kve_structsize;
+
+    const char* path = kve->kve_path;
+    if (path[0] == '\0' && (kve->kve_flags & KVME_FLAG_GROWS_DOWN)) {
+      path = "[stack]";
+    }
+
+    bool vnode  = kve->kve_type == KVME_TYPE_VNODE;
+    bool shared = vnode && !(kve->kve_flags & KVME_FLAG_COW);
+
+    int n = fprintf(out, "%08jx-%08jx %c%c%c%c %08jx %02x:%02x %ju",
+      (uintmax_t)kve->kve_start,
+      (uintmax_t)kve->kve_end,
+      (kve->kve_protection & KVME_PROT_READ)  ? 'r' : '-',
+      (kve->kve_protection & KVME_PROT_WRITE) ? 'w' : '-',
+      (kve->kve_protection & KVME_PROT_EXEC)  ? 'x' : '-',
+      shared ? 's' : 'p',
+      (uintmax_t)kve->kve_offset,
+      vnode ? major(kve->kve_vn_fsid) & 0xFFF : 0,
+      vnode ? minor(kve->kve_vn_fsid) & 0xFF  : 0,
+      vnode ? (uintmax_t)kve->kve_vn_fileid   : 0
+    );
+
+    if (path[0] != '\0') {
+      // Linux pads the path to a fixed column
+      fprintf(out, "%*s%s", MAX(1, 25 + (int)sizeof(void*) * 6 - 1 - n), "", path);
+    }
+
+    fputc('\n', out);
+  }
+
+  free(buf);
+}
+
+static void render_status(FILE* out) {
+
+  struct kinfo_proc kp;
+  if (!get_kinfo_proc(&kp)) {
+    return;
+  }
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+
+  unsigned long page_kb = getpagesize() / 1024;
+
+  fprintf(out, "Name:\t%s\n",      kp.ki_comm);
+  fprintf(out, "State:\tR (running)\n");
+  fprintf(out, "Tgid:\t%d\n",      kp.ki_pid);
+  fprintf(out, "Ngid:\t0\n");
+  fprintf(out, "Pid:\t%d\n",       kp.ki_pid);
+  fprintf(out, "PPid:\t%d\n",      kp.ki_ppid);
+  // best guess: debuggers usually are the parent
+  fprintf(out, "TracerPid:\t%d\n", (kp.ki_flag & P_TRACED) ? kp.ki_ppid : 0);
+  fprintf(out, "Uid:\t%d\t%d\t%d\t%d\n", kp.ki_ruid, kp.ki_uid, kp.ki_svuid, kp.ki_uid);
+  fprintf(out, "Gid:\t%d\t%d\t%d\t%d\n", kp.ki_rgid, kp.ki_groups[0], kp.ki_svgid, kp.ki_groups[0]);
+
+  fprintf(out, "Groups:\t");
+  for (int i = 0; i < kp.ki_ngroups; i++) {
+    fprintf(out, "%d ", kp.ki_groups[i]);
+  }
+  fprintf(out, "\n");
+
+  fprintf(out, "VmPeak:\t%8lu kB\n", (unsigned long)kp.ki_size / 1024);
+  fprintf(out, "VmSize:\t%8lu kB\n", (unsigned long)kp.ki_size / 1024);
+  fprintf(out, "VmLck:\t%8lu kB\n",  0ul);
+  fprintf(out, "VmHWM:\t%8lu kB\n",  (unsigned long)ru.ru_maxrss);
+  fprintf(out, "VmRSS:\t%8lu kB\n",  (unsigned long)kp.ki_rssize * page_kb);
+  fprintf(out, "VmData:\t%8lu kB\n", (unsigned long)kp.ki_dsize * page_kb);
+  fprintf(out, "VmStk:\t%8lu kB\n",  (unsigned long)kp.ki_ssize * page_kb);
+  fprintf(out, "VmExe:\t%8lu kB\n",  (unsigned long)kp.ki_tsize * page_kb);
+  fprintf(out, "VmLib:\t%8lu kB\n",  0ul);
+  fprintf(out, "VmPTE:\t%8lu kB\n",  0ul);
+  fprintf(out, "VmSwap:\t%8lu kB\n", 0ul);
+  fprintf(out, "Threads:\t%d\n",     kp.ki_numthreads);
+
+  // signal numbers differ from Linux beyond the basic ones, don't pretend
+  fprintf(out, "SigQ:\t0/%lu\n", (unsigned long)sysctl_ulong("kern.sigqueue.max_pending_per_proc"));
+  fprintf(out, "SigPnd:\t%016x\n", 0);
+  fprintf(out, "ShdPnd:\t%016x\n", 0);
+  fprintf(out, "SigBlk:\t%016x\n", 0);
+  fprintf(out, "SigIgn:\t%016x\n", 0);
+  fprintf(out, "SigCgt:\t%016x\n", 0);
+
+  cpuset_t cpus;
+  if (cpuset_getaffinity(CPU_LEVEL_WHICH, CPU_WHICH_PID, -1, sizeof(cpus), &cpus) == 0) {
+
+    char buf[8 * CPU_SETSIZE];
+    int ncpus = (int)sysctl_ulong("hw.ncpu");
+
+    format_cpumask(buf, sizeof(buf), &cpus, MAX(ncpus, 1));
+    fprintf(out, "Cpus_allowed:\t%s\n", buf);
+
+    format_cpulist(buf, sizeof(buf), &cpus);
+    fprintf(out, "Cpus_allowed_list:\t%s\n", buf);
+  }
+
+  int ndomains = native_ndomains();
+  fprintf(out, "Mems_allowed:\t%08x\n", (1u << ndomains) - 1);
+  fprintf(out, ndomains > 1 ? "Mems_allowed_list:\t0-%d\n" : "Mems_allowed_list:\t0\n", ndomains - 1);
+
+  fprintf(out, "voluntary_ctxt_switches:\t%ld\n",    ru.ru_nvcsw);
+  fprintf(out, "nonvoluntary_ctxt_switches:\t%ld\n", ru.ru_nivcsw);
+}
+
+static void render_stat(FILE* out) {
+
+  struct kinfo_proc kp;
+  if (!get_kinfo_proc(&kp)) {
+    return;
+  }
+
+  struct timeval boottime = get_boottime();
+  struct timeval started;
+  timersub(&kp.ki_start, &boottime, &started);
+
+  struct rlimit rss;
+  getrlimit(RLIMIT_RSS, &rss);
+
+  int shim_sched_getcpu_impl();
+
+  fprintf(out,
+    "%d (%s) R %d %d %d %d %d %d "
+    "%lu %lu %lu %lu "
+    "%lu %lu %lu %lu "
+    "%d %d %d 0 %lu %lu %ld %ju "
+    "0 0 0 0 0 0 0 0 0 0 0 0 17 %d 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+    kp.ki_pid, kp.ki_comm, kp.ki_ppid, kp.ki_pgid, kp.ki_sid, 0, kp.ki_tpgid, 0,
+    (unsigned long)kp.ki_rusage.ru_minflt, (unsigned long)kp.ki_rusage_ch.ru_minflt,
+    (unsigned long)kp.ki_rusage.ru_majflt, (unsigned long)kp.ki_rusage_ch.ru_majflt,
+    timeval_to_ticks(kp.ki_rusage.ru_utime),    timeval_to_ticks(kp.ki_rusage.ru_stime),
+    timeval_to_ticks(kp.ki_rusage_ch.ru_utime), timeval_to_ticks(kp.ki_rusage_ch.ru_stime),
+    20 + kp.ki_nice, kp.ki_nice, kp.ki_numthreads,
+    timeval_to_ticks(started),
+    (unsigned long)kp.ki_size,
+    (long)kp.ki_rssize,
+    rss.rlim_cur == RLIM_INFINITY ? UINTMAX_MAX : (uintmax_t)rss.rlim_cur,
+    MAX(shim_sched_getcpu_impl(), 0)
+  );
+}
+
+static void render_statm(FILE* out) {
+
+  struct kinfo_proc kp;
+  if (!get_kinfo_proc(&kp)) {
+    return;
+  }
+
+  fprintf(out, "%lu %lu 0 %lu 0 %lu 0\n",
+    (unsigned long)kp.ki_size / getpagesize(),
+    (unsigned long)kp.ki_rssize,
+    (unsigned long)kp.ki_tsize,
+    (unsigned long)(kp.ki_dsize + kp.ki_ssize)
+  );
+}
+
+static void render_meminfo(FILE* out) {
+
+  unsigned long page_kb = getpagesize() / 1024;
+
+  unsigned long total    = sysctl_ulong("hw.physmem") / 1024;
+  unsigned long free     = sysctl_ulong("vm.stats.vm.v_free_count")     * page_kb;
+  unsigned long active   = sysctl_ulong("vm.stats.vm.v_active_count")   * page_kb;
+  unsigned long inactive = sysctl_ulong("vm.stats.vm.v_inactive_count") * page_kb;
+  unsigned long laundry  = sysctl_ulong("vm.stats.vm.v_laundry_count")  * page_kb;
+  unsigned long wired    = sysctl_ulong("vm.stats.vm.v_wire_count")     * page_kb;
+  unsigned long buffers  = sysctl_ulong("vfs.bufspace") / 1024;
+
+  unsigned long swap_total, swap_used;
+  native_swap_usage(&swap_total, &swap_used);
+
+  // inactive pages are mostly clean page cache, the closest thing to Linux' Cached
+  fprintf(out, "MemTotal:       %8lu kB\n", total);
+  fprintf(out, "MemFree:        %8lu kB\n", free);
+  fprintf(out, "MemAvailable:   %8lu kB\n", free + inactive);
+  fprintf(out, "Buffers:        %8lu kB\n", buffers);
+  fprintf(out, "Cached:         %8lu kB\n", inactive);
+  fprintf(out, "SwapCached:     %8lu kB\n", 0ul);
+  fprintf(out, "Active:         %8lu kB\n", active);
+  fprintf(out, "Inactive:       %8lu kB\n", inactive + laundry);
+  fprintf(out, "Unevictable:    %8lu kB\n", wired);
+  fprintf(out, "Mlocked:        %8lu kB\n", 0ul);
+  fprintf(out, "SwapTotal:      %8lu kB\n", swap_total * page_kb);
+  fprintf(out, "SwapFree:       %8lu kB\n", (swap_total - swap_used) * page_kb);
+  fprintf(out, "Dirty:          %8lu kB\n", laundry);
+  fprintf(out, "Writeback:      %8lu kB\n", 0ul);
+  fprintf(out, "Shmem:          %8lu kB\n", 0ul);
+  fprintf(out, "HugePages_Total:   %5d\n", 0);
+  fprintf(out, "HugePages_Free:    %5d\n", 0);
+  fprintf(out, "HugePages_Rsvd:    %5d\n", 0);
+  fprintf(out, "HugePages_Surp:    %5d\n", 0);
+  fprintf(out, "Hugepagesize:   %8d kB\n", 2048);
+}
+
+static void render_cpu_line(FILE* out, const char* name, const long* times, unsigned long stathz) {
+  // user nice system idle iowait irq softirq steal guest guest_nice
+  fprintf(out, "%s %lu %lu %lu %lu 0 %lu 0 0 0 0\n", name,
+    times[CP_USER] * LINUX_USER_HZ / stathz,
+    times[CP_NICE] * LINUX_USER_HZ / stathz,
+    times[CP_SYS]  * LINUX_USER_HZ / stathz,
+    times[CP_IDLE] * LINUX_USER_HZ / stathz,
+    times[CP_INTR] * LINUX_USER_HZ / stathz
+  );
+}
+
+static void render_proc_stat(FILE* out) {
+
+  struct clockinfo clock = {0};
+  size_t len = sizeof(clock);
+  sysctlbyname("kern.clockrate", &clock, &len, NULL, 0);
+
+  unsigned long stathz = clock.stathz > 0 ? clock.stathz : clock.hz > 0 ? clock.hz : LINUX_USER_HZ;
+
+  long times[CPUSTATES] = {0};
+  len = sizeof(times);
+  sysctlbyname("kern.cp_time", times, &len, NULL, 0);
+  render_cpu_line(out, "cpu ", times, stathz);
+
+  len = 0;
+  if (sysctlbyname("kern.cp_times", NULL, &len, NULL, 0) == 0) {
+
+    long* cpu_times = malloc(len);
+
+    if (sysctlbyname("kern.cp_times", cpu_times, &len, NULL, 0) == 0) {
+      for (size_t cpu = 0; cpu < len / (sizeof(long) * CPUSTATES); cpu++) {
+        char name[16];
+        snprintf(name, sizeof(name), "cpu%zu", cpu);
+        render_cpu_line(out, name, &cpu_times[cpu * CPUSTATES], stathz);
+      }
+    }
+
+    free(cpu_times);
+  }
+
+  struct vmtotal total = {0};
+  len = sizeof(total);
+  sysctlbyname("vm.vmtotal", &total, &len, NULL, 0);
+
+  unsigned long forks =
+    sysctl_ulong("vm.stats.vm.v_forks") +
+    sysctl_ulong("vm.stats.vm.v_vforks") +
+    sysctl_ulong("vm.stats.vm.v_rforks");
+
+  fprintf(out, "intr %lu\n",          sysctl_ulong("vm.stats.sys.v_intr"));
+  fprintf(out, "ctxt %lu\n",          sysctl_ulong("vm.stats.sys.v_swtch"));
+  fprintf(out, "btime %ld\n",         (long)get_boottime().tv_sec);
+  fprintf(out, "processes %lu\n",     forks);
+  fprintf(out, "procs_running %d\n",  total.t_rq);
+  fprintf(out, "procs_blocked %d\n",  total.t_dw);
+}
+
+static struct vfile vfiles[] = {
+  { .path = "maps",          .ttl_ms = 0,   .render = render_maps,      .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "status",        .ttl_ms = 10,  .render = render_status,    .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "stat",          .ttl_ms = 10,  .render = render_stat,      .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "statm",         .ttl_ms = 10,  .render = render_statm,     .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/proc/meminfo", .ttl_ms = 100, .render = render_meminfo,   .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/proc/stat",    .ttl_ms = 100, .render = render_proc_stat, .mutex = PTHREAD_MUTEX_INITIALIZER },
+
+  { .path = "cgroup",                                .ttl_ms = 1000, .render = render_self_cgroup,            .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "mountinfo",                             .ttl_ms = 100,  .render = render_self_mountinfo,         .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/proc/cgroups",                         .ttl_ms = 1000, .render = render_proc_cgroups,           .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/sys/fs/cgroup/cgroup.controllers",     .ttl_ms = 1000, .render = render_cgroup_controllers,     .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/sys/fs/cgroup/cpu.max",                .ttl_ms = 1000, .render = render_cgroup_cpu_max,         .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/sys/fs/cgroup/cpu.weight",             .ttl_ms = 1000, .render = render_cgroup_cpu_weight,      .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/sys/fs/cgroup/cpuset.cpus.effective",  .ttl_ms = 1000, .render = render_cgroup_cpuset_cpus,     .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/sys/fs/cgroup/cpuset.mems.effective",  .ttl_ms = 1000, .render = render_cgroup_cpuset_mems,     .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/sys/fs/cgroup/memory.max",             .ttl_ms = 1000, .render = render_cgroup_memory_max,      .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/sys/fs/cgroup/memory.high",            .ttl_ms = 1000, .render = render_cgroup_memory_high,     .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/sys/fs/cgroup/memory.swap.max",        .ttl_ms = 1000, .render = render_cgroup_memory_swap_max, .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/sys/fs/cgroup/memory.current",         .ttl_ms = 100,  .render = render_cgroup_memory_current,  .mutex = PTHREAD_MUTEX_INITIALIZER },
+  { .path = "/sys/fs/cgroup/pids.max",               .ttl_ms = 1000, .render = render_cgroup_pids_max,        .mutex = PTHREAD_MUTEX_INITIALIZER },
+};
+
+static struct vfile* lookup(const char* path) {
+
+  // /proc/self/ or /proc/<our pid>/
+  const char* self = NULL;
+
+  if (str_starts_with(path, "/proc/self/")) {
+    self = path + sizeof("/proc/self/") - 1;
+  } else if (str_starts_with(path, "/proc/")) {
+    char* end;
+    long pid = strtol(path + sizeof("/proc/") - 1, &end, 10);
+    if (end != path + sizeof("/proc/") - 1 && *end == '/' && pid == getpid()) {
+      self = end + 1;
+    }
+  }
+
+  for (size_t i = 0; i < nitems(vfiles); i++) {
+    if (vfiles[i].path[0] == '/' ? strcmp(path, vfiles[i].path) == 0 : (self != NULL && strcmp(self, vfiles[i].path) == 0)) {
+      return &vfiles[i];
+    }
+  }
+
+  return NULL;
+}
+
+static bool is_fresh(struct vfile* vfile, const struct timespec* now) {
+
+  if (vfile->data == NULL || vfile->pid != getpid()) {
+    return false;
+  }
+
+  long elapsed_ms =
+    (now->tv_sec  - vfile->rendered_at.tv_sec)  * 1000 +
+    (now->tv_nsec - vfile->rendered_at.tv_nsec) / 1000000;
+
+  return elapsed_ms < vfile->ttl_ms;
+}
+
+static void write_contents(struct vfile* vfile, int fd) {
+
+  assert(pthread_mutex_lock(&vfile->mutex) == 0);
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_FAST, &now);
+
+  if (!is_fresh(vfile, &now)) {
+
+    free(vfile->data);
+    vfile->data = NULL;
+    vfile->size = 0;
+
+    FILE* out = open_memstream(&vfile->data, &vfile->size);
+    assert(out != NULL);
+
+    vfile->render(out);
+    fclose(out);
+
+    vfile->pid         = getpid();
+    vfile->rendered_at = now;
+  }
+
+  for (size_t offset = 0; offset < vfile->size;) {
+    ssize_t n = write(fd, vfile->data + offset, vfile->size - offset);
+    if (n <= 0) {
+      break;
+    }
+    offset += n;
+  }
+
+  assert(pthread_mutex_unlock(&vfile->mutex) == 0);
+}
+
+bool vfile_exists(const char* path) {
+  return lookup(path) != NULL;
+}
+
+int vfile_open(const char* path, int flags) {
+
+  struct vfile* vfile = lookup(path);
+  assert(vfile != NULL);
+
+#if __FreeBSD_version >= 1300139
+  int fd = memfd_create(vfile->path, (flags & O_CLOEXEC) ? MFD_CLOEXEC : 0);
+#else
+  int fd = shm_open(SHM_ANON, O_RDWR | (flags & O_CLOEXEC), 0400);
+#endif
+
+  if (fd == -1) {
+    return -1;
+  }
+
+  write_contents(vfile, fd);
+
+  off_t err = lseek(fd, 0, SEEK_SET);
+  assert(err == 0);
+
+  return fd;
+}
+
+int vfile_stat(const char* path, struct stat* sb) {
+
+  assert(lookup(path) != NULL);
+
+  // like procfs: readable, empty until read
+  memset(sb, 0, sizeof(*sb));
+
+  sb->st_mode  = S_IFREG | 0444;
+  sb->st_nlink = 1;
+  sb->st_uid   = getuid();
+  sb->st_gid   = getgid();
+
+  clock_gettime(CLOCK_REALTIME, &sb->st_mtim);
+  sb->st_atim = sb->st_mtim;
+  sb->st_ctim = sb->st_mtim;
+
+  return 0;
+}
@@ -109,6 +109,14 @@ def to_shim_type(type)
       'linux_pthread_once_t*'
     when 'pthread_mutex_t*'
       'linux_pthread_mutex_t*'
+    when 'pthread_rwlock_t*'
+      'linux_pthread_rwlock_t*'
+    when 'pthread_barrier_t*'
+      'linux_pthread_barrier_t*'
+    when 'pthread_cond_t*'
+      'linux_pthread_cond_t*'
+    when 'sem_t*'
+      'linux_sem_t*'
     when /^(const |)pthread_(barrier|cond|mutex|rwlock)attr_t\*/
       $1 + 'linux_pthread_' + $2 + 'attr_t*'
     else
@@ -116,7 +124,9 @@ def to_shim_type(type)
   end
 end
 
-def generate_wrapper(out, function, shim_fun_impl)
+# With pass_caller the wrapper's return address, i.e. the caller in the application,
+# is appended to the arguments of shim_fun_impl.
+def generate_wrapper(out, function, shim_fun_impl, pass_caller = false)
 
   args = function[:args]
   args = [] if args.size == 1 && args.first[:type] == 'void'
@@ -155,13 +165,15 @@ def generate_wrapper(out, function, shim_fun_impl)
     out.print function[:name]
   end
   out.print '('
-  out.print (args.map do |arg|
+  call_args = args.map do |arg|
     if arg[:name] == '...'
       '_args_'
     else
       arg[:name]
     end
-  end).join(', ')
+  end
+  call_args << '__builtin_return_address(0)' if pass_caller
+  out.print call_args.join(', ')
   out.puts ');'
 
   if is_variadic(function)
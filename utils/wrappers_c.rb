@@ -2,16 +2,23 @@
 # encoding: UTF-8
 
 SUBSTITUTIONS = {
-  __getdelim:      'getdelim',
-  __isoc99_sscanf: 'sscanf',
-  __libc_free:     'free',
-  __libc_malloc:   'malloc',
-  __strdup:        'strdup',
-  __strndup:       'strndup',
-  _exit:           '_Exit',
-  _IO_getc:        'getc',
-  _IO_putc:        'putc',
-  mkstemp64:       'mkstemp'
+  __getdelim:                 'getdelim',
+  __isoc99_sscanf:            'sscanf',
+  __libc_free:                'free',
+  __libc_malloc:              'malloc',
+  __pthread_rwlock_destroy:   'pthread_rwlock_destroy',
+  __pthread_rwlock_init:      'pthread_rwlock_init',
+  __pthread_rwlock_rdlock:    'pthread_rwlock_rdlock',
+  __pthread_rwlock_tryrdlock: 'pthread_rwlock_tryrdlock',
+  __pthread_rwlock_trywrlock: 'pthread_rwlock_trywrlock',
+  __pthread_rwlock_unlock:    'pthread_rwlock_unlock',
+  __pthread_rwlock_wrlock:    'pthread_rwlock_wrlock',
+  __strdup:                   'strdup',
+  __strndup:                  'strndup',
+  _exit:                      '_Exit',
+  _IO_getc:                   'getc',
+  _IO_putc:                   'putc',
+  mkstemp64:                  'mkstemp'
 }
 
 STRUCT_COMPATIBILITY = {
@@ -20,8 +27,10 @@ STRUCT_COMPATIBILITY = {
   cmsghdr:      false, # compatible on i386
   dirent:       false,
   dl_phdr_info: true,
+  gaicb:        false,
   in_addr:      true,
   iovec:        true,
+  mmsghdr:      false,
   hostent:      true,
   msghdr:       false, # compatible on i386
   option:       true,
@@ -32,6 +41,7 @@ STRUCT_COMPATIBILITY = {
   sembuf:       true,
   sched_param:  true,
   shmid_ds:     false,
+  sigevent:     false,
   sockaddr:     false,
   stat:         false,
   statfs:       false,
@@ -82,7 +92,11 @@ def check_compat(function)
 
   for type in args.map{|arg| arg[:type]} + [function[:type]]
     case type
-      when /^(const |)pthread_(barrier|cond|mutex)attr_t\*/
+      when /^(const |)pthread_(barrier|cond|mutex|rwlock)attr_t\*/
+        return false
+      when /^pthread_(barrier|cond|rwlock)_t\*/
+        return false
+      when /^sem_t\*/
         return false
       when /ucontext_t/
         return false
@@ -22,7 +22,7 @@ input.scan(/#{START_TAG}\s([^\s]+)\s@opts(.*?)\s#{END_TAG}/m) do |function_name,
   raise "Unknown function #{function_name}" if not $functions[function_name]
 
   io = StringIO.new
-  generate_wrapper(io, $functions[function_name], "shim_#{function_name}_impl")
+  generate_wrapper(io, $functions[function_name], "shim_#{function_name}_impl", options.split(/[\s,]+/).include?('caller'))
   lines = io.string.lines
 
   puts "#define SHIM_WRAPPER_#{function_name} \\"